@@ -0,0 +1,263 @@
+/**
+ * @file bench.h
+ * @brief Minimal Google-Benchmark-style harness for the time server microbenchmarks.
+ *
+ * This header provides benchmark registration, an auto-calibrated timing loop, allocation
+ * counting through a replaced global operator new, and a report in Google Benchmark's JSON
+ * format (so its compare tooling can diff two runs). It replaces the global allocation
+ * functions, so include it from exactly one translation unit of a benchmark program.
+ *
+ * Common switches: --filter TEXT (run benchmarks whose name contains TEXT),
+ *                  --min-time SECONDS (per benchmark, default 0.2), --json PATH.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/**
+ * @brief Heap allocations made by the process so far.
+ */
+inline std::atomic<uint64_t>& allocationCount() {
+    static std::atomic<uint64_t> count{ 0 };
+    return count;
+}
+
+/**
+ * @brief Keeps a value alive so the compiler cannot drop the computation producing it.
+ * @param value Value to keep.
+ */
+template <class T>
+inline void doNotOptimize(const T& value) {
+    static const void* volatile sink;
+    sink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+/**
+ * @brief Iteration control handed to a benchmark body.
+ *
+ * The body loops on keepRunning(); work done before the first call (setup) is not timed.
+ */
+class State {
+public:
+    /**
+     * @brief Constructs a state that runs the given number of iterations.
+     * @param iterations Iterations to run.
+     */
+    explicit State(uint64_t iterations) : iterations_(iterations), remaining_(iterations), started_(false), allocs_(0) {}
+
+    /**
+     * @brief Starts the clock on the first call and counts down the iterations.
+     * @return true while iterations remain.
+     */
+    bool keepRunning() {
+        if (!started_) {
+            started_ = true;
+            allocs_ = allocationCount().load(std::memory_order_relaxed);
+            start_ = std::chrono::steady_clock::now();
+        }
+        if (remaining_ != 0) {
+            --remaining_;
+            return true;
+        }
+        end_ = std::chrono::steady_clock::now();
+        allocs_ = allocationCount().load(std::memory_order_relaxed) - allocs_;
+        return false;
+    }
+
+    /**
+     * @brief Number of iterations this run executes.
+     * @return Iteration count.
+     */
+    uint64_t iterations() const { return iterations_; }
+
+    /**
+     * @brief Wall time of the timed loop.
+     * @return Elapsed nanoseconds.
+     */
+    double elapsedNs() const { return std::chrono::duration<double, std::nano>(end_ - start_).count(); }
+
+    /**
+     * @brief Heap allocations made inside the timed loop.
+     * @return Allocation count.
+     */
+    uint64_t allocations() const { return allocs_; }
+
+private:
+    uint64_t iterations_;                           /**< Iterations requested. */
+    uint64_t remaining_;                            /**< Iterations left. */
+    bool started_;                                  /**< true once the clock runs. */
+    uint64_t allocs_;                               /**< Allocation counter snapshot, then delta. */
+    std::chrono::steady_clock::time_point start_;   /**< Loop start. */
+    std::chrono::steady_clock::time_point end_;     /**< Loop end. */
+};
+
+/**
+ * @brief A registered benchmark.
+ */
+struct Benchmark {
+    std::string name;                   /**< Name reported in the results. */
+    std::function<void(State&)> body;   /**< Benchmark body. */
+};
+
+/**
+ * @brief Registry of the benchmarks of this program.
+ * @return Registered benchmarks in registration order.
+ */
+inline std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+/**
+ * @brief Registers a benchmark.
+ * @param name Reported name (use "Function/argument" for parameterized variants).
+ * @param body Benchmark body.
+ */
+inline void add(const std::string& name, std::function<void(State&)> body) {
+    registry().push_back(Benchmark{ name, std::move(body) });
+}
+
+/**
+ * @brief Result of one benchmark.
+ */
+struct Result {
+    std::string name;       /**< Benchmark name. */
+    uint64_t iterations;    /**< Iterations of the measured run. */
+    double nsPerOp;         /**< Wall time per iteration. */
+    double allocsPerOp;     /**< Heap allocations per iteration. */
+};
+
+/**
+ * @brief Runs one benchmark, growing the iteration count until the run lasts minTime.
+ * @param b Benchmark to run.
+ * @param minTime Minimum duration of the measured run in seconds.
+ * @return Result of the measured run.
+ */
+inline Result runOne(const Benchmark& b, double minTime) {
+    uint64_t iterations = 1;
+    while (true) {
+        State state(iterations);
+        b.body(state);
+        double ns = state.elapsedNs();
+        if (ns >= minTime * 1e9 || iterations >= (1ull << 40)) {
+            return Result{ b.name, iterations, ns / iterations,
+                           static_cast<double>(state.allocations()) / iterations };
+        }
+        // Aim 40% past the target, growing at most 100x per step
+        double scale = (ns > 0) ? (minTime * 1e9 * 1.4) / ns : 100.0;
+        if (scale > 100.0) scale = 100.0;
+        uint64_t next = static_cast<uint64_t>(iterations * scale);
+        iterations = (next > iterations) ? next : iterations + 1;
+    }
+}
+
+/**
+ * @brief Escapes backslashes and quotes for a JSON string (Windows paths contain backslashes).
+ * @param text Text to escape.
+ * @return Escaped text.
+ */
+inline std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '\\' || c == '"') out.push_back('\\');
+        out.push_back(c);
+    }
+    return out;
+}
+
+/**
+ * @brief Writes results in Google Benchmark's JSON format.
+ * @param out Destination stream.
+ * @param program Program name for the context block.
+ * @param results Results to write.
+ */
+inline void writeJson(std::FILE* out, const char* program, const std::vector<Result>& results) {
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::tm utc{};
+    gmtime_s(&utc, &now);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &utc);
+    std::fprintf(out, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"executable\": \"%s\"\n  },\n", date,
+                 jsonEscape(program).c_str());
+    std::fprintf(out, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        std::fprintf(out, "    {\n      \"name\": \"%s\",\n      \"run_type\": \"iteration\",\n"
+                          "      \"iterations\": %llu,\n      \"real_time\": %.3f,\n      \"cpu_time\": %.3f,\n"
+                          "      \"time_unit\": \"ns\",\n      \"allocs_per_iter\": %.3f\n    }%s\n",
+                     jsonEscape(r.name).c_str(), static_cast<unsigned long long>(r.iterations), r.nsPerOp, r.nsPerOp,
+                     r.allocsPerOp, (i + 1 < results.size()) ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+/**
+ * @brief Parses the common switches, runs the matching benchmarks and reports them.
+ *        A table goes to stderr; JSON goes to --json PATH, or to stdout if no path is given.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return Process exit code.
+ */
+inline int runAll(int argc, char* argv[]) {
+    std::string filter;
+    std::string jsonPath;
+    double minTime = 0.2;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) filter = argv[++i];
+        else if (arg == "--min-time" && hasValue) minTime = std::atof(argv[++i]);
+        else if (arg == "--json" && hasValue) jsonPath = argv[++i];
+        else {
+            std::fprintf(stderr, "Usage: %s [--filter TEXT] [--min-time SECONDS] [--json PATH]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    std::fprintf(stderr, "%-48s %14s %12s %12s\n", "Benchmark", "Iterations", "ns/op", "allocs/op");
+    for (const Benchmark& b : registry()) {
+        if (!filter.empty() && b.name.find(filter) == std::string::npos) continue;
+        Result r = runOne(b, minTime);
+        std::fprintf(stderr, "%-48s %14llu %12.1f %12.2f\n", r.name.c_str(),
+                     static_cast<unsigned long long>(r.iterations), r.nsPerOp, r.allocsPerOp);
+        results.push_back(r);
+    }
+
+    std::FILE* out = stdout;
+    if (!jsonPath.empty()) {
+        if (0 != fopen_s(&out, jsonPath.c_str(), "w") || !out) {
+            std::fprintf(stderr, "Cannot open %s\n", jsonPath.c_str());
+            return 1;
+        }
+    }
+    writeJson(out, argv[0], results);
+    if (out != stdout) std::fclose(out);
+    return 0;
+}
+
+} // namespace bench
+
+// Counting replacements of the global allocation functions (one definition per program)
+void* operator new(std::size_t size) {
+    bench::allocationCount().fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
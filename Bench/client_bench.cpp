@@ -0,0 +1,59 @@
+/**
+ * @file client_bench.cpp
+ * @brief Microbenchmarks of the client request encoding and reply decoding.
+ *
+ * Build: cl /O2 /EHsc /std:c++14 client_bench.cpp ..\Client\client.cpp ..\Client\probe.cpp ..\Client\utils.cpp
+ * Usage: client_bench [--filter TEXT] [--min-time SECONDS] [--json PATH]
+ * Compatible with C++14.
+ */
+
+#include "bench.h"
+#include "../Client/client.h"
+
+/**
+ * @brief Registers TimeClient::incode for one request.
+ * @param name Benchmark name.
+ * @param request Request to encode.
+ */
+static void addIncode(const char* name, const TimeClient::Request& request) {
+    bench::add(name, [request](bench::State& state) {
+        while (state.keepRunning()) {
+            std::vector<char> bytes = TimeClient::incode(request);
+            bench::doNotOptimize(bytes);
+        }
+    });
+}
+
+/**
+ * @brief Registers toUint32 for one reply payload.
+ * @param name Benchmark name.
+ * @param bytes Reply bytes (1-4).
+ */
+static void addToUint32(const char* name, const std::vector<char>& bytes) {
+    bench::add(name, [bytes](bench::State& state) {
+        while (state.keepRunning()) {
+            uint32_t val = toUint32(bytes);
+            bench::doNotOptimize(val);
+        }
+    });
+}
+
+int main(int argc, char* argv[]) {
+    addIncode("incode/no-args", TimeClient::Request(ReqCode::GetTime));
+    addIncode("incode/city", TimeClient::Request(ReqCode::GetTimeWithoutDateInCity, { "berlin" }));
+    addIncode("incode/253-byte-arg", TimeClient::Request(ReqCode::GetTimeWithoutDateInCity,
+                                                         { std::string(BUFFER_SIZE - 2, 'a') }));
+
+    addToUint32("toUint32/1-byte", std::vector<char>{ 0x2A });
+    addToUint32("toUint32/4-bytes", std::vector<char>{ 0x12, 0x34, 0x56, 0x78 });
+
+    bench::add("decodeTime", [](bench::State& state) {
+        char body[wire::kTimeFieldsSize] = { 0 };
+        while (state.keepRunning()) {
+            wire::TimeFields t = wire::decodeTime(body);
+            bench::doNotOptimize(t);
+        }
+    });
+
+    return bench::runAll(argc, argv);
+}
@@ -0,0 +1,169 @@
+/**
+ * @file lap_contention.cpp
+ * @brief Contention benchmark for the lap-timer store.
+ *
+ * Runs the MeasureTimeLap store operation (expire, take-or-insert) from 1..T threads and compares
+ * a single-shard store (one global mutex, as before sharding) with the sharded store. It also
+ * reports bucket collisions of the old and new EndpointKeyHash for clients behind one NAT address.
+ *
+ * Build: cl /O2 /EHsc /std:c++14 lap_contention.cpp ..\Server\lapstore.cpp ws2_32.lib
+ * Usage: lap_contention [--threads T] [--ops N] [--endpoints E] [--shards S]
+ * Compatible with C++14.
+ */
+
+#include "../Server/lapstore.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <winsock2.h>
+
+/**
+ * @brief Benchmark parameters.
+ */
+struct BenchOptions {
+    unsigned threads = 8;      /**< Highest thread count to run. */
+    unsigned ops = 1000000;    /**< Operations per thread. */
+    unsigned endpoints = 65536;/**< Distinct client endpoints per thread. */
+    unsigned shards = 64;      /**< Shards of the sharded store. */
+};
+
+/**
+ * @brief Recovers the IPv4 address of a key as the former hash saw it (network byte order).
+ * @param k IPv4 endpoint key.
+ * @return Address as stored in sin_addr.
+ */
+static uint32_t ipv4Of(const EndpointKey& k) {
+    unsigned char b[4] = { static_cast<unsigned char>(k.lo >> 24), static_cast<unsigned char>(k.lo >> 16),
+                           static_cast<unsigned char>(k.lo >> 8), static_cast<unsigned char>(k.lo) };
+    uint32_t addr;
+    std::memcpy(&addr, b, sizeof(addr));
+    return addr;
+}
+
+/**
+ * @brief Builds the endpoints of one thread: a few NAT addresses with many ports each.
+ * @param thread Thread index (selects the addresses).
+ * @param count Number of endpoints.
+ * @return Endpoint keys in network byte order.
+ */
+static std::vector<EndpointKey> makeEndpoints(unsigned thread, unsigned count) {
+    std::vector<EndpointKey> keys;
+    keys.reserve(count);
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned long addr = 0x0A000000ul + thread * 16 + (i >> 14); // 10.0.x.y
+        unsigned short port = static_cast<unsigned short>(1024 + (i & 0x3FFF));
+        keys.push_back(endpointKeyV4(htonl(addr), htons(port)));
+    }
+    return keys;
+}
+
+/**
+ * @brief Runs the lap operation from several threads against one store.
+ * @param store Store under test.
+ * @param threads Number of threads.
+ * @param opts Benchmark parameters.
+ * @return Total operations per second.
+ */
+static double runStore(ShardedLapStore& store, unsigned threads, const BenchOptions& opts) {
+    std::vector<std::vector<EndpointKey>> keys;
+    for (unsigned t = 0; t < threads; ++t) keys.push_back(makeEndpoints(t, opts.endpoints));
+
+    std::atomic<unsigned> ready{ 0 };
+    std::atomic<bool> go{ false };
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t]() {
+            const std::vector<EndpointKey>& mine = keys[t];
+            ShardedLapStore::clock::time_point start;
+            uint32_t rng = 0x9E3779B9u * (t + 1);
+            ready.fetch_add(1);
+            while (!go.load()) std::this_thread::yield();
+            for (unsigned i = 0; i < opts.ops; ++i) {
+                rng = rng * 1664525u + 1013904223u;
+                store.lap(mine[rng % mine.size()], ShardedLapStore::clock::now(), start);
+            }
+        });
+    }
+    while (ready.load() != threads) std::this_thread::yield();
+    auto begin = std::chrono::steady_clock::now();
+    go.store(true);
+    for (auto& th : pool) th.join();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return static_cast<double>(threads) * opts.ops / sec;
+}
+
+/**
+ * @brief Counts endpoints that land in an already occupied bucket.
+ * @param keys Endpoints.
+ * @param buckets Bucket count (power of two).
+ * @param oldHash true for the former (addr << 16) ^ port hash.
+ * @return Number of colliding endpoints.
+ */
+static size_t collisions(const std::vector<EndpointKey>& keys, size_t buckets, bool oldHash) {
+    std::vector<unsigned char> used(buckets, 0);
+    size_t count = 0;
+    for (const EndpointKey& k : keys) {
+        size_t h = oldHash ? ((static_cast<size_t>(ipv4Of(k)) << 16) ^ k.port_be) : EndpointKeyHash()(k);
+        unsigned char& slot = used[h & (buckets - 1)];
+        if (slot) ++count;
+        slot = 1;
+    }
+    return count;
+}
+
+/**
+ * @brief Parses command-line switches into benchmark options.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @param opts Options to fill in.
+ * @return true if all switches were recognized, false otherwise.
+ */
+static bool parseArgs(int argc, char* argv[], BenchOptions& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        unsigned value = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        if (arg == "--threads") opts.threads = std::max(1u, value);
+        else if (arg == "--ops") opts.ops = value;
+        else if (arg == "--endpoints") opts.endpoints = std::max(1u, value);
+        else if (arg == "--shards") opts.shards = std::max(1u, value);
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions opts;
+    if (!parseArgs(argc, argv, opts)) {
+        std::printf("Usage: lap_contention [--threads T] [--ops N] [--endpoints E] [--shards S]\n");
+        return 1;
+    }
+
+    // Clients behind a few NAT addresses with many ports each
+    std::vector<EndpointKey> nat;
+    for (unsigned t = 0; t < 4; ++t) {
+        std::vector<EndpointKey> part = makeEndpoints(t, opts.endpoints);
+        nat.insert(nat.end(), part.begin(), part.end());
+    }
+    size_t buckets = 1;
+    while (buckets < nat.size()) buckets <<= 1;
+    std::printf("hash collisions (%zu endpoints, %zu buckets): old %zu, new %zu\n",
+                nat.size(), buckets, collisions(nat, buckets, true), collisions(nat, buckets, false));
+
+    std::printf("%8s %16s %16s %8s\n", "threads", "1 mutex op/s", "sharded op/s", "speedup");
+    for (unsigned threads = 1; threads <= opts.threads; threads *= 2) {
+        size_t capacity = static_cast<size_t>(threads) * opts.endpoints;
+        ShardedLapStore single(1, capacity, std::chrono::seconds(180));
+        ShardedLapStore sharded(opts.shards, capacity, std::chrono::seconds(180));
+        double a = runStore(single, threads, opts);
+        double b = runStore(sharded, threads, opts);
+        std::printf("%8u %16.0f %16.0f %7.2fx\n", threads, a, b, b / a);
+    }
+    return 0;
+}
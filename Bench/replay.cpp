@@ -0,0 +1,400 @@
+/**
+ * @file replay.cpp
+ * @brief Replays a captured trace (TimeServer --trace) and reports throughput and latency.
+ *
+ * In process (the default) every datagram goes through TimeServer::process(): admission,
+ * decoding, dispatch and reply formatting, without sockets, so ns/op compares server builds on
+ * the recorded request mix. With --wire the datagrams are sent to a running server instead.
+ * Every recorded source gets its own connected socket (lane), so the server sees one client per
+ * source; a lane sends its next datagram once the previous one was answered or timed out, so
+ * per-client state (laps, subscriptions) sees the same sequence as in the capture and every
+ * reply is matched. Lanes are capped by --lanes (default and at most FD_SETSIZE); past the cap,
+ * sources share lanes and thus client state, and the run reports how many did.
+ *
+ * Datagrams are replayed in receive order. At --speed original (or a factor such as 2x) each one
+ * is released at its recorded offset divided by the factor; at --speed max as soon as possible.
+ * Results: a table on stdout and, with --json PATH, Google Benchmark JSON for its compare tool.
+ *
+ * Build: cl /O2 /EHsc /std:c++14 replay.cpp ..\Server\server.cpp ..\Server\utils.cpp
+ *        ..\Server\batchio.cpp ..\Server\logger.cpp ..\Server\lapstore.cpp ..\Server\timezones.cpp
+ *        ..\Server\subscribers.cpp ..\Server\reactor.cpp ..\Server\metrics.cpp ..\Server\admission.cpp
+ *        ..\Server\replycache.cpp ..\Server\affinity.cpp ..\Server\scheduler.cpp
+ *        ..\Server\rxstamp.cpp ..\Server\trace.cpp ..\Server\batchdecode.cpp
+ * Usage: replay TRACE [--wire HOST[:PORT]] [--speed original|max|FACTORx] [--loops N]
+ *               [--lanes N] [--timeout-ms MS] [--json PATH]
+ * Compatible with C++14.
+ */
+
+#define FD_SETSIZE 256
+#include "bench.h"
+#include "../Server/server.h"
+#include "../Server/trace.h"
+#include "../Common/netaddr.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Replay parameters.
+ */
+struct ReplayOptions {
+    std::string trace;         /**< Trace file. */
+    std::string wireHost;      /**< Server to send to (empty = in process). */
+    unsigned short wirePort = 27015; /**< Port of the server. */
+    double speed = 0;          /**< Replay speed factor (0 = as fast as possible). */
+    unsigned loops = 1;        /**< Passes over the trace. */
+    unsigned lanes = FD_SETSIZE; /**< Wire mode: most sockets, one per recorded source. */
+    unsigned timeoutMs = 500;  /**< Wire mode: wait for a reply before counting it lost. */
+    std::string jsonPath;      /**< Google Benchmark JSON output, empty for none. */
+};
+
+/**
+ * @brief Outcome of a replay run.
+ */
+struct ReplayStats {
+    uint64_t sent = 0;              /**< Datagrams replayed. */
+    uint64_t answered = 0;          /**< Datagrams that got a reply. */
+    uint64_t lost = 0;              /**< Wire mode: replies that did not arrive in time. */
+    uint64_t late = 0;              /**< Wire mode: replies that arrived after their timeout (or ticks). */
+    double seconds = 0;             /**< Wall time of the run. */
+    std::vector<uint64_t> latencyNs;/**< Per answered datagram: processing time or round trip. */
+};
+
+/**
+ * @brief A wire-mode socket and the datagrams it replays.
+ */
+struct Lane {
+    SOCKET sock = INVALID_SOCKET;   /**< Socket connected to the server. */
+    std::vector<size_t> records;    /**< Indices into the trace, in receive order. */
+    size_t next = 0;                /**< Next record to send (over all loops). */
+    bool waiting = false;           /**< A reply is outstanding. */
+    Clock::time_point sentAt;       /**< Send time of the outstanding datagram. */
+};
+
+/**
+ * @brief Parses the replay speed: "max", "original" or a factor ("2", "0.5x").
+ * @param text Speed text.
+ * @param speed Parsed factor (0 = max).
+ * @return true if valid, false otherwise.
+ */
+static bool parseSpeed(const std::string& text, double& speed) {
+    if (text == "max") speed = 0;
+    else if (text == "original") speed = 1;
+    else {
+        speed = std::atof(text.c_str());
+        if (speed <= 0) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Splits "host", "host:port" or "[v6]:port"; a bare IPv6 literal has no port.
+ * @param spec Server address.
+ * @param host Host part.
+ * @param port Port, left unchanged if none is given.
+ */
+static void splitHostPort(const std::string& spec, std::string& host, unsigned short& port) {
+    host = spec;
+    size_t colon = spec.rfind(':');
+    bool bracketed = !spec.empty() && spec[0] == '[';
+    if (colon == std::string::npos || (!bracketed && spec.find(':') != colon) || (bracketed && spec[colon - 1] != ']')) return;
+    host = spec.substr(0, colon);
+    port = static_cast<unsigned short>(std::atoi(spec.c_str() + colon + 1));
+}
+
+/**
+ * @brief Parses command-line switches into replay options.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @param opts Options to fill in.
+ * @return true if all switches were recognized and a trace was given, false otherwise.
+ */
+static bool parseArgs(int argc, char* argv[], ReplayOptions& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--wire" && hasValue) splitHostPort(argv[++i], opts.wireHost, opts.wirePort);
+        else if (arg == "--speed" && hasValue) {
+            if (!parseSpeed(argv[++i], opts.speed)) return false;
+        }
+        else if (arg == "--loops" && hasValue) opts.loops = std::max(1u, static_cast<unsigned>(std::atoi(argv[++i])));
+        else if (arg == "--lanes" && hasValue) opts.lanes = std::max(1u, static_cast<unsigned>(std::atoi(argv[++i])));
+        else if (arg == "--timeout-ms" && hasValue) opts.timeoutMs = std::max(1u, static_cast<unsigned>(std::atoi(argv[++i])));
+        else if (arg == "--json" && hasValue) opts.jsonPath = argv[++i];
+        else if (opts.trace.empty() && arg[0] != '-') opts.trace = arg;
+        else return false;
+    }
+    opts.lanes = std::min(opts.lanes, static_cast<unsigned>(FD_SETSIZE));
+    return !opts.trace.empty();
+}
+
+/**
+ * @brief Reads a whole trace, ordered by receive time (workers' records are interleaved), with
+ *        offsets counted from the first datagram.
+ * @param path Trace file.
+ * @param records Records read.
+ * @return true on success, false if the file is not a trace.
+ */
+static bool loadTrace(const std::string& path, std::vector<TraceRecord>& records) {
+    TraceReader reader;
+    if (!reader.open(path)) return false;
+    TraceRecord record;
+    while (reader.next(record)) records.push_back(record);
+    std::stable_sort(records.begin(), records.end(),
+                     [](const TraceRecord& a, const TraceRecord& b) { return a.offsetNs < b.offsetNs; });
+    uint64_t first = records.empty() ? 0 : records.front().offsetNs;
+    for (TraceRecord& r : records) r.offsetNs -= first;
+    return true;
+}
+
+/**
+ * @brief Release time of a record in a given pass.
+ * @param start Start of the run.
+ * @param offsetNs Recorded offset.
+ * @param loop Pass number.
+ * @param spanNs Length of one pass (offset of the last record).
+ * @param speed Speed factor (0 = max).
+ * @return When the record may be sent.
+ */
+static Clock::time_point releaseAt(Clock::time_point start, uint64_t offsetNs, unsigned loop, uint64_t spanNs, double speed) {
+    if (speed <= 0) return start;
+    double ns = (static_cast<double>(loop) * spanNs + offsetNs) / speed;
+    return start + std::chrono::nanoseconds(static_cast<int64_t>(ns));
+}
+
+/**
+ * @brief Sleeps until shortly before a deadline, then spins to it.
+ * @param at Deadline.
+ */
+static void waitUntil(Clock::time_point at) {
+    Clock::time_point now = Clock::now();
+    if (at - now > std::chrono::milliseconds(2)) std::this_thread::sleep_until(at - std::chrono::milliseconds(1));
+    while (Clock::now() < at) {}
+}
+
+/**
+ * @brief Replays a trace through TimeServer::process() on the calling thread.
+ * @param records Trace.
+ * @param opts Replay parameters.
+ * @param stats Outcome.
+ * @return true on success, false if the server cannot be set up.
+ */
+static bool replayInProcess(const std::vector<TraceRecord>& records, const ReplayOptions& opts, ReplayStats& stats) {
+    ServerOptions options;
+    options.port = 0; // Never served: the socket only lets the server initialize
+    options.family = AddressFamily::IPv4;
+    TimeServer server(options);
+    char reply[BUFFER_SIZE];
+    uint64_t spanNs = records.back().offsetNs;
+    stats.latencyNs.reserve(records.size() * opts.loops);
+
+    Clock::time_point start = Clock::now();
+    for (unsigned loop = 0; loop < opts.loops; ++loop) {
+        for (const TraceRecord& record : records) {
+            if (opts.speed > 0) waitUntil(releaseAt(start, record.offsetNs, loop, spanNs, opts.speed));
+            Clock::time_point begin = Clock::now();
+            size_t len = server.process(record.data, record.len, record.from, OutSpan{ reply, sizeof(reply) });
+            Clock::time_point end = Clock::now();
+            ++stats.sent;
+            if (len == 0) continue;
+            ++stats.answered;
+            stats.latencyNs.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()));
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return true;
+}
+
+/**
+ * @brief Replays a trace to a server over UDP, one outstanding datagram per lane.
+ * @param records Trace.
+ * @param opts Replay parameters.
+ * @param stats Outcome.
+ * @return true on success, false if the server cannot be resolved or a socket not opened.
+ */
+static bool replayOverWire(const std::vector<TraceRecord>& records, const ReplayOptions& opts, ReplayStats& stats) {
+    sockaddr_storage server;
+    if (!resolveAddress(opts.wireHost, opts.wirePort, AF_UNSPEC, server)) {
+        std::printf("Cannot resolve %s\n", opts.wireHost.c_str());
+        return false;
+    }
+
+    // One lane per source while the cap allows; sources keep their lane, so their requests stay in order
+    std::map<std::string, size_t> sourceOf;
+    std::vector<size_t> source(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        source[i] = sourceOf.emplace(formatAddress(records[i].from), sourceOf.size()).first->second;
+    }
+    std::vector<Lane> lanes(std::min(sourceOf.size(), static_cast<size_t>(opts.lanes)));
+    for (size_t i = 0; i < records.size(); ++i) lanes[source[i] % lanes.size()].records.push_back(i);
+    if (sourceOf.size() > lanes.size()) {
+        std::printf("%zu source(s) over %zu lane(s) (--lanes, at most %d): %zu merged into shared client state\n",
+                    sourceOf.size(), lanes.size(), FD_SETSIZE, sourceOf.size() - lanes.size());
+    }
+    for (Lane& lane : lanes) {
+        lane.sock = socket(server.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+        u_long nonBlocking = 1;
+        if (INVALID_SOCKET == lane.sock || SOCKET_ERROR == ioctlsocket(lane.sock, FIONBIO, &nonBlocking) ||
+            SOCKET_ERROR == connect(lane.sock, (const sockaddr*)&server, addressLength(server))) {
+            std::printf("Cannot open a socket to %s: %d\n", formatAddress(server).c_str(), WSAGetLastError());
+            for (Lane& l : lanes) if (l.sock != INVALID_SOCKET) closesocket(l.sock);
+            return false;
+        }
+    }
+
+    uint64_t spanNs = records.back().offsetNs;
+    size_t perLoop = 0;
+    for (const Lane& lane : lanes) perLoop = std::max(perLoop, lane.records.size());
+    std::chrono::milliseconds timeout(opts.timeoutMs);
+    char reply[BUFFER_SIZE];
+    stats.latencyNs.reserve(records.size() * opts.loops);
+
+    Clock::time_point start = Clock::now();
+    size_t active = lanes.size();
+    while (active > 0) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point wake = now + timeout;
+        fd_set readable;
+        FD_ZERO(&readable);
+        active = 0;
+        bool waiting = false;
+        for (Lane& lane : lanes) {
+            size_t total = lane.records.size() * opts.loops;
+            if (!lane.waiting && lane.next < total) {
+                const TraceRecord& record = records[lane.records[lane.next % lane.records.size()]];
+                unsigned loop = static_cast<unsigned>(lane.next / lane.records.size());
+                Clock::time_point due = releaseAt(start, record.offsetNs, loop, spanNs, opts.speed);
+                if (due <= now) {
+                    // Whatever is still queued answered an earlier, timed-out datagram; 0-byte
+                    // datagrams (Number replies of value 0) count too
+                    while (recv(lane.sock, reply, sizeof(reply), 0) >= 0) ++stats.late;
+                    lane.sentAt = Clock::now();
+                    if (SOCKET_ERROR == send(lane.sock, record.data, static_cast<int>(record.len), 0)) ++stats.lost;
+                    else lane.waiting = true;
+                    ++stats.sent;
+                    ++lane.next;
+                }
+                else wake = std::min(wake, due);
+            }
+            if (lane.waiting) {
+                FD_SET(lane.sock, &readable);
+                waiting = true;
+                wake = std::min(wake, lane.sentAt + timeout);
+            }
+            if (lane.waiting || lane.next < total) ++active;
+        }
+        if (active == 0) break;
+
+        auto waitUs = std::chrono::duration_cast<std::chrono::microseconds>(wake - Clock::now()).count();
+        timeval tv = { 0, 0 };
+        if (waitUs > 0) {
+            tv.tv_sec = static_cast<long>(waitUs / 1000000);
+            tv.tv_usec = static_cast<long>(waitUs % 1000000);
+        }
+        if (waiting) select(0, &readable, NULL, NULL, &tv);
+        else if (waitUs > 0) waitUntil(wake);
+
+        now = Clock::now();
+        for (Lane& lane : lanes) {
+            if (!lane.waiting) continue;
+            if (FD_ISSET(lane.sock, &readable) && recv(lane.sock, reply, sizeof(reply), 0) >= 0) {
+                ++stats.answered;
+                stats.latencyNs.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - lane.sentAt).count()));
+                lane.waiting = false;
+            }
+            else if (now - lane.sentAt >= timeout) {
+                ++stats.lost;
+                lane.waiting = false;
+            }
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (Lane& lane : lanes) closesocket(lane.sock);
+    return true;
+}
+
+/**
+ * @brief Latency at a quantile of the sorted samples.
+ * @param sorted Samples in ascending order (not empty).
+ * @param q Quantile in [0, 1].
+ * @return Sample at the quantile.
+ */
+static double quantile(const std::vector<uint64_t>& sorted, double q) {
+    size_t index = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return static_cast<double>(sorted[index]);
+}
+
+int main(int argc, char* argv[]) {
+    ReplayOptions opts;
+    if (!parseArgs(argc, argv, opts)) {
+        std::printf("Usage: replay TRACE [--wire HOST[:PORT]] [--speed original|max|FACTORx] [--loops N]\n"
+                    "              [--lanes N] [--timeout-ms MS] [--json PATH]\n");
+        return 1;
+    }
+    std::vector<TraceRecord> records;
+    if (!loadTrace(opts.trace, records)) {
+        std::printf("Cannot read trace %s\n", opts.trace.c_str());
+        return 1;
+    }
+    if (records.empty()) {
+        std::printf("Trace %s is empty\n", opts.trace.c_str());
+        return 0;
+    }
+    setLogLevel(LogLevel::Warn); // per-request debug records would dominate the replay
+
+    ReplayStats stats;
+    bool wire = !opts.wireHost.empty();
+    if (wire) {
+        WSADATA wsaData;
+        if (0 != WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+            std::printf("WSAStartup failed\n");
+            return 1;
+        }
+    }
+    bool ok = wire ? replayOverWire(records, opts, stats) : replayInProcess(records, opts, stats);
+    if (wire) WSACleanup();
+    if (!ok) return 1;
+
+    std::string mode = wire ? "wire" : "inproc";
+    char factor[32];
+    std::snprintf(factor, sizeof(factor), "%gx", opts.speed);
+    std::string speed = opts.speed <= 0 ? "max" : (opts.speed == 1 ? "original" : factor);
+    double throughput = stats.seconds > 0 ? stats.sent / stats.seconds : 0;
+    std::printf("replay %s: %zu record(s) x %u loop(s), %s, speed %s\n", opts.trace.c_str(), records.size(), opts.loops,
+                mode.c_str(), speed.c_str());
+    std::printf("  sent %llu, answered %llu, lost %llu, late %llu in %.3f s: %.0f datagrams/s\n",
+                static_cast<unsigned long long>(stats.sent), static_cast<unsigned long long>(stats.answered),
+                static_cast<unsigned long long>(stats.lost), static_cast<unsigned long long>(stats.late), stats.seconds, throughput);
+
+    std::vector<bench::Result> results;
+    std::string prefix = "replay/" + mode + "/" + speed + "/";
+    uint64_t iterations = stats.sent;
+    results.push_back(bench::Result{ prefix + "per_datagram", iterations, throughput > 0 ? 1e9 / throughput : 0, 0 });
+    if (!stats.latencyNs.empty()) {
+        std::sort(stats.latencyNs.begin(), stats.latencyNs.end());
+        const char* names[] = { "p50", "p99", "p999", "max" };
+        const double quantiles[] = { 0.5, 0.99, 0.999, 1.0 };
+        std::printf("  latency us:");
+        for (size_t i = 0; i < 4; ++i) {
+            double ns = quantile(stats.latencyNs, quantiles[i]);
+            std::printf(" %s %.1f", names[i], ns / 1000.0);
+            results.push_back(bench::Result{ prefix + "latency_" + names[i], stats.answered, ns, 0 });
+        }
+        std::printf("\n");
+    }
+
+    if (!opts.jsonPath.empty()) {
+        std::FILE* out = nullptr;
+        if (0 != fopen_s(&out, opts.jsonPath.c_str(), "w") || !out) {
+            std::printf("Cannot write %s\n", opts.jsonPath.c_str());
+            return 1;
+        }
+        bench::writeJson(out, argv[0], results);
+        std::fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,392 @@
+/**
+ * @file server_bench.cpp
+ * @brief Microbenchmarks of the server handlers, request decoding (per datagram and per batch)
+ *        and reply encoding.
+ *
+ * Before measuring it checks that the scheduler keeps a source's stateful requests and batches
+ * in arrival order, and exits with 1 if it does not.
+ * Build: cl /O2 /EHsc /std:c++14 server_bench.cpp ..\Server\server.cpp ..\Server\utils.cpp
+ *        ..\Server\batchio.cpp ..\Server\logger.cpp ..\Server\lapstore.cpp ..\Server\timezones.cpp
+ *        ..\Server\subscribers.cpp ..\Server\reactor.cpp ..\Server\metrics.cpp ..\Server\admission.cpp
+ *        ..\Server\replycache.cpp ..\Server\affinity.cpp ..\Server\scheduler.cpp
+ *        ..\Server\rxstamp.cpp ..\Server\trace.cpp ..\Server\batchdecode.cpp
+ * Usage: server_bench [--filter TEXT] [--min-time SECONDS] [--json PATH]
+ * Compatible with C++14.
+ */
+
+#include "bench.h"
+#include "../Server/server.h"
+#include "../Server/timezones.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief Registers a benchmark for a handler that formats text into a buffer.
+ * @param name Benchmark name.
+ * @param handler Handler under test.
+ */
+static void addTextHandler(const char* name, size_t (*handler)(OutSpan)) {
+    bench::add(name, [handler](bench::State& state) {
+        char buf[BUFFER_SIZE];
+        while (state.keepRunning()) {
+            size_t len = handler(OutSpan{ buf, sizeof(buf) });
+            bench::doNotOptimize(len);
+        }
+    });
+}
+
+/**
+ * @brief Registers a benchmark for a handler that returns a number.
+ * @param name Benchmark name.
+ * @param handler Handler under test.
+ */
+static void addNumericHandler(const char* name, uint32_t (*handler)()) {
+    bench::add(name, [handler](bench::State& state) {
+        while (state.keepRunning()) {
+            uint32_t val = handler();
+            bench::doNotOptimize(val);
+        }
+    });
+}
+
+/**
+ * @brief Registers GetTimeWithoutDateInCity for one city name.
+ * @param city City name as a client would send it.
+ */
+static void addCity(const std::string& city) {
+    bench::add("GetTimeWithoutDateInCity/" + city, [city](bench::State& state) {
+        char buf[BUFFER_SIZE];
+        ByteView name{ city.data(), city.size() };
+        while (state.keepRunning()) {
+            size_t len = GetTimeWithoutDateInCity(name, OutSpan{ buf, sizeof(buf) });
+            bench::doNotOptimize(len);
+        }
+    });
+}
+
+/**
+ * @brief Builds the client address of benchmark endpoint i: 10.0.x.y or 2001:db8::x:y.
+ * @param i Endpoint index.
+ * @param ipv6 Build an IPv6 address instead of an IPv4 one.
+ * @return Client address.
+ */
+static sockaddr_storage lapClient(unsigned i, bool ipv6) {
+    sockaddr_storage addr{};
+    unsigned short port = htons(static_cast<unsigned short>(i));
+    uint32_t host = htonl(0x0A000000u + (i >> 16));
+    if (ipv6) {
+        sockaddr_in6& v6 = reinterpret_cast<sockaddr_in6&>(addr);
+        v6.sin6_family = AF_INET6;
+        v6.sin6_addr.s6_addr[0] = 0x20; v6.sin6_addr.s6_addr[1] = 0x01;
+        v6.sin6_addr.s6_addr[2] = 0x0D; v6.sin6_addr.s6_addr[3] = 0xB8;
+        std::memcpy(&v6.sin6_addr.s6_addr[12], &host, 4);
+        v6.sin6_port = port;
+    }
+    else {
+        sockaddr_in& v4 = reinterpret_cast<sockaddr_in&>(addr);
+        v4.sin_family = AF_INET;
+        v4.sin_addr.s_addr = host;
+        v4.sin_port = port;
+    }
+    return addr;
+}
+
+/**
+ * @brief Registers MeasureTimeLap with a given number of live timers.
+ *        One iteration completes the lap of a random endpoint and starts it again; the key is
+ *        built from the client address each time, as the server does.
+ * @param live Number of endpoints with a running timer.
+ * @param ipv6 Use IPv6 clients instead of IPv4 ones.
+ */
+static void addLap(unsigned live, bool ipv6) {
+    std::string name = "MeasureTimeLap/live:" + std::to_string(live) + (ipv6 ? "/ipv6" : "/ipv4");
+    bench::add(name, [live, ipv6](bench::State& state) {
+        configureLapStore(live * 2 > kDefaultLapCapacity ? live * 2 : kDefaultLapCapacity);
+        char buf[BUFFER_SIZE];
+        std::vector<sockaddr_storage> clients;
+        for (unsigned i = 0; i < live; ++i) {
+            clients.push_back(lapClient(i, ipv6));
+            MeasureTimeLap(endpointKeyOf(clients.back()), OutSpan{ buf, sizeof(buf) });
+        }
+        uint32_t rng = 12345;
+        while (state.keepRunning()) {
+            rng = rng * 1664525u + 1013904223u;
+            const sockaddr_storage& client = clients[rng % live];
+            size_t a = MeasureTimeLap(endpointKeyOf(client), OutSpan{ buf, sizeof(buf) });
+            size_t b = MeasureTimeLap(endpointKeyOf(client), OutSpan{ buf, sizeof(buf) });
+            bench::doNotOptimize(a + b);
+        }
+    });
+}
+
+/**
+ * @brief Registers TimeServer::decode on a fixed packet.
+ * @param name Benchmark name.
+ * @param packet Request bytes.
+ */
+static void addDecode(const char* name, const std::string& packet) {
+    bench::add(name, [packet](bench::State& state) {
+        while (state.keepRunning()) {
+            TimeServer::Request req = TimeServer::decode(packet.data(), packet.size());
+            bench::doNotOptimize(req);
+        }
+    });
+}
+
+/**
+ * @brief Registers a 32-datagram receive batch decoded by BatchDecoder and, for comparison,
+ *        one TimeServer::decode() and well-formedness check per datagram.
+ * @param name Benchmark name suffix.
+ * @param packets Datagrams, repeated to fill the batch.
+ */
+static void addBatchDecode(const std::string& name, const std::vector<std::string>& packets) {
+    static const unsigned kBatch = 32;
+    auto makeBatch = [packets]() {
+        std::vector<BatchIo::Datagram> batch(kBatch);
+        for (unsigned i = 0; i < kBatch; ++i) {
+            const std::string& packet = packets[i % packets.size()];
+            batch[i].data = const_cast<char*>(packet.data());
+            batch[i].len = static_cast<int>(packet.size());
+            batch[i].addr = nullptr;
+            batch[i].stamp = 0;
+        }
+        return batch;
+    };
+    bench::add("batchDecode/" + name, [makeBatch](bench::State& state) {
+        std::vector<BatchIo::Datagram> batch = makeBatch();
+        BatchDecoder decoder(kBatch, MAX_PARAMS);
+        while (state.keepRunning()) {
+            decoder.decode(batch.data(), kBatch);
+            bench::doNotOptimize(decoder.order());
+        }
+    });
+    bench::add("decodeEach/" + name, [makeBatch](bench::State& state) {
+        std::vector<BatchIo::Datagram> batch = makeBatch();
+        while (state.keepRunning()) {
+            unsigned good = 0;
+            for (const BatchIo::Datagram& datagram : batch) {
+                TimeServer::Request req = TimeServer::decode(datagram.data, static_cast<size_t>(datagram.len));
+                good += (req.binary || wire::legacyWellFormed(req.code, req.paramCount)) ? 1 : 0;
+                bench::doNotOptimize(req);
+            }
+            bench::doNotOptimize(good);
+        }
+    });
+}
+
+/**
+ * @brief Checks that every stateful code and a Batch from one source leave the scheduler in the
+ *        order they arrived, whichever comes first (a batch may carry the same client's lap).
+ * @return true if no pair was reordered.
+ */
+static bool checkSchedulerOrder() {
+    SchedulerOptions options;
+    options.targetUs = 1000;
+    RequestScheduler scheduler(options, -1);
+    sockaddr_storage addr = lapClient(1, false);
+    auto frame = [](ReqCode code) {
+        wire::Header header;
+        header.code = code;
+        std::string datagram(wire::kHeaderSize, '\0');
+        wire::encodeHeader(&datagram[0], header);
+        return datagram;
+    };
+    const std::string batch = frame(ReqCode::Batch) + std::string{ static_cast<char>(ReqCode::GetTime), '\0' };
+    bool ok = true;
+    for (size_t slot = 0; slot < wire::kCodeCount; ++slot) {
+        const wire::CodeInfo& info = wire::kCodes[slot];
+        if (info.cache != wire::Cacheability::Client) continue;
+        const std::string stateful = frame(info.code);
+        for (int batchFirst = 0; batchFirst < 2; ++batchFirst) {
+            const std::string& first = batchFirst ? batch : stateful;
+            const std::string& second = batchFirst ? stateful : batch;
+            bool evicted = false;
+            unsigned shed = 0;
+            scheduler.push(first.data(), first.size(), addr, 0, 0, 0, evicted);
+            scheduler.push(second.data(), second.size(), addr, 0, 0, 0, evicted);
+            const RequestScheduler::Item* item = scheduler.pop(0, shed);
+            bool inOrder = item && static_cast<size_t>(item->len) == first.size() && std::memcmp(item->data, first.data(), first.size()) == 0;
+            while (scheduler.pop(0, shed)) {}
+            if (!inOrder) {
+                std::fprintf(stderr, "scheduler: %s overtook %s from the same source\n",
+                             batchFirst ? info.name : "Batch", batchFirst ? "Batch" : info.name);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    // Keep per-request logging out of the measurements
+    setLogLevel(LogLevel::Warn);
+    if (!checkSchedulerOrder()) return 1;
+
+    addTextHandler("GetTime", GetTime);
+    addTextHandler("GetTimeWithoutDate", GetTimeWithoutDate);
+    addNumericHandler("GetTimeSinceEpoch", GetTimeSinceEpoch);
+    addNumericHandler("GetClientToServerDelayEstimation", GetClientToServerDelayEstimation);
+    bench::add("MeasureRTT", [](bench::State& state) {
+        char buf[BUFFER_SIZE];
+        while (state.keepRunning()) {
+            size_t len = MeasureRTT(ByteView{ nullptr, 0 }, OutSpan{ buf, sizeof(buf) });
+            bench::doNotOptimize(len);
+        }
+    });
+    addTextHandler("GetTimeWithoutDateOrSeconds", GetTimeWithoutDateOrSeconds);
+    addTextHandler("GetYear", GetYear);
+    addTextHandler("GetMonthAndDay", GetMonthAndDay);
+    addNumericHandler("GetSecondsSinceBeginingOfMonth", GetSecondsSinceBeginingOfMonth);
+    addNumericHandler("GetWeekOfYear", GetWeekOfYear);
+    addTextHandler("GetDaylightSavings", GetDaylightSavings);
+    bench::add("GetPreciseTime", [](bench::State& state) {
+        char payload[kPreciseRequestSize] = { 0, 0, 0, 1 };
+        char buf[BUFFER_SIZE];
+        while (state.keepRunning()) {
+            size_t len = GetPreciseTime(ByteView{ payload, sizeof(payload) }, preciseNowNs(), OutSpan{ buf, sizeof(buf) });
+            bench::doNotOptimize(len);
+        }
+    });
+
+    bench::add("binary/GetTimeFields", [](bench::State& state) {
+        char buf[BUFFER_SIZE];
+        while (state.keepRunning()) {
+            size_t len = GetTimeFields(OutSpan{ buf, sizeof(buf) });
+            bench::doNotOptimize(len);
+        }
+    });
+    bench::add("binary/GetTimeFieldsInCity/berlin", [](bench::State& state) {
+        char buf[BUFFER_SIZE];
+        while (state.keepRunning()) {
+            uint8_t flags = 0;
+            size_t len = GetTimeFieldsInCity(ByteView{ "berlin", 6 }, OutSpan{ buf, sizeof(buf) }, flags);
+            bench::doNotOptimize(len);
+        }
+    });
+
+    for (size_t zone = 0; zone < zoneCount(); ++zone) addCity(zoneName(static_cast<int>(zone)));
+    addCity("  New York ");
+    addCity("unknown-city");
+
+    // What a cached city request costs instead: normalizing the name and one cache lookup
+    bench::add("replyCache/hit/  New York ", [](bench::State& state) {
+        ReplyCache cache(1024);
+        char buf[BUFFER_SIZE];
+        const std::string city = "  New York ";
+        char key[ReplyCache::kMaxKey + 1];
+        ByteView keyView{ key, normalizeCity(ByteView{ city.data(), city.size() }, key, sizeof(key)) };
+        int64_t epoch = static_cast<int64_t>(std::time(nullptr));
+        size_t len = GetTimeWithoutDateInCity(keyView, OutSpan{ buf, sizeof(buf) });
+        cache.store(ReqCode::GetTimeWithoutDateInCity, keyView, epoch, buf, len);
+        while (state.keepRunning()) {
+            keyView.len = normalizeCity(ByteView{ city.data(), city.size() }, key, sizeof(key));
+            bool hit = cache.lookup(ReqCode::GetTimeWithoutDateInCity, keyView, epoch, OutSpan{ buf, sizeof(buf) }, len);
+            bench::doNotOptimize(hit);
+        }
+    });
+
+    addLap(1000, false);
+    addLap(100000, false);
+    addLap(1000, true);
+    addLap(100000, true);
+
+    const uint32_t values[] = { 0u, 0xFFu, 0x12345678u };
+    for (uint32_t val : values) {
+        bench::add("toBytes/" + std::to_string(val), [val](bench::State& state) {
+            char buf[4];
+            while (state.keepRunning()) {
+                size_t len = toBytes(val, OutSpan{ buf, sizeof(buf) });
+                bench::doNotOptimize(len);
+            }
+        });
+    }
+
+    std::string city("\x0C", 1);
+    city += std::string("\0berlin", 7);
+    addDecode("decode/no-params", std::string("\x01", 1));
+    addDecode("decode/city", city);
+    // Worst cases at the 255-byte limit: one long parameter, and only separators
+    addDecode("decode/255-long-param", std::string("\x0C", 1) + std::string(1, '\0') + std::string(BUFFER_SIZE - 2, 'a'));
+    addDecode("decode/255-separators", std::string("\x0C", 1) + std::string(BUFFER_SIZE - 1, '\0'));
+
+    // A receive batch of the production mix: city lookups with messy names, plain polls, laps,
+    // and a few malformed datagrams (city without a name, unknown code)
+    std::vector<std::string> mix = {
+        city,
+        std::string("\x0C", 1) + std::string("\0  San Francisco   ", 19),
+        std::string("\x01", 1),
+        std::string("\x0D", 1),
+        std::string("\x0C", 1) + std::string("\0new-york\0ignored", 18),
+        std::string("\x02", 1),
+        std::string("\x0C\0", 2),
+        std::string("\x7F", 1),
+    };
+    addBatchDecode("mix", mix);
+    for (size_t len : { 24, 64 }) { // Around the cut-over of TimeServer::batchLoop
+        addBatchDecode("city-" + std::to_string(len), { std::string("\x0C", 1) + std::string(1, '\0') + std::string(len - 2, 'a') });
+    }
+    addBatchDecode("255-long-param", { std::string("\x0C", 1) + std::string(1, '\0') + std::string(BUFFER_SIZE - 2, 'a') });
+
+    wire::Header header;
+    header.code = ReqCode::GetTimeWithoutDateInCity;
+    std::string binaryCity(wire::kHeaderSize, '\0');
+    wire::encodeHeader(&binaryCity[0], header);
+    addDecode("decode/binary-city", binaryCity + "berlin");
+
+    // The dashboard poll: time, year, week, DST and three cities in one Batch datagram
+    std::string dashboard(wire::kHeaderSize, '\0');
+    header.code = ReqCode::Batch;
+    wire::encodeHeader(&dashboard[0], header);
+    const ReqCode plain[] = { ReqCode::GetTime, ReqCode::GetYear, ReqCode::GetWeekOfYear, ReqCode::GetDaylightSavings };
+    for (ReqCode code : plain) dashboard += std::string{ static_cast<char>(code), '\0' };
+    const char* cities[] = { "doha", "new-york", "berlin" };
+    for (const char* name : cities) {
+        dashboard += std::string{ static_cast<char>(ReqCode::GetTimeWithoutDateInCity), static_cast<char>(std::strlen(name)) };
+        dashboard += name;
+    }
+    bench::add("respondBinary/dashboard-batch", [dashboard](bench::State& state) {
+        sockaddr_storage addr = lapClient(1, false);
+        char buf[BUFFER_SIZE];
+        while (state.keepRunning()) {
+            TimeServer::Request req = TimeServer::decode(dashboard.data(), dashboard.size());
+            size_t len = TimeServer::respondBinary(req, addr, OutSpan{ buf, sizeof(buf) });
+            bench::doNotOptimize(len);
+        }
+    });
+
+    // Per-request instrumentation: the always-on counters, and a sampled request's clock reads
+    bench::add("metrics/countRequest", [](bench::State& state) {
+        std::unique_ptr<WorkerMetrics> metrics(new WorkerMetrics(16));
+        while (state.keepRunning()) {
+            metrics->countRequest(ReqCode::GetTime);
+            bench::doNotOptimize(metrics->sampleNext());
+        }
+    });
+    bench::add("metrics/timedStage", [](bench::State& state) {
+        std::unique_ptr<WorkerMetrics> metrics(new WorkerMetrics(1));
+        while (state.keepRunning()) {
+            uint64_t start = metricsNowNs();
+            metrics->record(Stage::Total, metricsNowNs() - start);
+        }
+    });
+
+    // Admission control: one lookup per datagram over many sources, plus the reply charge
+    bench::add("admission/admit+charge", [](bench::State& state) {
+        AdmissionOptions options;
+        options.ratePps = 1000000;
+        options.amplification = 3;
+        AdmissionControl admission(options);
+        std::vector<sockaddr_storage> sources;
+        for (unsigned i = 0; i < 4096; ++i) sources.push_back(lapClient(i << 16, false));
+        uint32_t rng = 12345;
+        while (state.keepRunning()) {
+            rng = rng * 1664525u + 1013904223u;
+            uint64_t key;
+            DropReason reason;
+            if (admission.admit(sources[rng % sources.size()], 1, key, reason) && key) admission.charge(key, 1);
+        }
+    });
+
+    return bench::runAll(argc, argv);
+}
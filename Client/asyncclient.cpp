@@ -0,0 +1,307 @@
+/**
+ * @file asyncclient.cpp
+ * @brief Implements the AsyncTimeClient class.
+ *
+ * Callers insert a request into the pending table and send it themselves; the I/O thread only
+ * receives, matches and expires. Callbacks always run outside the table lock, so they may send
+ * further requests.
+ *
+ * C++14 is used for compatibility.
+ */
+
+#include "asyncclient.h"
+#include <algorithm>
+#include <memory>
+
+static constexpr auto kPollInterval = std::chrono::milliseconds(20); // close() is noticed within this
+
+/**
+ * @brief Constructs a closed client; call open() before sending.
+ * @param options Client parameters.
+ */
+AsyncTimeClient::AsyncTimeClient(const AsyncOptions& options)
+    : options_(options), sock_(INVALID_SOCKET), initialized_(false), running_(false), seq_(0)
+{
+}
+
+/**
+ * @brief Destructor. Closes the client; pending requests complete with Closed.
+ */
+AsyncTimeClient::~AsyncTimeClient() {
+    close();
+}
+
+/**
+ * @brief Resolves the server, connects the socket and starts the I/O thread.
+ * @return true on success, false otherwise.
+ */
+bool AsyncTimeClient::open() {
+    if (running_) return true;
+    WSAData wsaData;
+    if (NO_ERROR != WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+        printError("WSAStartup");
+        return false;
+    }
+    initialized_ = true;
+
+    sockaddr_storage server;
+    if (!resolveAddress(options_.server, options_.port, AF_UNSPEC, server)) {
+        printError("getaddrinfo");
+        close();
+        return false;
+    }
+    sock_ = socket(server.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (INVALID_SOCKET == sock_) {
+        printError("socket");
+        close();
+        return false;
+    }
+    // A connected datagram socket needs no address per send and only receives from the server
+    if (SOCKET_ERROR == connect(sock_, (const sockaddr*)&server, addressLength(server))) {
+        printError("connect");
+        close();
+        return false;
+    }
+    u_long nonBlocking = 1;
+    if (SOCKET_ERROR == ioctlsocket(sock_, FIONBIO, &nonBlocking)) {
+        printError("ioctlsocket");
+        close();
+        return false;
+    }
+    running_ = true;
+    thread_ = std::thread(&AsyncTimeClient::loop, this);
+    return true;
+}
+
+/**
+ * @brief Stops the I/O thread and closes the socket; pending requests complete with Closed.
+ */
+void AsyncTimeClient::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    if (thread_.joinable()) thread_.join(); // The thread completes whatever is still pending
+    if (sock_ != INVALID_SOCKET) {
+        closesocket(sock_);
+        sock_ = INVALID_SOCKET;
+    }
+    if (initialized_) {
+        WSACleanup();
+        initialized_ = false;
+    }
+}
+
+/**
+ * @brief Runs a callback with a transport error.
+ * @param callback Completion handler.
+ * @param error Error to report.
+ * @param attempts Datagrams sent.
+ */
+void AsyncTimeClient::fail(const Callback& callback, AsyncError error, unsigned attempts) {
+    AsyncResult result;
+    result.error = error;
+    result.attempts = attempts;
+    callback(result);
+}
+
+/**
+ * @brief Sends a request; the callback runs once, on the I/O thread, when it completes.
+ * @param code Request code.
+ * @param payload Bytes after the header (e.g. the city name).
+ * @param callback Completion handler; must not block (it may send further requests).
+ */
+void AsyncTimeClient::request(ReqCode code, const std::string& payload, Callback callback) {
+    if (wire::kHeaderSize + payload.size() > BUFFER_SIZE) {
+        fail(callback, AsyncError::Socket, 0);
+        return;
+    }
+    wire::Header header;
+    header.code = code;
+    do header.seq = ++seq_; while (header.seq == 0); // 0 is never a valid sequence
+    Pending pending;
+    pending.code = code;
+    pending.message.resize(wire::kHeaderSize);
+    wire::encodeHeader(pending.message.data(), header);
+    pending.message.insert(pending.message.end(), payload.begin(), payload.end());
+    pending.attempts = 1;
+    pending.maxAttempts = (wire::codeInfo(code).cache == wire::Cacheability::Client) ? 1 : 1 + options_.retries;
+
+    std::vector<char> message = pending.message;
+    AsyncError refused = AsyncError::None;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) refused = AsyncError::Closed;
+        else if (pending_.size() >= options_.maxInFlight) refused = AsyncError::Busy;
+        else {
+            pending.sentAt = Clock::now();
+            pending.deadline = pending.sentAt + std::chrono::milliseconds(std::max(1u, options_.timeoutMs));
+            pending.callback = std::move(callback);
+            pending_.emplace(header.seq, std::move(pending));
+        }
+    }
+    if (refused != AsyncError::None) {
+        fail(callback, refused, 0);
+        return;
+    }
+
+    // A full send buffer only costs this attempt; the deadline resends it
+    if (SOCKET_ERROR == send(sock_, message.data(), static_cast<int>(message.size()), 0) &&
+        WSAGetLastError() != WSAEWOULDBLOCK) {
+        Callback failed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = pending_.find(header.seq);
+            if (it == pending_.end()) return; // Already completed by the I/O thread
+            failed = std::move(it->second.callback);
+            pending_.erase(it);
+        }
+        printError("send");
+        fail(failed, AsyncError::Socket, 1);
+    }
+}
+
+/**
+ * @brief Sends a request and returns a future for its outcome.
+ * @param code Request code.
+ * @param payload Bytes after the header (e.g. the city name).
+ * @return Future that becomes ready when the request completes; it never throws.
+ */
+std::future<AsyncResult> AsyncTimeClient::request(ReqCode code, const std::string& payload) {
+    auto promise = std::make_shared<std::promise<AsyncResult>>();
+    std::future<AsyncResult> future = promise->get_future();
+    request(code, payload, [promise](const AsyncResult& result) { promise->set_value(result); });
+    return future;
+}
+
+/**
+ * @brief I/O thread: receives replies and expires requests until close().
+ */
+void AsyncTimeClient::loop() {
+    AsyncError exitError = AsyncError::Closed;
+    Clock::duration wait = kPollInterval;
+    while (running_) {
+        long waitUs = static_cast<long>(std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock_, &readable);
+        timeval timeout{ waitUs / 1000000, waitUs % 1000000 };
+        int ready = select(0, &readable, nullptr, nullptr, &timeout);
+        if (SOCKET_ERROR == ready) {
+            printError("select");
+            exitError = AsyncError::Socket;
+            break;
+        }
+        if (ready > 0 && !drain()) {
+            printError("recv");
+            exitError = AsyncError::Socket;
+            break;
+        }
+        wait = expire(Clock::now());
+    }
+
+    // Closed or broken: nothing pending can complete any more
+    std::unordered_map<uint32_t, Pending> left;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        left.swap(pending_);
+    }
+    for (auto& entry : left) fail(entry.second.callback, exitError, entry.second.attempts);
+}
+
+/**
+ * @brief Receives every queued datagram and completes the requests they answer.
+ * @return false on a fatal socket error, true otherwise.
+ */
+bool AsyncTimeClient::drain() {
+    char buf[BUFFER_SIZE];
+    for (;;) {
+        int len = recv(sock_, buf, sizeof(buf), 0);
+        Clock::time_point now = Clock::now();
+        if (SOCKET_ERROR == len) {
+            int error = WSAGetLastError();
+            if (error == WSAEWOULDBLOCK) return true;
+            // Port unreachable (server not up yet) or an oversized datagram: the deadlines handle it
+            if (error == WSAECONNRESET || error == WSAENETRESET || error == WSAEMSGSIZE) continue;
+            return false;
+        }
+
+        wire::Header header;
+        if (!wire::decodeHeader(buf, static_cast<size_t>(len), header) || (header.flags & wire::kFlagTick)) {
+            continue; // Not a binary reply, or a subscription tick
+        }
+        Pending pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = pending_.find(header.seq);
+            if (it == pending_.end() || it->second.code != header.code) continue; // Late or duplicate
+            pending = std::move(it->second);
+            pending_.erase(it);
+        }
+        AsyncResult result;
+        result.error = AsyncError::None;
+        result.header = header;
+        result.body.assign(buf + wire::kHeaderSize, buf + len);
+        result.attempts = pending.attempts;
+        result.rttUs = std::chrono::duration<double, std::micro>(now - pending.sentAt).count();
+        result.receivedAt = now;
+        pending.callback(result);
+    }
+}
+
+/**
+ * @brief Resends or times out requests whose deadline passed.
+ * @param now Current time.
+ * @return Time to wait before the next deadline (capped at the poll interval).
+ */
+AsyncTimeClient::Clock::duration AsyncTimeClient::expire(Clock::time_point now) {
+    const auto timeout = std::chrono::milliseconds(std::max(1u, options_.timeoutMs));
+    Clock::time_point next = now + kPollInterval;
+    std::vector<Pending> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            Pending& pending = it->second;
+            if (pending.deadline <= now) {
+                if (pending.attempts >= pending.maxAttempts) {
+                    expired.push_back(std::move(pending));
+                    it = pending_.erase(it);
+                    continue;
+                }
+                // Same sequence number: a late reply to the earlier attempt still completes it
+                send(sock_, pending.message.data(), static_cast<int>(pending.message.size()), 0);
+                ++pending.attempts;
+                pending.deadline = now + timeout;
+            }
+            next = std::min(next, pending.deadline);
+            ++it;
+        }
+    }
+    for (const Pending& pending : expired) fail(pending.callback, AsyncError::Timeout, pending.attempts);
+    return next - now;
+}
+
+/**
+ * @brief Decodes the broken-down time of a date or time reply.
+ * @param result Completed request.
+ * @param t Receives the fields.
+ * @return true if the reply is Ok and holds TimeFields, false otherwise.
+ */
+bool AsyncTimeClient::decodeTime(const AsyncResult& result, wire::TimeFields& t) {
+    if (!result.ok() || result.body.size() != wire::kTimeFieldsSize) return false;
+    t = wire::decodeTime(result.body.data());
+    return true;
+}
+
+/**
+ * @brief Decodes the 32-bit value of a delay, seconds-of-month or lap reply.
+ * @param result Completed request.
+ * @param value Receives the value.
+ * @return true if the reply is Ok and holds a value, false otherwise.
+ */
+bool AsyncTimeClient::decodeValue(const AsyncResult& result, uint32_t& value) {
+    if (!result.ok() || result.body.size() != wire::kValueSize) return false;
+    value = wire::getLe32(result.body.data());
+    return true;
+}
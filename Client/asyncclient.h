@@ -0,0 +1,202 @@
+/**
+ * @file asyncclient.h
+ * @brief Declares AsyncTimeClient, a non-blocking, embeddable client for the binary protocol.
+ *
+ * Unlike TimeClient, which drives the console menu and blocks in recv(), AsyncTimeClient is meant
+ * to be called from code: every request returns at once with a std::future, or takes a callback,
+ * and any number of requests share one socket. Requests carry a sequence number in the binary
+ * header and replies are matched by it, so they may complete in any order.
+ *
+ * The socket is connect()ed to the server: sends skip the per-datagram address, and the stack
+ * drops datagrams from any other source. One I/O thread receives the replies and enforces the
+ * deadlines: a request without reply is sent again up to a number of retries and then completes
+ * with AsyncError::Timeout, so no caller ever waits forever. Codes whose answer depends on
+ * per-client server state (laps, subscriptions) are never resent, since a duplicate would change
+ * that state.
+ *
+ * C++14 is used for compatibility.
+ */
+#pragma once
+#include <winsock2.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "utils.h"
+
+/**
+ * @struct AsyncOptions
+ * @brief Parameters of an AsyncTimeClient.
+ */
+struct AsyncOptions {
+    std::string server = "127.0.0.1"; // Server name or IPv4/IPv6 literal
+    unsigned short port = 27015;      // Server port
+    unsigned timeoutMs = 500;         // Wait for a reply to one attempt
+    unsigned retries = 2;             // Extra attempts before a request times out
+    unsigned maxInFlight = 1024;      // Requests outstanding at once; more complete with Busy
+};
+
+/**
+ * @enum AsyncError
+ * @brief Why an asynchronous request completed without a reply.
+ */
+enum class AsyncError : uint8_t {
+    None,    // A reply arrived (check its status)
+    Timeout, // No reply after every attempt
+    Busy,    // Too many requests in flight
+    Closed,  // The client was closed (or never opened) before a reply arrived
+    Socket   // The request could not be sent
+};
+
+/**
+ * @struct AsyncResult
+ * @brief Outcome of one asynchronous request.
+ */
+struct AsyncResult {
+    AsyncError error = AsyncError::Closed; // Transport outcome
+    wire::Header header;                   // Reply header (status, flags) if error is None
+    std::vector<char> body;                // Reply body if error is None
+    unsigned attempts = 0;                 // Datagrams sent for the request
+    double rttUs = 0;                      // First attempt to reply, if error is None (see retried())
+    std::chrono::steady_clock::time_point receivedAt; // Time the reply was received, if error is None
+
+    /**
+     * @brief Whether the server answered with status Ok.
+     * @return true if a reply arrived and its status is Ok.
+     */
+    bool ok() const { return error == AsyncError::None && header.status == wire::Status::Ok; }
+
+    /**
+     * @brief Whether the request was resent; the reply may answer any attempt (Karn's rule),
+     *        so rttUs is not a round-trip sample and RTT estimates should skip it.
+     * @return true if more than one datagram was sent.
+     */
+    bool retried() const { return attempts > 1; }
+};
+
+/**
+ * @class AsyncTimeClient
+ * @brief Runs binary requests concurrently over one connected UDP socket.
+ */
+class AsyncTimeClient {
+public:
+    using Callback = std::function<void(const AsyncResult&)>;
+
+    /**
+     * @brief Constructs a closed client; call open() before sending.
+     * @param options Client parameters.
+     */
+    explicit AsyncTimeClient(const AsyncOptions& options);
+
+    /**
+     * @brief Destructor. Closes the client; pending requests complete with Closed.
+     */
+    ~AsyncTimeClient();
+
+    AsyncTimeClient(const AsyncTimeClient&) = delete;
+    AsyncTimeClient& operator=(const AsyncTimeClient&) = delete;
+
+    /**
+     * @brief Resolves the server, connects the socket and starts the I/O thread.
+     * @return true on success, false otherwise.
+     */
+    bool open();
+
+    /**
+     * @brief Stops the I/O thread and closes the socket; pending requests complete with Closed.
+     */
+    void close();
+
+    /**
+     * @brief Sends a request; the callback runs once, on the I/O thread, when it completes.
+     * @param code Request code.
+     * @param payload Bytes after the header (e.g. the city name).
+     * @param callback Completion handler; must not block (it may send further requests).
+     *
+     * If the request cannot be started (closed client, too many in flight, send error),
+     * the callback runs at once on the calling thread.
+     */
+    void request(ReqCode code, const std::string& payload, Callback callback);
+
+    /**
+     * @brief Sends a request and returns a future for its outcome.
+     * @param code Request code.
+     * @param payload Bytes after the header (e.g. the city name).
+     * @return Future that becomes ready when the request completes; it never throws.
+     */
+    std::future<AsyncResult> request(ReqCode code, const std::string& payload = std::string());
+
+    /**
+     * @brief Decodes the broken-down time of a date or time reply.
+     * @param result Completed request.
+     * @param t Receives the fields.
+     * @return true if the reply is Ok and holds TimeFields, false otherwise.
+     */
+    static bool decodeTime(const AsyncResult& result, wire::TimeFields& t);
+
+    /**
+     * @brief Decodes the 32-bit value of a delay, seconds-of-month or lap reply.
+     * @param result Completed request.
+     * @param value Receives the value.
+     * @return true if the reply is Ok and holds a value, false otherwise.
+     */
+    static bool decodeValue(const AsyncResult& result, uint32_t& value);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @struct Pending
+     * @brief A request waiting for its reply.
+     */
+    struct Pending {
+        ReqCode code;               // Request code, checked against the reply
+        std::vector<char> message;  // Datagram, kept for retries
+        Clock::time_point sentAt;   // Time of the first attempt
+        Clock::time_point deadline; // Time the last attempt gives up
+        unsigned attempts;          // Datagrams sent so far
+        unsigned maxAttempts;       // 1 + retries, or 1 for stateful codes
+        Callback callback;          // Completion handler
+    };
+
+    /**
+     * @brief I/O thread: receives replies and expires requests until close().
+     */
+    void loop();
+
+    /**
+     * @brief Receives every queued datagram and completes the requests they answer.
+     * @return false on a fatal socket error, true otherwise.
+     */
+    bool drain();
+
+    /**
+     * @brief Resends or times out requests whose deadline passed.
+     * @param now Current time.
+     * @return Time to wait before the next deadline (capped at the poll interval).
+     */
+    Clock::duration expire(Clock::time_point now);
+
+    /**
+     * @brief Runs a callback with a transport error.
+     * @param callback Completion handler.
+     * @param error Error to report.
+     * @param attempts Datagrams sent.
+     */
+    static void fail(const Callback& callback, AsyncError error, unsigned attempts);
+
+    AsyncOptions options_;     // Client parameters
+    SOCKET sock_;              // Socket connected to the server
+    bool initialized_;         // true once WSAStartup succeeded
+    std::atomic<bool> running_;// Cleared by close() to stop the I/O thread
+    std::atomic<uint32_t> seq_;// Last sequence number used
+    std::thread thread_;       // I/O thread
+    std::mutex mutex_;         // Guards pending_
+    std::unordered_map<uint32_t, Pending> pending_; // Requests in flight, by sequence number
+};
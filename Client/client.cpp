@@ -10,8 +10,14 @@
  */
 
 #include "client.h"
+#include "probe.h"
+#include <ws2tcpip.h>
 #include <algorithm>
+#include <chrono>
 #include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 
  /**
   * @brief Constructs a TimeClient and initializes Winsock and socket.
@@ -44,21 +50,27 @@ bool TimeClient::initialize() {
     }
     initialized_ = true;
 
-    connSocket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    // Name or literal of either family; the socket follows the resolved one
+    if (!resolveAddress(serverIp_, port_, AF_UNSPEC, serverAddr_)) {
+        printError("getaddrinfo");
+        cleanup();
+        return false;
+    }
+    connSocket_ = socket(serverAddr_.ss_family, SOCK_DGRAM, IPPROTO_UDP);
     if (INVALID_SOCKET == connSocket_) {
         printError("socket");
         cleanup();
         return false;
     }
-
-    serverAddr_.sin_family = AF_INET;
-    serverAddr_.sin_addr.s_addr = inet_addr(serverIp_.c_str());
-    if (serverAddr_.sin_addr.s_addr == INADDR_NONE) {
-        printError("inet_addr");
+    // Connected: sends need no address and only the server's datagrams are received
+    if (SOCKET_ERROR == connect(connSocket_, (const sockaddr*)&serverAddr_, addressLength(serverAddr_))) {
+        printError("connect");
         cleanup();
         return false;
     }
-    serverAddr_.sin_port = htons(port_);
+    // A lost reply fails the request instead of blocking the menu forever
+    DWORD timeoutMs = RECEIVE_TIMEOUT_MS;
+    setsockopt(connSocket_, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeoutMs, sizeof(timeoutMs));
     return true;
 }
 
@@ -82,10 +94,9 @@ void TimeClient::cleanup() {
  * @return true if successful, false otherwise.
  */
 bool TimeClient::sendRequest(const std::vector<char>& message) {
-    int bytesSent = sendto(connSocket_, message.data(), static_cast<int>(message.size()), 0,
-        (const sockaddr*)&serverAddr_, sizeof(serverAddr_));
+    int bytesSent = send(connSocket_, message.data(), static_cast<int>(message.size()), 0);
     if (SOCKET_ERROR == bytesSent) {
-        printError("sendto");
+        printError("send");
         return false;
     }
     if (debug_) std::cout << "Sent: " << bytesSent << "/" << message.size() << " bytes.\n";
@@ -176,7 +187,7 @@ bool TimeClient::run() {
     while (true) {
         system("cls");
         printMenu();
-        std::cout << "Enter your choice (1-13) or 0 to exit: ";
+        std::cout << "Enter your choice (1-16) or 0 to exit: ";
         std::string input;
         std::cin >> input;
 
@@ -184,7 +195,7 @@ bool TimeClient::run() {
         if (input.empty() || input.size() > 2 || !std::all_of(input.begin(), input.end(), ::isdigit)) {
             system("cls");
             printMenu();
-            std::cout << "Invalid choice. Please enter a number between 0 and 13 (max two digits).\n";
+            std::cout << "Invalid choice. Please enter a number between 0 and 16 (max two digits).\n";
             system("pause");
             continue;
         }
@@ -196,10 +207,10 @@ bool TimeClient::run() {
             std::cout << "Time Client: Closing Connection.\n";
             break;
         }
-        if (choice < 1 || choice > 13) {
+        if (choice < 1 || choice > 16) {
             system("cls");
             printMenu();
-            std::cout << "Invalid choice. Please select a valid option (1-13) or 0 to exit.\n";
+            std::cout << "Invalid choice. Please select a valid option (1-16) or 0 to exit.\n";
             system("pause");
             continue;
         }
@@ -222,35 +233,315 @@ bool TimeClient::run() {
  * @return true if successful, false otherwise.
  */
 bool TimeClient::dispatch(ReqCode code) {
+    if (binary_ && code != ReqCode::MeasuureRTT && code != ReqCode::GetClientToServerDelayEstimation &&
+        code != ReqCode::GetPreciseTime && code != ReqCode::Batch && code != ReqCode::Subscribe) {
+        return dispatchBinary(code);
+    }
+    // Indexed by code value, like wire::kCodes; null for codes without a menu entry
+    static constexpr bool (TimeClient::*kHandlers[])() = {
+        nullptr,
+        &TimeClient::GetTime,
+        &TimeClient::GetTimeWithoutDate,
+        &TimeClient::GetTimeSinceEpoch,
+        &TimeClient::GetClientToServerDelayEstimation,
+        &TimeClient::MeasureRTT,
+        &TimeClient::GetTimeWithoutDateOrSeconds,
+        &TimeClient::GetYear,
+        &TimeClient::GetMonthAndDay,
+        &TimeClient::GetSecondsSinceBeginningOfMonth,
+        &TimeClient::GetWeekOfYear,
+        &TimeClient::GetDaylightSavings,
+        &TimeClient::GetTimeWithoutDateInCity,
+        &TimeClient::MeasureTimeLap,
+        &TimeClient::MeasurePreciseTime,
+        &TimeClient::PollDashboard,
+        &TimeClient::WatchTicks,
+        nullptr
+    };
+    static_assert(sizeof(kHandlers) / sizeof(kHandlers[0]) == wire::kCodeCount, "one menu entry per registered code");
+    bool (TimeClient::*handler)() = kHandlers[wire::codeSlot(code)];
+    return handler ? (this->*handler)() : false;
+}
+
+/**
+ * @brief Sends a binary request and waits for the reply with the same sequence number.
+ * @param code Request code.
+ * @param payload Bytes after the header (e.g. the city name).
+ * @param header Receives the reply header.
+ * @param body Receives the reply body.
+ * @return true if a reply with status Ok arrived, false otherwise.
+ */
+bool TimeClient::queryBinary(ReqCode code, const std::string& payload, wire::Header& header, std::vector<char>& body) {
+    wire::Header request;
+    request.code = code;
+    request.seq = ++seq_;
+    std::vector<char> message(wire::kHeaderSize);
+    wire::encodeHeader(message.data(), request);
+    message.insert(message.end(), payload.begin(), payload.end());
+    if (!sendRequest(message)) return false;
+
+    // Skip stale replies of earlier requests and subscription ticks
+    std::vector<char> reply;
+    do {
+        if (!receiveResponse(reply)) return false;
+    } while (!wire::decodeHeader(reply.data(), reply.size(), header) || header.seq != request.seq ||
+             (header.flags & wire::kFlagTick));
+
+    if (header.status != wire::Status::Ok) {
+        std::cout << "Server answered with status " << static_cast<unsigned>(header.status) << ".\n";
+        return false;
+    }
+    body.assign(reply.begin() + wire::kHeaderSize, reply.end());
+    return true;
+}
+
+/**
+ * @brief Runs a date, time or lap request in binary mode and prints the decoded fields.
+ * @param code Request code.
+ * @return true if successful, false otherwise.
+ */
+bool TimeClient::dispatchBinary(ReqCode code) {
+    std::string city;
+    if (code == ReqCode::GetTimeWithoutDateInCity) city = promptCity(); // Ask user for city name
+    wire::Header header;
+    std::vector<char> body;
+    if (!queryBinary(code, city, header, body)) return false;
+    return printBinary(code, header.flags, body, city);
+}
+
+/**
+ * @brief Prints one binary answer the way the text handlers print theirs.
+ * @param code Request code.
+ * @param flags Reply flags.
+ * @param body Reply body.
+ * @param city City name (GetTimeWithoutDateInCity only).
+ * @return true if the body has the size of the code, false otherwise.
+ */
+bool TimeClient::printBinary(ReqCode code, uint8_t flags, const std::vector<char>& body, const std::string& city) {
+    int expected = wire::replyBodySize(code);
+    if (expected < 0 || body.size() != static_cast<size_t>(expected)) {
+        std::cout << "Invalid binary reply size: " << body.size() << " bytes.\n";
+        return false;
+    }
+    if (body.size() == wire::kValueSize) {
+        uint32_t value = wire::getLe32(body.data());
+        if (code == ReqCode::GetSecondsSinceBeginningOfMonth) {
+            std::cout << "Seconds since beginning of month: " << value << std::endl;
+        }
+        else if (code == ReqCode::GetClientToServerDelayEstimation) {
+            std::cout << "Server tick count: " << value << std::endl;
+        }
+        else if (flags & wire::kFlagLapStarted) {
+            std::cout << "Timer started. Send the same request again to stop the timer." << std::endl;
+        }
+        else {
+            std::printf("Time elapsed since the timer was started: %02u:%02u\n", value / 60, value % 60);
+        }
+        return true;
+    }
+
+    wire::TimeFields t = wire::decodeTime(body.data());
     switch (code) {
     case ReqCode::GetTime:
-        return GetTime();
+        std::printf("The time and date are: %02u/%02u/%04u %02u:%02u:%02u.%06u\n",
+                    t.day, t.month, t.year, t.hour, t.minute, t.second, t.micros);
+        break;
     case ReqCode::GetTimeWithoutDate:
-        return GetTimeWithoutDate();
+        std::printf("The time is: %02u:%02u:%02u\n", t.hour, t.minute, t.second);
+        break;
     case ReqCode::GetTimeSinceEpoch:
-        return GetTimeSinceEpoch();
-    case ReqCode::GetClientToServerDelayEstimation:
-        return GetClientToServerDelayEstimation();
-    case ReqCode::MeasuureRTT:
-        return MeasureRTT();
+        std::printf("Seconds since epoch: %llu.%06u\n", static_cast<unsigned long long>(t.epochSec), t.micros);
+        break;
     case ReqCode::GetTimeWithoutDateOrSeconds:
-        return GetTimeWithoutDateOrSeconds();
+        std::printf("The time is: %02u:%02u\n", t.hour, t.minute);
+        break;
     case ReqCode::GetYear:
-        return GetYear();
+        std::printf("The year is: %04u\n", t.year);
+        break;
     case ReqCode::GetMonthAndDay:
-        return GetMonthAndDay();
-    case ReqCode::GetSecondsSinceBeginningOfMonth:
-        return GetSecondsSinceBeginningOfMonth();
+        std::printf("The month and day are: %02u/%02u\n", t.day, t.month);
+        break;
     case ReqCode::GetWeekOfYear:
-        return GetWeekOfYear();
+        std::printf("Week of the year: %u\n", t.week);
+        break;
     case ReqCode::GetDaylightSavings:
-        return GetDaylightSavings();
+        std::printf("It is currently %s.\n", t.dst ? "Daylight Saving Time" : "Standard Time");
+        break;
     case ReqCode::GetTimeWithoutDateInCity:
-        return GetTimeWithoutDateInCity();
-    case ReqCode::MeasureTimeLap:
-        return MeasureTimeLap();
+        if (flags & wire::kFlagUnknownZone) std::cout << "Unknown city, showing UTC.\n";
+        std::printf("The time in %s is: %02u:%02u:%02u (UTC%+d:%02d)\n", city.c_str(), t.hour, t.minute, t.second,
+                    t.utcOffsetMin / 60, std::abs(t.utcOffsetMin % 60));
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Sends several requests in one Batch datagram and returns every answer.
+ * @param requests Sub-requests (code and at most one argument, up to 255 bytes).
+ * @param replies Receives one answer per sub-request, in order.
+ * @return true if every sub-request was answered, false on error or a truncated reply.
+ */
+bool TimeClient::queryBatch(const std::vector<Request>& requests, std::vector<BatchReply>& replies) {
+    if (requests.empty() || requests.size() > wire::kMaxBatchItems) {
+        std::cout << "A batch holds 1 to " << wire::kMaxBatchItems << " requests.\n";
+        return false;
     }
-    return false;
+    std::string packed;
+    for (const Request& request : requests) {
+        std::string arg = request.args.empty() ? std::string() : request.args[0];
+        if (arg.size() > 255) return false;
+        packed += static_cast<char>(request.code);
+        packed += static_cast<char>(arg.size());
+        packed += arg;
+    }
+    if (wire::kHeaderSize + packed.size() > BUFFER_SIZE) {
+        std::cout << "Batch does not fit in one datagram.\n";
+        return false;
+    }
+
+    wire::Header header;
+    std::vector<char> body;
+    if (!queryBinary(ReqCode::Batch, packed, header, body)) return false;
+
+    replies.clear();
+    size_t pos = 0;
+    while (pos + wire::kBatchReplyItemHeaderSize <= body.size()) {
+        BatchReply reply;
+        reply.code = static_cast<ReqCode>(body[pos]);
+        reply.status = static_cast<wire::Status>(body[pos + 1]);
+        reply.flags = static_cast<uint8_t>(body[pos + 2]);
+        size_t len = static_cast<unsigned char>(body[pos + 3]);
+        pos += wire::kBatchReplyItemHeaderSize;
+        if (pos + len > body.size()) break;
+        reply.body.assign(body.begin() + pos, body.begin() + pos + len);
+        pos += len;
+        replies.push_back(reply);
+    }
+    if (header.flags & wire::kFlagTruncated) std::cout << "Batch reply truncated.\n";
+    return replies.size() == requests.size();
+}
+
+/**
+ * @brief Polls time, year, week, DST and three city times with one Batch datagram.
+ * @return true if successful, false otherwise.
+ */
+bool TimeClient::PollDashboard() {
+    const std::vector<std::string> cities = { "doha", "new-york", "berlin" };
+    std::vector<Request> requests = {
+        Request(ReqCode::GetTime), Request(ReqCode::GetYear), Request(ReqCode::GetWeekOfYear),
+        Request(ReqCode::GetDaylightSavings)
+    };
+    for (const std::string& city : cities) requests.push_back(Request(ReqCode::GetTimeWithoutDateInCity, { city }));
+
+    std::vector<BatchReply> replies;
+    if (!queryBatch(requests, replies)) return false;
+    bool ok = true;
+    for (size_t i = 0; i < replies.size(); ++i) {
+        if (replies[i].status != wire::Status::Ok) {
+            std::cout << "Request " << static_cast<int>(replies[i].code) << " failed with status "
+                      << static_cast<unsigned>(replies[i].status) << ".\n";
+            ok = false;
+            continue;
+        }
+        const std::string city = requests[i].args.empty() ? std::string() : requests[i].args[0];
+        ok = printBinary(replies[i].code, replies[i].flags, replies[i].body, city) && ok;
+    }
+    return ok;
+}
+
+/**
+ * @brief Subscribes to time ticks, prints a few of them and unsubscribes.
+ *
+ * Unicast ticks arrive on the request socket; multicast ticks on a socket that joins the
+ * group the server announced. The subscription is renewed after half its time-to-live.
+ * @return true if every tick arrived, false otherwise.
+ */
+bool TimeClient::WatchTicks() {
+    const int kTicks = 10;
+    wire::Header header;
+    std::vector<char> body;
+    if (!queryBinary(ReqCode::Subscribe, std::string(), header, body)) return false;
+    if (body.size() != wire::kSubscribeBodySize) {
+        std::cout << "Invalid subscribe reply size: " << body.size() << " bytes.\n";
+        return false;
+    }
+    uint32_t ttlSec = wire::getLe32(body.data());
+    uint32_t intervalMs = wire::getLe32(body.data() + 4);
+    uint32_t group;
+    std::memcpy(&group, body.data() + 8, 4);
+    unsigned short groupPort = wire::getLe16(body.data() + 12);
+    std::cout << "Subscribed for " << ttlSec << " s, one tick every " << intervalMs << " ms";
+
+    SOCKET tickSocket = connSocket_;
+    if (group != 0) {
+        in_addr groupAddr;
+        groupAddr.s_addr = group;
+        std::cout << " on multicast group " << inet_ntoa(groupAddr) << ":" << groupPort;
+        tickSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (INVALID_SOCKET == tickSocket) {
+            printError("socket");
+            return false;
+        }
+        BOOL reuse = TRUE;
+        setsockopt(tickSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        sockaddr_in local;
+        std::memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = INADDR_ANY;
+        local.sin_port = htons(groupPort);
+        ip_mreq membership;
+        membership.imr_multiaddr = groupAddr;
+        membership.imr_interface.s_addr = INADDR_ANY;
+        if (SOCKET_ERROR == bind(tickSocket, (const sockaddr*)&local, sizeof(local)) ||
+            SOCKET_ERROR == setsockopt(tickSocket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&membership, sizeof(membership))) {
+            printError("join multicast group");
+            closesocket(tickSocket);
+            return false;
+        }
+    }
+    std::cout << ".\n";
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point renewAt = clock::now() + std::chrono::milliseconds(ttlSec * 500);
+    long waitMs = std::max<long>(1000, 3 * static_cast<long>(intervalMs));
+    uint32_t lastSeq = 0;
+    int received = 0;
+    char buf[BUFFER_SIZE];
+    while (received < kTicks) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(tickSocket, &readable);
+        timeval wait{ waitMs / 1000, (waitMs % 1000) * 1000 };
+        int ready = select(0, &readable, nullptr, nullptr, &wait);
+        if (ready <= 0) {
+            std::cout << "No tick within " << waitMs << " ms.\n";
+            break;
+        }
+        int len = recv(tickSocket, buf, sizeof(buf), 0);
+        wire::Header tick;
+        if (len != static_cast<int>(wire::kHeaderSize + wire::kTimeFieldsSize) ||
+            !wire::decodeHeader(buf, len, tick) || tick.code != ReqCode::Subscribe || !(tick.flags & wire::kFlagTick)) {
+            continue; // Not a tick (e.g. a late reply)
+        }
+        wire::TimeFields t = wire::decodeTime(buf + wire::kHeaderSize);
+        std::printf("Tick %u: %02u:%02u:%02u.%06u", tick.seq, t.hour, t.minute, t.second, t.micros);
+        if (lastSeq != 0 && tick.seq != lastSeq + 1) std::printf(" (%u missed)", tick.seq - lastSeq - 1);
+        std::printf("\n");
+        lastSeq = tick.seq;
+        ++received;
+
+        if (clock::now() >= renewAt) {
+            if (!queryBinary(ReqCode::Subscribe, std::string(), header, body)) break;
+            renewAt = clock::now() + std::chrono::milliseconds(ttlSec * 500);
+        }
+    }
+
+    if (tickSocket != connSocket_) closesocket(tickSocket);
+    queryBinary(ReqCode::Unsubscribe, std::string(), header, body);
+    return received == kTicks;
 }
 
 /**
@@ -326,45 +617,54 @@ bool TimeClient::GetTimeSinceEpoch() {
 }
 
 /**
- * @brief Estimates client-to-server delay by collecting 100 samples.
+ * @brief Estimates client-to-server delay from 100 pipelined four-timestamp probes.
+ *        Each forward delay t2 - t1 is corrected by the clock offset of the least queued probe.
  * @return true if successful, false otherwise.
  */
 bool TimeClient::GetClientToServerDelayEstimation() {
-    std::vector<uint32_t> samples;
-    samples.reserve(100);
-    double avg = 0.0;
-
-    // Send 100 requests
-    for (int i = 0; i < 100; ++i) {
-        if (!sendRequest(ReqCode::GetClientToServerDelayEstimation)) return false;
+    ProbeOptions options;
+    options.code = ReqCode::GetPreciseTime;
+    ProbeReport report;
+    if (!ProbeEngine(connSocket_, serverAddr_).run(options, report)) return false;
+    if (debug_) ProbeEngine::printCounters(report);
+
+    bool any = false;
+    PreciseSample best{ 0.0, 0.0 };
+    for (const Probe& probe : report.probes) {
+        if (!probe.received) continue;
+        PreciseSample sample = computePreciseSample(probe.t1, probe.t2, probe.t3, probe.t4);
+        if (!any || sample.rttUs < best.rttUs) best = sample;
+        any = true;
+    }
+    if (!any) {
+        std::cout << "No replies received.\n";
+        return true;
     }
-    // Receive 100 responses
-    for (int i = 0; i < 100; ++i) {
-        uint32_t sample;
-        if (!receiveResponse(sample)) return false;
-        samples.push_back(sample);
+    double sum = 0.0;
+    for (const Probe& probe : report.probes) {
+        if (probe.received) sum += (static_cast<double>(probe.t2) - static_cast<double>(probe.t1)) / 1000.0 - best.offsetUs;
     }
-    avg = calcAvgDifference(samples);
+    double avg = sum / report.received / 1000.0;
     std::cout << "Average client-to-server delay: " << avg << " ms\n";
     return true;
 }
 
 /**
- * @brief Measures round-trip time (RTT) by sending 100 requests and timing each.
+ * @brief Measures round-trip time (RTT) with 100 pipelined, sequence-numbered probes.
  * @return true if successful, false otherwise.
  */
 bool TimeClient::MeasureRTT() {
+    ProbeOptions options;
+    options.code = ReqCode::MeasuureRTT;
+    ProbeReport report;
+    if (!ProbeEngine(connSocket_, serverAddr_).run(options, report)) return false;
+
     double sum = 0.0;
-    for (int i = 0; i < 100; ++i) {
-        std::string response;
-        DWORD t0 = GetTickCount();
-        if (!sendRequest(ReqCode::MeasuureRTT)) return false;
-        if (!receiveResponse(response)) return false;
-        DWORD t1 = GetTickCount();
-        sum += static_cast<double>(t1 - t0);
-    }
-    double avg = sum / 100.0;
-    std::cout << "Average round-trip time (RTT): " << avg << " ms\n";
+    for (const Probe& probe : report.probes) {
+        if (probe.received) sum += (probe.t4 - probe.t1) / 1e6;
+    }
+    if (report.received) std::cout << "Average round-trip time (RTT): " << sum / report.received << " ms\n";
+    ProbeEngine::printCounters(report);
     return true;
 }
 
@@ -505,4 +805,48 @@ bool TimeClient::MeasureTimeLap() {
         std::cout << "Time elapsed since the timer was started: " << response << std::endl;
     }
     return true;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Runs 100 pipelined four-timestamp probes and reports RTT, jitter and clock offset.
+ *        The offset is taken from the exchange with the lowest RTT, the least queued one.
+ * @return true if successful, false otherwise.
+ */
+bool TimeClient::MeasurePreciseTime() {
+    ProbeOptions options;
+    options.code = ReqCode::GetPreciseTime;
+    ProbeReport report;
+    if (!ProbeEngine(connSocket_, serverAddr_).run(options, report)) return false;
+    ProbeEngine::printCounters(report);
+
+    std::vector<PreciseSample> samples;
+    samples.reserve(report.received);
+    for (const Probe& probe : report.probes) {
+        if (probe.received) samples.push_back(computePreciseSample(probe.t1, probe.t2, probe.t3, probe.t4));
+    }
+    if (samples.empty()) return true;
+
+    double sum = 0.0, jitter = 0.0;
+    const PreciseSample* best = &samples[0];
+    double minRtt = samples[0].rttUs, maxRtt = samples[0].rttUs;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        sum += samples[i].rttUs;
+        minRtt = std::min(minRtt, samples[i].rttUs);
+        maxRtt = std::max(maxRtt, samples[i].rttUs);
+        if (samples[i].rttUs < best->rttUs) best = &samples[i];
+        // RFC 3550 interarrival jitter estimator
+        if (i > 0) jitter += (std::fabs(samples[i].rttUs - samples[i - 1].rttUs) - jitter) / 16.0;
+    }
+    std::printf("RTT (us): min %.1f | avg %.1f | max %.1f | jitter %.1f\n",
+                minRtt, sum / samples.size(), maxRtt, jitter);
+    std::printf("Clock offset (server - client): %.1f us, one-way delay ~ %.1f us\n",
+                best->offsetUs, best->rttUs / 2.0);
+    // t3 - t2 is already taken out of every RTT above; with server receive stamps it includes
+    // the time the probe queued inside the server
+    double residence = 0.0;
+    for (const Probe& probe : report.probes) {
+        if (probe.received) residence += static_cast<double>(static_cast<int64_t>(probe.t3 - probe.t2)) / 1000.0;
+    }
+    std::printf("Server residence (t3 - t2): avg %.1f us\n", residence / report.received);
+    return true;
+}
@@ -5,6 +5,7 @@
  * The TimeClient class provides an interface for sending time-related requests
  * to a UDP time server and receiving responses. It supports various request types
  * and manages socket initialization, cleanup, and user interaction.
+ * Programs that call the server from code use AsyncTimeClient (asyncclient.h) instead.
  *
  * C++14 is used for compatibility.
  */
@@ -51,6 +52,32 @@ public:
         std::vector<std::string> args; // Arguments for the request
     };
 
+    /**
+     * @struct BatchReply
+     * @brief One answer of a Batch reply.
+     */
+    struct BatchReply {
+        ReqCode code = ReqCode::Error;          // Code of the sub-request
+        wire::Status status = wire::Status::Ok; // Outcome of the sub-request
+        uint8_t flags = 0;                      // wire::Flags bits
+        std::vector<char> body;                 // Fixed-width little-endian body
+    };
+
+    /**
+     * @brief Sends several requests in one Batch datagram and returns every answer.
+     * @param requests Sub-requests (code and at most one argument, up to 255 bytes).
+     * @param replies Receives one answer per sub-request, in order.
+     * @return true if every sub-request was answered, false on error or a truncated reply.
+     */
+    bool queryBatch(const std::vector<Request>& requests, std::vector<BatchReply>& replies);
+
+    /**
+     * @brief Encodes a Request object into a vector of bytes for sending.
+     * @param request Request object.
+     * @return Encoded request as vector<char>.
+     */
+    static std::vector<char> incode(const Request& request);
+
     /**
      * @brief Sends a request message to the server.
      * @param message The message to send to the server.
@@ -76,6 +103,13 @@ public:
      */
     bool run();
 
+    /**
+     * @brief Selects binary framing with fixed-width replies instead of text replies.
+     *        RTT, delay and precise-time probes keep their own formats.
+     * @param on true to send binary requests.
+     */
+    void setBinary(bool on) { binary_ = on; }
+
 private:
     /**
      * @brief Initializes Winsock and socket.
@@ -96,11 +130,31 @@ private:
     bool dispatch(ReqCode code);
 
     /**
-     * @brief Encodes a Request object into a vector of bytes for sending.
-     * @param request Request object.
-     * @return Encoded request as vector<char>.
+     * @brief Sends a binary request and waits for the reply with the same sequence number.
+     * @param code Request code.
+     * @param payload Bytes after the header (e.g. the city name).
+     * @param header Receives the reply header.
+     * @param body Receives the reply body.
+     * @return true if a reply with status Ok arrived, false otherwise.
+     */
+    bool queryBinary(ReqCode code, const std::string& payload, wire::Header& header, std::vector<char>& body);
+
+    /**
+     * @brief Runs a date, time or lap request in binary mode and prints the decoded fields.
+     * @param code Request code.
+     * @return true if successful, false otherwise.
+     */
+    bool dispatchBinary(ReqCode code);
+
+    /**
+     * @brief Prints one binary answer the way the text handlers print theirs.
+     * @param code Request code.
+     * @param flags Reply flags.
+     * @param body Reply body.
+     * @param city City name (GetTimeWithoutDateInCity only).
+     * @return true if the body has the size of the code, false otherwise.
      */
-    std::vector<char> incode(const Request& request);
+    bool printBinary(ReqCode code, uint8_t flags, const std::vector<char>& body, const std::string& city);
 
     /**
      * @brief Checks if the response indicates an error.
@@ -136,11 +190,19 @@ private:
     bool GetTimeWithoutDateInCity();
     // 13. Measure time lap
     bool MeasureTimeLap();
+    // 14. Precise RTT, jitter and clock offset
+    bool MeasurePreciseTime();
+    // 15. Dashboard poll in one batch datagram
+    bool PollDashboard();
+    // 16. Subscribe to time ticks
+    bool WatchTicks();
 
     std::string serverIp_;      // Server IP address
     unsigned short port_;       // Server port
     SOCKET connSocket_;         // UDP socket
-    sockaddr_in serverAddr_;    // Server address structure
+    sockaddr_storage serverAddr_; // Server address (IPv4 or IPv6)
     bool initialized_;          // Winsock initialization state
     bool debug_ = false;        // Debug mode flag
+    bool binary_ = false;       // Binary framing with fixed-width replies
+    uint32_t seq_ = 0;          // Sequence number of the last binary request
 };
\ No newline at end of file
@@ -0,0 +1,241 @@
+/**
+ * @file clocksync.cpp
+ * @brief Implements the ClockSync class.
+ *
+ * Offsets are kept in integer nanoseconds relative to steady_clock; the fit works on doubles
+ * relative to the newest sample, so the large epoch part never enters the floating-point math.
+ *
+ * C++14 is used for compatibility.
+ */
+
+#include "clocksync.h"
+#include <algorithm>
+#include <cmath>
+
+static constexpr double kUnknownDriftPpm = 15.0; // Drift uncertainty before a fit exists (crystal tolerance)
+static constexpr double kMaxDriftPpm = 500.0;    // Fitted drift beyond this is noise, not a clock
+static constexpr double kStepFactor = 100.0;     // A miss this many targets wide is a clock step
+
+/**
+ * @brief Constructs a stopped clock on an open client.
+ * @param client Client to sync over (must outlive the ClockSync).
+ * @param options Sync parameters.
+ */
+ClockSync::ClockSync(AsyncTimeClient& client, const ClockSyncOptions& options)
+    : client_(client), options_(options), version_(0), baseAt_(0), baseOffset_(0), drift_(0.0), synced_(false),
+      slopeErrorPpm_(kUnknownDriftPpm), running_(false)
+{
+    options_.samples = std::max(1u, options_.samples);
+    options_.history = std::max(1u, options_.history);
+    options_.minIntervalMs = std::max(1u, options_.minIntervalMs);
+    options_.maxIntervalMs = std::max(options_.minIntervalMs, options_.maxIntervalMs);
+    stats_.intervalMs = options_.minIntervalMs;
+}
+
+/**
+ * @brief Destructor. Stops the sync thread.
+ */
+ClockSync::~ClockSync() {
+    stop();
+}
+
+/**
+ * @brief Local monotonic clock the model runs on.
+ * @return steady_clock in nanoseconds.
+ */
+int64_t ClockSync::steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Syncs once, then keeps syncing in the background.
+ * @return true if the first sync succeeded (the thread is started either way).
+ */
+bool ClockSync::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) return synced();
+        running_ = true;
+    }
+    bool ok = syncNow();
+    thread_ = std::thread(&ClockSync::loop, this);
+    return ok;
+}
+
+/**
+ * @brief Stops the sync thread; nowNs() keeps extrapolating the last model.
+ */
+void ClockSync::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+/**
+ * @brief Background thread: syncs at the adaptive interval until stop().
+ */
+void ClockSync::loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        wake_.wait_for(lock, std::chrono::milliseconds(stats_.intervalMs), [this]() { return !running_; });
+        if (!running_) break;
+        lock.unlock();
+        syncNow();
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Runs one sync round on the calling thread.
+ * @return true if at least one exchange was answered and its sample kept.
+ */
+bool ClockSync::syncNow() {
+    // Sequential exchanges, so they do not queue behind each other
+    bool any = false;
+    Sample best{ 0, 0, 0.0 };
+    for (unsigned i = 0; i < options_.samples; ++i) {
+        char payload[8];
+        int64_t t1 = steadyNs();
+        wire::putLe64(payload, static_cast<uint64_t>(t1));
+        AsyncResult result = client_.request(ReqCode::GetPreciseTime, std::string(payload, sizeof(payload))).get();
+        if (!result.ok() || result.retried() || result.body.size() != wire::kPreciseBodySize ||
+            wire::getLe64(result.body.data()) != static_cast<uint64_t>(t1)) {
+            // Lost, resent (t1..t4 may span another attempt), or the reply of an attempt we no longer wait for
+            continue;
+        }
+        int64_t t4 = std::chrono::duration_cast<std::chrono::nanoseconds>(result.receivedAt.time_since_epoch()).count();
+        int64_t t2 = static_cast<int64_t>(wire::getLe64(result.body.data() + 8));
+        int64_t t3 = static_cast<int64_t>(wire::getLe64(result.body.data() + 16));
+        Sample sample;
+        sample.at = t1 + (t4 - t1) / 2;
+        sample.offset = ((t2 - t1) + (t3 - t4)) / 2;
+        sample.rttNs = static_cast<double>((t4 - t1) - (t3 - t2));
+        if (!any || sample.rttNs < best.rttNs) best = sample;
+        any = true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!any) {
+        ++stats_.failures;
+        stats_.intervalMs = options_.minIntervalMs; // Try again soon
+        return false;
+    }
+
+    double missUs = synced() ? (best.offset - offsetAt(best.at)) / 1000.0 : 0.0;
+    if (std::fabs(missUs) > kStepFactor * options_.targetErrorUs) {
+        // The server clock was set: the old samples describe another timeline
+        history_.clear();
+        ++stats_.steps;
+        missUs = 0.0;
+    }
+    history_.push_back(best);
+    while (history_.size() > options_.history) history_.pop_front();
+    refit();
+
+    ++stats_.syncs;
+    stats_.synced = true;
+    stats_.rttUs = best.rttNs / 1000.0;
+    stats_.predictionErrorUs = missUs;
+    // Adapt only once the drift is fitted; until then the prediction is the offset alone
+    if (history_.size() >= 3) {
+        if (std::fabs(missUs) < options_.targetErrorUs / 2) {
+            stats_.intervalMs = std::min(options_.maxIntervalMs, stats_.intervalMs * 2);
+        }
+        else if (std::fabs(missUs) > options_.targetErrorUs) {
+            stats_.intervalMs = std::max(options_.minIntervalMs, stats_.intervalMs / 2);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Refits the model to the history and publishes it.
+ */
+void ClockSync::refit() {
+    const Sample& last = history_.back();
+    const double n = static_cast<double>(history_.size());
+    double meanX = 0.0, meanY = 0.0;
+    for (const Sample& s : history_) {
+        meanX += static_cast<double>(s.at - last.at);
+        meanY += static_cast<double>(s.offset - last.offset);
+    }
+    meanX /= n;
+    meanY /= n;
+    double sxx = 0.0, sxy = 0.0;
+    for (const Sample& s : history_) {
+        double dx = static_cast<double>(s.at - last.at) - meanX;
+        sxx += dx * dx;
+        sxy += dx * (static_cast<double>(s.offset - last.offset) - meanY);
+    }
+    double slope = (sxx > 0.0) ? sxy / sxx : 0.0;
+    slope = std::max(-kMaxDriftPpm * 1e-6, std::min(kMaxDriftPpm * 1e-6, slope));
+    double intercept = meanY - slope * meanX; // Fitted offset at the newest sample
+
+    double squares = 0.0;
+    for (const Sample& s : history_) {
+        double residual = static_cast<double>(s.offset - last.offset) - (intercept + slope * static_cast<double>(s.at - last.at));
+        squares += residual * residual;
+    }
+    stats_.jitterUs = std::sqrt(squares / n) / 1000.0;
+    stats_.driftPpm = slope * 1e6;
+    slopeErrorPpm_ = (history_.size() > 2 && sxx > 0.0) ? std::sqrt(squares / (n - 2) / sxx) * 1e6 : kUnknownDriftPpm;
+
+    // Sequence lock: readers retry while the version is odd or changed under them
+    uint32_t version = version_.load(std::memory_order_relaxed);
+    version_.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    baseAt_.store(last.at, std::memory_order_relaxed);
+    baseOffset_.store(last.offset + static_cast<int64_t>(std::llround(intercept)), std::memory_order_relaxed);
+    drift_.store(slope, std::memory_order_relaxed);
+    version_.store(version + 2, std::memory_order_release);
+    synced_.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Offset the current model gives for a steady_clock time.
+ * @param at steady_clock time (ns).
+ * @return Server clock minus steady_clock (ns).
+ */
+int64_t ClockSync::offsetAt(int64_t at) const {
+    uint32_t before, after;
+    int64_t baseAt, baseOffset;
+    double drift;
+    do {
+        before = version_.load(std::memory_order_acquire);
+        baseAt = baseAt_.load(std::memory_order_relaxed);
+        baseOffset = baseOffset_.load(std::memory_order_relaxed);
+        drift = drift_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = version_.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1));
+    return baseOffset + static_cast<int64_t>(std::llround(drift * static_cast<double>(at - baseAt)));
+}
+
+/**
+ * @brief Server's current time, computed locally.
+ * @return Nanoseconds since the Unix epoch (the system clock until the first sync).
+ */
+uint64_t ClockSync::nowNs() const {
+    if (!synced()) return preciseNowNs();
+    int64_t now = steadyNs();
+    return static_cast<uint64_t>(now + offsetAt(now));
+}
+
+/**
+ * @brief Snapshot of the clock's quality.
+ * @return Counters and estimates.
+ */
+ClockStats ClockSync::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ClockStats stats = stats_;
+    if (!stats.synced) return stats;
+    int64_t now = steadyNs();
+    stats.offsetUs = static_cast<double>(now + offsetAt(now) - static_cast<int64_t>(preciseNowNs())) / 1000.0;
+    // Half the round trip bounds the asymmetry; the drift's uncertainty grows with the extrapolation
+    double elapsedNs = static_cast<double>(now - baseAt_.load(std::memory_order_relaxed));
+    stats.errorBoundUs = stats.rttUs / 2 + stats.jitterUs + slopeErrorPpm_ * 1e-6 * elapsedNs / 1000.0;
+    return stats;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file clocksync.h
+ * @brief Declares ClockSync, which answers "the server's current time" locally between syncs.
+ *
+ * A background thread runs a burst of four-timestamp GetPreciseTime exchanges over an
+ * AsyncTimeClient every sync interval and keeps the one with the lowest RTT, the least queued,
+ * as a sample of the offset between the server clock and the local steady_clock. A least-squares
+ * line through the recent samples gives the offset and the drift (the rate the two clocks run
+ * apart), so nowNs() is steady_clock plus the extrapolated offset: no round trip per call.
+ *
+ * Each sync first compares the measured offset with what the model predicted for that moment;
+ * the sync interval doubles while the prediction stays well under the error target and halves
+ * when it misses, so a stable pair of clocks is polled rarely and a wandering one often. A miss
+ * far beyond the target is taken as a step of the server clock and restarts the fit.
+ *
+ * C++14 is used for compatibility.
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "asyncclient.h"
+
+/**
+ * @struct ClockSyncOptions
+ * @brief Parameters of a ClockSync.
+ */
+struct ClockSyncOptions {
+    unsigned samples = 8;          // Exchanges per sync; the lowest-RTT one is kept
+    unsigned history = 8;          // Kept samples the drift is fitted over
+    unsigned minIntervalMs = 1000; // Shortest sync interval (also the initial one)
+    unsigned maxIntervalMs = 64000;// Longest sync interval
+    double targetErrorUs = 200;    // Prediction error the interval adapts to
+};
+
+/**
+ * @struct ClockStats
+ * @brief Estimated quality of the local clock.
+ */
+struct ClockStats {
+    bool synced = false;           // true once one sync succeeded
+    unsigned syncs = 0;            // Successful syncs
+    unsigned failures = 0;         // Syncs without any reply
+    unsigned steps = 0;            // Offset jumps (server clock set) that restarted the fit
+    double offsetUs = 0;           // Server clock minus system clock, now
+    double driftPpm = 0;           // Rate of the server clock relative to steady_clock, minus 1
+    double rttUs = 0;              // RTT of the last kept sample
+    double jitterUs = 0;           // RMS residual of the samples around the fitted line
+    double predictionErrorUs = 0;  // Last sync: measured offset minus the predicted one
+    double errorBoundUs = 0;       // Estimated error of nowNs() at this moment
+    unsigned intervalMs = 0;       // Current sync interval
+};
+
+/**
+ * @class ClockSync
+ * @brief Disciplines a local clock against the time server.
+ */
+class ClockSync {
+public:
+    /**
+     * @brief Constructs a stopped clock on an open client.
+     * @param client Client to sync over (must outlive the ClockSync).
+     * @param options Sync parameters.
+     */
+    ClockSync(AsyncTimeClient& client, const ClockSyncOptions& options = ClockSyncOptions());
+
+    /**
+     * @brief Destructor. Stops the sync thread.
+     */
+    ~ClockSync();
+
+    ClockSync(const ClockSync&) = delete;
+    ClockSync& operator=(const ClockSync&) = delete;
+
+    /**
+     * @brief Syncs once, then keeps syncing in the background.
+     * @return true if the first sync succeeded (the thread is started either way).
+     */
+    bool start();
+
+    /**
+     * @brief Stops the sync thread; nowNs() keeps extrapolating the last model.
+     */
+    void stop();
+
+    /**
+     * @brief Runs one sync round on the calling thread.
+     * @return true if at least one exchange was answered and its sample kept.
+     */
+    bool syncNow();
+
+    /**
+     * @brief Whether a sync has succeeded, i.e. nowNs() is the server's time.
+     * @return true once synced.
+     */
+    bool synced() const { return synced_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Server's current time, computed locally.
+     * @return Nanoseconds since the Unix epoch (the system clock until the first sync).
+     */
+    uint64_t nowNs() const;
+
+    /**
+     * @brief Snapshot of the clock's quality.
+     * @return Counters and estimates.
+     */
+    ClockStats stats() const;
+
+    /**
+     * @brief Local monotonic clock the model runs on.
+     * @return steady_clock in nanoseconds.
+     */
+    static int64_t steadyNs();
+
+private:
+    /**
+     * @struct Sample
+     * @brief One kept exchange.
+     */
+    struct Sample {
+        int64_t at;     // steady_clock midpoint of the exchange (ns)
+        int64_t offset; // Server clock minus steady_clock (ns)
+        double rttNs;   // Round trip without server processing
+    };
+
+    /**
+     * @brief Background thread: syncs at the adaptive interval until stop().
+     */
+    void loop();
+
+    /**
+     * @brief Offset the current model gives for a steady_clock time.
+     * @param at steady_clock time (ns).
+     * @return Server clock minus steady_clock (ns).
+     */
+    int64_t offsetAt(int64_t at) const;
+
+    /**
+     * @brief Refits the model to the history and publishes it.
+     */
+    void refit();
+
+    AsyncTimeClient& client_;      // Transport
+    ClockSyncOptions options_;     // Sync parameters
+
+    // Model, published with a sequence lock so nowNs() never blocks
+    std::atomic<uint32_t> version_;        // Odd while the model is being written
+    std::atomic<int64_t> baseAt_;          // steady_clock time of the fit's reference point
+    std::atomic<int64_t> baseOffset_;      // Offset at baseAt_ (ns)
+    std::atomic<double> drift_;            // Offset change per steady_clock ns
+    std::atomic<bool> synced_;             // true once a model is published
+
+    mutable std::mutex mutex_;     // Guards the members below
+    std::deque<Sample> history_;   // Kept samples, oldest first
+    ClockStats stats_;             // Counters and the last fit's quality
+    double slopeErrorPpm_;         // Standard error of the drift (grows the error bound)
+    std::condition_variable wake_; // Wakes the thread on stop()
+    bool running_;                 // Cleared by stop()
+    std::thread thread_;           // Sync thread
+};
@@ -0,0 +1,264 @@
+/**
+ * @file loadgen.cpp
+ * @brief Implements the LoadGenerator class.
+ *
+ * Each thread owns non-blocking sockets and alternates between sending the requests that are
+ * due (as one burst, Winsock has no sendmmsg) and draining all replies that have arrived.
+ * Winsock timers are coarse, so pacing is done against std::chrono::steady_clock (QPC).
+ *
+ * C++14 is used for compatibility.
+ */
+
+#include "loadgen.h"
+#include "client.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief A socket and the send times of its outstanding requests, oldest first.
+ */
+struct Flow {
+    SOCKET sock = INVALID_SOCKET;      // Non-blocking UDP socket
+    std::deque<Clock::time_point> inflight; // Send times of requests without reply
+};
+
+/**
+ * @brief Constructs a generator for the given options and initializes Winsock.
+ * @param options Load parameters.
+ */
+LoadGenerator::LoadGenerator(const LoadOptions& options)
+    : options_(options), resolved_(false), initialized_(false)
+{
+    memset(&serverAddr_, 0, sizeof(serverAddr_));
+    WSAData wsaData;
+    if (NO_ERROR != WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+        printError("WSAStartup");
+        return;
+    }
+    initialized_ = true;
+    resolved_ = resolveAddress(options_.serverIp, options_.port, AF_UNSPEC, serverAddr_);
+
+    if (options_.mix.empty()) options_.mix.push_back(LoadMix{ ReqCode::GetTime, 1 });
+    unsigned total = 0;
+    for (const LoadMix& entry : options_.mix) {
+        std::vector<std::string> args;
+        if (entry.code == ReqCode::GetTimeWithoutDateInCity) args.push_back(options_.city);
+        packets_.push_back(TimeClient::incode(TimeClient::Request(entry.code, args)));
+        total += entry.weight;
+        cumulative_.push_back(total);
+    }
+    options_.threads = std::max(1u, options_.threads);
+    options_.socketsPerThread = std::min(64u, std::max(1u, options_.socketsPerThread)); // FD_SETSIZE
+    options_.window = std::max(1u, options_.window);
+    options_.burst = std::max(1u, options_.burst);
+}
+
+/**
+ * @brief Destructor. Cleans up Winsock.
+ */
+LoadGenerator::~LoadGenerator() {
+    if (initialized_) WSACleanup();
+}
+
+/**
+ * @brief Picks a request according to the mix.
+ * @param rng Per-thread random state, advanced in place.
+ * @return Index into packets_.
+ */
+size_t LoadGenerator::pickPacket(uint32_t& rng) const {
+    rng = rng * 1664525u + 1013904223u;
+    unsigned ticket = (rng >> 8) % cumulative_.back();
+    return std::upper_bound(cumulative_.begin(), cumulative_.end(), ticket) - cumulative_.begin();
+}
+
+/**
+ * @brief Body of one load thread.
+ * @param index Thread index.
+ * @param result Counters and samples of this thread.
+ */
+void LoadGenerator::threadLoop(unsigned index, ThreadResult& result) {
+    std::vector<Flow> flows(options_.socketsPerThread);
+    for (Flow& flow : flows) {
+        flow.sock = socket(serverAddr_.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+        u_long nonBlocking = 1;
+        if (INVALID_SOCKET == flow.sock || SOCKET_ERROR == ioctlsocket(flow.sock, FIONBIO, &nonBlocking)) {
+            printError("socket");
+            result.ok = false;
+        }
+    }
+
+    const bool openLoop = options_.rate > 0;
+    const double perThreadRate = static_cast<double>(options_.rate) / options_.threads;
+    const auto timeout = std::chrono::milliseconds(options_.timeoutMs);
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point stopSending = start + std::chrono::seconds(options_.durationSec);
+    uint32_t rng = 0x9E3779B9u * (index + 1);
+    size_t nextFlow = 0;
+    char recvBuf[BUFFER_SIZE];
+    result.latencyNs.reserve(openLoop ? static_cast<size_t>(perThreadRate * options_.durationSec) + 1 : 1 << 20);
+
+    while (result.ok) {
+        Clock::time_point now = Clock::now();
+        bool sending = now < stopSending;
+
+        // Send what is due, at most one burst before looking at replies
+        unsigned burst = 0;
+        if (sending) {
+            if (openLoop) {
+                double elapsed = std::chrono::duration<double>(now - start).count();
+                uint64_t due = static_cast<uint64_t>(elapsed * perThreadRate) + 1;
+                while (result.sent < due && burst < options_.burst) {
+                    Flow& flow = flows[nextFlow];
+                    nextFlow = (nextFlow + 1) % flows.size();
+                    const std::vector<char>& packet = packets_[pickPacket(rng)];
+                    sendto(flow.sock, packet.data(), static_cast<int>(packet.size()), 0,
+                           (const sockaddr*)&serverAddr_, addressLength(serverAddr_));
+                    flow.inflight.push_back(Clock::now());
+                    ++result.sent;
+                    ++burst;
+                }
+            }
+            else {
+                for (Flow& flow : flows) {
+                    while (flow.inflight.size() < options_.window && burst < options_.burst) {
+                        const std::vector<char>& packet = packets_[pickPacket(rng)];
+                        sendto(flow.sock, packet.data(), static_cast<int>(packet.size()), 0,
+                               (const sockaddr*)&serverAddr_, addressLength(serverAddr_));
+                        flow.inflight.push_back(Clock::now());
+                        ++result.sent;
+                        ++burst;
+                    }
+                }
+            }
+        }
+
+        // Wait briefly for replies, then drain every readable socket
+        fd_set readable;
+        FD_ZERO(&readable);
+        for (Flow& flow : flows) FD_SET(flow.sock, &readable);
+        timeval wait{ 0, (burst == options_.burst) ? 0 : 1000 };
+        if (select(0, &readable, nullptr, nullptr, &wait) > 0) {
+            for (Flow& flow : flows) {
+                if (!FD_ISSET(flow.sock, &readable)) continue;
+                // A 0-byte datagram (a Number reply whose value is 0) is a reply too; only
+                // SOCKET_ERROR (WSAEWOULDBLOCK once drained) ends the loop
+                while (recv(flow.sock, recvBuf, sizeof(recvBuf), 0) >= 0) {
+                    Clock::time_point arrived = Clock::now();
+                    if (flow.inflight.empty()) {
+                        ++result.late;
+                        continue;
+                    }
+                    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(arrived - flow.inflight.front()).count();
+                    flow.inflight.pop_front();
+                    result.latencyNs.push_back(static_cast<uint32_t>(std::min<long long>(ns, UINT32_MAX)));
+                    ++result.received;
+                }
+            }
+        }
+
+        // Requests older than the timeout are lost
+        now = Clock::now();
+        bool idle = true;
+        for (Flow& flow : flows) {
+            while (!flow.inflight.empty() && now - flow.inflight.front() > timeout) {
+                flow.inflight.pop_front();
+                ++result.lost;
+            }
+            if (!flow.inflight.empty()) idle = false;
+        }
+        if (!sending && idle) break;
+    }
+
+    for (Flow& flow : flows) {
+        if (flow.sock != INVALID_SOCKET) closesocket(flow.sock);
+    }
+}
+
+/**
+ * @brief Runs the load and collects the results.
+ * @param report Receives throughput, loss and latency figures.
+ * @return true on success, false if the sockets could not be set up.
+ */
+bool LoadGenerator::run(LoadReport& report) {
+    if (!initialized_ || !resolved_) {
+        std::cout << "LoadGenerator: Not initialized properly.\n";
+        return false;
+    }
+    std::vector<ThreadResult> results(options_.threads);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < options_.threads; ++i) {
+        threads.emplace_back([this, i, &results]() { threadLoop(i, results[i]); });
+    }
+    for (auto& th : threads) th.join();
+
+    report = LoadReport();
+    report.seconds = options_.durationSec;
+    std::vector<uint32_t> latency;
+    bool ok = true;
+    for (ThreadResult& r : results) {
+        ok = ok && r.ok;
+        report.sent += r.sent;
+        report.received += r.received;
+        report.lost += r.lost;
+        report.late += r.late;
+        latency.insert(latency.end(), r.latencyNs.begin(), r.latencyNs.end());
+    }
+    if (!latency.empty()) {
+        std::sort(latency.begin(), latency.end());
+        auto at = [&latency](double q) {
+            size_t idx = static_cast<size_t>(q * (latency.size() - 1));
+            return latency[idx] / 1000.0;
+        };
+        report.p50Us = at(0.50);
+        report.p99Us = at(0.99);
+        report.p999Us = at(0.999);
+        report.maxUs = latency.back() / 1000.0;
+    }
+    return ok;
+}
+
+/**
+ * @brief Prints a report to the console.
+ * @param report Results of run().
+ */
+void LoadGenerator::print(const LoadReport& report) {
+    double loss = report.sent ? 100.0 * report.lost / report.sent : 0.0;
+    std::printf("Sent %llu, received %llu, lost %llu (%.3f%%), late %llu\n",
+                static_cast<unsigned long long>(report.sent), static_cast<unsigned long long>(report.received),
+                static_cast<unsigned long long>(report.lost), loss, static_cast<unsigned long long>(report.late));
+    std::printf("Throughput: %.0f req/s sent, %.0f replies/s\n",
+                report.sent / report.seconds, report.received / report.seconds);
+    std::printf("Latency (us): p50 %.1f | p99 %.1f | p999 %.1f | max %.1f\n",
+                report.p50Us, report.p99Us, report.p999Us, report.maxUs);
+}
+
+/**
+ * @brief Parses a mix such as "1:5,3:1,12:2" (ReqCode:weight, weight defaults to 1).
+ * @param text Mix specification.
+ * @param mix Parsed mix.
+ * @return true if valid, false otherwise.
+ */
+bool LoadGenerator::parseMix(const std::string& text, std::vector<LoadMix>& mix) {
+    mix.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos) end = text.size();
+        std::string item = text.substr(pos, end - pos);
+        size_t colon = item.find(':');
+        int code = std::atoi(item.substr(0, colon).c_str());
+        int weight = (colon == std::string::npos) ? 1 : std::atoi(item.substr(colon + 1).c_str());
+        if (code < static_cast<int>(ReqCode::GetTime) || code > static_cast<int>(ReqCode::MeasureTimeLap) || weight <= 0) {
+            return false;
+        }
+        mix.push_back(LoadMix{ static_cast<ReqCode>(code), static_cast<unsigned>(weight) });
+        pos = end + 1;
+    }
+    return !mix.empty();
+}
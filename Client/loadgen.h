@@ -0,0 +1,137 @@
+/**
+ * @file loadgen.h
+ * @brief Declares the non-interactive UDP load generator for the time server.
+ *
+ * The LoadGenerator drives a weighted mix of request codes from several threads, each owning
+ * several sockets, either closed-loop (a fixed number of requests in flight per socket, as fast
+ * as the server answers) or open-loop (a fixed total packet rate). Requests are built with
+ * TimeClient::incode so they always match the wire format of the interactive client.
+ *
+ * C++14 is used for compatibility.
+ */
+#pragma once
+#include <winsock2.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "utils.h"
+
+/**
+ * @struct LoadMix
+ * @brief One entry of the request mix.
+ */
+struct LoadMix {
+    ReqCode code;    // Request code to send
+    unsigned weight; // Relative share of this code in the mix
+};
+
+/**
+ * @struct LoadOptions
+ * @brief Parameters of a load run.
+ */
+struct LoadOptions {
+    std::string serverIp = "127.0.0.1"; // Server IP address
+    unsigned short port = 27015;         // Server port
+    unsigned threads = 1;                // Sending/receiving threads
+    unsigned socketsPerThread = 4;       // Sockets owned by each thread (at most 64)
+    unsigned rate = 0;                   // Total packets per second (0 = closed loop, as fast as possible)
+    unsigned window = 1;                 // Closed loop: requests in flight per socket
+    unsigned durationSec = 10;           // Length of the sending phase
+    unsigned timeoutMs = 1000;           // A request without reply after this long is lost
+    unsigned burst = 32;                 // Most requests sent back to back before polling replies
+    std::vector<LoadMix> mix;            // Request mix (empty = GetTime only)
+    std::string city = "berlin";         // Parameter of GetTimeWithoutDateInCity requests
+};
+
+/**
+ * @struct LoadReport
+ * @brief Results of a load run.
+ */
+struct LoadReport {
+    uint64_t sent = 0;       // Requests sent
+    uint64_t received = 0;   // Replies matched to a request
+    uint64_t lost = 0;       // Requests without reply within the timeout
+    uint64_t late = 0;       // Replies arriving after their request was declared lost
+    double seconds = 0;      // Length of the sending phase
+    double p50Us = 0;        // Median latency in microseconds
+    double p99Us = 0;        // 99th percentile latency in microseconds
+    double p999Us = 0;       // 99.9th percentile latency in microseconds
+    double maxUs = 0;        // Highest latency in microseconds
+};
+
+/**
+ * @class LoadGenerator
+ * @brief Multi-threaded, multi-socket UDP load generator.
+ *
+ * Datagrams carry no sequence number, so replies are matched to the oldest outstanding request
+ * of the socket they arrive on. An occasional reorder (several server workers sharing a socket)
+ * only swaps two latency samples; a lost datagram is detected by the timeout.
+ */
+class LoadGenerator {
+public:
+    /**
+     * @brief Constructs a generator for the given options and initializes Winsock.
+     * @param options Load parameters.
+     */
+    explicit LoadGenerator(const LoadOptions& options);
+
+    /**
+     * @brief Destructor. Cleans up Winsock.
+     */
+    ~LoadGenerator();
+
+    /**
+     * @brief Runs the load and collects the results.
+     * @param report Receives throughput, loss and latency figures.
+     * @return true on success, false if the sockets could not be set up.
+     */
+    bool run(LoadReport& report);
+
+    /**
+     * @brief Prints a report to the console.
+     * @param report Results of run().
+     */
+    static void print(const LoadReport& report);
+
+    /**
+     * @brief Parses a mix such as "1:5,3:1,12:2" (ReqCode:weight, weight defaults to 1).
+     * @param text Mix specification.
+     * @param mix Parsed mix.
+     * @return true if valid, false otherwise.
+     */
+    static bool parseMix(const std::string& text, std::vector<LoadMix>& mix);
+
+private:
+    /**
+     * @brief Per-thread counters and latency samples, merged after the run.
+     */
+    struct ThreadResult {
+        uint64_t sent = 0;              // Requests sent
+        uint64_t received = 0;          // Replies matched
+        uint64_t lost = 0;              // Requests timed out
+        uint64_t late = 0;              // Unmatched replies
+        std::vector<uint32_t> latencyNs;// Latency of every matched request (saturated at ~4.2 s)
+        bool ok = true;                 // false if socket setup failed
+    };
+
+    /**
+     * @brief Body of one load thread.
+     * @param index Thread index.
+     * @param result Counters and samples of this thread.
+     */
+    void threadLoop(unsigned index, ThreadResult& result);
+
+    /**
+     * @brief Picks a request according to the mix.
+     * @param rng Per-thread random state, advanced in place.
+     * @return Index into packets_.
+     */
+    size_t pickPacket(uint32_t& rng) const;
+
+    LoadOptions options_;                   // Load parameters
+    sockaddr_storage serverAddr_;           // Server address (IPv4 or IPv6)
+    bool resolved_;                         // Whether serverAddr_ holds a resolved address
+    std::vector<std::vector<char>> packets_;// Encoded request of each mix entry
+    std::vector<unsigned> cumulative_;      // Running sum of the mix weights
+    bool initialized_;                      // Winsock initialization state
+};
@@ -7,17 +7,181 @@
  * interface to the user for sending various time-related requests (such as current time,
  * date, epoch time, delay estimation, and more). Responses from the server are displayed
  * in the console. The client uses the TimeClient class for all networking and protocol logic.
+ *
+ * Usage: TimeClient [--binary] [--server HOST] [--port N]
+ * With --binary the interactive client uses binary framing with fixed-width replies.
+ * HOST is a name or an IPv4/IPv6 literal (e.g. 127.0.0.1, ::1 or [::1]).
+ * With --load the client runs non-interactively as a load generator instead:
+ * Usage: TimeClient --load [--server IP] [--port N] [--threads T] [--sockets S] [--rate PPS]
+ *                   [--window W] [--duration SECONDS] [--timeout MS] [--burst B]
+ *                   [--mix CODE:WEIGHT,...] [--city NAME]
+ * With --sync the client disciplines a local clock against the server and prints it once a second:
+ * Usage: TimeClient --sync SECONDS [--server HOST] [--port N]
+ * With --pool the client sends GetTime requests through a pool of servers and prints its counters:
+ * Usage: TimeClient --pool HOST[:PORT],... [--count N]
  */
 
 #include "client.h"
+#include "clocksync.h"
+#include "loadgen.h"
+#include "serverpool.h"
 #include "utils.h"
+#include <algorithm>
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
 
 constexpr int TIME_PORT = 27015;
 constexpr const char* SERVER_IP = "127.0.0.1";
 
-int main() {
-    TimeClient client(SERVER_IP, TIME_PORT);
+/**
+ * @brief Parses the load generator switches.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @param options Options to fill in.
+ * @return true if all switches were recognized, false otherwise.
+ */
+static bool parseLoadArgs(int argc, char* argv[], LoadOptions& options) {
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for " << arg << "\n";
+            return false;
+        }
+        std::string value = argv[++i];
+        unsigned number = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        if (arg == "--server") options.serverIp = value;
+        else if (arg == "--port") options.port = static_cast<unsigned short>(number);
+        else if (arg == "--threads") options.threads = number;
+        else if (arg == "--sockets") options.socketsPerThread = number;
+        else if (arg == "--rate") options.rate = number;
+        else if (arg == "--window") options.window = number;
+        else if (arg == "--duration") options.durationSec = number;
+        else if (arg == "--timeout") options.timeoutMs = number;
+        else if (arg == "--burst") options.burst = number;
+        else if (arg == "--city") options.city = value;
+        else if (arg == "--mix") {
+            if (!LoadGenerator::parseMix(value, options.mix)) {
+                std::cout << "Invalid mix: " << value << "\n";
+                return false;
+            }
+        }
+        else {
+            std::cout << "Unknown option: " << arg << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Syncs a local clock to the server and prints its time and estimated error once a second.
+ * @param options Client parameters.
+ * @param seconds How long to run.
+ * @return Process exit code.
+ */
+static int runSync(const AsyncOptions& options, unsigned seconds) {
+    AsyncTimeClient client(options);
+    if (!client.open()) return 1;
+    ClockSync clock(client);
+    if (!clock.start()) std::cout << "First sync failed; retrying in the background.\n";
+    for (unsigned i = 0; i < seconds; ++i) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t now = clock.nowNs();
+        ClockStats stats = clock.stats();
+        std::printf("%02u:%02u:%02u.%06u UTC | offset %.1f us, drift %.2f ppm, error <= %.1f us, "
+                    "rtt %.1f us | %u syncs, %u failed, next in %u ms\n",
+                    static_cast<unsigned>(now / 3600000000000ull % 24), static_cast<unsigned>(now / 60000000000ull % 60),
+                    static_cast<unsigned>(now / 1000000000ull % 60), static_cast<unsigned>(now / 1000 % 1000000),
+                    stats.offsetUs, stats.driftPpm, stats.errorBoundUs, stats.rttUs, stats.syncs, stats.failures,
+                    stats.intervalMs);
+    }
+    return 0;
+}
+
+/**
+ * @brief Sends GetTime requests one after another through a server pool and prints the latency.
+ * @param options Pool parameters.
+ * @param count Requests to send.
+ * @return Process exit code.
+ */
+static int runPool(const PoolOptions& options, unsigned count) {
+    ServerPool pool(options);
+    if (!pool.open()) return 1;
+    std::vector<double> latencies;
+    latencies.reserve(count);
+    for (unsigned i = 0; i < count; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        pool.request(ReqCode::GetTime).get();
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        std::printf("Latency (us): p50 %.1f | p99 %.1f | max %.1f\n", latencies[latencies.size() / 2],
+                    latencies[latencies.size() * 99 / 100], latencies.back());
+    }
+    ServerPool::print(pool.stats());
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--load") {
+        LoadOptions options;
+        options.serverIp = SERVER_IP;
+        options.port = TIME_PORT;
+        if (!parseLoadArgs(argc, argv, options)) {
+            std::cout << "Usage: TimeClient --load [--server IP] [--port N] [--threads T] [--sockets S] [--rate PPS]\n"
+                      << "                  [--window W] [--duration SECONDS] [--timeout MS] [--burst B]\n"
+                      << "                  [--mix CODE:WEIGHT,...] [--city NAME]\n";
+            return 1;
+        }
+        LoadGenerator generator(options);
+        LoadReport report;
+        if (!generator.run(report)) return 1;
+        LoadGenerator::print(report);
+        return 0;
+    }
+    std::string server = SERVER_IP;
+    unsigned short port = TIME_PORT;
+    bool binary = false;
+    unsigned syncSeconds = 0;
+    PoolOptions pool;
+    unsigned poolCount = 1000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--binary") binary = true;
+        else if (arg == "--sync" && i + 1 < argc) syncSeconds = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--pool" && i + 1 < argc) {
+            std::string list = argv[++i];
+            for (size_t pos = 0; pos <= list.size();) {
+                size_t comma = std::min(list.find(',', pos), list.size());
+                if (comma > pos) pool.servers.push_back(list.substr(pos, comma - pos));
+                pos = comma + 1;
+            }
+        }
+        else if (arg == "--count" && i + 1 < argc) poolCount = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--server" && i + 1 < argc) server = argv[++i];
+        else if (arg == "--port" && i + 1 < argc) port = static_cast<unsigned short>(std::atoi(argv[++i]));
+        else {
+            std::cout << "Usage: TimeClient [--binary] [--server HOST] [--port N]\n"
+                      << "       TimeClient --sync SECONDS [--server HOST] [--port N]\n"
+                      << "       TimeClient --pool HOST[:PORT],... [--count N]\n"
+                      << "       TimeClient --load [options]\n";
+            return 1;
+        }
+    }
+    if (!pool.servers.empty()) {
+        pool.defaultPort = port;
+        return runPool(pool, poolCount);
+    }
+    if (syncSeconds > 0) {
+        AsyncOptions options;
+        options.server = server;
+        options.port = port;
+        return runSync(options, syncSeconds);
+    }
+    TimeClient client(server, port);
+    client.setBinary(binary);
     client.run();
     return 0;
 }
@@ -0,0 +1,158 @@
+/**
+ * @file probe.cpp
+ * @brief Implements the ProbeEngine class.
+ *
+ * Probes share one timeout and are sent in sequence order, so their deadlines are ordered too:
+ * the engine only ever waits for the oldest outstanding probe.
+ *
+ * C++14 is used for compatibility.
+ */
+
+#include "probe.h"
+#include <algorithm>
+#include <cstdio>
+
+/**
+ * @brief Constructs an engine on an existing UDP socket.
+ * @param sock Socket to send from (blocking or not; reads are gated by select()).
+ * @param server Server address.
+ */
+ProbeEngine::ProbeEngine(SOCKET sock, const sockaddr_storage& server)
+    : sock_(sock), server_(server)
+{
+}
+
+/**
+ * @brief Sends the probe with the given sequence number.
+ * @param options Probe parameters.
+ * @param seq Sequence number (1-based).
+ * @param probe Probe record (t1 is set).
+ * @return true on success, false on socket error.
+ */
+bool ProbeEngine::send(const ProbeOptions& options, uint32_t seq, Probe& probe) {
+    char message[PRECISE_REQUEST_SIZE];
+    size_t len = 5;
+    message[0] = static_cast<char>(options.code);
+    wire::putBe32(&message[1], seq);
+    probe.t1 = preciseNowNs();
+    if (options.code == ReqCode::GetPreciseTime) {
+        wire::putBe64(&message[5], probe.t1);
+        len = PRECISE_REQUEST_SIZE;
+    }
+    if (SOCKET_ERROR == sendto(sock_, message, static_cast<int>(len), 0, (const sockaddr*)&server_, addressLength(server_))) {
+        printError("sendto");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Matches one reply to its probe and updates the counters.
+ * @param options Probe parameters.
+ * @param data Reply bytes.
+ * @param len Reply length.
+ * @param t4 Receive time.
+ * @param highest Highest sequence answered so far, updated in place.
+ * @param report Report to update.
+ */
+void ProbeEngine::accept(const ProbeOptions& options, const char* data, int len, uint64_t t4, uint32_t& highest, ProbeReport& report) {
+    uint32_t seq;
+    if (options.code == ReqCode::GetPreciseTime) {
+        if (len != static_cast<int>(PRECISE_REPLY_SIZE) || data[0] != static_cast<char>(ReqCode::GetPreciseTime)) return;
+        seq = wire::getBe32(data + 4);
+    }
+    else {
+        if (len != 4) return; // Echoed sequence number
+        seq = wire::getBe32(data);
+    }
+    if (seq == 0 || seq > report.sent) return; // Not one of ours
+
+    Probe& probe = report.probes[seq - 1];
+    if (probe.received) { ++report.duplicates; return; }
+    if (probe.lost) { ++report.late; return; }
+    probe.received = true;
+    probe.t4 = t4;
+    if (options.code == ReqCode::GetPreciseTime) {
+        probe.t2 = wire::getBe64(data + 16);
+        probe.t3 = wire::getBe64(data + 24);
+    }
+    ++report.received;
+    if (seq < highest) ++report.reordered;
+    highest = std::max(highest, seq);
+}
+
+/**
+ * @brief Runs the probes; returns after the last probe is answered or timed out.
+ * @param options Probe parameters.
+ * @param report Receives counters and per-probe timestamps.
+ * @return true on success, false on socket error.
+ */
+bool ProbeEngine::run(const ProbeOptions& options, ProbeReport& report) {
+    report = ProbeReport();
+    report.probes.resize(options.count);
+    const uint64_t timeoutNs = static_cast<uint64_t>(options.timeoutMs) * 1000000ull;
+    const unsigned window = std::max(1u, options.window);
+    const uint64_t start = preciseNowNs();
+    uint32_t oldest = 1;   // Oldest probe neither answered nor lost
+    uint32_t highest = 0;  // Highest sequence answered
+    unsigned inflight = 0;
+    char buf[BUFFER_SIZE];
+
+    while (oldest <= options.count) {
+        // Keep the window full
+        while (report.sent < options.count && inflight < window) {
+            uint32_t seq = report.sent + 1;
+            if (!send(options, seq, report.probes[seq - 1])) return false;
+            ++report.sent;
+            ++inflight;
+        }
+
+        // Wait until a reply arrives or the oldest probe's deadline passes
+        uint64_t now = preciseNowNs();
+        uint64_t deadline = report.probes[oldest - 1].t1 + timeoutNs;
+        uint64_t waitUs = (deadline > now) ? (deadline - now) / 1000 : 0;
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock_, &readable);
+        timeval wait{ static_cast<long>(waitUs / 1000000), static_cast<long>(waitUs % 1000000) };
+        int ready = select(0, &readable, nullptr, nullptr, &wait);
+        if (SOCKET_ERROR == ready) {
+            printError("select");
+            return false;
+        }
+        if (ready > 0) {
+            int len = recv(sock_, buf, sizeof(buf), 0);
+            uint64_t t4 = preciseNowNs();
+            if (len > 0) {
+                unsigned before = report.received;
+                accept(options, buf, len, t4, highest, report);
+                inflight -= report.received - before;
+            }
+        }
+
+        // Retire answered probes and those past their deadline
+        now = preciseNowNs();
+        while (oldest <= report.sent) {
+            Probe& probe = report.probes[oldest - 1];
+            if (!probe.received) {
+                if (now < probe.t1 + timeoutNs) break;
+                probe.lost = true;
+                ++report.lost;
+                --inflight;
+            }
+            ++oldest;
+        }
+    }
+    report.elapsedMs = (preciseNowNs() - start) / 1e6;
+    return true;
+}
+
+/**
+ * @brief Prints the loss and ordering counters of a run.
+ * @param report Results of run().
+ */
+void ProbeEngine::printCounters(const ProbeReport& report) {
+    std::printf("Probes: %u sent, %u received, %u lost, %u reordered, %u duplicate, %u late (%.1f ms)\n",
+                report.sent, report.received, report.lost, report.reordered, report.duplicates, report.late,
+                report.elapsedMs);
+}
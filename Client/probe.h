@@ -0,0 +1,106 @@
+/**
+ * @file probe.h
+ * @brief Declares the pipelined, windowed probe engine used for RTT and delay measurements.
+ *
+ * Probes carry a sequence number that the server echoes. Up to a window of probes is in flight
+ * at once; replies are matched by sequence, so loss, reordering and duplicates are counted
+ * instead of desynchronizing the measurement, and every probe has a receive deadline.
+ *
+ * C++14 is used for compatibility.
+ */
+#pragma once
+#include <winsock2.h>
+#include <vector>
+#include <cstdint>
+#include "utils.h"
+
+/**
+ * @struct ProbeOptions
+ * @brief Parameters of a probe run.
+ */
+struct ProbeOptions {
+    ReqCode code = ReqCode::GetPreciseTime; // MeasuureRTT (echoed sequence) or GetPreciseTime (four timestamps)
+    unsigned count = 100;                   // Probes to send
+    unsigned window = 16;                   // Probes in flight at once
+    unsigned timeoutMs = 500;               // A probe without reply after this long is lost
+};
+
+/**
+ * @struct Probe
+ * @brief Timestamps of one probe (ns since the Unix epoch; t2/t3 only for GetPreciseTime).
+ */
+struct Probe {
+    uint64_t t1 = 0;       // Client transmit time
+    uint64_t t2 = 0;       // Server receive time
+    uint64_t t3 = 0;       // Server transmit time
+    uint64_t t4 = 0;       // Client receive time
+    bool received = false; // true once the reply arrived in time
+    bool lost = false;     // true once the deadline passed without reply
+};
+
+/**
+ * @struct ProbeReport
+ * @brief Results of a probe run.
+ */
+struct ProbeReport {
+    unsigned sent = 0;        // Probes sent
+    unsigned received = 0;    // Probes answered in time
+    unsigned lost = 0;        // Probes without reply within the timeout
+    unsigned reordered = 0;   // Replies arriving after a reply of a later probe
+    unsigned duplicates = 0;  // Extra replies for an already answered probe
+    unsigned late = 0;        // Replies arriving after their probe was declared lost
+    double elapsedMs = 0;     // Duration of the whole run
+    std::vector<Probe> probes;// Probe i has sequence number i + 1
+};
+
+/**
+ * @class ProbeEngine
+ * @brief Sends sequence-numbered probes over a socket with a bounded in-flight window.
+ */
+class ProbeEngine {
+public:
+    /**
+     * @brief Constructs an engine on an existing UDP socket.
+     * @param sock Socket to send from (blocking or not; reads are gated by select()).
+     * @param server Server address (IPv4 or IPv6).
+     */
+    ProbeEngine(SOCKET sock, const sockaddr_storage& server);
+
+    /**
+     * @brief Runs the probes; returns after the last probe is answered or timed out.
+     * @param options Probe parameters.
+     * @param report Receives counters and per-probe timestamps.
+     * @return true on success, false on socket error.
+     */
+    bool run(const ProbeOptions& options, ProbeReport& report);
+
+    /**
+     * @brief Prints the loss and ordering counters of a run.
+     * @param report Results of run().
+     */
+    static void printCounters(const ProbeReport& report);
+
+private:
+    /**
+     * @brief Sends the probe with the given sequence number.
+     * @param options Probe parameters.
+     * @param seq Sequence number (1-based).
+     * @param probe Probe record (t1 is set).
+     * @return true on success, false on socket error.
+     */
+    bool send(const ProbeOptions& options, uint32_t seq, Probe& probe);
+
+    /**
+     * @brief Matches one reply to its probe and updates the counters.
+     * @param options Probe parameters.
+     * @param data Reply bytes.
+     * @param len Reply length.
+     * @param t4 Receive time.
+     * @param highest Highest sequence answered so far, updated in place.
+     * @param report Report to update.
+     */
+    void accept(const ProbeOptions& options, const char* data, int len, uint64_t t4, uint32_t& highest, ProbeReport& report);
+
+    SOCKET sock_;         // Socket used for probing
+    sockaddr_storage server_; // Server address structure
+};
@@ -0,0 +1,417 @@
+/**
+ * @file serverpool.cpp
+ * @brief Implements the ServerPool class.
+ *
+ * Lock order: a Call's mutex before the pool's mutex_. Sends and callbacks run with no lock
+ * held, since a member client may complete a request on the calling thread.
+ *
+ * C++14 is used for compatibility.
+ */
+
+#include "serverpool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * @brief Splits "host", "host:port" or "[v6]:port"; a bare IPv6 literal has no port.
+ * @param spec Server as given.
+ * @param defaultPort Port if the spec has none.
+ * @param host Receives the host (brackets kept; resolveAddress strips them).
+ * @param port Receives the port.
+ */
+static void splitServer(const std::string& spec, unsigned short defaultPort, std::string& host, unsigned short& port) {
+    host = spec;
+    port = defaultPort;
+    size_t colon = spec.rfind(':');
+    if (colon == std::string::npos) return;
+    if (!spec.empty() && spec[0] == '[') {
+        size_t close = spec.find(']');
+        if (close != std::string::npos && colon == close + 1) {
+            host = spec.substr(0, close + 1);
+            port = static_cast<unsigned short>(std::atoi(spec.c_str() + colon + 1));
+        }
+        return;
+    }
+    if (spec.find(':') != colon) return; // Several colons: an IPv6 literal without port
+    host = spec.substr(0, colon);
+    port = static_cast<unsigned short>(std::atoi(spec.c_str() + colon + 1));
+}
+
+/**
+ * @brief Constructs a closed pool; call open() before sending.
+ * @param options Pool parameters.
+ */
+ServerPool::ServerPool(const PoolOptions& options) : options_(options), running_(false) {
+    options_.maxServers = std::max(1u, options_.maxServers);
+    options_.rttWindow = std::max(1u, options_.rttWindow);
+    options_.failThreshold = std::max(1u, options_.failThreshold);
+    options_.probeIntervalMs = std::max(1u, options_.probeIntervalMs);
+}
+
+/**
+ * @brief Destructor. Closes the pool.
+ */
+ServerPool::~ServerPool() {
+    close();
+}
+
+/**
+ * @brief Opens a client per server, probes them all once and starts the timer thread.
+ * @return true if at least one server could be opened, false otherwise.
+ */
+bool ServerPool::open() {
+    if (running_) return true;
+    members_.clear();
+    members_.resize(options_.servers.size());
+    bool any = false;
+    for (size_t i = 0; i < members_.size(); ++i) {
+        Member& member = members_[i];
+        member.address = options_.servers[i];
+        member.counters.address = member.address;
+        AsyncOptions client;
+        splitServer(member.address, options_.defaultPort, client.server, client.port);
+        client.timeoutMs = options_.timeoutMs;
+        client.retries = 0; // The pool fails over to another server instead
+        member.client.reset(new AsyncTimeClient(client));
+        if (!member.client->open()) {
+            std::cout << "Server " << member.address << " unavailable.\n";
+            member.client.reset();
+            member.healthy = false;
+            continue;
+        }
+        any = true;
+    }
+    if (!any) return false;
+    {
+        std::lock_guard<std::mutex> lock(timerMutex_);
+        running_ = true;
+    }
+    probeAll();
+    thread_ = std::thread(&ServerPool::loop, this);
+    return true;
+}
+
+/**
+ * @brief Stops the timer thread and closes every client; pending requests complete with Closed.
+ */
+void ServerPool::close() {
+    {
+        std::lock_guard<std::mutex> lock(timerMutex_);
+        running_ = false;
+        while (!hedges_.empty()) hedges_.pop();
+    }
+    timerWake_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    for (Member& member : members_) {
+        if (member.client) member.client->close();
+    }
+}
+
+/**
+ * @brief Picks the fastest usable server not yet tried by a call.
+ * @param tried Servers already used.
+ * @param anyIfNoneHealthy Fall back to dead servers if no healthy one is left.
+ * @return Member index, or members_.size() if none.
+ */
+size_t ServerPool::pick(const std::vector<size_t>& tried, bool anyIfNoneHealthy) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t best = members_.size();
+    double bestRtt = 0;
+    size_t fallback = members_.size();
+    for (size_t i = 0; i < members_.size(); ++i) {
+        const Member& member = members_[i];
+        if (!member.client || std::find(tried.begin(), tried.end(), i) != tried.end()) continue;
+        if (fallback == members_.size()) fallback = i;
+        if (!member.healthy) continue;
+        double rtt = (member.srttUs > 0) ? member.srttUs : 1e12; // Unmeasured: after every measured one
+        if (best == members_.size() || rtt < bestRtt) {
+            best = i;
+            bestRtt = rtt;
+        }
+    }
+    return (best == members_.size() && anyIfNoneHealthy) ? fallback : best;
+}
+
+/**
+ * @brief Sends a request; the callback runs once, with the first reply or the last failure.
+ * @param code Request code.
+ * @param payload Bytes after the header (e.g. the city name).
+ * @param callback Completion handler; must not block.
+ */
+void ServerPool::request(ReqCode code, const std::string& payload, Callback callback) {
+    std::shared_ptr<Call> call = std::make_shared<Call>();
+    call->code = code;
+    call->payload = payload;
+    call->callback = std::move(callback);
+    call->movable = wire::codeInfo(code).cache != wire::Cacheability::Client;
+
+    size_t server = members_.size();
+    if (call->movable) {
+        server = pick(std::vector<size_t>(), true);
+    }
+    else {
+        // Stateful codes stick to the first healthy server in list order
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < members_.size() && server == members_.size(); ++i) {
+            if (members_[i].client && members_[i].healthy) server = i;
+        }
+    }
+    if (server == members_.size()) {
+        AsyncResult closed;
+        call->callback(closed);
+        return;
+    }
+    call->tried.push_back(server);
+    call->outstanding = 1;
+
+    if (call->movable && options_.maxServers > 1 && members_.size() > 1) {
+        double delayUs;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const Member& member = members_[server];
+            delayUs = member.window.empty() ? options_.timeoutMs * 500.0 : member.p95Us;
+        }
+        delayUs = std::max(delayUs, static_cast<double>(options_.hedgeMinUs));
+        if (delayUs < options_.timeoutMs * 1000.0) {
+            Hedge entry{ Clock::now() + std::chrono::microseconds(static_cast<int64_t>(delayUs)), call };
+            std::lock_guard<std::mutex> lock(timerMutex_);
+            if (running_) {
+                bool earliest = hedges_.empty() || entry.at < hedges_.top().at;
+                hedges_.push(entry);
+                if (earliest) timerWake_.notify_one();
+            }
+        }
+    }
+    send(call, server);
+}
+
+/**
+ * @brief Sends a request and returns a future for its outcome.
+ * @param code Request code.
+ * @param payload Bytes after the header (e.g. the city name).
+ * @return Future that becomes ready when the request completes; it never throws.
+ */
+std::future<AsyncResult> ServerPool::request(ReqCode code, const std::string& payload) {
+    auto promise = std::make_shared<std::promise<AsyncResult>>();
+    std::future<AsyncResult> future = promise->get_future();
+    request(code, payload, [promise](const AsyncResult& result) { promise->set_value(result); });
+    return future;
+}
+
+/**
+ * @brief Sends a call to one server.
+ * @param call Request.
+ * @param server Member index.
+ */
+void ServerPool::send(const std::shared_ptr<Call>& call, size_t server) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++members_[server].counters.sent;
+    }
+    members_[server].client->request(call->code, call->payload, [this, call, server](const AsyncResult& result) {
+        onReply(call, server, result);
+    });
+}
+
+/**
+ * @brief Handles the outcome of one send: completes the call, or fails it over.
+ * @param call Request.
+ * @param server Member index.
+ * @param result Outcome.
+ */
+void ServerPool::onReply(const std::shared_ptr<Call>& call, size_t server, const AsyncResult& result) {
+    // A status reply (Unavailable, BadRequest...) is not a win: the call fails over, but the
+    // member answered, so it is neither scored healthy nor counted as failing
+    const bool ok = result.ok();
+    record(server, ok, result.retried() ? -1.0 : result.rttUs, result.error == AsyncError::Timeout || result.error == AsyncError::Socket);
+
+    Callback callback;
+    AsyncResult outcome;
+    size_t next = members_.size();
+    bool hedgeWin = false;
+    {
+        std::lock_guard<std::mutex> lock(call->mutex);
+        --call->outstanding;
+        if (call->done) return; // The other copy answered first
+        if (ok) {
+            call->done = true;
+            hedgeWin = call->hedged && server != call->tried.front();
+            callback = std::move(call->callback);
+            outcome = result;
+        }
+        else {
+            call->failure = result;
+            if (call->outstanding > 0) return; // The hedge may still answer
+            if (call->movable && result.error != AsyncError::Closed && call->tried.size() < options_.maxServers) {
+                next = pick(call->tried, true);
+            }
+            if (next != members_.size()) {
+                call->tried.push_back(next);
+                ++call->outstanding;
+            }
+            else {
+                call->done = true;
+                callback = std::move(call->callback);
+                outcome = call->failure;
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (next != members_.size()) ++counters_.failovers;
+        else {
+            ++counters_.requests;
+            if (!ok) ++counters_.failed;
+            if (hedgeWin) ++counters_.hedgeWins;
+        }
+    }
+    if (next != members_.size()) send(call, next);
+    else callback(outcome);
+}
+
+/**
+ * @brief Sends the duplicate of a call whose hedge deadline passed.
+ * @param call Request.
+ */
+void ServerPool::hedge(const std::shared_ptr<Call>& call) {
+    size_t next;
+    {
+        std::lock_guard<std::mutex> lock(call->mutex);
+        if (call->done || call->hedged || call->outstanding == 0 || call->tried.size() >= options_.maxServers) return;
+        next = pick(call->tried, false); // Only a healthy server is worth a duplicate
+        if (next == members_.size()) return;
+        call->hedged = true;
+        call->tried.push_back(next);
+        ++call->outstanding;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++counters_.hedged;
+    }
+    send(call, next);
+}
+
+/**
+ * @brief Sends a GetPreciseTime probe to every member.
+ */
+void ServerPool::probeAll() {
+    for (size_t i = 0; i < members_.size(); ++i) {
+        if (!members_[i].client) continue;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++members_[i].counters.sent;
+        }
+        char payload[8];
+        wire::putLe64(payload, preciseNowNs());
+        members_[i].client->request(ReqCode::GetPreciseTime, std::string(payload, sizeof(payload)), [this, i](const AsyncResult& result) {
+            bool ok = result.ok() && result.body.size() == wire::kPreciseBodySize;
+            double rttUs = result.retried() ? -1.0 : result.rttUs;
+            if (ok && rttUs >= 0) {
+                // Without the server's processing time, as in computePreciseSample()
+                uint64_t t2 = wire::getLe64(result.body.data() + 8);
+                uint64_t t3 = wire::getLe64(result.body.data() + 16);
+                rttUs = std::max(0.0, rttUs - static_cast<double>(t3 - t2) / 1000.0);
+            }
+            record(i, ok, rttUs, result.error == AsyncError::Timeout || result.error == AsyncError::Socket);
+        });
+    }
+}
+
+/**
+ * @brief Updates a member's health and RTT estimate with one outcome.
+ * @param server Member index.
+ * @param ok true if a reply with status Ok arrived.
+ * @param rttUs RTT of the reply, or negative to leave the RTT estimate alone (retried exchange).
+ * @param counted Whether the outcome counts toward failures (timeouts and send errors do).
+ */
+void ServerPool::record(size_t server, bool ok, double rttUs, bool counted) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Member& member = members_[server];
+    if (!ok) {
+        if (!counted) return;
+        ++member.counters.failed;
+        if (++member.failures >= options_.failThreshold && member.healthy) {
+            member.healthy = false;
+            std::cout << "Server " << member.address << " marked dead after " << member.failures << " timeouts.\n";
+        }
+        return;
+    }
+    ++member.counters.answered;
+    member.failures = 0;
+    if (!member.healthy) {
+        member.healthy = true;
+        std::cout << "Server " << member.address << " is back.\n";
+    }
+    if (rttUs < 0) return;
+    member.srttUs = (member.srttUs > 0) ? member.srttUs + (rttUs - member.srttUs) / 8.0 : rttUs;
+    if (member.window.size() < options_.rttWindow) member.window.push_back(rttUs);
+    else member.window[member.next] = rttUs;
+    member.next = (member.next + 1) % options_.rttWindow;
+    std::vector<double> sorted(member.window);
+    size_t rank = (sorted.size() * 95 + 99) / 100 - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    member.p95Us = sorted[rank];
+}
+
+/**
+ * @brief Timer thread: fires hedges and probes until close().
+ */
+void ServerPool::loop() {
+    const auto probeInterval = std::chrono::milliseconds(options_.probeIntervalMs);
+    std::unique_lock<std::mutex> lock(timerMutex_);
+    Clock::time_point nextProbe = Clock::now() + probeInterval;
+    while (running_) {
+        Clock::time_point wakeAt = nextProbe;
+        if (!hedges_.empty()) wakeAt = std::min(wakeAt, hedges_.top().at);
+        timerWake_.wait_until(lock, wakeAt);
+        if (!running_) break;
+
+        Clock::time_point now = Clock::now();
+        std::vector<std::shared_ptr<Call>> due;
+        while (!hedges_.empty() && hedges_.top().at <= now) {
+            if (std::shared_ptr<Call> call = hedges_.top().call.lock()) due.push_back(call);
+            hedges_.pop();
+        }
+        bool probe = now >= nextProbe;
+        if (probe) nextProbe = now + probeInterval;
+        lock.unlock();
+        for (const std::shared_ptr<Call>& call : due) hedge(call);
+        if (probe) probeAll();
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Snapshot of the pool and member counters.
+ * @return Counters.
+ */
+PoolStats ServerPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PoolStats stats = counters_;
+    for (const Member& member : members_) {
+        ServerStats server = member.counters;
+        server.healthy = member.client && member.healthy;
+        server.srttUs = member.srttUs;
+        server.p95Us = member.p95Us;
+        stats.servers.push_back(server);
+    }
+    return stats;
+}
+
+/**
+ * @brief Prints the counters of stats() to stdout.
+ * @param stats Counters.
+ */
+void ServerPool::print(const PoolStats& stats) {
+    std::printf("Requests: %llu (%llu failed), %llu hedged (%llu won by the hedge), %llu failovers\n",
+                static_cast<unsigned long long>(stats.requests), static_cast<unsigned long long>(stats.failed),
+                static_cast<unsigned long long>(stats.hedged), static_cast<unsigned long long>(stats.hedgeWins),
+                static_cast<unsigned long long>(stats.failovers));
+    for (const ServerStats& server : stats.servers) {
+        std::printf("  %-24s %-7s srtt %8.1f us | p95 %8.1f us | %llu sent, %llu answered, %llu failed\n",
+                    server.address.c_str(), server.healthy ? "healthy" : "dead", server.srttUs, server.p95Us,
+                    static_cast<unsigned long long>(server.sent), static_cast<unsigned long long>(server.answered),
+                    static_cast<unsigned long long>(server.failed));
+    }
+}
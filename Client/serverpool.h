@@ -0,0 +1,233 @@
+/**
+ * @file serverpool.h
+ * @brief Declares ServerPool, a client that spreads requests over several time servers.
+ *
+ * Every server gets its own AsyncTimeClient. The pool keeps a rolling RTT estimate per server,
+ * fed by the replies and by a GetPreciseTime probe it sends to every server each probe interval,
+ * and sends each request to the healthy server with the lowest smoothed RTT. If no reply has
+ * arrived by that server's p95 RTT, the request is hedged: a duplicate goes to the next fastest
+ * server and the first reply wins. A request whose server fails fails over to the next one.
+ *
+ * A server that times out failThreshold times in a row is marked dead and gets no requests;
+ * the probes keep going to it, and the first probe answered marks it healthy again.
+ *
+ * Codes whose answer depends on per-client server state (laps, subscriptions) are neither hedged
+ * nor failed over: they always go to the first healthy server in list order, so they keep
+ * meeting the same state.
+ *
+ * C++14 is used for compatibility.
+ */
+#pragma once
+#include <condition_variable>
+#include <memory>
+#include <queue>
+#include "asyncclient.h"
+
+/**
+ * @struct PoolOptions
+ * @brief Parameters of a ServerPool.
+ */
+struct PoolOptions {
+    std::vector<std::string> servers;   // "host", "host:port" or "[v6]:port"
+    unsigned short defaultPort = 27015; // Port of servers given without one
+    unsigned timeoutMs = 500;           // Wait for one server's reply before failing over
+    unsigned maxServers = 3;            // Servers one request may be sent to (hedge and failovers)
+    unsigned hedgeMinUs = 100;          // Never hedge earlier than this
+    unsigned rttWindow = 64;            // RTT samples the p95 is taken over
+    unsigned failThreshold = 3;         // Consecutive timeouts that mark a server dead
+    unsigned probeIntervalMs = 1000;    // Period of the RTT and health probes
+};
+
+/**
+ * @struct ServerStats
+ * @brief Health and latency of one pool member.
+ */
+struct ServerStats {
+    std::string address;   // Server as given in PoolOptions::servers
+    bool healthy = false;  // Receives requests
+    double srttUs = 0;     // Smoothed RTT (0 until measured)
+    double p95Us = 0;      // 95th percentile of the RTT window (the hedge deadline)
+    uint64_t sent = 0;     // Requests and probes sent
+    uint64_t answered = 0; // Replies received
+    uint64_t failed = 0;   // Timeouts and send errors
+};
+
+/**
+ * @struct PoolStats
+ * @brief Counters of a ServerPool.
+ */
+struct PoolStats {
+    uint64_t requests = 0;  // Requests completed
+    uint64_t hedged = 0;    // Requests duplicated to a second server
+    uint64_t hedgeWins = 0; // Hedged requests answered by the duplicate first
+    uint64_t failovers = 0; // Requests resent after their server failed
+    uint64_t failed = 0;    // Requests completed without a reply
+    std::vector<ServerStats> servers; // Per member, in list order
+};
+
+/**
+ * @class ServerPool
+ * @brief Routes binary requests to the fastest healthy server, with hedging and failover.
+ */
+class ServerPool {
+public:
+    using Callback = AsyncTimeClient::Callback;
+
+    /**
+     * @brief Constructs a closed pool; call open() before sending.
+     * @param options Pool parameters.
+     */
+    explicit ServerPool(const PoolOptions& options);
+
+    /**
+     * @brief Destructor. Closes the pool.
+     */
+    ~ServerPool();
+
+    ServerPool(const ServerPool&) = delete;
+    ServerPool& operator=(const ServerPool&) = delete;
+
+    /**
+     * @brief Opens a client per server, probes them all once and starts the timer thread.
+     * @return true if at least one server could be opened, false otherwise.
+     */
+    bool open();
+
+    /**
+     * @brief Stops the timer thread and closes every client; pending requests complete with Closed.
+     */
+    void close();
+
+    /**
+     * @brief Sends a request; the callback runs once, with the first reply or the last failure.
+     * @param code Request code.
+     * @param payload Bytes after the header (e.g. the city name).
+     * @param callback Completion handler; must not block.
+     */
+    void request(ReqCode code, const std::string& payload, Callback callback);
+
+    /**
+     * @brief Sends a request and returns a future for its outcome.
+     * @param code Request code.
+     * @param payload Bytes after the header (e.g. the city name).
+     * @return Future that becomes ready when the request completes; it never throws.
+     */
+    std::future<AsyncResult> request(ReqCode code, const std::string& payload = std::string());
+
+    /**
+     * @brief Snapshot of the pool and member counters.
+     * @return Counters.
+     */
+    PoolStats stats() const;
+
+    /**
+     * @brief Prints the counters of stats() to stdout.
+     * @param stats Counters.
+     */
+    static void print(const PoolStats& stats);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @struct Member
+     * @brief One server of the pool.
+     */
+    struct Member {
+        std::string address;                    // As given
+        std::unique_ptr<AsyncTimeClient> client;// Null if it could not be opened
+        bool healthy = true;                    // Receives requests
+        unsigned failures = 0;                  // Consecutive timeouts
+        double srttUs = 0;                      // Smoothed RTT (0 until measured)
+        std::vector<double> window;             // Recent RTTs (ring)
+        size_t next = 0;                        // Next ring slot
+        double p95Us = 0;                       // p95 of the window
+        ServerStats counters;                   // sent, answered, failed
+    };
+
+    /**
+     * @struct Call
+     * @brief One request, possibly sent to several servers.
+     */
+    struct Call {
+        ReqCode code;                // Request code
+        std::string payload;         // Request payload
+        Callback callback;           // Completion handler
+        bool movable = true;         // May be hedged and failed over
+        std::mutex mutex;            // Guards the members below
+        bool done = false;           // Callback has run
+        bool hedged = false;         // Duplicate sent
+        unsigned outstanding = 0;    // Sends without outcome yet
+        std::vector<size_t> tried;   // Servers sent to, first is the primary
+        AsyncResult failure;         // Last failure, reported if no server answers
+    };
+
+    /**
+     * @struct Hedge
+     * @brief A hedge deadline waiting in the timer queue.
+     */
+    struct Hedge {
+        Clock::time_point at;     // When to send the duplicate
+        std::weak_ptr<Call> call; // Request (expired once completed)
+        bool operator>(const Hedge& other) const { return at > other.at; }
+    };
+
+    /**
+     * @brief Timer thread: fires hedges and probes until close().
+     */
+    void loop();
+
+    /**
+     * @brief Picks the fastest usable server not yet tried by a call.
+     * @param tried Servers already used.
+     * @param anyIfNoneHealthy Fall back to dead servers if no healthy one is left.
+     * @return Member index, or members_.size() if none.
+     */
+    size_t pick(const std::vector<size_t>& tried, bool anyIfNoneHealthy) const;
+
+    /**
+     * @brief Sends a call to one server.
+     * @param call Request.
+     * @param server Member index.
+     */
+    void send(const std::shared_ptr<Call>& call, size_t server);
+
+    /**
+     * @brief Handles the outcome of one send: completes the call, or fails it over.
+     * @param call Request.
+     * @param server Member index.
+     * @param result Outcome.
+     */
+    void onReply(const std::shared_ptr<Call>& call, size_t server, const AsyncResult& result);
+
+    /**
+     * @brief Sends the duplicate of a call whose hedge deadline passed.
+     * @param call Request.
+     */
+    void hedge(const std::shared_ptr<Call>& call);
+
+    /**
+     * @brief Sends a GetPreciseTime probe to every member.
+     */
+    void probeAll();
+
+    /**
+     * @brief Updates a member's health and RTT estimate with one outcome.
+     * @param server Member index.
+     * @param ok true if a reply with status Ok arrived.
+     * @param rttUs RTT of the reply, or negative to leave the RTT estimate alone (retried exchange).
+     * @param counted Whether the outcome counts toward failures (timeouts and send errors do).
+     */
+    void record(size_t server, bool ok, double rttUs, bool counted);
+
+    PoolOptions options_;              // Pool parameters
+    std::vector<Member> members_;      // Servers, in list order
+    mutable std::mutex mutex_;         // Guards members_ state and counters_
+    PoolStats counters_;               // Pool counters (servers filled by stats())
+
+    std::mutex timerMutex_;            // Guards hedges_, running_
+    std::condition_variable timerWake_;// Wakes the timer thread
+    std::priority_queue<Hedge, std::vector<Hedge>, std::greater<Hedge>> hedges_; // Earliest first
+    bool running_;                     // Cleared by close()
+    std::thread thread_;               // Timer thread
+};
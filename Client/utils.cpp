@@ -55,6 +55,26 @@ uint32_t toUint32(const std::vector<char>& bytes) {
     return ntohl(val);  // Convert from network byte order
 }
 
+/**
+ * @brief Computes RTT and clock offset from the four timestamps of one exchange.
+ * @param t1 Client transmit time (ns).
+ * @param t2 Server receive time (ns).
+ * @param t3 Server transmit time (ns).
+ * @param t4 Client receive time (ns).
+ * @return RTT and offset in microseconds.
+ */
+PreciseSample computePreciseSample(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4) {
+    // Differences of the same clock are small, so signed 64-bit arithmetic cannot overflow
+    int64_t clientSpan = static_cast<int64_t>(t4 - t1);
+    int64_t serverSpan = static_cast<int64_t>(t3 - t2);
+    int64_t up = static_cast<int64_t>(t2 - t1);
+    int64_t down = static_cast<int64_t>(t3 - t4);
+    PreciseSample sample;
+    sample.rttUs = (clientSpan - serverSpan) / 1000.0;
+    sample.offsetUs = (up + down) / 2000.0;
+    return sample;
+}
+
 /**
  * @brief Prints the main menu for time requests to the console.
  */
@@ -74,7 +94,10 @@ void printMenu() {
     std::cout << "10. Week number of year\n";
     std::cout << "11. Daylight savings status\n";
     std::cout << "12. Time in another city\n";
-    std::cout << "13. Measure time lap\n\n";
+    std::cout << "13. Measure time lap\n";
+    std::cout << "14. Precise RTT, jitter and clock offset\n";
+    std::cout << "15. Dashboard poll (batch)\n";
+    std::cout << "16. Subscribe to time ticks\n\n";
 }
 
 /**
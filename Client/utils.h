@@ -13,29 +13,24 @@
 #include <cstring>
 #include <winsock2.h>
 #include <algorithm>
+#include <cstdint>
+#include "../Common/protocol.h"
+#include "../Common/netaddr.h"
+#include "../Common/clock.h"
 
 static constexpr int BUFFER_SIZE = 255; ///< Buffer size for UDP messages
+static constexpr unsigned RECEIVE_TIMEOUT_MS = 2000; ///< Longest wait for a reply in the interactive client
+
+static constexpr size_t PRECISE_REQUEST_SIZE = 13; ///< Code, sequence u32, t1 u64
+static constexpr size_t PRECISE_REPLY_SIZE = 32;   ///< Code, 3 reserved, sequence u32, t1/t2/t3 u64
 
 /**
- * @enum ReqCode
- * @brief Request codes for time server operations.
+ * @struct PreciseSample
+ * @brief Result of one four-timestamp (NTP-style) exchange.
  */
-enum class ReqCode : char {
-    Error = -1,                      ///< Error or invalid request
-    Default = 0,                     ///< Default request
-    GetTime,                         ///< Get current date and time
-    GetTimeWithoutDate,              ///< Get current time (no date)
-    GetTimeSinceEpoch,               ///< Get seconds since epoch
-    GetClientToServerDelayEstimation,///< Estimate client-to-server delay
-    MeasuureRTT,                     ///< Measure round-trip time (RTT)
-    GetTimeWithoutDateOrSeconds,     ///< Get time without seconds
-    GetYear,                         ///< Get current year
-    GetMonthAndDay,                  ///< Get current month and day
-    GetSecondsSinceBeginningOfMonth, ///< Get seconds since month start
-    GetWeekOfYear,                   ///< Get week number of year
-    GetDaylightSavings,              ///< Get daylight savings status
-    GetTimeWithoutDateInCity,        ///< Get time in another city
-    MeasureTimeLap                   ///< Measure time lap
+struct PreciseSample {
+    double rttUs;    ///< Round-trip time without server processing: (t4 - t1) - (t3 - t2)
+    double offsetUs; ///< Server clock minus client clock: ((t2 - t1) + (t3 - t4)) / 2
 };
 
 /**
@@ -70,6 +65,16 @@ double calcAvgDifference(const std::vector<uint32_t>& samples);
  */
 uint32_t toUint32(const std::vector<char>& bytes);
 
+/**
+ * @brief Computes RTT and clock offset from the four timestamps of one exchange.
+ * @param t1 Client transmit time (ns).
+ * @param t2 Server receive time (ns).
+ * @param t3 Server transmit time (ns).
+ * @param t4 Client receive time (ns).
+ * @return RTT and offset in microseconds.
+ */
+PreciseSample computePreciseSample(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4);
+
 /**
  * @brief Prints the main menu for time requests to the console.
  */
@@ -0,0 +1,22 @@
+/**
+ * @file clock.h
+ * @brief Wall clock shared by the UDP time server and client.
+ *
+ * GetPreciseTime timestamps (t1..t4), trace headers and the client's disciplined clock all read
+ * the same clock, so both sides take it from here.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h> // Before any windows.h, which would pull in the old winsock.h
+#include <cstdint>
+
+/**
+ * @brief Current UTC time with sub-microsecond resolution (GetSystemTimePreciseAsFileTime).
+ * @return Nanoseconds since the Unix epoch.
+ */
+inline uint64_t preciseNowNs() {
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    uint64_t ticks = (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    return (ticks - 116444736000000000ull) * 100; // 100 ns ticks since 1601 -> ns since 1970
+}
@@ -0,0 +1,77 @@
+/**
+ * @file netaddr.h
+ * @brief IPv4/IPv6 socket address helpers shared by the UDP time server and client.
+ *
+ * Addresses are carried in a sockaddr_storage so both families fit; these helpers resolve
+ * names and literals into one, and give its length and printable form.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <cstring>
+#include <string>
+
+/**
+ * @brief Length of the socket address held in a storage (for sendto/bind).
+ * @param addr Address of family AF_INET or AF_INET6.
+ * @return sizeof(sockaddr_in6) for IPv6, sizeof(sockaddr_in) otherwise.
+ */
+inline int addressLength(const sockaddr_storage& addr) {
+    return addr.ss_family == AF_INET6 ? static_cast<int>(sizeof(sockaddr_in6)) : static_cast<int>(sizeof(sockaddr_in));
+}
+
+/**
+ * @brief Whether an IPv6 address is an IPv4-mapped address (::ffff:a.b.c.d).
+ * @param addr IPv6 address.
+ * @return true if mapped, false otherwise.
+ */
+inline bool isV4Mapped(const in6_addr& addr) {
+    static const unsigned char kPrefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+    return std::memcmp(addr.s6_addr, kPrefix, sizeof(kPrefix)) == 0;
+}
+
+/**
+ * @brief Resolves a host name or IPv4/IPv6 literal (brackets allowed: "[::1]").
+ * @param host Host to resolve; the first address returned is used.
+ * @param port Port in host byte order.
+ * @param family AF_INET or AF_INET6 to restrict the lookup, AF_UNSPEC for either.
+ * @param out Receives the address.
+ * @return true on success, false if the host cannot be resolved.
+ */
+inline bool resolveAddress(const std::string& host, unsigned short port, int family, sockaddr_storage& out) {
+    std::string name = host;
+    if (name.size() > 2 && name.front() == '[' && name.back() == ']') name = name.substr(1, name.size() - 2);
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    addrinfo* result = nullptr;
+    std::string service = std::to_string(port);
+    if (0 != getaddrinfo(name.c_str(), service.c_str(), &hints, &result) || !result) return false;
+    std::memset(&out, 0, sizeof(out));
+    std::memcpy(&out, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+    return true;
+}
+
+/**
+ * @brief Formats an address as "a.b.c.d:port" or "[v6]:port".
+ * @param addr Address to format.
+ * @return Printable address.
+ */
+inline std::string formatAddress(const sockaddr_storage& addr) {
+    char host[INET6_ADDRSTRLEN] = "?";
+    unsigned short port = 0;
+    if (addr.ss_family == AF_INET6) {
+        const sockaddr_in6& v6 = reinterpret_cast<const sockaddr_in6&>(addr);
+        inet_ntop(AF_INET6, &v6.sin6_addr, host, sizeof(host));
+        port = ntohs(v6.sin6_port);
+        return "[" + std::string(host) + "]:" + std::to_string(port);
+    }
+    const sockaddr_in& v4 = reinterpret_cast<const sockaddr_in&>(addr);
+    inet_ntop(AF_INET, &v4.sin_addr, host, sizeof(host));
+    port = ntohs(v4.sin_port);
+    return std::string(host) + ":" + std::to_string(port);
+}
@@ -0,0 +1,472 @@
+/**
+ * @file protocol.h
+ * @brief Wire definitions shared by the UDP time server and client.
+ *
+ * This header provides the request codes and the binary framing. A legacy request is the code
+ * byte followed by null-separated text parameters and is answered with text or a
+ * leading-zero-stripped integer. A binary request starts with a Header whose first byte has the
+ * binary marker as its high nibble (0x8v, v = version; legacy codes are 1..127, and 0x90-0xFF,
+ * Error among them, are not binary), and is answered with a Header followed by a fixed-width
+ * little-endian body, so replies have one size per code and can be decoded without guessing at
+ * their layout.
+ *
+ * A Batch request body is a list of [code][len][payload] items; its reply body is the list of
+ * [code][status][flags][len][body] answers in the same order, so one datagram serves a poll.
+ *
+ * Subscribers receive unsolicited ticks: a Header with code Subscribe and kFlagTick, the tick
+ * number as seq, and a TimeFields body, sent unicast or to a multicast group once per interval.
+ *
+ * Per-code metadata (name, parameters, reply encoding, cacheability and reply sizes) lives in
+ * one constexpr registry, wire::kCodes, so handlers, buffers and logs agree on it at compile time.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Request codes for time server operations.
+ */
+enum class ReqCode : char {
+    Error = -1,              /**< Error or invalid request. */
+    Default = 0,             /**< Default value. */
+    GetTime,                 /**< Get current date and time. */
+    GetTimeWithoutDate,      /**< Get current time (no date). */
+    GetTimeSinceEpoch,       /**< Get seconds since Unix epoch. */
+    GetClientToServerDelayEstimation, /**< Get tick count for delay estimation. */
+    MeasuureRTT,             /**< Measure round-trip time. */
+    GetTimeWithoutDateOrSeconds, /**< Get current time (no seconds). */
+    GetYear,                 /**< Get current year. */
+    GetMonthAndDay,          /**< Get current month and day. */
+    GetSecondsSinceBeginningOfMonth, /**< Get seconds since month start. */
+    GetWeekOfYear,           /**< Get current week of year. */
+    GetDaylightSavings,      /**< Get daylight savings status. */
+    GetTimeWithoutDateInCity,/**< Get current time in a specified city. */
+    MeasureTimeLap,          /**< Measure time lap for a client. */
+    GetPreciseTime,          /**< NTP-style receive/transmit timestamps (binary payload). */
+    Batch,                   /**< Several sub-requests answered in one datagram (binary framing only). */
+    Subscribe,               /**< Register or renew a time-tick subscription (binary framing only). */
+    Unsubscribe              /**< End a time-tick subscription (binary framing only). */
+};
+
+namespace wire {
+
+/**
+ * @brief Binary protocol version carried in the low nibble of the first header byte.
+ */
+constexpr uint8_t kVersion = 1;
+
+/**
+ * @brief High nibble of the first byte of every binary frame.
+ */
+constexpr uint8_t kBinaryMarker = 0x80;
+
+/**
+ * @brief Size of the Header on the wire.
+ */
+constexpr size_t kHeaderSize = 8;
+
+/**
+ * @brief Size of the TimeFields body on the wire.
+ */
+constexpr size_t kTimeFieldsSize = 24;
+
+/**
+ * @brief Size of a single-value body (seconds, ticks) on the wire.
+ */
+constexpr size_t kValueSize = 4;
+
+/**
+ * @brief Size of the GetPreciseTime reply body (t1 echoed, t2, t3) on the wire.
+ */
+constexpr size_t kPreciseBodySize = 24;
+
+/**
+ * @brief Size of the Subscribe reply body: [ttlSec u32][intervalMs u32][group addr, network order][group port u16].
+ */
+constexpr size_t kSubscribeBodySize = 14;
+
+/**
+ * @brief Size of the per-item header of a Batch request: [code][payload length].
+ */
+constexpr size_t kBatchItemHeaderSize = 2;
+
+/**
+ * @brief Size of the per-item header of a Batch reply: [code][status][flags][body length].
+ */
+constexpr size_t kBatchReplyItemHeaderSize = 4;
+
+/**
+ * @brief Most sub-requests answered from one Batch request (extra ones are ignored).
+ */
+constexpr size_t kMaxBatchItems = 16;
+
+/**
+ * @brief Outcome of a binary request.
+ */
+enum class Status : uint8_t {
+    Ok = 0,                 /**< Body holds the answer. */
+    BadRequest = 1,         /**< Payload malformed for the code (body empty). */
+    UnknownCode = 2,        /**< Code not supported (body empty). */
+    UnsupportedVersion = 3, /**< Request version not supported; the reply carries the server's. */
+    Unavailable = 4         /**< Feature disabled or out of capacity (e.g. subscriptions). */
+};
+
+/**
+ * @brief Header flag bits.
+ */
+enum Flags : uint8_t {
+    kFlagLapStarted = 0x01, /**< MeasureTimeLap: this request started the timer. */
+    kFlagUnknownZone = 0x02,/**< GetTimeWithoutDateInCity: unknown city, answered in UTC. */
+    kFlagTruncated = 0x04,  /**< Batch: not every sub-request fitted; the reply holds a prefix. */
+    kFlagTick = 0x08        /**< Subscribe: unsolicited time tick rather than a reply. */
+};
+
+/**
+ * @brief Fixed header of every binary request and reply (little-endian on the wire).
+ *
+ * Layout: [marker|version][code][status][flags][seq u32]. The server copies code and seq from
+ * the request, so replies can be matched to requests without relying on their order.
+ */
+struct Header {
+    uint8_t version = kVersion;  /**< Protocol version (without the marker bit). */
+    ReqCode code = ReqCode::Error; /**< Request code. */
+    Status status = Status::Ok;  /**< Ok in requests; result in replies. */
+    uint8_t flags = 0;           /**< Flags bits. */
+    uint32_t seq = 0;            /**< Sequence number chosen by the client. */
+};
+
+/**
+ * @brief Broken-down time answered by every date and time code (little-endian on the wire).
+ *
+ * Layout: [epochSec u64][micros u32][utcOffsetMin i16][year u16]
+ *         [month][day][hour][minute][second][weekday][dst][week], 24 bytes.
+ */
+struct TimeFields {
+    uint64_t epochSec = 0;    /**< Seconds since the Unix epoch (UTC). */
+    uint32_t micros = 0;      /**< Microseconds within the second. */
+    int16_t utcOffsetMin = 0; /**< Offset of the broken-down fields from UTC in minutes. */
+    uint16_t year = 0;        /**< Year (e.g. 2024). */
+    uint8_t month = 0;        /**< Month (1-12). */
+    uint8_t day = 0;          /**< Day of month (1-31). */
+    uint8_t hour = 0;         /**< Hour (0-23). */
+    uint8_t minute = 0;       /**< Minute (0-59). */
+    uint8_t second = 0;       /**< Second (0-60). */
+    uint8_t weekday = 0;      /**< Day of week (0 = Sunday). */
+    uint8_t dst = 0;          /**< 1 if daylight saving time is in effect. */
+    uint8_t week = 0;         /**< Sunday-based week of the year (0-53). */
+};
+
+/**
+ * @brief Checks whether a datagram uses binary framing.
+ * @param first First byte of the datagram.
+ * @return true if the high nibble is the binary marker.
+ */
+inline bool isBinary(char first) {
+    return (static_cast<uint8_t>(first) & 0xF0) == kBinaryMarker;
+}
+
+/**
+ * @brief Writes a 16-bit value in little-endian order.
+ * @param dst Destination (2 bytes).
+ * @param val Value to write.
+ */
+inline void putLe16(char* dst, uint16_t val) {
+    dst[0] = static_cast<char>(val);
+    dst[1] = static_cast<char>(val >> 8);
+}
+
+/**
+ * @brief Writes a 32-bit value in little-endian order.
+ * @param dst Destination (4 bytes).
+ * @param val Value to write.
+ */
+inline void putLe32(char* dst, uint32_t val) {
+    for (int i = 0; i < 4; ++i) { dst[i] = static_cast<char>(val & 0xFF); val >>= 8; }
+}
+
+/**
+ * @brief Writes a 64-bit value in little-endian order.
+ * @param dst Destination (8 bytes).
+ * @param val Value to write.
+ */
+inline void putLe64(char* dst, uint64_t val) {
+    for (int i = 0; i < 8; ++i) { dst[i] = static_cast<char>(val & 0xFF); val >>= 8; }
+}
+
+/**
+ * @brief Reads a 16-bit value in little-endian order.
+ * @param src Source (2 bytes).
+ * @return Value read.
+ */
+inline uint16_t getLe16(const char* src) {
+    return static_cast<uint16_t>(static_cast<uint8_t>(src[0]) | (static_cast<uint8_t>(src[1]) << 8));
+}
+
+/**
+ * @brief Reads a 32-bit value in little-endian order.
+ * @param src Source (4 bytes).
+ * @return Value read.
+ */
+inline uint32_t getLe32(const char* src) {
+    uint32_t val = 0;
+    for (int i = 3; i >= 0; --i) val = (val << 8) | static_cast<uint8_t>(src[i]);
+    return val;
+}
+
+/**
+ * @brief Reads a 64-bit value in little-endian order.
+ * @param src Source (8 bytes).
+ * @return Value read.
+ */
+inline uint64_t getLe64(const char* src) {
+    uint64_t val = 0;
+    for (int i = 7; i >= 0; --i) val = (val << 8) | static_cast<uint8_t>(src[i]);
+    return val;
+}
+
+/**
+ * @brief Writes a 32-bit value in big-endian (network) order.
+ * @param dst Destination (4 bytes).
+ * @param val Value to write.
+ */
+inline void putBe32(char* dst, uint32_t val) {
+    for (int i = 3; i >= 0; --i) { dst[i] = static_cast<char>(val & 0xFF); val >>= 8; }
+}
+
+/**
+ * @brief Writes a 64-bit value in big-endian (network) order.
+ * @param dst Destination (8 bytes).
+ * @param val Value to write.
+ */
+inline void putBe64(char* dst, uint64_t val) {
+    for (int i = 7; i >= 0; --i) { dst[i] = static_cast<char>(val & 0xFF); val >>= 8; }
+}
+
+/**
+ * @brief Reads a 32-bit value in big-endian (network) order.
+ * @param src Source (4 bytes).
+ * @return Value read.
+ */
+inline uint32_t getBe32(const char* src) {
+    uint32_t val = 0;
+    for (int i = 0; i < 4; ++i) val = (val << 8) | static_cast<uint8_t>(src[i]);
+    return val;
+}
+
+/**
+ * @brief Reads a 64-bit value in big-endian (network) order.
+ * @param src Source (8 bytes).
+ * @return Value read.
+ */
+inline uint64_t getBe64(const char* src) {
+    uint64_t val = 0;
+    for (int i = 0; i < 8; ++i) val = (val << 8) | static_cast<uint8_t>(src[i]);
+    return val;
+}
+
+/**
+ * @brief Serializes a header.
+ * @param dst Destination (kHeaderSize bytes).
+ * @param header Header to write.
+ */
+inline void encodeHeader(char* dst, const Header& header) {
+    dst[0] = static_cast<char>(kBinaryMarker | (header.version & 0x0F));
+    dst[1] = static_cast<char>(header.code);
+    dst[2] = static_cast<char>(header.status);
+    dst[3] = static_cast<char>(header.flags);
+    putLe32(dst + 4, header.seq);
+}
+
+/**
+ * @brief Parses a header.
+ * @param src Datagram bytes.
+ * @param len Datagram length.
+ * @param header Parsed header.
+ * @return true if the datagram is binary and long enough, false otherwise.
+ */
+inline bool decodeHeader(const char* src, size_t len, Header& header) {
+    if (len < kHeaderSize || !isBinary(src[0])) return false;
+    header.version = static_cast<uint8_t>(src[0]) & 0x0F;
+    header.code = static_cast<ReqCode>(src[1]);
+    header.status = static_cast<Status>(src[2]);
+    header.flags = static_cast<uint8_t>(src[3]);
+    header.seq = getLe32(src + 4);
+    return true;
+}
+
+/**
+ * @brief Serializes a TimeFields body.
+ * @param dst Destination (kTimeFieldsSize bytes).
+ * @param t Fields to write.
+ */
+inline void encodeTime(char* dst, const TimeFields& t) {
+    putLe64(dst, t.epochSec);
+    putLe32(dst + 8, t.micros);
+    putLe16(dst + 12, static_cast<uint16_t>(t.utcOffsetMin));
+    putLe16(dst + 14, t.year);
+    const uint8_t small[8] = { t.month, t.day, t.hour, t.minute, t.second, t.weekday, t.dst, t.week };
+    for (int i = 0; i < 8; ++i) dst[16 + i] = static_cast<char>(small[i]);
+}
+
+/**
+ * @brief Parses a TimeFields body.
+ * @param src Source (kTimeFieldsSize bytes).
+ * @return Parsed fields.
+ */
+inline TimeFields decodeTime(const char* src) {
+    TimeFields t;
+    t.epochSec = getLe64(src);
+    t.micros = getLe32(src + 8);
+    t.utcOffsetMin = static_cast<int16_t>(getLe16(src + 12));
+    t.year = getLe16(src + 14);
+    t.month = static_cast<uint8_t>(src[16]);
+    t.day = static_cast<uint8_t>(src[17]);
+    t.hour = static_cast<uint8_t>(src[18]);
+    t.minute = static_cast<uint8_t>(src[19]);
+    t.second = static_cast<uint8_t>(src[20]);
+    t.weekday = static_cast<uint8_t>(src[21]);
+    t.dst = static_cast<uint8_t>(src[22]);
+    t.week = static_cast<uint8_t>(src[23]);
+    return t;
+}
+
+/**
+ * @brief How the legacy (non-binary) reply of a code is encoded.
+ */
+enum class ReplyKind : uint8_t {
+    None,   /**< No legacy reply: the code needs binary framing. */
+    Text,   /**< Printable text. */
+    Number, /**< A uint32 in network order without leading zero bytes (toBytes). */
+    Echo,   /**< The request payload, echoed. */
+    Record  /**< A fixed-size binary record (GetPreciseTime). */
+};
+
+/**
+ * @brief How long the answer of a code stays valid, for caching replies.
+ */
+enum class Cacheability : uint8_t {
+    None,      /**< Depends on the moment, the payload or server state (not cacheable). */
+    Second,    /**< Legacy reply is the same for everyone within one wall-clock second. */
+    SecondArg, /**< Legacy reply is the same within one second for the same first parameter. */
+    Client     /**< Depends on per-client state (laps, subscriptions). */
+};
+
+/**
+ * @brief Scheduling class of a code when the server is overloaded (RequestScheduler).
+ */
+enum class Priority : uint8_t {
+    Probe,  /**< Timing probes: served first and never shed, so they measure the network, not the backlog. */
+    Normal, /**< Cheap fixed-size answers and per-client state. */
+    Bulk    /**< Formatting-heavy work (city lookups, batches) and unknown codes: served last, shed first. */
+};
+
+/**
+ * @brief Compile-time description of one request code.
+ */
+struct CodeInfo {
+    ReqCode code;       /**< Request code (the registry is indexed by its value). */
+    const char* name;   /**< Name used in logs and metric labels. */
+    uint8_t arity;      /**< Legacy parameters the request needs (the city name). */
+    ReplyKind legacy;   /**< Encoding of the legacy reply. */
+    Cacheability cache; /**< Validity of the answer. */
+    uint8_t maxText;    /**< Longest legacy reply in bytes (0 for Echo and None). */
+    int16_t body;       /**< Size of the Ok binary reply body, or -1 if it varies or the code is unknown. */
+    Priority priority;  /**< Scheduling class under overload. */
+};
+
+/**
+ * @brief Registry of every request code, indexed by code value; entry 0 stands for unknown codes.
+ */
+constexpr CodeInfo kCodes[] = {
+    { ReqCode::Default, "Unknown", 0, ReplyKind::None, Cacheability::None, 0, -1, Priority::Bulk },
+    { ReqCode::GetTime, "GetTime", 0, ReplyKind::Text, Cacheability::Second, 19, kTimeFieldsSize, Priority::Normal },
+    { ReqCode::GetTimeWithoutDate, "GetTimeWithoutDate", 0, ReplyKind::Text, Cacheability::Second, 8, kTimeFieldsSize, Priority::Normal },
+    { ReqCode::GetTimeSinceEpoch, "GetTimeSinceEpoch", 0, ReplyKind::Number, Cacheability::Second, 4, kTimeFieldsSize, Priority::Normal },
+    { ReqCode::GetClientToServerDelayEstimation, "GetClientToServerDelayEstimation", 0, ReplyKind::Number, Cacheability::None, 4, kValueSize, Priority::Probe },
+    { ReqCode::MeasuureRTT, "MeasuureRTT", 0, ReplyKind::Echo, Cacheability::None, 0, -1, Priority::Probe },
+    { ReqCode::GetTimeWithoutDateOrSeconds, "GetTimeWithoutDateOrSeconds", 0, ReplyKind::Text, Cacheability::Second, 5, kTimeFieldsSize, Priority::Normal },
+    { ReqCode::GetYear, "GetYear", 0, ReplyKind::Text, Cacheability::Second, 4, kTimeFieldsSize, Priority::Normal },
+    { ReqCode::GetMonthAndDay, "GetMonthAndDay", 0, ReplyKind::Text, Cacheability::Second, 5, kTimeFieldsSize, Priority::Normal },
+    { ReqCode::GetSecondsSinceBeginningOfMonth, "GetSecondsSinceBeginningOfMonth", 0, ReplyKind::Number, Cacheability::Second, 4, kValueSize, Priority::Normal },
+    { ReqCode::GetWeekOfYear, "GetWeekOfYear", 0, ReplyKind::Number, Cacheability::Second, 4, kTimeFieldsSize, Priority::Normal },
+    { ReqCode::GetDaylightSavings, "GetDaylightSavings", 0, ReplyKind::Text, Cacheability::Second, 1, kTimeFieldsSize, Priority::Normal },
+    { ReqCode::GetTimeWithoutDateInCity, "GetTimeWithoutDateInCity", 1, ReplyKind::Text, Cacheability::SecondArg, 8, kTimeFieldsSize, Priority::Bulk },
+    { ReqCode::MeasureTimeLap, "MeasureTimeLap", 0, ReplyKind::Text, Cacheability::Client, 15, kValueSize, Priority::Normal },
+    { ReqCode::GetPreciseTime, "GetPreciseTime", 0, ReplyKind::Record, Cacheability::None, 32, kPreciseBodySize, Priority::Probe },
+    { ReqCode::Batch, "Batch", 0, ReplyKind::None, Cacheability::None, 0, -1, Priority::Bulk },
+    { ReqCode::Subscribe, "Subscribe", 0, ReplyKind::None, Cacheability::Client, 0, kSubscribeBodySize, Priority::Normal },
+    { ReqCode::Unsubscribe, "Unsubscribe", 0, ReplyKind::None, Cacheability::Client, 0, 0, Priority::Normal }
+};
+
+/**
+ * @brief Number of registry entries (highest code + 1).
+ */
+constexpr size_t kCodeCount = sizeof(kCodes) / sizeof(kCodes[0]);
+
+/**
+ * @brief Checks that every registry entry sits at the index of its code.
+ * @param i First entry to check.
+ * @return true if entries i.. are in code order.
+ */
+constexpr bool codesInOrder(size_t i = 0) {
+    return i == kCodeCount || (static_cast<size_t>(kCodes[i].code) == i && codesInOrder(i + 1));
+}
+static_assert(codesInOrder(), "kCodes must be indexed by code value");
+
+/**
+ * @brief Largest fixed binary reply body of the registry entries from i on.
+ * @param i First entry.
+ * @return Body size in bytes.
+ */
+constexpr size_t maxReplyBody(size_t i = 0) {
+    return i == kCodeCount ? 0
+        : (kCodes[i].body > 0 && static_cast<size_t>(kCodes[i].body) > maxReplyBody(i + 1))
+            ? static_cast<size_t>(kCodes[i].body) : maxReplyBody(i + 1);
+}
+
+/**
+ * @brief Largest fixed binary reply body of any code, for sizing reply buffers.
+ */
+constexpr size_t kMaxReplyBody = maxReplyBody();
+
+/**
+ * @brief Registry slot of a code (bounds-checked).
+ * @param code Request code.
+ * @return Index into kCodes, or 0 if the code is unknown.
+ */
+constexpr size_t codeSlot(ReqCode code) {
+    return static_cast<unsigned char>(code) < kCodeCount ? static_cast<unsigned char>(code) : 0;
+}
+
+/**
+ * @brief Looks up the description of a code.
+ * @param code Request code (any byte value).
+ * @return Registry entry, or entry 0 ("Unknown") if the code is unknown.
+ */
+constexpr CodeInfo codeInfo(ReqCode code) {
+    return kCodes[codeSlot(code)];
+}
+
+/**
+ * @brief Whether a legacy request can be answered: its code has a legacy reply and the
+ *        request carries every parameter the code needs.
+ * @param code Request code (any byte value).
+ * @param params Parameters in the request.
+ * @return true if well-formed, false if it is dropped undispatched.
+ */
+constexpr bool legacyWellFormed(ReqCode code, size_t params) {
+    return codeInfo(code).legacy != ReplyKind::None && params >= codeInfo(code).arity;
+}
+
+/**
+ * @brief Size of the Ok reply body of a code, so clients can validate replies up front.
+ * @param code Request code.
+ * @return Body size in bytes, or -1 if it varies (MeasuureRTT echoes its payload) or the code
+ *         is unknown.
+ */
+constexpr int replyBodySize(ReqCode code) {
+    return codeInfo(code).body;
+}
+
+} // namespace wire
@@ -0,0 +1,239 @@
+/**
+ * @file admission.cpp
+ * @brief Implementation of the admission table (token buckets and reply byte credit).
+ *
+ * Buckets refill lazily on lookup from GetTickCount(), so idle sources cost nothing and there is
+ * no timer. Tokens and credit are kept in thousandths, so frequent lookups do not lose the
+ * fractional refill of short intervals.
+ * Compatible with C++14.
+ */
+#include "admission.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+static constexpr uint32_t kMilli = 1000;          // fixed-point scale of tokens and credit
+static constexpr int64_t kMaxCredit = 1 << 30;    // thousandths of a byte, keeps credit in int32
+
+/**
+ * @brief Name of a drop reason as used in metric labels.
+ * @param reason Drop reason.
+ * @return "rate", "amplification", "shed", "queue_full" or "malformed".
+ */
+const char* dropReasonName(DropReason reason) {
+    switch (reason) {
+    case DropReason::Rate: return "rate";
+    case DropReason::Amplification: return "amplification";
+    case DropReason::Shed: return "shed";
+    case DropReason::QueueFull: return "queue_full";
+    case DropReason::Malformed: return "malformed";
+    default: return "unknown";
+    }
+}
+
+/**
+ * @brief Parses "ADDR" or "ADDR/BITS" (IPv4 or IPv6 literal).
+ * @param text Prefix given on the command line.
+ * @param prefix Receives the prefix.
+ * @return true if the prefix is well formed, false otherwise.
+ */
+bool parseAddressPrefix(const std::string& text, AddressPrefix& prefix) {
+    size_t slash = text.find('/');
+    sockaddr_storage addr;
+    if (!resolveAddress(text.substr(0, slash), 0, AF_UNSPEC, addr)) return false;
+    bool v4 = addr.ss_family == AF_INET;
+    unsigned maxBits = v4 ? 32 : 128;
+    unsigned bits = maxBits;
+    if (slash != std::string::npos) {
+        std::string count = text.substr(slash + 1);
+        if (count.empty() || count.find_first_not_of("0123456789") != std::string::npos) return false;
+        bits = static_cast<unsigned>(std::strtoul(count.c_str(), nullptr, 10));
+        if (bits > maxBits) return false;
+    }
+    EndpointKey key = endpointKeyOf(addr);
+    prefix.hi = key.hi;
+    prefix.lo = key.lo;
+    prefix.bits = v4 ? bits + 96 : bits; // IPv4 keys are IPv4-mapped: 96 fixed bits in front
+    return true;
+}
+
+/**
+ * @brief Creates a table for the given settings.
+ * @param options Limits, table size and trusted prefixes.
+ */
+AdmissionControl::AdmissionControl(const AdmissionOptions& options)
+    : options_(options), burstTokens_(0), shift_(58), sets_(nullptr)
+{
+    static_assert(sizeof(Set) == 64, "a set must fill one cache line");
+    unsigned burst = options_.burst ? options_.burst : std::max(1u, options_.ratePps);
+    burstTokens_ = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(burst) * kMilli, UINT32_MAX));
+
+    size_t sets = 64; // 2^(64 - shift_)
+    while (sets * 2 < options_.tableSize) {
+        sets *= 2;
+        --shift_;
+    }
+    storage_.reset(new unsigned char[sets * sizeof(Set) + 63]);
+    uintptr_t base = (reinterpret_cast<uintptr_t>(storage_.get()) + 63) & ~static_cast<uintptr_t>(63);
+    sets_ = reinterpret_cast<Set*>(base);
+    for (size_t i = 0; i < sets; ++i) {
+        Set* set = new (&sets_[i]) Set();
+        set->lock.store(0, std::memory_order_relaxed);
+        for (Entry& entry : set->entries) entry.tag = 0;
+    }
+}
+
+/**
+ * @brief Whether a source is verified (exempt from the amplification cap).
+ * @param key Source key (port 0).
+ * @return true if it lies in a trusted prefix.
+ */
+bool AdmissionControl::trusted(const EndpointKey& key) const {
+    if (key.hi == 0 && (key.lo == 1 || (key.lo >> 24) == 0x0000FFFF7Full)) return true; // ::1, 127.0.0.0/8
+    for (const AddressPrefix& p : options_.trusted) {
+        if (p.bits == 0) return true;
+        if (p.bits <= 64) {
+            if (((key.hi ^ p.hi) >> (64 - p.bits)) == 0) return true;
+        }
+        else if (key.hi == p.hi && ((key.lo ^ p.lo) >> (128 - p.bits)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Locks a set (spins; contention only when two workers hit the same set).
+ * @param set Set to lock.
+ */
+void AdmissionControl::lock(Set& set) {
+    while (set.lock.exchange(1, std::memory_order_acquire) != 0) {
+        while (set.lock.load(std::memory_order_relaxed) != 0) std::this_thread::yield();
+    }
+}
+
+/**
+ * @brief Decides whether a datagram may be processed, before it is decoded.
+ * @param from Source address.
+ * @param len Datagram length.
+ * @param chargeKey Receives the key replies are charged to, or 0 if they are not charged.
+ * @param reason Receives why the datagram was dropped.
+ * @return true if admitted, false if it must be dropped.
+ */
+bool AdmissionControl::admit(const sockaddr_storage& from, size_t len, uint64_t& chargeKey, DropReason& reason) {
+    chargeKey = 0;
+    EndpointKey key = endpointKeyOf(from);
+    key.port_be = 0;
+    bool verified = options_.amplification == 0 || trusted(key);
+    if (options_.ratePps == 0 && verified) return true;
+
+    uint64_t hash = hashEndpoint(key);
+    uint64_t tag = hash | 1;
+    uint32_t now = static_cast<uint32_t>(GetTickCount());
+    int64_t allowance = static_cast<int64_t>(options_.allowanceBytes) * kMilli;
+    Set& set = setOf(hash);
+    lock(set);
+    Entry* entry = nullptr;
+    Entry* victim = &set.entries[0];
+    for (Entry& e : set.entries) {
+        if (e.tag == tag) { entry = &e; break; }
+        if (e.tag == 0 || (victim->tag != 0 && now - e.stampMs > now - victim->stampMs)) victim = &e;
+    }
+    if (!entry) {
+        // New (or evicted) source: a full bucket and the byte allowance
+        entry = victim;
+        entry->tag = tag;
+        entry->stampMs = now;
+        entry->tokens = burstTokens_;
+        entry->credit = static_cast<int32_t>(std::min(allowance, kMaxCredit));
+    }
+    refill(*entry, now);
+
+    bool admitted = true;
+    if (options_.ratePps > 0 && entry->tokens < kMilli) {
+        reason = DropReason::Rate;
+        admitted = false;
+    }
+    else if (!verified && entry->credit <= 0) {
+        reason = DropReason::Amplification;
+        admitted = false;
+    }
+    else {
+        if (options_.ratePps > 0) entry->tokens -= kMilli;
+        if (!verified) {
+            int64_t earned = static_cast<int64_t>(len) * options_.amplification * kMilli;
+            entry->credit = static_cast<int32_t>(std::min(entry->credit + earned, kMaxCredit));
+            chargeKey = tag;
+        }
+    }
+    unlock(set);
+    return admitted;
+}
+
+/**
+ * @brief Refills an entry's packet tokens and byte allowance for the time since its last refill.
+ * @param entry Entry (its set locked).
+ * @param now Current GetTickCount().
+ */
+void AdmissionControl::refill(Entry& entry, uint32_t now) const {
+    uint32_t elapsed = now - entry.stampMs;
+    if (elapsed == 0) return;
+    int64_t allowance = static_cast<int64_t>(options_.allowanceBytes) * kMilli;
+    entry.stampMs = now;
+    uint64_t tokens = entry.tokens + static_cast<uint64_t>(elapsed) * options_.ratePps;
+    entry.tokens = static_cast<uint32_t>(std::min<uint64_t>(tokens, burstTokens_));
+    if (entry.credit < allowance) {
+        int64_t credit = entry.credit + static_cast<int64_t>(elapsed) * options_.allowanceBytes;
+        entry.credit = static_cast<int32_t>(std::min(std::min(credit, allowance), kMaxCredit));
+    }
+}
+
+/**
+ * @brief Charges an unsolicited datagram (a subscriber tick) to the credit of its destination.
+ *
+ * Unlike charge(), nothing was received just before, so a destination without credit left, or
+ * no longer in the table, is refused rather than put in debt.
+ * @param to Destination address.
+ * @param bytes Datagram length.
+ * @return true if the datagram may be sent, false if the destination has no credit for it.
+ */
+bool AdmissionControl::spend(const sockaddr_storage& to, size_t bytes) {
+    EndpointKey key = endpointKeyOf(to);
+    key.port_be = 0;
+    if (options_.amplification == 0 || trusted(key)) return true;
+
+    uint64_t tag = hashEndpoint(key) | 1;
+    Set& set = setOf(tag);
+    bool allowed = false;
+    lock(set);
+    for (Entry& e : set.entries) {
+        if (e.tag != tag) continue;
+        refill(e, static_cast<uint32_t>(GetTickCount()));
+        if (e.credit > 0) {
+            e.credit = static_cast<int32_t>(std::max(e.credit - static_cast<int64_t>(bytes) * kMilli, -kMaxCredit));
+            allowed = true;
+        }
+        break;
+    }
+    unlock(set);
+    return allowed;
+}
+
+/**
+ * @brief Charges a reply against the byte credit of its source.
+ * @param chargeKey Key from admit() (non-zero).
+ * @param bytes Reply length.
+ */
+void AdmissionControl::charge(uint64_t chargeKey, size_t bytes) {
+    Set& set = setOf(chargeKey);
+    lock(set);
+    for (Entry& e : set.entries) {
+        if (e.tag != chargeKey) continue;
+        int64_t credit = e.credit - static_cast<int64_t>(bytes) * kMilli;
+        e.credit = static_cast<int32_t>(std::max(credit, -kMaxCredit));
+        break;
+    }
+    unlock(set);
+}
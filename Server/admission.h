@@ -0,0 +1,179 @@
+/**
+ * @file admission.h
+ * @brief Admission control in front of dispatch: per-source token buckets and an amplification guard.
+ *
+ * Every datagram is checked against the bucket of its source address (the port is ignored, so
+ * one host cannot multiply its budget over ports) before it is decoded. A source that is not
+ * trusted also has a byte credit: each admitted request earns amplification x its size, every
+ * reply is charged against it, and a small allowance refills it over time. A source in debt is
+ * dropped, so a spoofed victim receives little more than amplification x the attacker's bytes.
+ * Subscriber ticks are charged to the subscriber the same way (spend()), so one spoofed Subscribe
+ * cannot keep a victim receiving ticks beyond its credit.
+ *
+ * Sources live in a fixed, set-associative table of 64-byte sets (two entries each) keyed by
+ * hashEndpoint(), so a lookup touches one cache line and takes one uncontended spin lock.
+ * A set that is full evicts its least recently seen entry.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "lapstore.h"
+
+/**
+ * @brief Why a datagram was refused by admission control, shed under overload or rejected as malformed.
+ */
+enum class DropReason {
+    Rate,          /**< The source's packet bucket is empty. */
+    Amplification, /**< An unverified source has used up its reply byte credit. */
+    Shed,          /**< Dropped by the scheduler's CoDel after queuing too long (RequestScheduler). */
+    QueueFull,     /**< Refused, or evicted for a more important request, by a full scheduler queue. */
+    Malformed,     /**< Unknown code, or missing parameters for its code: rejected before dispatch. */
+    Count          /**< Number of reasons. */
+};
+
+/**
+ * @brief Name of a drop reason as used in metric labels.
+ * @param reason Drop reason.
+ * @return "rate", "amplification", "shed", "queue_full" or "malformed".
+ */
+const char* dropReasonName(DropReason reason);
+
+/**
+ * @brief IPv4 or IPv6 address prefix, held in the 128-bit form of EndpointKey.
+ */
+struct AddressPrefix {
+    uint64_t hi;   /**< Address bytes 0-7. */
+    uint64_t lo;   /**< Address bytes 8-15 (IPv4 prefixes are IPv4-mapped). */
+    unsigned bits; /**< Prefix length over the 128-bit form. */
+};
+
+/**
+ * @brief Parses "ADDR" or "ADDR/BITS" (IPv4 or IPv6 literal).
+ * @param text Prefix given on the command line.
+ * @param prefix Receives the prefix.
+ * @return true if the prefix is well formed, false otherwise.
+ */
+bool parseAddressPrefix(const std::string& text, AddressPrefix& prefix);
+
+/**
+ * @brief Admission control settings; all checks are off by default.
+ */
+struct AdmissionOptions {
+    unsigned ratePps = 0;          /**< Sustained packets per second per source (0 = no rate limit). */
+    unsigned burst = 0;            /**< Packets a source may send at once (0 = ratePps). */
+    unsigned amplification = 0;    /**< Reply bytes an unverified source earns per request byte (0 = no cap). */
+    unsigned allowanceBytes = 512; /**< Reply bytes per second, and at most, granted beyond the earned credit. */
+    size_t tableSize = 65536;      /**< Sources tracked (rounded up to a power of two). */
+    std::vector<AddressPrefix> trusted; /**< Verified sources, exempt from the amplification cap (loopback is always). */
+
+    /**
+     * @brief Whether any check is enabled.
+     * @return true if a rate or an amplification limit is set.
+     */
+    bool enabled() const { return ratePps > 0 || amplification > 0; }
+};
+
+/**
+ * @brief Shared admission table; admit() and charge() may be called from any worker.
+ */
+class AdmissionControl {
+public:
+    /**
+     * @brief Creates a table for the given settings.
+     * @param options Limits, table size and trusted prefixes.
+     */
+    explicit AdmissionControl(const AdmissionOptions& options);
+
+    /**
+     * @brief Decides whether a datagram may be processed, before it is decoded.
+     * @param from Source address.
+     * @param len Datagram length.
+     * @param chargeKey Receives the key replies are charged to, or 0 if they are not charged.
+     * @param reason Receives why the datagram was dropped.
+     * @return true if admitted, false if it must be dropped.
+     */
+    bool admit(const sockaddr_storage& from, size_t len, uint64_t& chargeKey, DropReason& reason);
+
+    /**
+     * @brief Charges a reply against the byte credit of its source.
+     * @param chargeKey Key from admit() (non-zero).
+     * @param bytes Reply length.
+     */
+    void charge(uint64_t chargeKey, size_t bytes);
+
+    /**
+     * @brief Charges an unsolicited datagram (a subscriber tick) to the credit of its destination.
+     * @param to Destination address.
+     * @param bytes Datagram length.
+     * @return true if the datagram may be sent, false if the destination has no credit for it.
+     */
+    bool spend(const sockaddr_storage& to, size_t bytes);
+
+private:
+    /**
+     * @brief One tracked source.
+     */
+    struct Entry {
+        uint64_t tag;     /**< Source hash with the low bit set (0 = free). */
+        uint32_t stampMs; /**< Last refill (GetTickCount). */
+        uint32_t tokens;  /**< Packet tokens, in thousandths. */
+        int32_t credit;   /**< Reply byte credit (negative = in debt). */
+        uint32_t unused;  /**< Padding. */
+    };
+
+    /**
+     * @brief One cache line: a spin lock and two entries.
+     */
+    struct Set {
+        std::atomic<uint32_t> lock; /**< 0 = free. */
+        uint32_t unused;            /**< Padding. */
+        Entry entries[2];           /**< Entries of the set. */
+        char pad[8];                /**< Fills the set to 64 bytes. */
+    };
+
+    /**
+     * @brief Whether a source is verified (exempt from the amplification cap).
+     * @param key Source key (port 0).
+     * @return true if it lies in a trusted prefix.
+     */
+    bool trusted(const EndpointKey& key) const;
+
+    /**
+     * @brief Refills an entry's packet tokens and byte allowance for the time since its last refill.
+     * @param entry Entry (its set locked).
+     * @param now Current GetTickCount().
+     */
+    void refill(Entry& entry, uint32_t now) const;
+
+    /**
+     * @brief Set of a source hash.
+     * @param hash Source hash.
+     * @return Set holding the source.
+     */
+    Set& setOf(uint64_t hash) { return sets_[hash >> shift_]; }
+
+    /**
+     * @brief Locks a set (spins; contention only when two workers hit the same set).
+     * @param set Set to lock.
+     */
+    static void lock(Set& set);
+
+    /**
+     * @brief Unlocks a set.
+     * @param set Set to unlock.
+     */
+    static void unlock(Set& set) { set.lock.store(0, std::memory_order_release); }
+
+    AdmissionOptions options_;              /**< Limits and trusted prefixes. */
+    uint32_t burstTokens_;                  /**< Bucket size, in thousandths. */
+    unsigned shift_;                        /**< 64 - log2(set count). */
+    std::unique_ptr<unsigned char[]> storage_; /**< Set storage, over-allocated for alignment. */
+    Set* sets_;                             /**< Sets, aligned to 64 bytes. */
+};
@@ -0,0 +1,136 @@
+/**
+ * @file affinity.cpp
+ * @brief Implementation of CPU pinning, NUMA-local allocation and socket steering.
+ * Compatible with C++14.
+ */
+#include "affinity.h"
+#include <mstcpip.h>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef SIO_CPU_AFFINITY
+#define SIO_CPU_AFFINITY _WSAIOW(IOC_VENDOR, 21)
+#endif
+
+/**
+ * @brief Parses a CPU list such as "0,2,4-7".
+ * @param text List given on the command line.
+ * @param cpus Receives the CPUs in list order.
+ * @return true if the list is well formed and not empty, false otherwise.
+ */
+bool parseCpuList(const std::string& text, std::vector<unsigned>& cpus) {
+    cpus.clear();
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t comma = text.find(',', pos);
+        std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        size_t dash = item.find('-');
+        std::string first = item.substr(0, dash);
+        std::string last = (dash == std::string::npos) ? first : item.substr(dash + 1);
+        if (first.empty() || last.empty() || first.find_first_not_of("0123456789") != std::string::npos ||
+            last.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        unsigned from = static_cast<unsigned>(std::strtoul(first.c_str(), nullptr, 10));
+        unsigned to = static_cast<unsigned>(std::strtoul(last.c_str(), nullptr, 10));
+        if (to < from || to - from > 4096) return false;
+        for (unsigned cpu = from; cpu <= to; ++cpu) cpus.push_back(cpu);
+        if (comma == std::string::npos) break;
+        pos = comma + 1;
+    }
+    return !cpus.empty();
+}
+
+/**
+ * @brief Converts a dense CPU index to its processor group and number.
+ * @param cpu Dense CPU index.
+ * @param number Receives the group and the number within the group.
+ * @return true if the CPU exists, false otherwise.
+ */
+static bool processorOf(unsigned cpu, PROCESSOR_NUMBER& number) {
+    WORD groups = GetActiveProcessorGroupCount();
+    for (WORD group = 0; group < groups; ++group) {
+        DWORD count = GetActiveProcessorCount(group);
+        if (cpu < count) {
+            number.Group = group;
+            number.Number = static_cast<BYTE>(cpu);
+            number.Reserved = 0;
+            return true;
+        }
+        cpu -= count;
+    }
+    return false;
+}
+
+/**
+ * @brief Number of active logical CPUs over all processor groups.
+ * @return CPU count.
+ */
+unsigned cpuCount() {
+    return static_cast<unsigned>(GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+}
+
+/**
+ * @brief Pins the calling thread to one CPU and makes it the thread's ideal processor.
+ * @param cpu Dense CPU index.
+ * @return true on success, false if the CPU does not exist or the call failed.
+ */
+bool pinCurrentThread(unsigned cpu) {
+    PROCESSOR_NUMBER number;
+    if (!processorOf(cpu, number)) return false;
+    GROUP_AFFINITY affinity;
+    memset(&affinity, 0, sizeof(affinity));
+    affinity.Group = number.Group;
+    affinity.Mask = static_cast<KAFFINITY>(1) << number.Number;
+    HANDLE thread = GetCurrentThread();
+    if (!SetThreadGroupAffinity(thread, &affinity, NULL)) return false;
+    SetThreadIdealProcessorEx(thread, &number, NULL);
+    return true;
+}
+
+/**
+ * @brief NUMA node of a CPU.
+ * @param cpu Dense CPU index.
+ * @return Node number, or -1 if unknown.
+ */
+int numaNodeOfCpu(unsigned cpu) {
+    PROCESSOR_NUMBER number;
+    USHORT node = 0;
+    if (!processorOf(cpu, number) || !GetNumaProcessorNodeEx(&number, &node)) return -1;
+    return static_cast<int>(node);
+}
+
+/**
+ * @brief Allocates zeroed, page-aligned memory, preferably on a NUMA node.
+ * @param bytes Size in bytes.
+ * @param node Preferred node, or -1 for the default policy.
+ * @return Memory to release with freeNodeMemory(), or null on failure.
+ */
+void* allocOnNode(size_t bytes, int node) {
+    if (node >= 0) {
+        void* memory = VirtualAllocExNuma(GetCurrentProcess(), NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE,
+                                          static_cast<DWORD>(node));
+        if (memory) return memory;
+    }
+    return VirtualAlloc(NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+/**
+ * @brief Releases memory from allocOnNode().
+ * @param memory Memory to release (may be null).
+ */
+void freeNodeMemory(void* memory) {
+    if (memory) VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+/**
+ * @brief Asks the stack to process a socket's traffic on one CPU (SIO_CPU_AFFINITY).
+ * @param sock Socket.
+ * @param cpu Dense CPU index.
+ * @return true on success, false if the stack refused (e.g. no RSS).
+ */
+bool steerSocketToCpu(SOCKET sock, unsigned cpu) {
+    USHORT processor = static_cast<USHORT>(cpu);
+    DWORD bytes = 0;
+    return 0 == WSAIoctl(sock, SIO_CPU_AFFINITY, &processor, sizeof(processor), NULL, 0, &bytes, NULL, NULL);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file affinity.h
+ * @brief CPU pinning, NUMA-local allocation and socket-to-CPU steering for the server workers.
+ *
+ * CPUs are numbered densely across processor groups (group 0 first), the way they are listed
+ * on the command line. A worker pinned to a CPU allocates its state on that CPU's NUMA node and,
+ * if steering is asked for, has its socket's receive processing moved to the same CPU
+ * (SIO_CPU_AFFINITY, the Windows counterpart of SO_INCOMING_CPU), so a packet is received,
+ * decoded and answered without crossing cores or sockets.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h>
+#include <windows.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Parses a CPU list such as "0,2,4-7".
+ * @param text List given on the command line.
+ * @param cpus Receives the CPUs in list order.
+ * @return true if the list is well formed and not empty, false otherwise.
+ */
+bool parseCpuList(const std::string& text, std::vector<unsigned>& cpus);
+
+/**
+ * @brief Number of active logical CPUs over all processor groups.
+ * @return CPU count.
+ */
+unsigned cpuCount();
+
+/**
+ * @brief Pins the calling thread to one CPU and makes it the thread's ideal processor.
+ * @param cpu Dense CPU index.
+ * @return true on success, false if the CPU does not exist or the call failed.
+ */
+bool pinCurrentThread(unsigned cpu);
+
+/**
+ * @brief NUMA node of a CPU.
+ * @param cpu Dense CPU index.
+ * @return Node number, or -1 if unknown.
+ */
+int numaNodeOfCpu(unsigned cpu);
+
+/**
+ * @brief Allocates zeroed, page-aligned memory, preferably on a NUMA node.
+ * @param bytes Size in bytes.
+ * @param node Preferred node, or -1 for the default policy.
+ * @return Memory to release with freeNodeMemory(), or null on failure.
+ */
+void* allocOnNode(size_t bytes, int node);
+
+/**
+ * @brief Releases memory from allocOnNode().
+ * @param memory Memory to release (may be null).
+ */
+void freeNodeMemory(void* memory);
+
+/**
+ * @brief Asks the stack to process a socket's traffic on one CPU (SIO_CPU_AFFINITY).
+ * @param sock Socket.
+ * @param cpu Dense CPU index.
+ * @return true on success, false if the stack refused (e.g. no RSS).
+ */
+bool steerSocketToCpu(SOCKET sock, unsigned cpu);
@@ -0,0 +1,222 @@
+/**
+ * @file batchdecode.cpp
+ * @brief Implementation of the batch decoder.
+ *
+ * SSE2 is part of every x64 CPU, so x64 (and x86) builds always take the vector paths; other
+ * targets fall back to byte compares with the same results. The dispatch order is a
+ * counting sort over (priority, code), which keeps arrival order within a group.
+ * Compatible with C++14.
+ */
+#include "batchdecode.h"
+#include <algorithm>
+#include <cstring>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TIMESERVER_SSE2 1
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static constexpr unsigned kLanes = 16; // bytes per SSE2 compare
+static constexpr size_t kGroups = 3 * wire::kCodeCount + 1; // (priority, code) pairs, and the stateful group
+static constexpr size_t kStatefulGroup = static_cast<size_t>(wire::Priority::Normal) * wire::kCodeCount;
+
+/**
+ * @brief Dispatch group of a code slot.
+ *
+ * Codes that touch per-client state (laps, subscriptions) and batches, which may carry them,
+ * share one group in arrival order, so a client's Unsubscribe then Subscribe, or its Batch then
+ * MeasureTimeLap, run as sent. The group sits at the head of the Normal band; every other code
+ * has a group of its own.
+ * @param slot Code slot.
+ * @return Group index below kGroups.
+ */
+static inline size_t groupOf(size_t slot) {
+    const wire::CodeInfo& info = wire::kCodes[slot];
+    if (info.cache == wire::Cacheability::Client || info.code == ReqCode::Batch) return kStatefulGroup;
+    size_t group = static_cast<size_t>(info.priority) * wire::kCodeCount + slot;
+    return (group >= kStatefulGroup) ? group + 1 : group;
+}
+
+/**
+ * @brief Index of the lowest set bit.
+ * @param mask Non-zero mask.
+ * @return Bit index.
+ */
+static inline unsigned lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+/**
+ * @brief Bit mask of the null bytes among 16 bytes.
+ * @param data First byte (16 readable bytes).
+ * @return Bit i set if data[i] is 0.
+ */
+static inline unsigned nullMask(const char* data) {
+#ifdef TIMESERVER_SSE2
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_setzero_si128())));
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < kLanes; ++i) mask |= (data[i] == 0 ? 1u : 0u) << i;
+    return mask;
+#endif
+}
+
+/**
+ * @brief Creates a decoder.
+ * @param capacity Largest batch decoded at once.
+ * @param maxParams Parameters kept per datagram (further ones are ignored).
+ */
+BatchDecoder::BatchDecoder(unsigned capacity, size_t maxParams)
+    : maxParams_(std::max<size_t>(1, maxParams)), codes_(capacity), flags_(capacity), paramCounts_(capacity),
+      params_(static_cast<size_t>(capacity) * maxParams_), malformed_(0)
+{
+    order_.reserve(capacity);
+}
+
+/**
+ * @brief Decodes a batch; the results stay valid until the next call.
+ * @param batch Datagrams (their bytes must stay valid while the results are used).
+ * @param n Number of datagrams (the arrays grow if it exceeds the capacity).
+ */
+void BatchDecoder::decode(const BatchIo::Datagram* batch, unsigned n) {
+    if (n > codes_.size()) {
+        codes_.resize(n);
+        flags_.resize(n);
+        paramCounts_.resize(n);
+        params_.resize(static_cast<size_t>(n) * maxParams_);
+    }
+    for (unsigned first = 0; first < n; first += kLanes) {
+        classify(batch, first, std::min(kLanes, n - first));
+    }
+
+    size_t starts[kGroups + 1] = {};
+    malformed_ = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        if (flags_[i] & kMalformed) {
+            ++malformed_;
+            continue;
+        }
+        ++starts[groupOf(wire::codeSlot(codes_[i])) + 1];
+    }
+    for (size_t g = 1; g <= kGroups; ++g) starts[g] += starts[g - 1];
+    order_.resize(n - malformed_);
+    for (unsigned i = 0; i < n; ++i) {
+        if (flags_[i] & kMalformed) continue;
+        order_[starts[groupOf(wire::codeSlot(codes_[i]))]++] = i;
+    }
+}
+
+/**
+ * @brief Sets the code and flags of datagrams [first, first + count) from their first bytes.
+ *
+ * One compare classifies the whole group: a byte whose high nibble is the marker starts a
+ * binary frame, and a byte in 1..kCodeCount-1 is a registered legacy code. Bytes from 0x80 up
+ * are negative as signed chars, so the greater-than-zero test excludes them.
+ * @param batch Datagrams.
+ * @param first First datagram.
+ * @param count Datagrams (at most 16).
+ */
+void BatchDecoder::classify(const BatchIo::Datagram* batch, unsigned first, unsigned count) {
+    alignas(16) char lead[kLanes] = {}; // Empty datagrams read as 0, an unknown code
+    for (unsigned j = 0; j < count; ++j) {
+        if (batch[first + j].len > 0) lead[j] = batch[first + j].data[0];
+    }
+    unsigned binaryMask = 0;
+    unsigned knownMask = 0;
+#ifdef TIMESERVER_SSE2
+    __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(lead));
+    __m128i marker = _mm_and_si128(bytes, _mm_set1_epi8(static_cast<char>(0xF0)));
+    binaryMask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(marker, _mm_set1_epi8(static_cast<char>(wire::kBinaryMarker)))));
+    __m128i known = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_setzero_si128()),
+                                  _mm_cmplt_epi8(bytes, _mm_set1_epi8(static_cast<char>(wire::kCodeCount))));
+    knownMask = static_cast<unsigned>(_mm_movemask_epi8(known));
+#else
+    for (unsigned j = 0; j < count; ++j) {
+        if (wire::isBinary(lead[j])) binaryMask |= 1u << j;
+        signed char byte = static_cast<signed char>(lead[j]);
+        if (byte > 0 && static_cast<size_t>(byte) < wire::kCodeCount) knownMask |= 1u << j;
+    }
+#endif
+
+    for (unsigned j = 0; j < count; ++j) {
+        unsigned i = first + j;
+        const BatchIo::Datagram& datagram = batch[i];
+        size_t len = static_cast<size_t>(datagram.len);
+        codes_[i] = ReqCode::Error;
+        paramCounts_[i] = 0;
+        if (binaryMask & (1u << j)) {
+            // Any code is answered, unknown ones with a status; only a cut header is unanswerable
+            flags_[i] = (len < wire::kHeaderSize) ? (kBinary | kMalformed) : kBinary;
+            if (len >= wire::kHeaderSize) codes_[i] = static_cast<ReqCode>(datagram.data[1]);
+            continue;
+        }
+        flags_[i] = kMalformed;
+        if (!(knownMask & (1u << j))) continue;
+        ReqCode code = static_cast<ReqCode>(lead[j]);
+        if (wire::codeInfo(code).legacy == wire::ReplyKind::None) continue;
+        size_t params = scanParams(datagram.data, len, &params_[static_cast<size_t>(i) * maxParams_]);
+        if (!wire::legacyWellFormed(code, params)) continue;
+        codes_[i] = code;
+        flags_[i] = 0;
+        paramCounts_[i] = static_cast<uint8_t>(params);
+    }
+}
+
+/**
+ * @brief Finds the parameters of a legacy datagram.
+ *
+ * Whole 16-byte blocks are compared at once and their null bytes walked as a bit mask. The
+ * tail shorter than a block is covered by one more load ending at the last byte, with the
+ * bytes already seen masked off; datagrams too short for that are checked byte by byte. No
+ * load reads past the datagram.
+ * @param data Datagram bytes.
+ * @param len Datagram length.
+ * @param out Receives up to maxParams_ spans.
+ * @return Number of parameters.
+ */
+size_t BatchDecoder::scanParams(const char* data, size_t len, ParamSpan* out) const {
+    size_t count = 0;
+    size_t at = 1;
+    for (; at + kLanes <= len; at += kLanes) {
+        for (unsigned mask = nullMask(data + at); mask != 0; mask &= mask - 1) {
+            if (!separator(at + lowestBit(mask), len, out, count)) return count;
+        }
+    }
+    if (at < len && len >= kLanes + 1) {
+        size_t base = len - kLanes;
+        for (unsigned mask = nullMask(data + base) >> (at - base) << (at - base); mask != 0; mask &= mask - 1) {
+            if (!separator(base + lowestBit(mask), len, out, count)) return count;
+        }
+        return count;
+    }
+    for (; at < len; ++at) {
+        if (data[at] == 0 && !separator(at, len, out, count)) return count;
+    }
+    return count;
+}
+
+/**
+ * @brief Handles one null byte: ends the open parameter and opens the next one.
+ * @param at Position of the null byte.
+ * @param len Datagram length.
+ * @param out Parameter spans.
+ * @param count Parameters so far, updated in place.
+ * @return false once no further parameter can be opened (the scan may stop).
+ */
+bool BatchDecoder::separator(size_t at, size_t len, ParamSpan* out, size_t& count) const {
+    if (count > 0 && out[count - 1].offset + out[count - 1].len == len) {
+        out[count - 1].len = static_cast<uint16_t>(at - out[count - 1].offset);
+    }
+    if (at + 1 >= len || count >= maxParams_) return false;
+    out[count++] = ParamSpan{ static_cast<uint16_t>(at + 1), static_cast<uint16_t>(len - at - 1) };
+    return true;
+}
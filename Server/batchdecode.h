@@ -0,0 +1,133 @@
+/**
+ * @file batchdecode.h
+ * @brief Decodes a whole receive batch at once into a structure of arrays.
+ *
+ * The batched loop hands every admitted datagram of a receive to BatchDecoder::decode(). The
+ * first bytes of sixteen datagrams at a time are classified with SSE2 (binary marker, known
+ * legacy code), the null separators of each legacy datagram are found sixteen bytes per
+ * compare, and malformed datagrams (unknown legacy codes, codes without a legacy reply, a city
+ * request without its city, a truncated binary header) are marked before anything is
+ * dispatched. The result keeps one entry per datagram in parallel arrays: code, flags and the
+ * offsets of up to maxParams parameters, plus an order in which the well-formed datagrams are
+ * grouped by code, timing probes first, so dispatch runs the same handler back to back. Codes
+ * with per-client state (laps, subscriptions) and batches are not regrouped: they form one
+ * group in arrival order, so no client sees its stateful requests reordered.
+ *
+ * Parameters follow TimeServer::decode(): each '\0' after the code byte that is not the last
+ * byte starts one, which runs up to the next '\0'. Builds without SSE2 compare byte by byte.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "batchio.h"
+#include "../Common/protocol.h"
+
+/**
+ * @brief Location of one legacy parameter inside its datagram.
+ */
+struct ParamSpan {
+    uint16_t offset;   /**< First byte, counted from the start of the datagram. */
+    uint16_t len;      /**< Length in bytes. */
+};
+
+/**
+ * @brief Batch decoder owned by one worker; its arrays are reused from batch to batch.
+ */
+class BatchDecoder {
+public:
+    static constexpr uint8_t kBinary = 0x01;    /**< Flag: binary framing (code is the header's). */
+    static constexpr uint8_t kMalformed = 0x02; /**< Flag: rejected, not to be dispatched. */
+
+    /**
+     * @brief Creates a decoder.
+     * @param capacity Largest batch decoded at once.
+     * @param maxParams Parameters kept per datagram (further ones are ignored).
+     */
+    BatchDecoder(unsigned capacity, size_t maxParams);
+
+    /**
+     * @brief Decodes a batch; the results stay valid until the next call.
+     * @param batch Datagrams (their bytes must stay valid while the results are used).
+     * @param n Number of datagrams (the arrays grow if it exceeds the capacity).
+     */
+    void decode(const BatchIo::Datagram* batch, unsigned n);
+
+    /**
+     * @brief Request code of a datagram (Error if malformed).
+     * @param i Datagram index.
+     * @return Code byte of a legacy datagram, header code of a binary one.
+     */
+    ReqCode code(unsigned i) const { return codes_[i]; }
+
+    /**
+     * @brief Flags of a datagram.
+     * @param i Datagram index.
+     * @return kBinary and/or kMalformed.
+     */
+    uint8_t flags(unsigned i) const { return flags_[i]; }
+
+    /**
+     * @brief Number of legacy parameters found in a datagram.
+     * @param i Datagram index.
+     * @return Parameter count (0 for binary datagrams).
+     */
+    size_t paramCount(unsigned i) const { return paramCounts_[i]; }
+
+    /**
+     * @brief Parameters of a datagram.
+     * @param i Datagram index.
+     * @return paramCount(i) spans.
+     */
+    const ParamSpan* params(unsigned i) const { return &params_[static_cast<size_t>(i) * maxParams_]; }
+
+    /**
+     * @brief Well-formed datagrams grouped by priority, then code (stateful codes together, in
+     *        arrival order); arrival order within a group.
+     * @return Datagram indices.
+     */
+    const std::vector<uint32_t>& order() const { return order_; }
+
+    /**
+     * @brief Datagrams of the last batch marked kMalformed.
+     * @return Count.
+     */
+    unsigned malformed() const { return malformed_; }
+
+private:
+    /**
+     * @brief Sets the code and flags of datagrams [first, first + count) from their first bytes.
+     * @param batch Datagrams.
+     * @param first First datagram.
+     * @param count Datagrams (at most 16).
+     */
+    void classify(const BatchIo::Datagram* batch, unsigned first, unsigned count);
+
+    /**
+     * @brief Finds the parameters of a legacy datagram.
+     * @param data Datagram bytes.
+     * @param len Datagram length.
+     * @param out Receives up to maxParams_ spans.
+     * @return Number of parameters.
+     */
+    size_t scanParams(const char* data, size_t len, ParamSpan* out) const;
+
+    /**
+     * @brief Handles one null byte: ends the open parameter and opens the next one.
+     * @param at Position of the null byte.
+     * @param len Datagram length.
+     * @param out Parameter spans.
+     * @param count Parameters so far, updated in place.
+     * @return false once no further parameter can be opened (the scan may stop).
+     */
+    bool separator(size_t at, size_t len, ParamSpan* out, size_t& count) const;
+
+    size_t maxParams_;                 /**< Parameter stride of params_. */
+    std::vector<ReqCode> codes_;       /**< Per datagram: code. */
+    std::vector<uint8_t> flags_;       /**< Per datagram: kBinary, kMalformed. */
+    std::vector<uint8_t> paramCounts_; /**< Per datagram: parameters found. */
+    std::vector<ParamSpan> params_;    /**< Per datagram: maxParams_ spans. */
+    std::vector<uint32_t> order_;      /**< Dispatch order of the well-formed datagrams. */
+    unsigned malformed_;               /**< Malformed datagrams of the last batch. */
+};
@@ -0,0 +1,331 @@
+/**
+ * @file batchio.cpp
+ * @brief Implementation of the Registered I/O batched datagram backend.
+ *
+ * One registered memory region holds four areas: receive slots, send slots and the matching
+ * address slots, plus a control slot per receive when receive stamps are on. Address slots are sockaddr_storage sized so a received address can be used as
+ * one; RIO reads and writes the SOCKADDR_INET at their start. Receives complete on an event-notified completion queue, sends
+ * on a separate, polled one so their slots can be reclaimed without blocking.
+ * Compatible with C++14.
+ */
+#include "batchio.h"
+#include "utils.h"
+#include "affinity.h"
+#include <chrono>
+
+static constexpr unsigned kSendStallUs = 1000; // longest wait for a send slot before a reply is dropped
+
+/**
+ * @brief Constructs an unopened backend.
+ */
+BatchIo::BatchIo()
+    : recvCq_(RIO_INVALID_CQ), sendCq_(RIO_INVALID_CQ), rq_(RIO_INVALID_RQ),
+      bufferId_(RIO_INVALID_BUFFERID), event_(NULL), memory_(nullptr),
+      depth_(0), slotSize_(0), deferred_(false), sendStalled_(false), stamps_(false), spinUs_(0), woken_(false)
+{
+    memset(&rio_, 0, sizeof(rio_));
+}
+
+/**
+ * @brief Destructor. Releases RIO queues and registered memory.
+ */
+BatchIo::~BatchIo() {
+    close();
+}
+
+/**
+ * @brief Creates a UDP socket suitable for Registered I/O.
+ * @return Socket created with WSA_FLAG_REGISTERED_IO, or INVALID_SOCKET on error.
+ *         It is also overlapped, so the reactor can serve it if RIO setup fails.
+ * @param family AF_INET or AF_INET6.
+ */
+SOCKET BatchIo::createSocket(int family) {
+    return WSASocket(family, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+}
+
+/**
+ * @brief Loads the RIO function table, registers the buffer ring and posts all receives.
+ * @param sock Bound socket created by createSocket().
+ * @param depth Number of receive slots (and send slots) in the ring.
+ * @param slotSize Size of one datagram slot in bytes.
+ * @param node NUMA node to place the buffer ring on, or -1 for the default policy.
+ * @param receiveStamps Also receive the control messages, so datagrams carry their stack
+ *        receive stamp (the socket must have them enabled, see enableReceiveStamps()).
+ * @return true on success, false if RIO is unavailable or setup failed.
+ */
+bool BatchIo::open(SOCKET sock, unsigned depth, unsigned slotSize, int node, bool receiveStamps) {
+    GUID rioId = WSAID_MULTIPLE_RIO;
+    DWORD bytes = 0;
+    rio_.cbSize = sizeof(rio_);
+    if (0 != WSAIoctl(sock, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &rioId, sizeof(rioId),
+                      &rio_, sizeof(rio_), &bytes, NULL, NULL)) {
+        logError("WSAIoctl(RIO)");
+        return false;
+    }
+    depth_ = depth;
+    slotSize_ = slotSize;
+    stamps_ = receiveStamps;
+
+    size_t dataBytes = static_cast<size_t>(depth_) * slotSize_;
+    size_t addrBytes = static_cast<size_t>(depth_) * sizeof(sockaddr_storage);
+    size_t total = stamps_ ? controlOffset(depth_) : 2 * dataBytes + 2 * addrBytes;
+    memory_ = static_cast<char*>(allocOnNode(total, node));
+    if (!memory_) {
+        logError("VirtualAlloc");
+        return false;
+    }
+    bufferId_ = rio_.RIORegisterBuffer(memory_, static_cast<DWORD>(total));
+    if (RIO_INVALID_BUFFERID == bufferId_) {
+        logError("RIORegisterBuffer");
+        close();
+        return false;
+    }
+
+    event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    RIO_NOTIFICATION_COMPLETION notify;
+    memset(&notify, 0, sizeof(notify));
+    notify.Type = RIO_EVENT_COMPLETION;
+    notify.Event.EventHandle = event_;
+    notify.Event.NotifyReset = TRUE;
+    recvCq_ = rio_.RIOCreateCompletionQueue(depth_, &notify);
+    sendCq_ = rio_.RIOCreateCompletionQueue(depth_, NULL);
+    if (RIO_INVALID_CQ == recvCq_ || RIO_INVALID_CQ == sendCq_) {
+        logError("RIOCreateCompletionQueue");
+        close();
+        return false;
+    }
+    rq_ = rio_.RIOCreateRequestQueue(sock, depth_, 1, depth_, 1, recvCq_, sendCq_, NULL);
+    if (RIO_INVALID_RQ == rq_) {
+        logError("RIOCreateRequestQueue");
+        close();
+        return false;
+    }
+
+    for (unsigned slot = 0; slot < depth_; ++slot) {
+        if (!postReceive(slot)) {
+            close();
+            return false;
+        }
+        freeSend_.push_back(slot);
+    }
+    pending_.reserve(depth_);
+    results_.resize(depth_);
+    rio_.RIOReceive(rq_, NULL, 0, RIO_MSG_COMMIT_ONLY, NULL);
+    return true;
+}
+
+/**
+ * @brief Releases RIO queues and registered memory.
+ */
+void BatchIo::close() {
+    if (RIO_INVALID_CQ != recvCq_) rio_.RIOCloseCompletionQueue(recvCq_);
+    if (RIO_INVALID_CQ != sendCq_) rio_.RIOCloseCompletionQueue(sendCq_);
+    recvCq_ = sendCq_ = RIO_INVALID_CQ;
+    rq_ = RIO_INVALID_RQ; // released together with the socket
+    if (RIO_INVALID_BUFFERID != bufferId_) rio_.RIODeregisterBuffer(bufferId_);
+    bufferId_ = RIO_INVALID_BUFFERID;
+    freeNodeMemory(memory_);
+    memory_ = nullptr;
+    if (event_) CloseHandle(event_);
+    event_ = NULL;
+    pending_.clear();
+    freeSend_.clear();
+    results_.clear();
+}
+
+/**
+ * @brief Posts (deferred) a receive on the given slot.
+ * @param slot Receive slot index.
+ * @return true on success, false on error.
+ */
+bool BatchIo::postReceive(unsigned slot) {
+    size_t dataBytes = static_cast<size_t>(depth_) * slotSize_;
+    RIO_BUF data;
+    data.BufferId = bufferId_;
+    data.Offset = static_cast<ULONG>(static_cast<size_t>(slot) * slotSize_);
+    data.Length = slotSize_;
+    RIO_BUF addr;
+    addr.BufferId = bufferId_;
+    addr.Offset = static_cast<ULONG>(2 * dataBytes + static_cast<size_t>(slot) * sizeof(sockaddr_storage));
+    addr.Length = sizeof(SOCKADDR_INET);
+    RIO_BUF control;
+    if (stamps_) {
+        // Zeroed, so receive() finds the stamp by walking the slot (RIO reports no length)
+        size_t offset = controlOffset(slot);
+        memset(memory_ + offset, 0, kStampControlBytes);
+        control.BufferId = bufferId_;
+        control.Offset = static_cast<ULONG>(offset);
+        control.Length = static_cast<ULONG>(kStampControlBytes);
+    }
+    if (!rio_.RIOReceiveEx(rq_, &data, 1, NULL, &addr, stamps_ ? &control : NULL, NULL, RIO_MSG_DEFER,
+                           reinterpret_cast<PVOID>(static_cast<ULONG_PTR>(slot)))) {
+        logError("RIOReceiveEx");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Blocks until at least one datagram arrives, then drains up to max of them.
+ * @param out Array receiving the datagrams.
+ * @param max Capacity of out.
+ * @param wait false to only take what has already arrived, without polling or sleeping.
+ * @return Number of datagrams stored in out (0 after wake(), or if nothing arrived and !wait).
+ */
+unsigned BatchIo::receive(Datagram* out, unsigned max, bool wait) {
+    if (max > depth_) max = depth_;
+    RIORESULT* results = results_.data();
+    ULONG n = 0;
+    if (!wait) {
+        n = rio_.RIODequeueCompletion(recvCq_, results, max);
+    }
+    else {
+        if (spinUs_ > 0 && 0 == (n = rio_.RIODequeueCompletion(recvCq_, results, max))) {
+            // Poll mode: RIODequeueCompletion only reads shared memory, so spinning costs no
+            // system calls; the clock is read once every 64 empty polls
+            using clock = std::chrono::steady_clock;
+            clock::time_point deadline = clock::now() + std::chrono::microseconds(spinUs_);
+            unsigned polls = 0;
+            while (0 == (n = rio_.RIODequeueCompletion(recvCq_, results, max))) {
+                if (woken_.load(std::memory_order_relaxed)) return 0;
+                if ((++polls & 63) == 0 && clock::now() >= deadline) break;
+                YieldProcessor();
+            }
+        }
+        while (0 == n && 0 == (n = rio_.RIODequeueCompletion(recvCq_, results, max))) {
+            if (woken_.load()) return 0;
+            rio_.RIONotify(recvCq_);
+            WaitForSingleObject(event_, INFINITE);
+        }
+    }
+    if (RIO_CORRUPT_CQ == n) {
+        logError("RIODequeueCompletion");
+        return 0;
+    }
+
+    size_t dataBytes = static_cast<size_t>(depth_) * slotSize_;
+    unsigned count = 0;
+    for (ULONG i = 0; i < n; ++i) {
+        unsigned slot = static_cast<unsigned>(results[i].RequestContext);
+        pending_.push_back(slot); // re-posted by flush() even if the receive failed
+        if (0 != results[i].Status) continue;
+        out[count].data = memory_ + static_cast<size_t>(slot) * slotSize_;
+        out[count].len = static_cast<int>(results[i].BytesTransferred);
+        out[count].addr = &reinterpret_cast<const sockaddr_storage*>(memory_ + 2 * dataBytes)[slot];
+        out[count].stamp = stamps_ ? findReceiveStamp(memory_ + controlOffset(slot), kStampControlBytes) : 0;
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * @brief Makes a blocked receive() (and every later one that finds nothing) return 0.
+ */
+void BatchIo::wake() {
+    woken_.store(true);
+    if (event_) SetEvent(event_);
+}
+
+/**
+ * @brief Reclaims send slots whose transmission has completed.
+ */
+void BatchIo::reapSends() {
+    RIORESULT results[64];
+    ULONG n = 0;
+    while ((n = rio_.RIODequeueCompletion(sendCq_, results, 64)) > 0 && RIO_CORRUPT_CQ != n) {
+        for (ULONG i = 0; i < n; ++i) {
+            freeSend_.push_back(static_cast<unsigned>(results[i].RequestContext));
+        }
+        sendStalled_ = false;
+    }
+}
+
+/**
+ * @brief Queues a reply in a free send slot; it is transmitted by flush().
+ *
+ * With every slot in flight it commits and polls the send completions for at most
+ * kSendStallUs. If none completes, the reply is dropped, and later replies are dropped
+ * without waiting until a send completes again, so a stalled queue cannot pin the worker.
+ * @param data Reply bytes.
+ * @param len Reply length (at most the slot size).
+ * @param addr Destination address (IPv4 or IPv6).
+ * @return true if queued, false if the reply is too large, no send slot freed up or sending failed.
+ */
+bool BatchIo::queueSend(const char* data, int len, const sockaddr_storage& addr) {
+    if (len < 0 || static_cast<unsigned>(len) > slotSize_) return false;
+    if (freeSend_.empty()) {
+        commitSends(); // push out what is queued so its slots can complete
+        reapSends();
+        if (freeSend_.empty() && !sendStalled_) {
+            using clock = std::chrono::steady_clock;
+            clock::time_point deadline = clock::now() + std::chrono::microseconds(kSendStallUs);
+            unsigned polls = 0;
+            while (freeSend_.empty() && ((++polls & 63) != 0 || clock::now() < deadline)) {
+                YieldProcessor();
+                reapSends();
+            }
+            sendStalled_ = freeSend_.empty();
+        }
+        if (freeSend_.empty()) return false;
+    }
+    unsigned slot = freeSend_.back();
+    freeSend_.pop_back();
+
+    size_t dataBytes = static_cast<size_t>(depth_) * slotSize_;
+    size_t dataOff = dataBytes + static_cast<size_t>(slot) * slotSize_;
+    size_t addrOff = 2 * dataBytes + static_cast<size_t>(depth_ + slot) * sizeof(sockaddr_storage);
+    memcpy(memory_ + dataOff, data, len);
+    SOCKADDR_INET* dst = reinterpret_cast<SOCKADDR_INET*>(memory_ + addrOff);
+    memset(dst, 0, sizeof(*dst));
+    if (addr.ss_family == AF_INET6) dst->Ipv6 = reinterpret_cast<const sockaddr_in6&>(addr);
+    else dst->Ipv4 = reinterpret_cast<const sockaddr_in&>(addr);
+
+    RIO_BUF buf;
+    buf.BufferId = bufferId_;
+    buf.Offset = static_cast<ULONG>(dataOff);
+    buf.Length = static_cast<ULONG>(len);
+    RIO_BUF remote;
+    remote.BufferId = bufferId_;
+    remote.Offset = static_cast<ULONG>(addrOff);
+    remote.Length = sizeof(SOCKADDR_INET);
+    if (!rio_.RIOSendEx(rq_, &buf, 1, NULL, &remote, NULL, NULL, RIO_MSG_DEFER,
+                        reinterpret_cast<PVOID>(static_cast<ULONG_PTR>(slot)))) {
+        logError("RIOSendEx");
+        freeSend_.push_back(slot);
+        return false;
+    }
+    deferred_ = true;
+    return true;
+}
+
+/**
+ * @brief Commits the deferred sends queued so far.
+ * @return true on success, false on error.
+ */
+bool BatchIo::commitSends() {
+    if (!deferred_) return true;
+    deferred_ = false;
+    if (!rio_.RIOSendEx(rq_, NULL, 0, NULL, NULL, NULL, NULL, RIO_MSG_COMMIT_ONLY, NULL)) {
+        logError("RIOSendEx(commit)");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Commits all queued replies and re-posts the receive slots of the last batch.
+ * @return true on success, false on error.
+ */
+bool BatchIo::flush() {
+    bool ok = commitSends();
+    if (!pending_.empty()) {
+        for (unsigned slot : pending_) ok = postReceive(slot) && ok;
+        pending_.clear();
+        if (!rio_.RIOReceive(rq_, NULL, 0, RIO_MSG_COMMIT_ONLY, NULL)) {
+            logError("RIOReceive(commit)");
+            ok = false;
+        }
+    }
+    reapSends();
+    return ok;
+}
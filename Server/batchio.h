@@ -0,0 +1,161 @@
+/**
+ * @file batchio.h
+ * @brief Batched datagram I/O backend for the UDP time server (Winsock Registered I/O).
+ *
+ * This header provides the BatchIo class, which drains up to K datagrams per call from a
+ * preallocated ring of registered receive buffers and queues all replies of a batch so they
+ * are committed to the socket with a single call. Winsock has no recvmmsg/sendmmsg; Registered
+ * I/O (RIO, Windows 8+) is its batched, syscall-amortizing equivalent.
+ *
+ * With busy polling the receive completion queue is read from user space in a spin loop, so
+ * a loaded worker never enters the kernel to wait; this is the Windows counterpart of the
+ * poll-mode (AF_XDP, DPDK) backends on Linux. It only sleeps on the notification event after
+ * the queue has stayed empty for the spin budget.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h>
+#include <mswsock.h>
+#include <ws2ipdef.h>
+#include <ws2tcpip.h>
+#include <vector>
+#include <atomic>
+#include "rxstamp.h"
+
+/**
+ * @brief RIO-based batched receive/send engine bound to one socket.
+ *
+ * Receive buffers are posted once and re-posted after each batch has been dispatched, so
+ * datagrams returned by receive() stay valid until the next call to flush(). A socket can own
+ * a single RIO request queue, therefore every worker using BatchIo needs its own socket.
+ */
+class BatchIo {
+public:
+    /**
+     * @brief A received datagram referencing a slot of the registered receive ring.
+     */
+    struct Datagram {
+        const char* data;         /**< Payload (valid until flush()). */
+        int len;                  /**< Payload length in bytes. */
+        const sockaddr_storage* addr; /**< Sender address, IPv4 or IPv6 (valid until flush()). */
+        uint64_t stamp;           /**< Stack receive stamp (counter ticks), 0 if none. */
+    };
+
+    /**
+     * @brief Constructs an unopened backend.
+     */
+    BatchIo();
+
+    /**
+     * @brief Destructor. Releases RIO queues and registered memory.
+     */
+    ~BatchIo();
+
+    /**
+     * @brief Creates a UDP socket suitable for Registered I/O.
+     * @param family AF_INET or AF_INET6.
+     * @return Socket created with WSA_FLAG_REGISTERED_IO, or INVALID_SOCKET on error.
+     */
+    static SOCKET createSocket(int family);
+
+    /**
+     * @brief Loads the RIO function table, registers the buffer ring and posts all receives.
+     * @param sock Bound socket created by createSocket().
+     * @param depth Number of receive slots (and send slots) in the ring.
+     * @param slotSize Size of one datagram slot in bytes.
+     * @param node NUMA node to place the buffer ring on, or -1 for the default policy.
+     * @param receiveStamps Also receive the control messages, so datagrams carry their stack
+     *        receive stamp (the socket must have them enabled, see enableReceiveStamps()).
+     * @return true on success, false if RIO is unavailable or setup failed.
+     */
+    bool open(SOCKET sock, unsigned depth, unsigned slotSize, int node = -1, bool receiveStamps = false);
+
+    /**
+     * @brief Releases RIO queues and registered memory.
+     */
+    void close();
+
+    /**
+     * @brief Blocks until at least one datagram arrives, then drains up to max of them.
+     * @param out Array receiving the datagrams.
+     * @param max Capacity of out.
+     * @param wait false to only take what has already arrived, without polling or sleeping.
+     * @return Number of datagrams stored in out (0 after wake(), or if nothing arrived and !wait).
+     */
+    unsigned receive(Datagram* out, unsigned max, bool wait = true);
+
+    /**
+     * @brief Sets how long receive() polls an empty completion queue before it sleeps.
+     * @param spinUs Spin budget in microseconds (0 = sleep at once, the default).
+     */
+    void setBusyPoll(unsigned spinUs) { spinUs_ = spinUs; }
+
+    /**
+     * @brief Makes a blocked receive() (and every later one that finds nothing) return 0.
+     *        Safe to call from any thread; used for shutdown.
+     */
+    void wake();
+
+    /**
+     * @brief Queues a reply in a free send slot; it is transmitted by flush().
+     * @param data Reply bytes.
+     * @param len Reply length (at most the slot size).
+     * @param addr Destination address (IPv4 or IPv6).
+     * @return true if queued, false if the reply is too large, no send slot freed up or sending failed.
+     */
+    bool queueSend(const char* data, int len, const sockaddr_storage& addr);
+
+    /**
+     * @brief Commits all queued replies and re-posts the receive slots of the last batch.
+     * @return true on success, false on error.
+     */
+    bool flush();
+
+private:
+    /**
+     * @brief Posts (deferred) a receive on the given slot.
+     * @param slot Receive slot index.
+     * @return true on success, false on error.
+     */
+    bool postReceive(unsigned slot);
+
+    /**
+     * @brief Offset of a receive slot's control buffer in the registered region.
+     *        The control area starts 16-byte aligned after the address areas.
+     * @param slot Receive slot index (depth_ gives the end of the area).
+     * @return Byte offset (only meaningful with receive stamps).
+     */
+    size_t controlOffset(unsigned slot) const {
+        size_t base = (2 * static_cast<size_t>(depth_) * (slotSize_ + sizeof(sockaddr_storage)) + 15) & ~static_cast<size_t>(15);
+        return base + static_cast<size_t>(slot) * kStampControlBytes;
+    }
+
+    /**
+     * @brief Commits the deferred sends queued so far.
+     * @return true on success, false on error.
+     */
+    bool commitSends();
+
+    /**
+     * @brief Reclaims send slots whose transmission has completed.
+     */
+    void reapSends();
+
+    RIO_EXTENSION_FUNCTION_TABLE rio_; /**< RIO function pointers. */
+    RIO_CQ recvCq_;                    /**< Completion queue for receives (event-notified). */
+    RIO_CQ sendCq_;                    /**< Completion queue for sends (polled). */
+    RIO_RQ rq_;                        /**< Request queue of the socket. */
+    RIO_BUFFERID bufferId_;            /**< Registered memory region. */
+    HANDLE event_;                     /**< Event signalled by RIONotify on receive completion. */
+    char* memory_;                     /**< Receive data, send data, address and control areas. */
+    unsigned depth_;                   /**< Slots per ring. */
+    unsigned slotSize_;                /**< Bytes per data slot. */
+    std::vector<unsigned> pending_;    /**< Receive slots handed out by the last receive(). */
+    std::vector<unsigned> freeSend_;   /**< Send slots available for queueSend(). */
+    std::vector<RIORESULT> results_;   /**< Completion scratch space for receive(). */
+    bool deferred_;                    /**< true if sends are waiting for a commit. */
+    bool sendStalled_;                 /**< No send slot freed up within kSendStallUs; cleared by a completion. */
+    bool stamps_;                      /**< Receives return control messages (receive stamps). */
+    unsigned spinUs_;                  /**< Busy-poll budget of receive() in microseconds. */
+    std::atomic<bool> woken_;          /**< Set by wake(). */
+};
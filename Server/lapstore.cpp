@@ -0,0 +1,165 @@
+/**
+ * @file lapstore.cpp
+ * @brief Implementation of the bounded, expiry-ordered lap-timer store and its sharded wrapper.
+ * Compatible with C++14.
+ */
+#include "lapstore.h"
+
+// Out-of-class definition for the ODR-used constant (required before C++17)
+constexpr uint32_t LapStore::kNil;
+
+/**
+ * @brief Constructs a store and preallocates all of its nodes.
+ * @param capacity Maximum number of live timers (oldest is evicted when full).
+ * @param ttl Age after which a timer expires.
+ */
+LapStore::LapStore(size_t capacity, clock::duration ttl)
+    : nodes_(capacity ? capacity : 1), oldest_(kNil), newest_(kNil), free_(0),
+      size_(0), evictions_(0), ttl_(ttl)
+{
+    size_t buckets = 1;
+    while (buckets < nodes_.size()) buckets <<= 1;
+    buckets_.assign(buckets, kNil);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        nodes_[i].next = (i + 1 < nodes_.size()) ? static_cast<uint32_t>(i + 1) : kNil;
+    }
+}
+
+/**
+ * @brief Removes the timer of an endpoint and returns its start time.
+ * @param key Client endpoint.
+ * @param start Receives the start time if found.
+ * @return true if the endpoint had a live timer, false otherwise.
+ */
+bool LapStore::take(const EndpointKey& key, clock::time_point& start) {
+    for (uint32_t idx = buckets_[bucketOf(key)]; idx != kNil; idx = nodes_[idx].chain) {
+        if (nodes_[idx].key == key) {
+            start = nodes_[idx].start;
+            remove(idx);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Starts a timer for an endpoint, evicting the oldest timer if the store is full.
+ * @param key Client endpoint (must not have a live timer).
+ * @param now Start time (not earlier than any stored start time).
+ */
+void LapStore::insert(const EndpointKey& key, clock::time_point now) {
+    if (free_ == kNil) {
+        remove(oldest_);
+        ++evictions_;
+    }
+    uint32_t idx = free_;
+    Node& node = nodes_[idx];
+    free_ = node.next;
+
+    node.key = key;
+    node.start = now;
+    size_t bucket = bucketOf(key);
+    node.chain = buckets_[bucket];
+    buckets_[bucket] = idx;
+
+    node.prev = newest_;
+    node.next = kNil;
+    if (newest_ != kNil) nodes_[newest_].next = idx;
+    else oldest_ = idx;
+    newest_ = idx;
+    ++size_;
+}
+
+/**
+ * @brief Removes every timer older than the time-to-live.
+ * @param now Current time.
+ * @return Number of timers removed.
+ */
+size_t LapStore::expire(clock::time_point now) {
+    size_t removed = 0;
+    while (oldest_ != kNil && now - nodes_[oldest_].start > ttl_) {
+        remove(oldest_);
+        ++removed;
+    }
+    return removed;
+}
+
+/**
+ * @brief Unlinks a node from its bucket and the age list and returns it to the free list.
+ * @param idx Node index.
+ */
+void LapStore::remove(uint32_t idx) {
+    Node& node = nodes_[idx];
+
+    uint32_t* link = &buckets_[bucketOf(node.key)];
+    while (*link != idx) link = &nodes_[*link].chain;
+    *link = node.chain;
+
+    if (node.prev != kNil) nodes_[node.prev].next = node.next;
+    else oldest_ = node.next;
+    if (node.next != kNil) nodes_[node.next].prev = node.prev;
+    else newest_ = node.prev;
+
+    node.next = free_;
+    free_ = idx;
+    --size_;
+}
+
+/**
+ * @brief Constructs the shards and preallocates all of their nodes.
+ * @param shards Number of independently locked shards (at least 1).
+ * @param capacity Total maximum number of live timers, split evenly over the shards.
+ * @param ttl Age after which a timer expires.
+ */
+ShardedLapStore::ShardedLapStore(size_t shards, size_t capacity, clock::duration ttl) {
+    if (shards == 0) shards = 1;
+    size_t perShard = (capacity + shards - 1) / shards;
+    shards_.reserve(shards);
+    for (size_t i = 0; i < shards; ++i) {
+        shards_.emplace_back(new Shard(perShard, ttl));
+    }
+}
+
+/**
+ * @brief Completes the lap of an endpoint, or starts one if it has no live timer.
+ *        Expired timers of the endpoint's shard are dropped first.
+ * @param key Client endpoint.
+ * @param now Current time.
+ * @param start Receives the start time of the completed lap.
+ * @return true if a lap was completed, false if a new timer was started.
+ */
+bool ShardedLapStore::lap(const EndpointKey& key, clock::time_point now, clock::time_point& start) {
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lk(shard.mx);
+    shard.store.expire(now);
+    if (shard.store.take(key, start)) return true;
+    shard.store.insert(key, now);
+    return false;
+}
+
+/**
+ * @brief Removes every expired timer from every shard (one shard locked at a time).
+ * @param now Current time.
+ * @return Number of timers removed.
+ */
+size_t ShardedLapStore::expire(clock::time_point now) {
+    size_t removed = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard->mx);
+        removed += shard->store.expire(now);
+    }
+    return removed;
+}
+
+/**
+ * @brief Number of live timers over all shards.
+ * @return Live timer count.
+ */
+size_t ShardedLapStore::size() const {
+    size_t total = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard->mx);
+        total += shard->store.size();
+    }
+    return total;
+}
@@ -0,0 +1,256 @@
+/**
+ * @file lapstore.h
+ * @brief Bounded lap-timer store with O(1) insert, lookup and expiry.
+ *
+ * This header provides the EndpointKey type, the single-threaded LapStore and the lock-striped
+ * ShardedLapStore used by MeasureTimeLap.
+ * Entries sit in a preallocated node pool that is threaded on two intrusive structures: a
+ * chained hash index for lookup and a doubly-linked list in start-time order. Because every
+ * entry has the same time-to-live, the oldest entry is always at the list head, so expiry and
+ * capacity eviction only ever look at the head.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Key for identifying client endpoints (IPv4 or IPv6) for lap timing.
+ *
+ * The address is held as the two big-endian halves of its IPv6 form. IPv4 addresses use the
+ * IPv4-mapped form ::ffff:a.b.c.d, so a client has the same key whether it reached an IPv4
+ * or a dual-stack socket, and hi is 0 for every IPv4 client.
+ */
+struct EndpointKey {
+    uint64_t hi;            /**< Address bytes 0-7 (0 for IPv4). */
+    uint64_t lo;            /**< Address bytes 8-15 (0x0000FFFF'aabbccdd for IPv4 a.b.c.d). */
+    unsigned short port_be; /**< Port (big-endian). */
+};
+
+/**
+ * @brief Builds the key of an IPv4 endpoint.
+ * @param addr_be Address (big-endian, as in sin_addr).
+ * @param port_be Port (big-endian).
+ * @return Endpoint key.
+ */
+inline EndpointKey endpointKeyV4(uint32_t addr_be, unsigned short port_be) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(&addr_be);
+    uint64_t addr = (static_cast<uint64_t>(b[0]) << 24) | (static_cast<uint64_t>(b[1]) << 16) |
+                    (static_cast<uint64_t>(b[2]) << 8) | b[3];
+    return EndpointKey{ 0, 0x0000FFFF00000000ull | addr, port_be };
+}
+
+/**
+ * @brief Builds the key of an IPv6 endpoint (IPv4-mapped addresses get their IPv4 key).
+ * @param addr 16 address bytes (as in sin6_addr).
+ * @param port_be Port (big-endian).
+ * @return Endpoint key.
+ */
+inline EndpointKey endpointKeyV6(const unsigned char* addr, unsigned short port_be) {
+    uint64_t hi = 0, lo = 0;
+    for (int i = 0; i < 8; ++i) {
+        hi = (hi << 8) | addr[i];
+        lo = (lo << 8) | addr[8 + i];
+    }
+    return EndpointKey{ hi, lo, port_be };
+}
+
+/**
+ * @brief Equality operator for EndpointKey.
+ * @param a First key.
+ * @param b Second key.
+ * @return true if keys are equal, false otherwise.
+ */
+inline bool operator==(const EndpointKey& a, const EndpointKey& b) {
+    return a.lo == b.lo && a.port_be == b.port_be && a.hi == b.hi;
+}
+
+/**
+ * @brief Mixes an endpoint into a 64-bit hash (splitmix64 finalizer).
+ *        Every input bit affects every output bit, so clients behind one NAT address that
+ *        differ only in port spread evenly over buckets and shards. The upper address half
+ *        only enters through one multiply, which is 0 for IPv4 keys.
+ * @param k Client endpoint.
+ * @return 64-bit hash.
+ */
+inline uint64_t hashEndpoint(const EndpointKey& k) {
+    uint64_t x = ((k.lo << 16) | (k.lo >> 48)) ^ k.port_be ^ (k.hi * 0x9E3779B97F4A7C15ull);
+    x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27; x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * @brief Hash function for EndpointKey.
+ */
+struct EndpointKeyHash {
+    size_t operator()(const EndpointKey& k) const noexcept {
+        return static_cast<size_t>(hashEndpoint(k));
+    }
+};
+
+/**
+ * @brief Fixed-capacity lap-timer store (not thread-safe; callers lock around it).
+ */
+class LapStore {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Constructs a store and preallocates all of its nodes.
+     * @param capacity Maximum number of live timers (oldest is evicted when full).
+     * @param ttl Age after which a timer expires.
+     */
+    LapStore(size_t capacity, clock::duration ttl);
+
+    /**
+     * @brief Removes the timer of an endpoint and returns its start time.
+     * @param key Client endpoint.
+     * @param start Receives the start time if found.
+     * @return true if the endpoint had a live timer, false otherwise.
+     */
+    bool take(const EndpointKey& key, clock::time_point& start);
+
+    /**
+     * @brief Starts a timer for an endpoint, evicting the oldest timer if the store is full.
+     * @param key Client endpoint (must not have a live timer).
+     * @param now Start time (not earlier than any stored start time).
+     */
+    void insert(const EndpointKey& key, clock::time_point now);
+
+    /**
+     * @brief Removes every timer older than the time-to-live.
+     * @param now Current time.
+     * @return Number of timers removed.
+     */
+    size_t expire(clock::time_point now);
+
+    /**
+     * @brief Number of live timers.
+     * @return Live timer count.
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Maximum number of live timers.
+     * @return Capacity.
+     */
+    size_t capacity() const { return nodes_.size(); }
+
+    /**
+     * @brief Number of timers evicted because the store was full.
+     * @return Eviction count since construction.
+     */
+    uint64_t evictions() const { return evictions_; }
+
+private:
+    static constexpr uint32_t kNil = 0xFFFFFFFFu;
+
+    /**
+     * @brief Pooled entry, linked into one hash chain and the age list.
+     */
+    struct Node {
+        EndpointKey key;          /**< Client endpoint. */
+        clock::time_point start;  /**< Timer start. */
+        uint32_t prev;            /**< Older entry in the age list. */
+        uint32_t next;            /**< Newer entry in the age list (or next free node). */
+        uint32_t chain;           /**< Next entry in the same hash bucket. */
+    };
+
+    /**
+     * @brief Maps a key to its bucket index.
+     * @param key Client endpoint.
+     * @return Bucket index.
+     */
+    size_t bucketOf(const EndpointKey& key) const { return EndpointKeyHash()(key) & (buckets_.size() - 1); }
+
+    /**
+     * @brief Unlinks a node from its bucket and the age list and returns it to the free list.
+     * @param idx Node index.
+     */
+    void remove(uint32_t idx);
+
+    std::vector<Node> nodes_;       /**< Node pool (size == capacity). */
+    std::vector<uint32_t> buckets_; /**< Hash bucket heads (power-of-two count). */
+    uint32_t oldest_;               /**< Head of the age list. */
+    uint32_t newest_;               /**< Tail of the age list. */
+    uint32_t free_;                 /**< Head of the free list. */
+    size_t size_;                   /**< Live timers. */
+    uint64_t evictions_;            /**< Capacity evictions. */
+    clock::duration ttl_;           /**< Timer lifetime. */
+};
+
+/**
+ * @brief Thread-safe lap-timer store split into independently locked LapStore shards.
+ *
+ * An endpoint always maps to the same shard (by the high bits of its hash, while the shard
+ * buckets use the low bits), so workers only contend when their clients share a shard.
+ */
+class ShardedLapStore {
+public:
+    using clock = LapStore::clock;
+
+    /**
+     * @brief Constructs the shards and preallocates all of their nodes.
+     * @param shards Number of independently locked shards (at least 1).
+     * @param capacity Total maximum number of live timers, split evenly over the shards.
+     * @param ttl Age after which a timer expires.
+     */
+    ShardedLapStore(size_t shards, size_t capacity, clock::duration ttl);
+
+    /**
+     * @brief Completes the lap of an endpoint, or starts one if it has no live timer.
+     *        Expired timers of the endpoint's shard are dropped first.
+     * @param key Client endpoint.
+     * @param now Current time.
+     * @param start Receives the start time of the completed lap.
+     * @return true if a lap was completed, false if a new timer was started.
+     */
+    bool lap(const EndpointKey& key, clock::time_point now, clock::time_point& start);
+
+    /**
+     * @brief Removes every expired timer from every shard (one shard locked at a time).
+     * @param now Current time.
+     * @return Number of timers removed.
+     */
+    size_t expire(clock::time_point now);
+
+    /**
+     * @brief Number of live timers over all shards.
+     * @return Live timer count.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Number of shards.
+     * @return Shard count.
+     */
+    size_t shards() const { return shards_.size(); }
+
+private:
+    /**
+     * @brief One lock and its store; padded so neighbouring shards' locks do not share a cache line.
+     */
+    struct Shard {
+        Shard(size_t capacity, clock::duration ttl) : store(capacity, ttl) {}
+        mutable std::mutex mx; /**< Guards store. */
+        LapStore store;        /**< Timers of this shard. */
+        char pad[64];
+    };
+
+    /**
+     * @brief Maps a key to its shard.
+     * @param key Client endpoint.
+     * @return Shard owning the key.
+     */
+    Shard& shardOf(const EndpointKey& key) const {
+        return *shards_[static_cast<size_t>(hashEndpoint(key) >> 32) % shards_.size()];
+    }
+
+    std::vector<std::unique_ptr<Shard>> shards_; /**< Shards (fixed after construction). */
+};
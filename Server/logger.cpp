@@ -0,0 +1,372 @@
+/**
+ * @file logger.cpp
+ * @brief Implementation of the asynchronous, batched logger.
+ *
+ * Every producing thread owns a single-producer/single-consumer ring of fixed-size records that
+ * it formats into in place. The flusher thread is the only consumer of all rings: it stamps the
+ * records (timestamps are formatted once per second), concatenates them into one buffer and
+ * writes it with a single fwrite. Until startLogger() is called records are written synchronously.
+ * A producer flags its ring busy while it fills a record, so stopLogger() can wait for records
+ * that are still being written and drain them before the flusher exits.
+ * Compatible with C++14.
+ */
+#include "logger.h"
+#include <winsock2.h>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+std::atomic<int> g_log_level{ static_cast<int>(LogLevel::Debug) };
+
+static constexpr size_t kRingSize = 1024;   // records per thread (power of two)
+static constexpr size_t kRecordText = 232;  // bytes of message text per record
+
+/**
+ * @brief One log record as stored in a ring.
+ */
+struct LogRecord {
+    std::time_t time;        /**< Wall-clock second the record was produced. */
+    uint32_t len;            /**< Valid bytes in text. */
+    char text[kRecordText];  /**< Message text (not null-terminated). */
+};
+
+/**
+ * @brief Per-thread SPSC ring; head and tail are kept on separate cache lines.
+ */
+struct LogRing {
+    LogRing() : head(0), busy(false), tail(0), dropped(0) {}
+    std::atomic<size_t> head;     /**< Next slot to write (producer). */
+    std::atomic<bool> busy;       /**< Producer is between its running check and the commit. */
+    char pad1[64];
+    std::atomic<size_t> tail;     /**< Next slot to read (flusher). */
+    char pad2[64];
+    std::atomic<uint64_t> dropped;/**< Records lost because the ring was full. */
+    LogRecord records[kRingSize]; /**< Record storage. */
+};
+
+static std::mutex g_rings_mx;                 // guards registration only
+static std::vector<LogRing*> g_rings;         // rings live for the whole process
+static std::atomic<uint64_t> g_ringsGen{ 0 };  // bumped on each registration
+static thread_local LogRing* t_ring = nullptr;
+
+static std::mutex g_sync_mx;                  // synchronous path before startLogger()
+static std::atomic<bool> g_running{ false };
+static std::thread g_flusher;
+static std::FILE* g_out = nullptr;
+
+/**
+ * @brief Returns the calling thread's ring, registering it on first use.
+ * @return Ring of the calling thread.
+ */
+static LogRing& threadRing() {
+    if (!t_ring) {
+        t_ring = new LogRing();
+        std::lock_guard<std::mutex> lk(g_rings_mx);
+        g_rings.push_back(t_ring);
+        g_ringsGen.fetch_add(1, std::memory_order_release);
+    }
+    return *t_ring;
+}
+
+/**
+ * @brief Returns the calling thread's ring flagged busy, if the flusher is running.
+ *
+ * The flag is raised before running is re-checked, so once stopLogger() clears running the
+ * flusher either sees the flag and waits, or the producer sees the stop and writes synchronously.
+ * @return Busy ring of the calling thread, or nullptr to write synchronously.
+ */
+static LogRing* enterRing() {
+    if (!g_running.load(std::memory_order_acquire)) return nullptr;
+    LogRing& ring = threadRing();
+    ring.busy.store(true, std::memory_order_seq_cst);
+    if (!g_running.load(std::memory_order_seq_cst)) {
+        ring.busy.store(false, std::memory_order_release);
+        return nullptr;
+    }
+    return &ring;
+}
+
+/**
+ * @brief Clears the busy flag raised by enterRing().
+ * @param ring Calling thread's ring.
+ */
+static void leaveRing(LogRing& ring) {
+    ring.busy.store(false, std::memory_order_release);
+}
+
+/**
+ * @brief Refreshes the flusher's copy of the ring list if a ring registered since the last copy.
+ * @param rings Flusher's copy, updated in place.
+ * @param gen Registration generation of the copy, updated in place.
+ */
+static void refreshRings(std::vector<LogRing*>& rings, uint64_t& gen) {
+    if (g_ringsGen.load(std::memory_order_acquire) == gen) return;
+    std::lock_guard<std::mutex> lk(g_rings_mx);
+    rings = g_rings;
+    gen = g_ringsGen.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Formats "\n[YYYY-MM-DD HH:MM:SS] " for the given second.
+ * @param t Time value.
+ * @param buf Output buffer (at least 32 bytes).
+ * @return Number of bytes written.
+ */
+static size_t formatStamp(std::time_t t, char* buf) {
+    std::tm tm{};
+    localtime_s(&tm, &t);
+    return std::strftime(buf, 32, "\n[%Y-%m-%d %H:%M:%S] ", &tm);
+}
+
+/**
+ * @brief Writes one record immediately (used while the flusher is not running).
+ * @param text Message bytes.
+ * @param len Message length.
+ */
+static void writeSync(const char* text, size_t len) {
+    char stamp[32];
+    size_t n = formatStamp(std::time(nullptr), stamp);
+    std::lock_guard<std::mutex> lk(g_sync_mx);
+    std::fwrite(stamp, 1, n, stdout);
+    std::fwrite(text, 1, len, stdout);
+    std::fflush(stdout);
+}
+
+/**
+ * @brief Reserves the next record of the calling thread's ring.
+ * @param ring Calling thread's ring.
+ * @return Record to fill, or nullptr if the ring is full (the drop is counted).
+ */
+static LogRecord* reserveRecord(LogRing& ring) {
+    size_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= kRingSize) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    LogRecord* rec = &ring.records[head & (kRingSize - 1)];
+    rec->time = std::time(nullptr);
+    return rec;
+}
+
+/**
+ * @brief Publishes the record reserved last by reserveRecord().
+ * @param ring Calling thread's ring.
+ */
+static void commitRecord(LogRing& ring) {
+    ring.head.store(ring.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Moves every pending record of every ring into the output batch.
+ * @param rings Rings to drain.
+ * @param batch Output buffer (appended to).
+ * @param lastSecond Second of the cached timestamp, updated in place.
+ * @param stamp Cached timestamp text, updated in place.
+ * @param stampLen Length of the cached timestamp, updated in place.
+ */
+static void drainRings(const std::vector<LogRing*>& rings, std::string& batch, std::time_t& lastSecond,
+                       char* stamp, size_t& stampLen) {
+    for (LogRing* ring : rings) {
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const LogRecord& rec = ring->records[tail & (kRingSize - 1)];
+            if (rec.time != lastSecond) {
+                lastSecond = rec.time;
+                stampLen = formatStamp(rec.time, stamp);
+            }
+            batch.append(stamp, stampLen);
+            batch.append(rec.text, rec.len);
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+}
+
+/**
+ * @brief Flusher thread: drains the rings, reports drops and writes in batches.
+ *
+ * Once running is cleared it waits for producers still filling a record, then drains a last time.
+ */
+static void flushLoop() {
+    std::string batch;
+    batch.reserve(64 * 1024);
+    std::time_t lastSecond = 0;
+    char stamp[32];
+    size_t stampLen = 0;
+    uint64_t reportedDrops = 0;
+    std::vector<LogRing*> rings;
+    uint64_t gen = ~0ull;
+
+    while (true) {
+        bool running = g_running.load(std::memory_order_seq_cst);
+        refreshRings(rings, gen);
+        if (!running) {
+            for (LogRing* ring : rings) {
+                while (ring->busy.load(std::memory_order_seq_cst)) std::this_thread::yield();
+            }
+        }
+        drainRings(rings, batch, lastSecond, stamp, stampLen);
+
+        uint64_t drops = 0;
+        for (LogRing* ring : rings) drops += ring->dropped.load(std::memory_order_relaxed);
+        if (drops != reportedDrops) {
+            char msg[96];
+            int n = std::snprintf(msg, sizeof(msg), "Logger: dropped %llu record(s) under load",
+                                  static_cast<unsigned long long>(drops - reportedDrops));
+            stampLen = formatStamp(std::time(nullptr), stamp);
+            lastSecond = 0;
+            batch.append(stamp, stampLen);
+            if (n > 0) batch.append(msg, static_cast<size_t>(n));
+            reportedDrops = drops;
+        }
+
+        if (!batch.empty()) {
+            std::fwrite(batch.data(), 1, batch.size(), g_out);
+            std::fflush(g_out);
+            batch.clear();
+        }
+        else if (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!running) break;
+    }
+}
+
+/**
+ * @brief Sets the runtime log level.
+ * @param level Most verbose level to keep.
+ */
+void setLogLevel(LogLevel level) {
+    g_log_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Parses a level name ("error", "warn", "info", "debug").
+ * @param name Level name.
+ * @param level Parsed level.
+ * @return true if the name is valid, false otherwise.
+ */
+bool parseLogLevel(const std::string& name, LogLevel& level) {
+    if (name == "error") level = LogLevel::Error;
+    else if (name == "warn") level = LogLevel::Warn;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "debug") level = LogLevel::Debug;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief Starts the background flusher.
+ * @param path Output file (appended), or empty for stdout.
+ * @return true on success, false if the file cannot be opened.
+ */
+bool startLogger(const std::string& path) {
+    if (g_running.load()) return true;
+    g_out = stdout;
+    if (!path.empty()) {
+        if (0 != fopen_s(&g_out, path.c_str(), "ab") || !g_out) {
+            g_out = stdout;
+            return false;
+        }
+    }
+    g_running.store(true, std::memory_order_release);
+    g_flusher = std::thread(flushLoop);
+    return true;
+}
+
+/**
+ * @brief Drains every ring, writes the remaining records and stops the flusher.
+ */
+void stopLogger() {
+    if (!g_running.exchange(false)) return;
+    if (g_flusher.joinable()) g_flusher.join();
+    if (g_out && g_out != stdout) std::fclose(g_out);
+    g_out = nullptr;
+}
+
+/**
+ * @brief Number of records dropped because a ring was full.
+ * @return Total drops since start.
+ */
+uint64_t loggerDropped() {
+    uint64_t total = 0;
+    std::lock_guard<std::mutex> lk(g_rings_mx);
+    for (LogRing* ring : g_rings) total += ring->dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+/**
+ * @brief Logs a message with a timestamp at the given level (thread-safe, non-blocking).
+ * @param level Record level.
+ * @param message Message bytes.
+ * @param len Message length (truncated to the record size).
+ */
+void logMessage(LogLevel level, const char* message, size_t len) {
+    if (!logEnabled(level)) return;
+    if (len > kRecordText) len = kRecordText;
+    LogRing* ring = enterRing();
+    if (!ring) {
+        writeSync(message, len);
+        return;
+    }
+    LogRecord* rec = reserveRecord(*ring);
+    if (rec) {
+        std::memcpy(rec->text, message, len);
+        rec->len = static_cast<uint32_t>(len);
+        commitRecord(*ring);
+    }
+    leaveRing(*ring);
+}
+
+/**
+ * @brief Logs a message with a timestamp at Info level (thread-safe, non-blocking).
+ * @param message Message to log.
+ */
+void logMessage(const std::string& message) {
+    logMessage(LogLevel::Info, message.data(), message.size());
+}
+
+/**
+ * @brief Logs a printf-style message without heap allocation (thread-safe, non-blocking).
+ * @param level Record level.
+ * @param fmt Format string.
+ */
+void logFormat(LogLevel level, const char* fmt, ...) {
+    if (!logEnabled(level)) return;
+    char local[kRecordText];
+    LogRing* ring = enterRing();
+    LogRecord* rec = ring ? reserveRecord(*ring) : nullptr;
+    if (ring && !rec) { // dropped
+        leaveRing(*ring);
+        return;
+    }
+    char* dst = rec ? rec->text : local;
+
+    va_list args;
+    va_start(args, fmt);
+    int n = std::vsnprintf(dst, kRecordText, fmt, args);
+    va_end(args);
+    size_t len = (n < 0) ? 0 : (static_cast<size_t>(n) >= kRecordText ? kRecordText - 1 : static_cast<size_t>(n));
+
+    if (rec) {
+        rec->len = static_cast<uint32_t>(len);
+        commitRecord(*ring);
+        leaveRing(*ring);
+    }
+    else {
+        writeSync(local, len);
+    }
+}
+
+/**
+ * @brief Logs an error message with the location and last Winsock error code.
+ * @param where Name of the function or location where the error occurred.
+ */
+void logError(const char* where) {
+    logFormat(LogLevel::Error, "Time Server: Error at %s(): %d", where, WSAGetLastError());
+}
@@ -0,0 +1,108 @@
+/**
+ * @file logger.h
+ * @brief Asynchronous, batched logging for the UDP time server.
+ *
+ * This header provides log levels, the logging entry points used throughout the server and the
+ * background flusher control. Each thread appends fixed-size records to its own lock-free ring;
+ * a flusher thread drains all rings and writes them to stdout or a file in large batches. When a
+ * ring is full the record is dropped and counted instead of blocking the caller.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Severity of a log record; higher values are more verbose.
+ */
+enum class LogLevel : int {
+    Error = 0, /**< Failures (socket errors, bad setup). */
+    Warn,      /**< Degraded operation (fallbacks, drops). */
+    Info,      /**< Lifecycle and periodic statistics. */
+    Debug      /**< Per-request records. */
+};
+
+/**
+ * @brief Most verbose level compiled in; records above it are removed at compile time.
+ *        Build with TIMESERVER_LOG_MAX_LEVEL=2 to compile out per-request logging.
+ */
+#ifndef TIMESERVER_LOG_MAX_LEVEL
+#define TIMESERVER_LOG_MAX_LEVEL 3
+#endif
+
+/**
+ * @brief Runtime log level (records above it are discarded before formatting).
+ */
+extern std::atomic<int> g_log_level;
+
+/**
+ * @brief Checks whether records of the given level are compiled in and enabled.
+ *        Callers test it before building a message so disabled logging costs one branch.
+ * @param level Level to check.
+ * @return true if a record of this level would be written.
+ */
+inline bool logEnabled(LogLevel level) {
+    return static_cast<int>(level) <= TIMESERVER_LOG_MAX_LEVEL &&
+           static_cast<int>(level) <= g_log_level.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Sets the runtime log level.
+ * @param level Most verbose level to keep.
+ */
+void setLogLevel(LogLevel level);
+
+/**
+ * @brief Parses a level name ("error", "warn", "info", "debug").
+ * @param name Level name.
+ * @param level Parsed level.
+ * @return true if the name is valid, false otherwise.
+ */
+bool parseLogLevel(const std::string& name, LogLevel& level);
+
+/**
+ * @brief Starts the background flusher.
+ * @param path Output file (appended), or empty for stdout.
+ * @return true on success, false if the file cannot be opened.
+ */
+bool startLogger(const std::string& path = std::string());
+
+/**
+ * @brief Drains every ring, writes the remaining records and stops the flusher.
+ */
+void stopLogger();
+
+/**
+ * @brief Number of records dropped because a ring was full.
+ * @return Total drops since start.
+ */
+uint64_t loggerDropped();
+
+/**
+ * @brief Logs an error message with the location and last Winsock error code.
+ * @param where Name of the function or location where the error occurred.
+ */
+void logError(const char* where);
+
+/**
+ * @brief Logs a message with a timestamp at Info level (thread-safe, non-blocking).
+ * @param message Message to log.
+ */
+void logMessage(const std::string& message);
+
+/**
+ * @brief Logs a message with a timestamp at the given level (thread-safe, non-blocking).
+ * @param level Record level.
+ * @param message Message bytes.
+ * @param len Message length (truncated to the record size).
+ */
+void logMessage(LogLevel level, const char* message, size_t len);
+
+/**
+ * @brief Logs a printf-style message without heap allocation (thread-safe, non-blocking).
+ * @param level Record level.
+ * @param fmt Format string.
+ */
+void logFormat(LogLevel level, const char* fmt, ...);
@@ -6,6 +6,18 @@
  * The server uses the TimeServer class to handle socket initialization, request decoding,
  * dispatching, and response sending. Supported requests include current time, date, epoch time,
  * delay estimation, and more. All responses are sent back to the client over UDP.
+ *
+ * Usage: TimeServer [--port N] [--workers N] [--shard] [--stats SECONDS] [--batch K] [--busy-poll US]
+ *                   [--schedule TARGET_US[:INTERVAL_MS]] [--queue-capacity N]
+ *                   [--lap-capacity N] [--quiet]
+ *                   [--tick-ms MS] [--multicast GROUP[:PORT]] [--multicast-ttl N]
+ *                   [--reactor auto|iocp|select] [--listen PORT]... [--family dual|ipv4|ipv6]
+ *                   [--metrics [HOST:]PORT] [--latency-sample N] [--reply-cache N]
+ *                   [--cpus LIST] [--steer-sockets] [--rx-timestamps]
+ *                   [--rate-limit PPS[:BURST]] [--amplification N[:BYTES]] [--trust ADDR[/BITS]]...
+ *                   [--log-level error|warn|info|debug] [--log-file PATH]
+ *                   [--trace PATH] [--trace-max-mb N]
+ * Ctrl+C, Ctrl+Break or closing the console stops the server gracefully.
  * Compatible with C++14.
  */
 
@@ -14,10 +26,198 @@
 #include <iostream>
 #include <ctime>
 
-int main() {
+/**
+ * @brief Server stopped by the console control handler.
+ */
+static TimeServer* g_server = nullptr;
+
+/**
+ * @brief Console control handler: stops the server on Ctrl+C, Ctrl+Break and console close.
+ * @param type Control event.
+ * @return TRUE if the event was handled.
+ */
+static BOOL WINAPI onConsoleControl(DWORD type) {
+    if (type != CTRL_C_EVENT && type != CTRL_BREAK_EVENT && type != CTRL_CLOSE_EVENT) return FALSE;
+    if (g_server) g_server->stop();
+    return TRUE;
+}
+
+/**
+ * @brief Parses command-line switches into server options.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @param options Options to fill in.
+ * @param logFile Log output file (empty for stdout).
+ * @return true if all switches were recognized, false otherwise.
+ */
+static bool parseArgs(int argc, char* argv[], ServerOptions& options, std::string& logFile) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--port" && hasValue) {
+            options.port = static_cast<unsigned short>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--workers" && hasValue) {
+            options.workers = static_cast<unsigned>(std::atoi(argv[++i]));
+            if (options.workers == 0) options.workers = std::thread::hardware_concurrency();
+        }
+        else if (arg == "--shard") {
+            options.shardSockets = true;
+        }
+        else if (arg == "--stats" && hasValue) {
+            options.statsIntervalSec = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--batch" && hasValue) {
+            options.batchSize = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--busy-poll" && hasValue) {
+            options.busyPollUs = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--schedule" && hasValue) {
+            // TARGET_US[:INTERVAL_MS]
+            std::string value = argv[++i];
+            size_t colon = value.find(':');
+            options.scheduler.targetUs = static_cast<unsigned>(std::atoi(value.c_str()));
+            if (colon != std::string::npos) options.scheduler.intervalMs = static_cast<unsigned>(std::atoi(value.c_str() + colon + 1));
+        }
+        else if (arg == "--queue-capacity" && hasValue) {
+            options.scheduler.capacity = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--lap-capacity" && hasValue) {
+            options.lapCapacity = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--tick-ms" && hasValue) {
+            options.tickIntervalMs = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--multicast" && hasValue) {
+            // GROUP[:PORT]
+            std::string value = argv[++i];
+            size_t colon = value.find(':');
+            options.multicastGroup = value.substr(0, colon);
+            if (colon != std::string::npos) options.multicastPort = static_cast<unsigned short>(std::atoi(value.c_str() + colon + 1));
+        }
+        else if (arg == "--multicast-ttl" && hasValue) {
+            options.multicastTtl = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--reactor" && hasValue) {
+            if (!parseReactorKind(argv[++i], options.reactor)) {
+                std::cout << "Unknown reactor: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if (arg == "--listen" && hasValue) {
+            options.extraPorts.push_back(static_cast<unsigned short>(std::atoi(argv[++i])));
+        }
+        else if (arg == "--family" && hasValue) {
+            std::string family = argv[++i];
+            if (family == "dual") options.family = AddressFamily::Dual;
+            else if (family == "ipv4") options.family = AddressFamily::IPv4;
+            else if (family == "ipv6") options.family = AddressFamily::IPv6;
+            else {
+                std::cout << "Unknown address family: " << family << "\n";
+                return false;
+            }
+        }
+        else if (arg == "--metrics" && hasValue) {
+            if (!parseMetricsAddress(argv[++i], options.metricsHost, options.metricsPort)) {
+                std::cout << "Invalid metrics address: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if (arg == "--latency-sample" && hasValue) {
+            options.latencySampleEvery = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--reply-cache" && hasValue) {
+            options.replyCacheEntries = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--cpus" && hasValue) {
+            if (!parseCpuList(argv[++i], options.cpus)) {
+                std::cout << "Invalid CPU list: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if (arg == "--steer-sockets") {
+            options.steerSockets = true;
+        }
+        else if (arg == "--rx-timestamps") {
+            options.receiveStamps = true;
+        }
+        else if (arg == "--rate-limit" && hasValue) {
+            // PPS[:BURST]
+            std::string value = argv[++i];
+            size_t colon = value.find(':');
+            options.admission.ratePps = static_cast<unsigned>(std::atoi(value.c_str()));
+            if (colon != std::string::npos) options.admission.burst = static_cast<unsigned>(std::atoi(value.c_str() + colon + 1));
+        }
+        else if (arg == "--amplification" && hasValue) {
+            // N[:BYTES]
+            std::string value = argv[++i];
+            size_t colon = value.find(':');
+            options.admission.amplification = static_cast<unsigned>(std::atoi(value.c_str()));
+            if (colon != std::string::npos) options.admission.allowanceBytes = static_cast<unsigned>(std::atoi(value.c_str() + colon + 1));
+        }
+        else if (arg == "--trust" && hasValue) {
+            AddressPrefix prefix;
+            if (!parseAddressPrefix(argv[++i], prefix)) {
+                std::cout << "Invalid address prefix: " << argv[i] << "\n";
+                return false;
+            }
+            options.admission.trusted.push_back(prefix);
+        }
+        else if (arg == "--quiet") {
+            setLogLevel(LogLevel::Info);
+        }
+        else if (arg == "--log-level" && hasValue) {
+            LogLevel level;
+            if (!parseLogLevel(argv[++i], level)) {
+                std::cout << "Unknown log level: " << argv[i] << "\n";
+                return false;
+            }
+            setLogLevel(level);
+        }
+        else if (arg == "--log-file" && hasValue) {
+            logFile = argv[++i];
+        }
+        else if (arg == "--trace" && hasValue) {
+            options.tracePath = argv[++i];
+        }
+        else if (arg == "--trace-max-mb" && hasValue) {
+            options.traceMaxBytes = static_cast<uint64_t>(std::strtoul(argv[++i], nullptr, 10)) << 20;
+        }
+        else {
+            std::cout << "Unknown option: " << arg << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    ServerOptions options;
+    std::string logFile;
+    if (!parseArgs(argc, argv, options, logFile)) {
+        std::cout << "Usage: TimeServer [--port N] [--workers N|0=all cores] [--shard] [--stats SECONDS] [--batch K] [--busy-poll US] [--quiet]\n"
+                  << "                  [--schedule TARGET_US[:INTERVAL_MS]] [--queue-capacity N]\n"
+                  << "                  [--lap-capacity N] [--tick-ms MS] [--multicast GROUP[:PORT]] [--multicast-ttl N]\n"
+                  << "                  [--reactor auto|iocp|select] [--listen PORT]... [--family dual|ipv4|ipv6]\n"
+                  << "                  [--metrics [HOST:]PORT] [--latency-sample N] [--reply-cache N]\n"
+                  << "                  [--cpus LIST] [--steer-sockets] [--rx-timestamps]\n"
+                  << "                  [--rate-limit PPS[:BURST]] [--amplification N[:BYTES]] [--trust ADDR[/BITS]]...\n"
+                  << "                  [--log-level error|warn|info|debug] [--log-file PATH]\n"
+                  << "                  [--trace PATH] [--trace-max-mb N]\n";
+        return 1;
+    }
     system("cls");
-    TimeServer server;
+    if (!startLogger(logFile)) {
+        std::cout << "Cannot open log file " << logFile << "; logging to stdout.\n";
+    }
+    TimeServer server(options);
+    g_server = &server;
+    SetConsoleCtrlHandler(onConsoleControl, TRUE);
     server.run();
+    SetConsoleCtrlHandler(onConsoleControl, FALSE);
+    g_server = nullptr;
+    stopLogger();
     return 0;
 }
     
\ No newline at end of file
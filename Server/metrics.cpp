@@ -0,0 +1,333 @@
+/**
+ * @file metrics.cpp
+ * @brief Implementation of the worker metrics, the latency histogram and the metrics endpoint.
+ *
+ * The exposition follows the Prometheus text format 0.0.4: counters per worker and per request
+ * code, and one summary per stage whose quantiles come from the merged histograms of all workers.
+ * Compatible with C++14.
+ */
+#include "metrics.h"
+#include "utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * @brief Name of a stage as used in metric labels.
+ * @param stage Stage.
+ * @return "decode", "dispatch", "send" or "total".
+ */
+const char* stageName(Stage stage) {
+    switch (stage) {
+    case Stage::Decode: return "decode";
+    case Stage::Dispatch: return "dispatch";
+    case Stage::Send: return "send";
+    case Stage::Total: return "total";
+    default: return "unknown";
+    }
+}
+
+/**
+ * @brief Name of an error kind as used in metric labels.
+ * @param kind Error kind.
+ * @return "dispatch", "send" or "flush".
+ */
+const char* errorKindName(ErrorKind kind) {
+    switch (kind) {
+    case ErrorKind::Dispatch: return "dispatch";
+    case ErrorKind::Send: return "send";
+    case ErrorKind::Flush: return "flush";
+    default: return "unknown";
+    }
+}
+
+/**
+ * @brief Constructs an empty histogram.
+ */
+LatencyHistogram::LatencyHistogram() : sum_(0) {
+    for (std::atomic<uint64_t>& c : counts_) c.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Adds the counts of this histogram to totals (any thread).
+ * @param counts Per-bucket totals (kBuckets entries).
+ * @param sum Sum of the recorded values, added to.
+ * @param count Number of recorded values, added to.
+ */
+void LatencyHistogram::addTo(std::vector<uint64_t>& counts, uint64_t& sum, uint64_t& count) const {
+    counts.resize(kBuckets, 0);
+    for (unsigned i = 0; i < kBuckets; ++i) {
+        uint64_t n = counts_[i].load(std::memory_order_relaxed);
+        counts[i] += n;
+        count += n;
+    }
+    sum += sum_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Smallest value of a bucket.
+ * @param bucket Bucket index.
+ * @return Lower bound.
+ */
+uint64_t LatencyHistogram::bucketLow(unsigned bucket) {
+    if (bucket < kSubCount) return bucket;
+    unsigned shift = bucket / kSubCount - 1;
+    return static_cast<uint64_t>(kSubCount + bucket % kSubCount) << shift;
+}
+
+/**
+ * @brief Largest value of a bucket.
+ * @param bucket Bucket index.
+ * @return Upper bound (inclusive).
+ */
+uint64_t LatencyHistogram::bucketHigh(unsigned bucket) {
+    if (bucket < kSubCount) return bucket;
+    unsigned shift = bucket / kSubCount - 1;
+    return bucketLow(bucket) + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+/**
+ * @brief Value at a quantile of per-bucket totals (bucket midpoint).
+ * @param counts Per-bucket totals from addTo().
+ * @param count Total number of values.
+ * @param q Quantile in [0, 1].
+ * @return Estimated value, or 0 if count is 0.
+ */
+uint64_t LatencyHistogram::quantile(const std::vector<uint64_t>& counts, uint64_t count, double q) {
+    if (count == 0) return 0;
+    // Rank of the value, 1-based: the smallest bucket whose running total reaches it holds it
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) return bucketLow(i) + (bucketHigh(i) - bucketLow(i)) / 2;
+    }
+    return bucketHigh(kBuckets - 1);
+}
+
+/**
+ * @brief Constructs zeroed metrics.
+ * @param sampleEvery Time one request in this many (rounded down to a power of two; 0 = never).
+ */
+WorkerMetrics::WorkerMetrics(unsigned sampleEvery) : sampleMask(~0u), sampleTick(0) {
+    for (std::atomic<uint64_t>& c : byCode) c.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t>& c : errors) c.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t>& c : dropped) c.store(0, std::memory_order_relaxed);
+    if (sampleEvery > 0) {
+        unsigned period = 1;
+        while (period <= sampleEvery / 2) period *= 2;
+        sampleMask = period - 1;
+    }
+}
+
+/**
+ * @brief Appends one metric family in the Prometheus text format.
+ * @param out Exposition text, appended to.
+ * @param name Metric name.
+ * @param type "counter" or "gauge".
+ * @param help Help text.
+ * @param samples Samples of the family.
+ */
+void appendMetric(std::string& out, const char* name, const char* type, const char* help,
+                  const std::vector<MetricSample>& samples) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    out += line;
+    for (const MetricSample& sample : samples) {
+        if (sample.labels.empty()) std::snprintf(line, sizeof(line), "%s %.17g\n", name, sample.value);
+        else std::snprintf(line, sizeof(line), "%s{%s} %.17g\n", name, sample.labels.c_str(), sample.value);
+        out += line;
+    }
+}
+
+/**
+ * @brief Appends the counters and stage latency summaries of all workers.
+ *        Latency histograms are merged across workers before quantiles are taken.
+ * @param out Exposition text, appended to.
+ * @param workers Metrics of every worker, in worker order.
+ * @param tick Counters of the subscriber tick timer, labelled worker="tick" (null = none).
+ */
+void appendWorkerMetrics(std::string& out, const std::vector<const WorkerMetrics*>& workers, const WorkerMetrics* tick) {
+    std::vector<MetricSample> requests, responses, errors, dropped, byCode, cacheHits, cacheMisses;
+    uint64_t codes[kCodeSlots] = {};
+    uint64_t hits = 0, misses = 0;
+    for (size_t w = 0; w < workers.size() + (tick ? 1 : 0); ++w) {
+        const WorkerMetrics& m = (w < workers.size()) ? *workers[w] : *tick;
+        std::string worker = "worker=\"" + ((w < workers.size()) ? std::to_string(w) : std::string("tick")) + "\"";
+        requests.push_back(MetricSample{ worker, static_cast<double>(m.requests.load(std::memory_order_relaxed)) });
+        responses.push_back(MetricSample{ worker, static_cast<double>(m.responses.load(std::memory_order_relaxed)) });
+        for (int k = 0; k < static_cast<int>(ErrorKind::Count); ++k) {
+            errors.push_back(MetricSample{ worker + ",kind=\"" + errorKindName(static_cast<ErrorKind>(k)) + "\"",
+                                           static_cast<double>(m.errors[k].load(std::memory_order_relaxed)) });
+        }
+        for (int r = 0; r < static_cast<int>(DropReason::Count); ++r) {
+            dropped.push_back(MetricSample{ worker + ",reason=\"" + dropReasonName(static_cast<DropReason>(r)) + "\"",
+                                            static_cast<double>(m.dropped[r].load(std::memory_order_relaxed)) });
+        }
+        for (unsigned c = 0; c < kCodeSlots; ++c) codes[c] += m.byCode[c].load(std::memory_order_relaxed);
+        uint64_t workerHits = m.cacheHits.load(std::memory_order_relaxed);
+        uint64_t workerMisses = m.cacheMisses.load(std::memory_order_relaxed);
+        cacheHits.push_back(MetricSample{ worker, static_cast<double>(workerHits) });
+        cacheMisses.push_back(MetricSample{ worker, static_cast<double>(workerMisses) });
+        hits += workerHits;
+        misses += workerMisses;
+    }
+    for (unsigned c = 0; c < kCodeSlots; ++c) {
+        const char* name = (c == 0) ? "Invalid" : wire::kCodes[c].name;
+        byCode.push_back(MetricSample{ std::string("code=\"") + name + "\"", static_cast<double>(codes[c]) });
+    }
+    appendMetric(out, "timeserver_requests_total", "counter", "Requests received.", requests);
+    appendMetric(out, "timeserver_responses_total", "counter", "Responses sent.", responses);
+    appendMetric(out, "timeserver_errors_total", "counter", "Failures by kind.", errors);
+    appendMetric(out, "timeserver_dropped_total", "counter", "Datagrams refused by admission control, shed under overload or rejected as malformed.", dropped);
+    appendMetric(out, "timeserver_requests_by_code_total", "counter", "Requests received, by request code.", byCode);
+    appendMetric(out, "timeserver_reply_cache_hits_total", "counter", "Legacy replies served from the reply cache.", cacheHits);
+    appendMetric(out, "timeserver_reply_cache_misses_total", "counter", "Cacheable legacy replies that had to be formatted.", cacheMisses);
+    double ratio = (hits + misses) ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0;
+    appendMetric(out, "timeserver_reply_cache_hit_ratio", "gauge", "Reply cache hits over lookups since start.",
+                 { MetricSample{ std::string(), ratio } });
+
+    static const double kQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    out += "# HELP timeserver_stage_latency_seconds Sampled latency of each request stage.\n"
+           "# TYPE timeserver_stage_latency_seconds summary\n";
+    char line[160];
+    for (int s = 0; s < static_cast<int>(Stage::Count); ++s) {
+        std::vector<uint64_t> counts;
+        uint64_t sum = 0, count = 0;
+        for (const WorkerMetrics* m : workers) m->stages[s].addTo(counts, sum, count);
+        const char* stage = stageName(static_cast<Stage>(s));
+        for (double q : kQuantiles) {
+            double seconds = static_cast<double>(LatencyHistogram::quantile(counts, count, q)) * 1e-9;
+            std::snprintf(line, sizeof(line), "timeserver_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9g\n",
+                          stage, q, seconds);
+            out += line;
+        }
+        std::snprintf(line, sizeof(line), "timeserver_stage_latency_seconds_sum{stage=\"%s\"} %.9g\n"
+                                          "timeserver_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+                      stage, static_cast<double>(sum) * 1e-9, stage, static_cast<unsigned long long>(count));
+        out += line;
+    }
+}
+
+/**
+ * @brief Constructs a stopped exporter.
+ */
+MetricsExporter::MetricsExporter() : listen_(INVALID_SOCKET), running_(false) {}
+
+/**
+ * @brief Destructor. Stops the exporter.
+ */
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+/**
+ * @brief Listens on an address and starts serving scrapes.
+ * @param addr Address to listen on (IPv4 or IPv6).
+ * @param render Renderer called on the exporter thread for each scrape.
+ * @return true on success, false otherwise.
+ */
+bool MetricsExporter::start(const sockaddr_storage& addr, Renderer render) {
+    listen_ = socket(addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (INVALID_SOCKET == listen_) {
+        logError("socket(metrics)");
+        return false;
+    }
+    if (SOCKET_ERROR == bind(listen_, (const sockaddr*)&addr, addressLength(addr)) ||
+        SOCKET_ERROR == listen(listen_, 8)) {
+        logError("bind(metrics)");
+        closesocket(listen_);
+        listen_ = INVALID_SOCKET;
+        return false;
+    }
+    render_ = std::move(render);
+    running_.store(true, std::memory_order_release);
+    thread_ = std::thread([this]() { serve(); });
+    return true;
+}
+
+/**
+ * @brief Stops serving and joins the exporter thread.
+ */
+void MetricsExporter::stop() {
+    if (!running_.exchange(false)) return;
+    // Closing the listening socket makes the blocked accept() fail
+    closesocket(listen_);
+    listen_ = INVALID_SOCKET;
+    if (thread_.joinable()) thread_.join();
+}
+
+/**
+ * @brief Exporter thread: accepts connections and answers GET /metrics.
+ */
+void MetricsExporter::serve() {
+    while (running_.load(std::memory_order_acquire)) {
+        SOCKET conn = accept(listen_, nullptr, nullptr);
+        if (INVALID_SOCKET == conn) {
+            if (running_.load(std::memory_order_acquire)) logError("accept(metrics)");
+            continue;
+        }
+        answer(conn);
+        closesocket(conn);
+    }
+}
+
+/**
+ * @brief Answers one HTTP request on an accepted connection.
+ * @param conn Connected socket.
+ */
+void MetricsExporter::answer(SOCKET conn) {
+    // A slow or silent peer must not hold the exporter for long
+    DWORD timeoutMs = 2000;
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeoutMs, sizeof(timeoutMs));
+    char request[1024];
+    int got = 0;
+    while (got < static_cast<int>(sizeof(request)) - 1) {
+        int n = recv(conn, request + got, static_cast<int>(sizeof(request)) - 1 - got, 0);
+        if (n <= 0) break;
+        got += n;
+        request[got] = '\0';
+        if (std::strstr(request, "\r\n\r\n")) break;
+    }
+    request[got] = '\0';
+
+    std::string body;
+    const char* status = "404 Not Found";
+    if (std::strncmp(request, "GET /metrics ", 13) == 0 || std::strncmp(request, "GET / ", 6) == 0) {
+        status = "200 OK";
+        body = render_();
+    }
+    char head[160];
+    int headLen = std::snprintf(head, sizeof(head),
+        "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+        status, static_cast<unsigned>(body.size()));
+    std::string reply(head, static_cast<size_t>(headLen));
+    reply += body;
+    size_t sent = 0;
+    while (sent < reply.size()) {
+        int n = send(conn, reply.data() + sent, static_cast<int>(reply.size() - sent), 0);
+        if (n <= 0) break;
+        sent += static_cast<size_t>(n);
+    }
+    shutdown(conn, SD_SEND);
+}
+
+/**
+ * @brief Parses the metrics listen address: "PORT" (loopback), "HOST:PORT" or "[V6]:PORT".
+ * @param value Address given on the command line.
+ * @param host Receives the host (127.0.0.1 if only a port is given).
+ * @param port Receives the port.
+ * @return true if the value is well formed, false otherwise.
+ */
+bool parseMetricsAddress(const std::string& value, std::string& host, unsigned short& port) {
+    size_t colon = value.rfind(':');
+    std::string portText = (colon == std::string::npos) ? value : value.substr(colon + 1);
+    host = (colon == std::string::npos) ? std::string("127.0.0.1") : value.substr(0, colon);
+    if (portText.empty() || host.empty() || portText.find_first_not_of("0123456789") != std::string::npos) return false;
+    unsigned long number = std::strtoul(portText.c_str(), nullptr, 10);
+    if (number == 0 || number > 65535) return false;
+    port = static_cast<unsigned short>(number);
+    return true;
+}
@@ -0,0 +1,323 @@
+/**
+ * @file metrics.h
+ * @brief Per-worker counters, latency histograms and the Prometheus text endpoint of the server.
+ *
+ * Every worker owns one WorkerMetrics and is its only writer, so counting is a plain relaxed
+ * load and store on a cache line no other worker writes, without locked instructions. Latency is
+ * taken for one request in latencySampleEvery, so the clock is read rarely; counters are exact.
+ * Readers (the metrics endpoint, the throughput report) only load relaxed values, so a scrape
+ * never stalls the workers and nothing is aggregated until somebody asks.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Common/protocol.h"
+#include "admission.h"
+
+/**
+ * @brief Adds to a counter that only the calling thread writes (no locked instruction).
+ * @param counter Counter owned by the calling thread.
+ * @param n Amount to add.
+ */
+inline void bumpCounter(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Monotonic clock used for stage latencies.
+ * @return Nanoseconds since an arbitrary epoch.
+ */
+inline uint64_t metricsNowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief Request processing stages that are timed.
+ */
+enum class Stage {
+    Decode,   /**< Decoding (or its share of the batch decode) and accounting a received datagram (acceptRequest). */
+    Dispatch, /**< Running the handler up to the reply (dispatch, without sending). */
+    Send,     /**< Sending or queueing the reply (sendResponse). */
+    Total,    /**< Whole request, from the datagram to the sent reply. */
+    Count     /**< Number of stages. */
+};
+
+/**
+ * @brief Name of a stage as used in metric labels.
+ * @param stage Stage.
+ * @return "decode", "dispatch", "send" or "total".
+ */
+const char* stageName(Stage stage);
+
+/**
+ * @brief Log-linear (HDR-style) histogram of nanosecond values with a single writer.
+ *
+ * Values below 8 have a bucket each; above, every power of two is split into 8 buckets, so a
+ * bucket is at most 12.5% wide relative to its value and 496 buckets cover the whole uint64 range.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBits = 3;                          /**< Sub-buckets per power of two = 2^kSubBits. */
+    static constexpr unsigned kSubCount = 1u << kSubBits;            /**< Sub-buckets per power of two. */
+    static constexpr unsigned kBuckets = (64 - kSubBits) * kSubCount + kSubCount; /**< Bucket count. */
+
+    /**
+     * @brief Constructs an empty histogram.
+     */
+    LatencyHistogram();
+
+    /**
+     * @brief Records one value (owning thread only).
+     * @param ns Value in nanoseconds.
+     */
+    void record(uint64_t ns) {
+        bumpCounter(counts_[bucketOf(ns)]);
+        bumpCounter(sum_, ns);
+    }
+
+    /**
+     * @brief Adds the counts of this histogram to totals (any thread).
+     * @param counts Per-bucket totals (kBuckets entries).
+     * @param sum Sum of the recorded values, added to.
+     * @param count Number of recorded values, added to.
+     */
+    void addTo(std::vector<uint64_t>& counts, uint64_t& sum, uint64_t& count) const;
+
+    /**
+     * @brief Bucket of a value.
+     * @param v Value.
+     * @return Bucket index (< kBuckets).
+     */
+    static unsigned bucketOf(uint64_t v) {
+        if (v < kSubCount) return static_cast<unsigned>(v);
+#if defined(_MSC_VER)
+        unsigned long msb;
+        _BitScanReverse64(&msb, v);
+#else
+        unsigned msb = 63u - static_cast<unsigned>(__builtin_clzll(v));
+#endif
+        unsigned shift = static_cast<unsigned>(msb) - kSubBits;
+        return (shift + 1) * kSubCount + static_cast<unsigned>((v >> shift) & (kSubCount - 1));
+    }
+
+    /**
+     * @brief Smallest value of a bucket.
+     * @param bucket Bucket index.
+     * @return Lower bound.
+     */
+    static uint64_t bucketLow(unsigned bucket);
+
+    /**
+     * @brief Largest value of a bucket.
+     * @param bucket Bucket index.
+     * @return Upper bound (inclusive).
+     */
+    static uint64_t bucketHigh(unsigned bucket);
+
+    /**
+     * @brief Value at a quantile of per-bucket totals (bucket midpoint).
+     * @param counts Per-bucket totals from addTo().
+     * @param count Total number of values.
+     * @param q Quantile in [0, 1].
+     * @return Estimated value, or 0 if count is 0.
+     */
+    static uint64_t quantile(const std::vector<uint64_t>& counts, uint64_t count, double q);
+
+private:
+    std::atomic<uint64_t> counts_[kBuckets]; /**< Values per bucket. */
+    std::atomic<uint64_t> sum_;              /**< Sum of the recorded values. */
+};
+
+/**
+ * @brief Failure kinds counted per worker.
+ */
+enum class ErrorKind {
+    Dispatch, /**< Request not answered (unknown code, bad parameters or failed send). */
+    Send,     /**< sendto or queueing the reply failed. */
+    Flush,    /**< Committing a batch of replies failed. */
+    Count     /**< Number of kinds. */
+};
+
+/**
+ * @brief Name of an error kind as used in metric labels.
+ * @param kind Error kind.
+ * @return "dispatch", "send" or "flush".
+ */
+const char* errorKindName(ErrorKind kind);
+
+/**
+ * @brief Number of per-code request counters: slot 0 counts invalid and unknown codes.
+ */
+static constexpr unsigned kCodeSlots = static_cast<unsigned>(wire::kCodeCount);
+
+/**
+ * @brief Counters and histograms of one worker, written only by that worker's thread.
+ *        Padded on both sides so no other worker's writes share its cache lines.
+ */
+struct WorkerMetrics {
+    /**
+     * @brief Constructs zeroed metrics.
+     * @param sampleEvery Time one request in this many (rounded down to a power of two; 0 = never).
+     */
+    explicit WorkerMetrics(unsigned sampleEvery);
+
+    /**
+     * @brief Counts a request by code.
+     * @param code Decoded request code.
+     */
+    void countRequest(ReqCode code) {
+        bumpCounter(requests);
+        bumpCounter(byCode[wire::codeSlot(code)]);
+    }
+
+    /**
+     * @brief Counts a failure.
+     * @param kind Failure kind.
+     */
+    void countError(ErrorKind kind) { bumpCounter(errors[static_cast<int>(kind)]); }
+
+    /**
+     * @brief Counts datagrams refused by admission control, shed by the scheduler or rejected as malformed.
+     * @param reason Drop reason.
+     * @param n Number of datagrams.
+     */
+    void countDrop(DropReason reason, uint64_t n = 1) { bumpCounter(dropped[static_cast<int>(reason)], n); }
+
+    /**
+     * @brief Decides whether the next request is timed.
+     * @return true for one request in the sampling period.
+     */
+    bool sampleNext() { return sampleMask != ~0u && (++sampleTick & sampleMask) == 0; }
+
+    /**
+     * @brief Whether one of the next calls to sampleNext() will time its request.
+     * @param n Number of calls.
+     * @return true if a sampled request falls within the next n.
+     */
+    bool sampleWithin(unsigned n) const {
+        return sampleMask != ~0u && n > sampleMask - (sampleTick & sampleMask);
+    }
+
+    /**
+     * @brief Records the latency of a stage.
+     * @param stage Stage.
+     * @param ns Duration in nanoseconds.
+     */
+    void record(Stage stage, uint64_t ns) { stages[static_cast<int>(stage)].record(ns); }
+
+    char padBefore[64];
+    std::atomic<uint64_t> requests{ 0 };                                /**< Requests received. */
+    std::atomic<uint64_t> responses{ 0 };                               /**< Responses sent. */
+    std::atomic<uint64_t> byCode[kCodeSlots];                           /**< Requests per code. */
+    std::atomic<uint64_t> errors[static_cast<int>(ErrorKind::Count)];   /**< Failures per kind. */
+    std::atomic<uint64_t> dropped[static_cast<int>(DropReason::Count)]; /**< Datagrams refused by admission control, shed by the scheduler or rejected as malformed. */
+    std::atomic<uint64_t> cacheHits{ 0 };                               /**< Legacy replies served from the reply cache. */
+    std::atomic<uint64_t> cacheMisses{ 0 };                             /**< Cacheable legacy replies that had to be formatted. */
+    unsigned sampleMask;                                                /**< Timed when (tick & mask) == 0; ~0 = off. */
+    unsigned sampleTick;                                                /**< Requests seen by sampleNext(). */
+    LatencyHistogram stages[static_cast<int>(Stage::Count)];            /**< Latency per stage (sampled). */
+    char padAfter[64];
+};
+
+/**
+ * @brief Minimal HTTP endpoint serving the Prometheus text format on a side port.
+ *
+ * A dedicated thread blocks in accept(), so the exporter costs nothing between scrapes; each
+ * scrape renders a fresh snapshot with the renderer.
+ */
+class MetricsExporter {
+public:
+    /**
+     * @brief Builds the exposition text of one scrape.
+     */
+    using Renderer = std::function<std::string()>;
+
+    /**
+     * @brief Constructs a stopped exporter.
+     */
+    MetricsExporter();
+
+    /**
+     * @brief Destructor. Stops the exporter.
+     */
+    ~MetricsExporter();
+
+    /**
+     * @brief Listens on an address and starts serving scrapes.
+     * @param addr Address to listen on (IPv4 or IPv6).
+     * @param render Renderer called on the exporter thread for each scrape.
+     * @return true on success, false otherwise.
+     */
+    bool start(const sockaddr_storage& addr, Renderer render);
+
+    /**
+     * @brief Stops serving and joins the exporter thread.
+     */
+    void stop();
+
+private:
+    /**
+     * @brief Exporter thread: accepts connections and answers GET /metrics.
+     */
+    void serve();
+
+    /**
+     * @brief Answers one HTTP request on an accepted connection.
+     * @param conn Connected socket.
+     */
+    void answer(SOCKET conn);
+
+    SOCKET listen_;               /**< Listening socket. */
+    Renderer render_;             /**< Builds the exposition text. */
+    std::atomic<bool> running_;   /**< Cleared by stop(). */
+    std::thread thread_;          /**< Exporter thread. */
+};
+
+/**
+ * @brief One sample of a metric: its label set (e.g. worker="0") and value.
+ */
+struct MetricSample {
+    std::string labels; /**< Labels without braces, or empty. */
+    double value;       /**< Sample value. */
+};
+
+/**
+ * @brief Appends one metric family in the Prometheus text format.
+ * @param out Exposition text, appended to.
+ * @param name Metric name.
+ * @param type "counter" or "gauge".
+ * @param help Help text.
+ * @param samples Samples of the family.
+ */
+void appendMetric(std::string& out, const char* name, const char* type, const char* help,
+                  const std::vector<MetricSample>& samples);
+
+/**
+ * @brief Appends the counters and stage latency summaries of all workers.
+ *        Latency histograms are merged across workers before quantiles are taken.
+ * @param out Exposition text, appended to.
+ * @param workers Metrics of every worker, in worker order.
+ * @param tick Counters of the subscriber tick timer, labelled worker="tick" (null = none).
+ */
+void appendWorkerMetrics(std::string& out, const std::vector<const WorkerMetrics*>& workers, const WorkerMetrics* tick = nullptr);
+
+/**
+ * @brief Parses the metrics listen address: "PORT" (loopback), "HOST:PORT" or "[V6]:PORT".
+ * @param value Address given on the command line.
+ * @param host Receives the host (127.0.0.1 if only a port is given).
+ * @param port Receives the port.
+ * @return true if the value is well formed, false otherwise.
+ */
+bool parseMetricsAddress(const std::string& value, std::string& host, unsigned short& port);
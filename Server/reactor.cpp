@@ -0,0 +1,417 @@
+/**
+ * @file reactor.cpp
+ * @brief IOCP and select() implementations of the server event loop.
+ *
+ * The IOCP backend keeps overlapped WSARecvFrom calls in flight on every socket (WSARecvMsg when
+ * receive stamps are on, so the control messages come back with the data); any loop
+ * thread dequeues a completion, runs the handler on the received buffer and re-posts it. The
+ * select() backend puts the sockets in non-blocking mode and drains each readable one; a
+ * loopback socket nobody reads from wakes every loop on stop().
+ * Compatible with C++14.
+ */
+#include "reactor.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief Largest number of datagrams drained from one readable socket before the others
+ *        get their turn (select() backend).
+ */
+constexpr int kMaxDrain = 64;
+
+/**
+ * @brief Converts a wait to a Win32 timeout, rounding up so a timer is never woken early.
+ * @param wait Time until the next deadline (clock::duration::max() for none).
+ * @return Timeout in milliseconds, or INFINITE.
+ */
+DWORD timeoutMs(Reactor::clock::duration wait) {
+    if (wait == Reactor::clock::duration::max()) return INFINITE;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wait + std::chrono::milliseconds(1) - Reactor::clock::duration(1));
+    return static_cast<DWORD>(std::min<long long>(ms.count(), INFINITE - 1));
+}
+
+/**
+ * @brief Reactor on an I/O completion port.
+ */
+class IocpReactor : public Reactor {
+public:
+    explicit IocpReactor(size_t slotSize) : port_(NULL), slotSize_(slotSize), pending_(0) {}
+
+    /**
+     * @brief Cancels the receives in flight and waits for their completions before the
+     *        buffers they write into are freed.
+     */
+    ~IocpReactor() override {
+        for (SOCKET sock : sockets_) CancelIoEx(reinterpret_cast<HANDLE>(sock), NULL);
+        while (pending_.load() > 0) {
+            DWORD bytes = 0;
+            ULONG_PTR key = 0;
+            OVERLAPPED* overlapped = nullptr;
+            BOOL ok = GetQueuedCompletionStatus(port_, &bytes, &key, &overlapped, 1000);
+            if (overlapped) --pending_;
+            else if (!ok) break; // Timed out
+        }
+        if (port_) CloseHandle(port_);
+    }
+
+    /**
+     * @brief Creates the completion port.
+     * @return true on success, false otherwise.
+     */
+    bool open() {
+        port_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+        if (!port_) {
+            logError("CreateIoCompletionPort");
+            return false;
+        }
+        return true;
+    }
+
+    const char* name() const override { return "iocp"; }
+
+    bool add(SOCKET sock, unsigned depth) override {
+        prepareStamps(sock);
+        if (!CreateIoCompletionPort(reinterpret_cast<HANDLE>(sock), port_, static_cast<ULONG_PTR>(sock), 0)) {
+            logError("CreateIoCompletionPort(socket)");
+            return false;
+        }
+        sockets_.push_back(sock);
+        for (unsigned i = 0; i < std::max(depth, 1u); ++i) {
+            std::unique_ptr<Receive> receive(new Receive(sock, slotSize_));
+            if (!post(*receive)) return false;
+            receives_.push_back(std::move(receive));
+        }
+        return true;
+    }
+
+    void run(unsigned loop) override {
+        while (!stopping()) {
+            DWORD timeout = (loop == 0) ? timeoutMs(runTimers()) : INFINITE;
+            DWORD bytes = 0;
+            ULONG_PTR key = 0;
+            OVERLAPPED* overlapped = nullptr;
+            BOOL ok = GetQueuedCompletionStatus(port_, &bytes, &key, &overlapped, timeout);
+            if (!overlapped) continue; // Timer deadline or wake-up packet
+            Receive* receive = CONTAINING_RECORD(overlapped, Receive, overlapped);
+            --pending_;
+            // A failed receive (e.g. WSAECONNRESET after an ICMP port unreachable) is only re-posted
+            if (ok && recvMsg_) {
+                uint64_t stamp = findReceiveStamp(receive->control, sizeof(receive->control));
+                handler_(loop, receive->sock, receive->data.data(), bytes, receive->from, receive->msg.namelen, stamp);
+            }
+            else if (ok) {
+                handler_(loop, receive->sock, receive->data.data(), bytes, receive->from, receive->fromLen, 0);
+            }
+            if (!stopping()) post(*receive);
+        }
+        // Pass the wake-up on to the next loop still blocked in the port
+        PostQueuedCompletionStatus(port_, 0, 0, NULL);
+    }
+
+protected:
+    void wake() override {
+        PostQueuedCompletionStatus(port_, 0, 0, NULL);
+    }
+
+private:
+    /**
+     * @brief One overlapped receive and the buffer it fills.
+     */
+    struct Receive {
+        Receive(SOCKET sock_, size_t size) : sock(sock_), fromLen(0), flags(0), data(size) {}
+        OVERLAPPED overlapped;  /**< Completion key of the receive. */
+        SOCKET sock;            /**< Socket the receive is posted on. */
+        sockaddr_storage from;  /**< Sender address. */
+        INT fromLen;            /**< Length of from. */
+        DWORD flags;            /**< WSARecvFrom flags. */
+        WSABUF buf;             /**< Points into data. */
+        WSAMSG msg;             /**< WSARecvMsg arguments (receive stamps). */
+        char control[kStampControlBytes]; /**< Control messages of WSARecvMsg. */
+        std::vector<char> data; /**< Datagram buffer. */
+    };
+
+    /**
+     * @brief Posts an overlapped receive.
+     * @param receive Receive to post.
+     * @return true if the receive is in flight, false otherwise.
+     */
+    bool post(Receive& receive) {
+        memset(&receive.overlapped, 0, sizeof(receive.overlapped));
+        receive.buf.buf = receive.data.data();
+        receive.buf.len = static_cast<ULONG>(receive.data.size());
+        receive.fromLen = sizeof(receive.from);
+        receive.flags = 0;
+        ++pending_;
+        int result;
+        if (recvMsg_) {
+            // Zeroed, so the stamp is found by walking the buffer whatever length is reported
+            memset(receive.control, 0, sizeof(receive.control));
+            memset(&receive.msg, 0, sizeof(receive.msg));
+            receive.msg.name = (sockaddr*)&receive.from;
+            receive.msg.namelen = sizeof(receive.from);
+            receive.msg.lpBuffers = &receive.buf;
+            receive.msg.dwBufferCount = 1;
+            receive.msg.Control.buf = receive.control;
+            receive.msg.Control.len = sizeof(receive.control);
+            result = recvMsg_(receive.sock, &receive.msg, NULL, &receive.overlapped, NULL);
+        }
+        else {
+            result = WSARecvFrom(receive.sock, &receive.buf, 1, NULL, &receive.flags,
+                                 (sockaddr*)&receive.from, &receive.fromLen, &receive.overlapped, NULL);
+        }
+        if (SOCKET_ERROR == result && WSA_IO_PENDING != WSAGetLastError()) {
+            --pending_;
+            logError(recvMsg_ ? "WSARecvMsg" : "WSARecvFrom");
+            return false;
+        }
+        return true;
+    }
+
+    HANDLE port_;                                   /**< Completion port of all sockets. */
+    size_t slotSize_;                               /**< Bytes per receive buffer. */
+    std::vector<SOCKET> sockets_;                   /**< Registered sockets. */
+    std::vector<std::unique_ptr<Receive>> receives_;/**< Receives owned by the reactor. */
+    std::atomic<int> pending_;                      /**< Receives posted and not yet dequeued. */
+};
+
+/**
+ * @brief Reactor polling non-blocking sockets with select().
+ */
+class SelectReactor : public Reactor {
+public:
+    explicit SelectReactor(size_t slotSize) : wake_(INVALID_SOCKET), slotSize_(slotSize) {
+        memset(&wakeAddr_, 0, sizeof(wakeAddr_));
+    }
+
+    ~SelectReactor() override {
+        if (wake_ != INVALID_SOCKET) closesocket(wake_);
+    }
+
+    /**
+     * @brief Binds the loopback wake-up socket.
+     * @return true on success, false otherwise.
+     */
+    bool open() {
+        wake_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (INVALID_SOCKET == wake_) {
+            logError("socket");
+            return false;
+        }
+        wakeAddr_.sin_family = AF_INET;
+        wakeAddr_.sin_addr.s_addr = htonl(0x7F000001); // 127.0.0.1, any free port
+        int len = sizeof(wakeAddr_);
+        if (SOCKET_ERROR == bind(wake_, (const sockaddr*)&wakeAddr_, sizeof(wakeAddr_)) ||
+            SOCKET_ERROR == getsockname(wake_, (sockaddr*)&wakeAddr_, &len)) {
+            logError("bind(wake-up socket)");
+            return false;
+        }
+        return true;
+    }
+
+    const char* name() const override { return "select"; }
+
+    bool add(SOCKET sock, unsigned) override {
+        if (sockets_.size() + 1 >= FD_SETSIZE) {
+            logFormat(LogLevel::Error, "Reactor: select() watches at most %d sockets.", (int)FD_SETSIZE - 1);
+            return false;
+        }
+        prepareStamps(sock);
+        u_long nonBlocking = 1;
+        if (SOCKET_ERROR == ioctlsocket(sock, FIONBIO, &nonBlocking)) {
+            logError("ioctlsocket(FIONBIO)");
+            return false;
+        }
+        sockets_.push_back(sock);
+        return true;
+    }
+
+    void run(unsigned loop) override {
+        std::vector<char> buf(slotSize_);
+        while (!stopping()) {
+            timeval wait;
+            timeval* waitPtr = nullptr;
+            if (loop == 0) {
+                clock::duration next = runTimers();
+                if (next != clock::duration::max()) {
+                    long long us = std::chrono::duration_cast<std::chrono::microseconds>(next).count() + 1;
+                    wait.tv_sec = static_cast<long>(us / 1000000);
+                    wait.tv_usec = static_cast<long>(us % 1000000);
+                    waitPtr = &wait;
+                }
+            }
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(wake_, &readable);
+            for (SOCKET sock : sockets_) FD_SET(sock, &readable);
+            if (SOCKET_ERROR == select(0, &readable, nullptr, nullptr, waitPtr)) {
+                logError("select");
+                return;
+            }
+            for (SOCKET sock : sockets_) {
+                if (FD_ISSET(sock, &readable)) drain(loop, sock, buf);
+            }
+        }
+    }
+
+protected:
+    void wake() override {
+        // Never read, so the socket stays readable and every loop returns from select()
+        char byte = 0;
+        sendto(wake_, &byte, 1, 0, (const sockaddr*)&wakeAddr_, sizeof(wakeAddr_));
+    }
+
+private:
+    /**
+     * @brief Hands up to kMaxDrain queued datagrams of a socket to the handler.
+     * @param loop Loop index.
+     * @param sock Readable socket.
+     * @param buf Receive buffer of the loop.
+     */
+    void drain(unsigned loop, SOCKET sock, std::vector<char>& buf) {
+        for (int i = 0; i < kMaxDrain; ++i) {
+            sockaddr_storage from;
+            int fromLen = sizeof(from);
+            int len = recvMsg_ ? receiveMsg(sock, buf, from, fromLen) :
+                                 recvfrom(sock, buf.data(), static_cast<int>(buf.size()), 0, (sockaddr*)&from, &fromLen);
+            if (SOCKET_ERROR == len) {
+                int error = WSAGetLastError();
+                if (WSAEWOULDBLOCK == error) return; // Drained, or another loop was faster
+                if (WSAECONNRESET != error) logError(recvMsg_ ? "WSARecvMsg" : "recvfrom");
+                continue;
+            }
+            uint64_t stamp = recvMsg_ ? findReceiveStamp(control_, sizeof(control_)) : 0;
+            handler_(loop, sock, buf.data(), static_cast<size_t>(len), from, fromLen, stamp);
+        }
+    }
+
+    /**
+     * @brief Receives one datagram with WSARecvMsg, leaving its control messages in control_.
+     * @param sock Readable socket.
+     * @param buf Receive buffer of the loop.
+     * @param from Receives the sender address.
+     * @param fromLen Receives the sender address length.
+     * @return Datagram length, or SOCKET_ERROR.
+     */
+    int receiveMsg(SOCKET sock, std::vector<char>& buf, sockaddr_storage& from, int& fromLen) {
+        WSABUF data;
+        data.buf = buf.data();
+        data.len = static_cast<ULONG>(buf.size());
+        memset(control_, 0, sizeof(control_));
+        WSAMSG msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.name = (sockaddr*)&from;
+        msg.namelen = fromLen;
+        msg.lpBuffers = &data;
+        msg.dwBufferCount = 1;
+        msg.Control.buf = control_;
+        msg.Control.len = sizeof(control_);
+        DWORD bytes = 0;
+        if (SOCKET_ERROR == recvMsg_(sock, &msg, &bytes, NULL, NULL)) return SOCKET_ERROR;
+        fromLen = msg.namelen;
+        return static_cast<int>(bytes);
+    }
+
+    static thread_local char control_[kStampControlBytes]; /**< Control messages of the last WSARecvMsg on this loop. */
+    SOCKET wake_;                 /**< Loopback socket made readable by wake(). */
+    sockaddr_in wakeAddr_;        /**< Address wake_ is bound to. */
+    size_t slotSize_;             /**< Receive buffer size. */
+    std::vector<SOCKET> sockets_; /**< Registered sockets. */
+};
+
+thread_local char SelectReactor::control_[kStampControlBytes];
+
+} // namespace
+
+/**
+ * @brief Parses a reactor name (auto, iocp, select).
+ * @param name Name given on the command line.
+ * @param kind Receives the parsed kind.
+ * @return true if the name is known, false otherwise.
+ */
+bool parseReactorKind(const std::string& name, ReactorKind& kind) {
+    if (name == "auto") kind = ReactorKind::Auto;
+    else if (name == "iocp") kind = ReactorKind::Iocp;
+    else if (name == "select") kind = ReactorKind::Select;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief Creates a reactor of the given kind.
+ * @param kind Requested mechanism (Auto falls back to select() if IOCP is unavailable).
+ * @param slotSize Largest datagram received, in bytes.
+ * @param receiveStamps Receive with WSARecvMsg and pass each datagram's stack timestamp to
+ *        the handler (the sockets must have them enabled, see enableReceiveStamps()).
+ * @return Reactor, or null if the mechanism could not be set up.
+ */
+std::unique_ptr<Reactor> Reactor::create(ReactorKind kind, size_t slotSize, bool receiveStamps) {
+    if (kind != ReactorKind::Select) {
+        std::unique_ptr<IocpReactor> iocp(new IocpReactor(slotSize));
+        if (iocp->open()) {
+            iocp->receiveStamps_ = receiveStamps;
+            return std::move(iocp);
+        }
+        if (kind == ReactorKind::Iocp) return nullptr;
+        logFormat(LogLevel::Warn, "Reactor: IOCP unavailable; using select().");
+    }
+    std::unique_ptr<SelectReactor> poller(new SelectReactor(slotSize));
+    if (poller->open()) {
+        poller->receiveStamps_ = receiveStamps;
+        return std::move(poller);
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Loads WSARecvMsg with the first socket added if stamps are asked for; without it
+ *        the reactor receives without stamps.
+ * @param sock Socket being added.
+ */
+void Reactor::prepareStamps(SOCKET sock) {
+    if (!receiveStamps_ || recvMsg_) return;
+    recvMsg_ = loadRecvMsg(sock);
+    if (!recvMsg_) {
+        logFormat(LogLevel::Warn, "Reactor: WSARecvMsg unavailable; receiving without timestamps.");
+        receiveStamps_ = false;
+    }
+}
+
+/**
+ * @brief Adds a periodic timer (before run()).
+ * @param interval Period of the timer.
+ * @param handler Task to run.
+ */
+void Reactor::addTimer(clock::duration interval, TimerHandler handler) {
+    timers_.push_back(Timer{ clock::now() + interval, interval, std::move(handler) });
+}
+
+/**
+ * @brief Ends every run() call; safe to call from any thread.
+ */
+void Reactor::stop() {
+    stopping_.store(true, std::memory_order_release);
+    wake();
+}
+
+/**
+ * @brief Runs the due timers.
+ * @return Time until the next deadline, or clock::duration::max() without timers.
+ */
+Reactor::clock::duration Reactor::runTimers() {
+    if (timers_.empty()) return clock::duration::max();
+    clock::time_point now = clock::now();
+    clock::time_point earliest = clock::time_point::max();
+    for (Timer& timer : timers_) {
+        if (timer.next <= now) {
+            timer.handler();
+            timer.next += timer.interval;
+            now = clock::now();
+            if (timer.next < now) timer.next = now + timer.interval; // Skip missed deadlines
+        }
+        earliest = std::min(earliest, timer.next);
+    }
+    return (earliest > now) ? earliest - now : clock::duration::zero();
+}
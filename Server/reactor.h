@@ -0,0 +1,154 @@
+/**
+ * @file reactor.h
+ * @brief Event loop the UDP time server is driven by (IOCP, with a select() fallback).
+ *
+ * This header provides the Reactor interface: sockets registered with a reactor deliver their
+ * datagrams to one handler, and periodic tasks run as timers on the same loop, so the server
+ * needs no blocking recvfrom() per socket and no housekeeping threads. run() may be called
+ * from several threads (one "loop" each); stop() ends all of them.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rxstamp.h"
+
+/**
+ * @brief Event notification mechanism behind a Reactor.
+ */
+enum class ReactorKind {
+    Auto,   /**< IOCP, or select() if no completion port can be created. */
+    Iocp,   /**< I/O completion port with overlapped WSARecvFrom. */
+    Select  /**< Non-blocking sockets polled with select() (at most FD_SETSIZE - 1 sockets). */
+};
+
+/**
+ * @brief Parses a reactor name (auto, iocp, select).
+ * @param name Name given on the command line.
+ * @param kind Receives the parsed kind.
+ * @return true if the name is known, false otherwise.
+ */
+bool parseReactorKind(const std::string& name, ReactorKind& kind);
+
+/**
+ * @brief Datagram event loop with periodic timers.
+ */
+class Reactor {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Called for every datagram received on a registered socket.
+     *        Arguments: loop index, socket, data, length, sender (IPv4 or IPv6), sender length,
+     *        stack receive stamp (0 if none). data and the sender are valid until it returns.
+     */
+    using DatagramHandler = std::function<void(unsigned, SOCKET, const char*, size_t, const sockaddr_storage&, int, uint64_t)>;
+
+    /**
+     * @brief Called when a timer is due.
+     */
+    using TimerHandler = std::function<void()>;
+
+    /**
+     * @brief Creates a reactor of the given kind.
+     * @param kind Requested mechanism (Auto falls back to select() if IOCP is unavailable).
+     * @param slotSize Largest datagram received, in bytes.
+     * @param receiveStamps Receive with WSARecvMsg and pass each datagram's stack timestamp to
+     *        the handler (the sockets must have them enabled, see enableReceiveStamps()).
+     * @return Reactor, or null if the mechanism could not be set up.
+     */
+    static std::unique_ptr<Reactor> create(ReactorKind kind, size_t slotSize, bool receiveStamps = false);
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~Reactor() {}
+
+    /**
+     * @brief Name of the mechanism, for logging.
+     * @return "iocp" or "select".
+     */
+    virtual const char* name() const = 0;
+
+    /**
+     * @brief Registers a bound UDP socket; its datagrams go to the handler.
+     * @param sock Socket to watch (must stay open until the reactor is destroyed).
+     * @param depth Receives kept in flight on the socket (IOCP; typically one per loop).
+     * @return true on success, false otherwise.
+     */
+    virtual bool add(SOCKET sock, unsigned depth) = 0;
+
+    /**
+     * @brief Runs the loop on the calling thread until stop().
+     *        Timers only run on loop 0, so they never run concurrently with each other.
+     * @param loop Index of this loop, passed to the handler.
+     */
+    virtual void run(unsigned loop) = 0;
+
+    /**
+     * @brief Sets the datagram handler (before run()).
+     * @param handler Handler of received datagrams.
+     */
+    void setHandler(DatagramHandler handler) { handler_ = std::move(handler); }
+
+    /**
+     * @brief Adds a periodic timer (before run()). Deadlines advance by whole intervals, so the
+     *        timer does not drift; a deadline missed by more than one interval is skipped.
+     * @param interval Period of the timer.
+     * @param handler Task to run.
+     */
+    void addTimer(clock::duration interval, TimerHandler handler);
+
+    /**
+     * @brief Ends every run() call; safe to call from any thread (e.g. a console handler).
+     */
+    void stop();
+
+    /**
+     * @brief Whether stop() has been called.
+     * @return true once stopping.
+     */
+    bool stopping() const { return stopping_.load(std::memory_order_acquire); }
+
+protected:
+    /**
+     * @brief Runs the due timers.
+     * @return Time until the next deadline, or clock::duration::max() without timers.
+     */
+    clock::duration runTimers();
+
+    /**
+     * @brief Wakes the loops blocked in the backend so they notice stop().
+     */
+    virtual void wake() = 0;
+
+    /**
+     * @brief Loads WSARecvMsg with the first socket added if stamps are asked for; without it
+     *        the reactor receives without stamps.
+     * @param sock Socket being added.
+     */
+    void prepareStamps(SOCKET sock);
+
+    DatagramHandler handler_;             /**< Handler of received datagrams. */
+    std::atomic<bool> stopping_{ false }; /**< Set by stop(). */
+    bool receiveStamps_ = false;          /**< Stamps were asked for. */
+    LPFN_WSARECVMSG recvMsg_ = nullptr;   /**< WSARecvMsg if receives return stamps, else null. */
+
+private:
+    /**
+     * @brief One periodic task.
+     */
+    struct Timer {
+        clock::time_point next;   /**< Next deadline. */
+        clock::duration interval; /**< Period. */
+        TimerHandler handler;     /**< Task to run. */
+    };
+
+    std::vector<Timer> timers_;   /**< Periodic tasks (only touched by loop 0 once running). */
+};
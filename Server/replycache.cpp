@@ -0,0 +1,86 @@
+/**
+ * @file replycache.cpp
+ * @brief Implementation of the per-worker legacy reply cache.
+ * Compatible with C++14.
+ */
+#include "replycache.h"
+
+/**
+ * @brief Creates a cache.
+ * @param entries Number of entries (rounded up to a power of two; 0 disables the cache).
+ * @param node NUMA node to place the table on, or -1 for the default policy.
+ */
+ReplyCache::ReplyCache(size_t entries, int node) : entries_(nullptr), mask_(0) {
+    static_assert(sizeof(Entry) == 64, "a cache entry must fill 64 bytes");
+    if (entries == 0) return;
+    size_t size = 1;
+    while (size < entries) size *= 2;
+    entries_ = static_cast<Entry*>(allocOnNode(size * sizeof(Entry), node)); // zeroed, page aligned
+    if (!entries_) return;
+    for (size_t i = 0; i < size; ++i) entries_[i].epoch = -1;
+    mask_ = size - 1;
+}
+
+/**
+ * @brief Destructor. Releases the table.
+ */
+ReplyCache::~ReplyCache() {
+    freeNodeMemory(entries_);
+}
+
+/**
+ * @brief Slot of a key.
+ * @param code Request code.
+ * @param key Normalized parameter.
+ * @return Index into the table.
+ */
+size_t ReplyCache::slotOf(ReqCode code, ByteView key) const {
+    // FNV-1a over the code and the key
+    uint64_t hash = 14695981039346656037ull;
+    hash = (hash ^ static_cast<unsigned char>(code)) * 1099511628211ull;
+    for (size_t i = 0; i < key.len; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(key.data[i])) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32)) & mask_;
+}
+
+/**
+ * @brief Copies the cached reply of a request, if it was stored in the same second.
+ * @param code Request code.
+ * @param key Normalized parameter (at most kMaxKey bytes).
+ * @param epoch Current second.
+ * @param out Buffer receiving the reply.
+ * @param len Receives the reply length on a hit.
+ * @return true on a hit, false on a miss.
+ */
+bool ReplyCache::lookup(ReqCode code, ByteView key, int64_t epoch, OutSpan out, size_t& len) const {
+    if (!entries_ || key.len > kMaxKey) return false;
+    const Entry& entry = entries_[slotOf(code, key)];
+    if (entry.epoch != epoch || entry.code != static_cast<uint8_t>(code) || entry.keyLen != key.len ||
+        std::memcmp(entry.key, key.data, key.len) != 0 || entry.len > out.size) {
+        return false;
+    }
+    std::memcpy(out.data, entry.reply, entry.len);
+    len = entry.len;
+    return true;
+}
+
+/**
+ * @brief Stores a reply, replacing whatever shared its slot. Oversized replies are not stored.
+ * @param code Request code.
+ * @param key Normalized parameter (at most kMaxKey bytes).
+ * @param epoch Second read before the reply was formatted, so a reply that straddles a
+ *        tick is never served in the next second.
+ * @param reply Reply bytes.
+ * @param len Reply length.
+ */
+void ReplyCache::store(ReqCode code, ByteView key, int64_t epoch, const char* reply, size_t len) {
+    if (!entries_ || key.len > kMaxKey || len > kMaxReply) return;
+    Entry& entry = entries_[slotOf(code, key)];
+    entry.epoch = epoch;
+    entry.code = static_cast<uint8_t>(code);
+    entry.keyLen = static_cast<uint8_t>(key.len);
+    entry.len = static_cast<uint8_t>(len);
+    std::memcpy(entry.key, key.data, key.len);
+    std::memcpy(entry.reply, reply, len);
+}
@@ -0,0 +1,109 @@
+/**
+ * @file replycache.h
+ * @brief Per-worker cache of ready-to-send legacy replies for parameterized, per-second codes.
+ *
+ * Codes whose registry entry is Cacheability::SecondArg (the city time) answer the same bytes to
+ * everybody asking with the same normalized parameter within one wall-clock second. The worker
+ * keeps those replies in a small direct-mapped table keyed by (code, normalized parameter) and
+ * stamped with the second they belong to, so a repeated "new york" or "3" skips the zone lookup
+ * and the formatting and is answered with one copy. Entries of a past second are simply stale.
+ *
+ * Each worker owns its cache, so there is no locking; the cost is one entry per worker per key.
+ * The table is allocated on the worker's NUMA node when the worker is pinned.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "utils.h"
+#include "affinity.h"
+
+/**
+ * @brief Longest legacy reply of the cacheable codes in the registry, from entry i on.
+ * @param i First registry entry.
+ * @return Reply size in bytes.
+ */
+constexpr size_t maxCachedReply(size_t i = 0) {
+    return i == wire::kCodeCount ? 0
+        : (wire::kCodes[i].cache == wire::Cacheability::SecondArg && wire::kCodes[i].maxText > maxCachedReply(i + 1))
+            ? wire::kCodes[i].maxText : maxCachedReply(i + 1);
+}
+
+/**
+ * @brief Direct-mapped cache of legacy replies, written and read by one worker.
+ */
+class ReplyCache {
+public:
+    static constexpr size_t kMaxKey = 31;   /**< Longest normalized parameter (the zone lookup truncates the same way). */
+    static constexpr size_t kMaxReply = 16; /**< Longest cached reply. */
+
+    /**
+     * @brief Creates a cache.
+     * @param entries Number of entries (rounded up to a power of two; 0 disables the cache).
+     * @param node NUMA node to place the table on, or -1 for the default policy.
+     */
+    explicit ReplyCache(size_t entries, int node = -1);
+
+    /**
+     * @brief Destructor. Releases the table.
+     */
+    ~ReplyCache();
+
+    ReplyCache(const ReplyCache&) = delete;
+    ReplyCache& operator=(const ReplyCache&) = delete;
+
+    /**
+     * @brief Whether the cache holds any entries.
+     * @return true unless it was created with 0 entries.
+     */
+    bool enabled() const { return entries_ != nullptr; }
+
+    /**
+     * @brief Copies the cached reply of a request, if it was stored in the same second.
+     * @param code Request code.
+     * @param key Normalized parameter (at most kMaxKey bytes).
+     * @param epoch Current second.
+     * @param out Buffer receiving the reply.
+     * @param len Receives the reply length on a hit.
+     * @return true on a hit, false on a miss.
+     */
+    bool lookup(ReqCode code, ByteView key, int64_t epoch, OutSpan out, size_t& len) const;
+
+    /**
+     * @brief Stores a reply, replacing whatever shared its slot. Oversized replies are not stored.
+     * @param code Request code.
+     * @param key Normalized parameter (at most kMaxKey bytes).
+     * @param epoch Second read before the reply was formatted, so a reply that straddles a
+     *        tick is never served in the next second.
+     * @param reply Reply bytes.
+     * @param len Reply length.
+     */
+    void store(ReqCode code, ByteView key, int64_t epoch, const char* reply, size_t len);
+
+private:
+    /**
+     * @brief One cached reply.
+     */
+    struct Entry {
+        int64_t epoch;          /**< Second the reply belongs to (-1 = empty). */
+        uint8_t code;           /**< Request code. */
+        uint8_t keyLen;         /**< Length of key. */
+        uint8_t len;            /**< Length of reply. */
+        char key[kMaxKey];      /**< Normalized parameter. */
+        char reply[kMaxReply];  /**< Ready-to-send reply bytes. */
+        char pad[6];            /**< Fills the entry to 64 bytes. */
+    };
+
+    /**
+     * @brief Slot of a key.
+     * @param code Request code.
+     * @param key Normalized parameter.
+     * @return Index into the table.
+     */
+    size_t slotOf(ReqCode code, ByteView key) const;
+
+    Entry* entries_; /**< Table, a power of two in size (null if disabled). */
+    size_t mask_;    /**< Entry count - 1. */
+};
+
+static_assert(maxCachedReply() <= ReplyCache::kMaxReply, "every cacheable legacy reply must fit a cache entry");
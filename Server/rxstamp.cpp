@@ -0,0 +1,107 @@
+/**
+ * @file rxstamp.cpp
+ * @brief Implementation of stack receive timestamps.
+ *
+ * Stamps are QueryPerformanceCounter values. They are moved to wall-clock time by reading the
+ * counter and the precise system time back to back and subtracting the stamp's age, which keeps
+ * the conversion independent of how far the counter and the system clock have drifted apart.
+ * Compatible with C++14.
+ */
+#include "rxstamp.h"
+#include "utils.h"
+#include <mstcpip.h>
+#include <cstring>
+
+#ifndef SIO_TIMESTAMPING
+#define SIO_TIMESTAMPING _WSAIOW(IOC_VENDOR, 235)
+#endif
+#ifndef TIMESTAMPING_FLAG_RX
+#define TIMESTAMPING_FLAG_RX 0x1
+#endif
+#ifndef SO_TIMESTAMP
+#define SO_TIMESTAMP 0x300A
+#endif
+
+/**
+ * @brief Input of SIO_TIMESTAMPING (TIMESTAMPING_CONFIG of newer SDKs).
+ */
+struct StampingConfig {
+    ULONG flags;          /**< TIMESTAMPING_FLAG_RX and/or _TX. */
+    USHORT txBuffered;    /**< Transmit stamps kept for SIO_GET_TX_TIMESTAMP (unused). */
+};
+
+/**
+ * @brief Enables stack receive timestamps on a socket.
+ * @param sock UDP socket.
+ * @return true on success, false if the stack does not support SIO_TIMESTAMPING.
+ */
+bool enableReceiveStamps(SOCKET sock) {
+    StampingConfig config = { TIMESTAMPING_FLAG_RX, 0 };
+    DWORD bytes = 0;
+    return 0 == WSAIoctl(sock, SIO_TIMESTAMPING, &config, sizeof(config), NULL, 0, &bytes, NULL, NULL);
+}
+
+/**
+ * @brief Loads WSARecvMsg, the receive call that returns control messages.
+ * @param sock Any socket of the provider.
+ * @return Function pointer, or null if unavailable.
+ */
+LPFN_WSARECVMSG loadRecvMsg(SOCKET sock) {
+    GUID id = WSAID_WSARECVMSG;
+    LPFN_WSARECVMSG recvMsg = nullptr;
+    DWORD bytes = 0;
+    if (0 != WSAIoctl(sock, SIO_GET_EXTENSION_FUNCTION_POINTER, &id, sizeof(id), &recvMsg, sizeof(recvMsg), &bytes, NULL, NULL)) {
+        return nullptr;
+    }
+    return recvMsg;
+}
+
+/**
+ * @brief Finds the receive timestamp among the control messages of a datagram.
+ * @param control Control buffer filled by WSARecvMsg or RIOReceiveEx.
+ * @param len Bytes of control data (the whole zeroed buffer if the length is not reported).
+ * @return Performance counter ticks, or 0 if the datagram carries no timestamp.
+ */
+uint64_t findReceiveStamp(char* control, size_t len) {
+    WSAMSG msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.Control.buf = control;
+    msg.Control.len = static_cast<ULONG>(len);
+    for (WSACMSGHDR* header = WSA_CMSG_FIRSTHDR(&msg); header && header->cmsg_len != 0; header = WSA_CMSG_NXTHDR(&msg, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SO_TIMESTAMP) {
+            UINT64 ticks;
+            memcpy(&ticks, WSA_CMSG_DATA(header), sizeof(ticks));
+            return ticks;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Current performance counter value, in the unit of receive stamps.
+ * @return Counter ticks.
+ */
+uint64_t stampNow() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<uint64_t>(now.QuadPart);
+}
+
+/**
+ * @brief Converts a receive stamp to the clock of preciseNowNs().
+ * @param ticks Performance counter ticks (non-zero).
+ * @return Nanoseconds since the Unix epoch at which the datagram was received.
+ */
+uint64_t stampToPreciseNs(uint64_t ticks) {
+    static const uint64_t frequency = []() {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        return static_cast<uint64_t>(f.QuadPart);
+    }();
+    uint64_t now = stampNow();
+    uint64_t wallNs = preciseNowNs();
+    uint64_t age = (now > ticks) ? now - ticks : 0;
+    // Split so the multiplication cannot overflow for ages of hours
+    uint64_t ageNs = (age / frequency) * 1000000000ull + (age % frequency) * 1000000000ull / frequency;
+    return wallNs - ageNs;
+}
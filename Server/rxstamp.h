@@ -0,0 +1,60 @@
+/**
+ * @file rxstamp.h
+ * @brief Per-datagram receive timestamps taken by the network stack (SIO_TIMESTAMPING).
+ *
+ * A socket with receive timestamping enabled gets a SO_TIMESTAMP control message with every
+ * datagram: the performance counter value at which the stack received it, before the datagram
+ * waited in the socket buffer, a completion queue or the worker's scheduler. GetPreciseTime
+ * reports that moment as its receive time t2, so the server residence time t3 - t2 includes
+ * every server-side queue and clients subtract it from the round trip instead of counting it as
+ * network delay. This is the Windows counterpart of SO_TIMESTAMPNS on Linux (Windows 10 2004+).
+ *
+ * Stamps travel through the server as raw counter ticks (0 = none) and are converted to the
+ * preciseNowNs() clock only by the codes that report them.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h>
+#include <mswsock.h>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Control buffer bytes reserved per receive for the timestamp message.
+ */
+static constexpr size_t kStampControlBytes = 64;
+
+/**
+ * @brief Enables stack receive timestamps on a socket.
+ * @param sock UDP socket.
+ * @return true on success, false if the stack does not support SIO_TIMESTAMPING.
+ */
+bool enableReceiveStamps(SOCKET sock);
+
+/**
+ * @brief Loads WSARecvMsg, the receive call that returns control messages.
+ * @param sock Any socket of the provider.
+ * @return Function pointer, or null if unavailable.
+ */
+LPFN_WSARECVMSG loadRecvMsg(SOCKET sock);
+
+/**
+ * @brief Finds the receive timestamp among the control messages of a datagram.
+ * @param control Control buffer filled by WSARecvMsg or RIOReceiveEx.
+ * @param len Bytes of control data (the whole zeroed buffer if the length is not reported).
+ * @return Performance counter ticks, or 0 if the datagram carries no timestamp.
+ */
+uint64_t findReceiveStamp(char* control, size_t len);
+
+/**
+ * @brief Current performance counter value, in the unit of receive stamps.
+ * @return Counter ticks.
+ */
+uint64_t stampNow();
+
+/**
+ * @brief Converts a receive stamp to the clock of preciseNowNs().
+ * @param ticks Performance counter ticks (non-zero).
+ * @return Nanoseconds since the Unix epoch at which the datagram was received.
+ */
+uint64_t stampToPreciseNs(uint64_t ticks);
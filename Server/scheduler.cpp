@@ -0,0 +1,187 @@
+/**
+ * @file scheduler.cpp
+ * @brief Implementation of the per-worker priority queue and its CoDel shedding.
+ *
+ * Items live in a fixed pool of node-local slots; the class queues are rings of slot indices,
+ * so queueing and dequeueing never allocate. CoDel follows the pseudocode of RFC 8289, with the
+ * queue being empty standing in for its "less than one MTU queued" test.
+ * Compatible with C++14.
+ */
+#include "scheduler.h"
+#include "affinity.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+/**
+ * @brief Creates a queue.
+ * @param options Target, interval and capacity.
+ * @param node NUMA node to place the slots on, or -1 for the default policy.
+ */
+RequestScheduler::RequestScheduler(const SchedulerOptions& options, int node)
+    : targetNs_(static_cast<uint64_t>(options.targetUs) * 1000),
+      intervalNs_(static_cast<uint64_t>(std::max(1u, options.intervalMs)) * 1000000),
+      capacity_(std::max(1u, options.capacity)), size_(0), slots_(nullptr)
+{
+    slots_ = static_cast<Item*>(allocOnNode(capacity_ * sizeof(Item), node));
+    if (!slots_) throw std::bad_alloc();
+    free_.reserve(capacity_);
+    for (size_t i = capacity_; i > 0; --i) free_.push_back(static_cast<uint32_t>(i - 1));
+    for (Queue& queue : queues_) queue.ring.resize(capacity_);
+}
+
+/**
+ * @brief Destructor. Releases the slots.
+ */
+RequestScheduler::~RequestScheduler() {
+    freeNodeMemory(slots_);
+}
+
+/**
+ * @brief Scheduling class of a datagram, from the code in it (legacy or binary framing).
+ *
+ * Codes with per-client state (Cacheability::Client) and batches, which may carry them, all go
+ * to the Normal class: a class is a FIFO, so one source's stateful requests keep their order.
+ * @param data Datagram bytes.
+ * @param len Datagram length.
+ * @return Registry priority of the code (Bulk for unknown codes and empty datagrams).
+ */
+wire::Priority RequestScheduler::classify(const char* data, size_t len) {
+    if (len == 0) return wire::Priority::Bulk;
+    size_t at = wire::isBinary(data[0]) ? 1 : 0;
+    if (len <= at) return wire::Priority::Bulk;
+    wire::CodeInfo info = wire::codeInfo(static_cast<ReqCode>(static_cast<uint8_t>(data[at])));
+    if (info.cache == wire::Cacheability::Client || info.code == ReqCode::Batch) return wire::Priority::Normal;
+    return info.priority;
+}
+
+/**
+ * @brief Queues a copy of a datagram.
+ *
+ * When every slot is taken, the oldest item of the least important non-empty class below the
+ * arriving one is evicted: under overload the queue fills with Bulk first, and a probe always
+ * finds room while anything else is queued.
+ * @param data Datagram bytes.
+ * @param len Datagram length (datagrams over kSlotBytes are refused).
+ * @param addr Sender address.
+ * @param chargeKey Admission key of the request.
+ * @param stamp Receive stamp of the datagram.
+ * @param nowNs metricsNowNs().
+ * @param evicted Set if a less important item was dropped to make room.
+ * @return true if queued, false if the queue is full of items at least as important.
+ */
+bool RequestScheduler::push(const char* data, size_t len, const sockaddr_storage& addr, uint64_t chargeKey, uint64_t stamp, uint64_t nowNs, bool& evicted) {
+    evicted = false;
+    if (len > kSlotBytes) return false;
+    unsigned cls = static_cast<unsigned>(classify(data, len));
+    if (free_.empty()) {
+        unsigned victim = kClasses - 1;
+        while (victim > cls && queues_[victim].count == 0) --victim;
+        if (victim <= cls) return false;
+        take(queues_[victim]);
+        evicted = true;
+    }
+
+    uint32_t slot = free_.back();
+    free_.pop_back();
+    Item& item = slots_[slot];
+    item.enqueuedNs = nowNs;
+    item.chargeKey = chargeKey;
+    item.stamp = stamp;
+    item.addr = addr;
+    item.len = static_cast<int>(len);
+    std::memcpy(item.data, data, len);
+
+    Queue& queue = queues_[cls];
+    queue.ring[(queue.head + queue.count) % capacity_] = slot;
+    ++queue.count;
+    ++size_;
+    return true;
+}
+
+/**
+ * @brief Takes the most important item, shedding what CoDel drops on the way.
+ *
+ * Classes are served in strict priority order. Probes are returned as they come; Normal and
+ * Bulk items go through CoDel first, which may drop a run of them before one is returned.
+ * @param nowNs metricsNowNs().
+ * @param shed Incremented by the number of items dropped.
+ * @return Item valid until the next push() or pop(), or null if the queue is empty.
+ */
+const RequestScheduler::Item* RequestScheduler::pop(uint64_t nowNs, unsigned& shed) {
+    for (unsigned cls = 0; cls < kClasses; ++cls) {
+        Queue& queue = queues_[cls];
+        while (queue.count > 0) {
+            const Item& item = slots_[take(queue)];
+            if (cls == static_cast<unsigned>(wire::Priority::Probe)) return &item;
+
+            bool over = overTarget(queue, item, nowNs);
+            if (queue.dropping) {
+                if (!over) {
+                    queue.dropping = false;
+                    return &item;
+                }
+                if (nowNs < queue.dropNextNs) return &item;
+                ++shed;
+                ++queue.drops;
+                queue.dropNextNs = nextDrop(queue.dropNextNs, queue.drops);
+                continue;
+            }
+            if (!over) return &item;
+
+            // Enter the dropping state; resume near the old rate if it ended only recently
+            ++shed;
+            queue.dropping = true;
+            uint32_t delta = queue.drops - queue.lastDrops;
+            queue.drops = (delta > 1 && (nowNs < queue.dropNextNs || nowNs - queue.dropNextNs < 16 * intervalNs_)) ? delta : 1;
+            queue.lastDrops = queue.drops;
+            queue.dropNextNs = nextDrop(nowNs, queue.drops);
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Removes the oldest entry of a queue and frees its slot.
+ * @param queue Queue (not empty).
+ * @return Slot index of the removed entry (still readable until reused).
+ */
+uint32_t RequestScheduler::take(Queue& queue) {
+    uint32_t slot = queue.ring[queue.head];
+    queue.head = (queue.head + 1) % capacity_;
+    --queue.count;
+    --size_;
+    free_.push_back(slot);
+    return slot;
+}
+
+/**
+ * @brief CoDel's per-packet test: has the delay stayed above target for an interval?
+ * @param queue Queue the item came from.
+ * @param item Dequeued item.
+ * @param nowNs Current time.
+ * @return true if the item may be dropped.
+ */
+bool RequestScheduler::overTarget(Queue& queue, const Item& item, uint64_t nowNs) const {
+    uint64_t sojournNs = (nowNs > item.enqueuedNs) ? nowNs - item.enqueuedNs : 0;
+    if (sojournNs < targetNs_ || queue.count == 0) {
+        queue.firstAboveNs = 0;
+        return false;
+    }
+    if (queue.firstAboveNs == 0) {
+        queue.firstAboveNs = nowNs + intervalNs_;
+        return false;
+    }
+    return nowNs >= queue.firstAboveNs;
+}
+
+/**
+ * @brief CoDel control law: the next drop time.
+ * @param fromNs Time the spacing is counted from.
+ * @param drops Drops so far.
+ * @return Next drop time.
+ */
+uint64_t RequestScheduler::nextDrop(uint64_t fromNs, uint32_t drops) const {
+    return fromNs + static_cast<uint64_t>(static_cast<double>(intervalNs_) / std::sqrt(static_cast<double>(drops)));
+}
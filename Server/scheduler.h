@@ -0,0 +1,153 @@
+/**
+ * @file scheduler.h
+ * @brief Per-worker priority queue between receive and dispatch, with CoDel shedding.
+ *
+ * A batched worker that schedules copies every datagram it receives into this queue, classed by
+ * the registry priority of its code, and re-posts its receive ring at once. It then dispatches
+ * from the queue in priority order: timing probes (MeasuureRTT, delay estimation, precise time)
+ * first, cheap answers, per-client state and batches next, city lookups last. When the worker falls behind, the
+ * backlog therefore waits in this queue instead of in the socket, where it would sit in front of
+ * the probes and make them report the server's queue rather than the network.
+ *
+ * Normal and Bulk items are policed by CoDel (RFC 8289): once the queue delay of a class has
+ * stayed above the target for an interval, its dequeues start dropping items, at a rate that
+ * grows with the square root of the drop count until the delay is back under the target. Bulk
+ * waits longest, so it is shed first. A full queue evicts the oldest item of a class less
+ * important than the arriving one; probes are never shed.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "../Common/protocol.h"
+
+/**
+ * @brief Runtime configuration of the scheduling stage.
+ */
+struct SchedulerOptions {
+    unsigned targetUs = 0;      /**< CoDel target queue delay (0 disables the scheduling stage). */
+    unsigned intervalMs = 100;  /**< CoDel interval: how long the delay must stay above target. */
+    unsigned capacity = 1024;   /**< Datagrams queued per worker over all classes. */
+};
+
+/**
+ * @brief Strict-priority datagram queue with CoDel on the sheddable classes, owned by one worker.
+ */
+class RequestScheduler {
+public:
+    static constexpr size_t kSlotBytes = 256; /**< Largest datagram queued. */
+    static constexpr unsigned kClasses = 3;   /**< One queue per wire::Priority. */
+
+    /**
+     * @brief A queued datagram.
+     */
+    struct Item {
+        uint64_t enqueuedNs;      /**< metricsNowNs() when it was queued. */
+        uint64_t chargeKey;       /**< Admission key its reply is charged to, 0 if uncharged. */
+        uint64_t stamp;           /**< Receive stamp (counter ticks, see rxstamp.h). */
+        sockaddr_storage addr;    /**< Sender address. */
+        int len;                  /**< Datagram length. */
+        char data[kSlotBytes];    /**< Datagram bytes. */
+    };
+
+    /**
+     * @brief Creates a queue.
+     * @param options Target, interval and capacity.
+     * @param node NUMA node to place the slots on, or -1 for the default policy.
+     */
+    RequestScheduler(const SchedulerOptions& options, int node);
+
+    /**
+     * @brief Destructor. Releases the slots.
+     */
+    ~RequestScheduler();
+
+    RequestScheduler(const RequestScheduler&) = delete;
+    RequestScheduler& operator=(const RequestScheduler&) = delete;
+
+    /**
+     * @brief Scheduling class of a datagram, from the code in it (legacy or binary framing).
+     * @param data Datagram bytes.
+     * @param len Datagram length.
+     * @return Registry priority of the code (Bulk for unknown codes and empty datagrams); stateful
+     *         codes and batches share Normal so they keep their arrival order.
+     */
+    static wire::Priority classify(const char* data, size_t len);
+
+    /**
+     * @brief Queues a copy of a datagram.
+     * @param data Datagram bytes.
+     * @param len Datagram length (datagrams over kSlotBytes are refused).
+     * @param addr Sender address.
+     * @param chargeKey Admission key of the request.
+     * @param stamp Receive stamp of the datagram.
+     * @param nowNs metricsNowNs().
+     * @param evicted Set if a less important item was dropped to make room.
+     * @return true if queued, false if the queue is full of items at least as important.
+     */
+    bool push(const char* data, size_t len, const sockaddr_storage& addr, uint64_t chargeKey, uint64_t stamp, uint64_t nowNs, bool& evicted);
+
+    /**
+     * @brief Takes the most important item, shedding what CoDel drops on the way.
+     * @param nowNs metricsNowNs().
+     * @param shed Incremented by the number of items dropped.
+     * @return Item valid until the next push() or pop(), or null if the queue is empty.
+     */
+    const Item* pop(uint64_t nowNs, unsigned& shed);
+
+    /**
+     * @brief Whether nothing is queued.
+     * @return true if empty.
+     */
+    bool empty() const { return size_ == 0; }
+
+private:
+    /**
+     * @brief FIFO of slot indices of one class, with its CoDel state.
+     */
+    struct Queue {
+        std::vector<uint32_t> ring; /**< Slot indices (capacity entries). */
+        size_t head = 0;            /**< Index of the oldest entry. */
+        size_t count = 0;           /**< Entries queued. */
+        bool dropping = false;      /**< CoDel is in its dropping state. */
+        uint64_t firstAboveNs = 0;  /**< When the delay first exceeded target (+ interval), 0 if below. */
+        uint64_t dropNextNs = 0;    /**< Next drop while dropping. */
+        uint32_t drops = 0;         /**< Drops in the current dropping state. */
+        uint32_t lastDrops = 0;     /**< drops when the current dropping state began. */
+    };
+
+    /**
+     * @brief Removes the oldest entry of a queue and frees its slot.
+     * @param queue Queue (not empty).
+     * @return Slot index of the removed entry (still readable until reused).
+     */
+    uint32_t take(Queue& queue);
+
+    /**
+     * @brief CoDel's per-packet test: has the delay stayed above target for an interval?
+     * @param queue Queue the item came from.
+     * @param item Dequeued item.
+     * @param nowNs Current time.
+     * @return true if the item may be dropped.
+     */
+    bool overTarget(Queue& queue, const Item& item, uint64_t nowNs) const;
+
+    /**
+     * @brief CoDel control law: the next drop time.
+     * @param fromNs Time the spacing is counted from.
+     * @param drops Drops so far.
+     * @return Next drop time.
+     */
+    uint64_t nextDrop(uint64_t fromNs, uint32_t drops) const;
+
+    uint64_t targetNs_;            /**< CoDel target. */
+    uint64_t intervalNs_;          /**< CoDel interval. */
+    size_t capacity_;              /**< Slots. */
+    size_t size_;                  /**< Items queued over all classes. */
+    Item* slots_;                  /**< Slot storage (node-local). */
+    std::vector<uint32_t> free_;   /**< Free slot indices. */
+    Queue queues_[kClasses];       /**< Indexed by wire::Priority. */
+};
@@ -12,9 +12,22 @@
  * @param port Port number to bind the server to.
  */
 TimeServer::TimeServer(unsigned short port)
-    : m_port(port), m_socket(INVALID_SOCKET), initialized_(false)
+    : m_port(port), m_socket(INVALID_SOCKET), initialized_(false), tickSocket_(INVALID_SOCKET), tickSeq_(0), tickMetrics_(0)
 {
-    memset(&serverAddr_, 0, sizeof(serverAddr_));
+    options_.port = port;
+    memset(&groupAddr_, 0, sizeof(groupAddr_));
+    initialize();
+}
+
+/**
+ * @brief Constructs a TimeServer with a worker pool configuration.
+ * @param options Port, worker count, socket sharding and stats settings.
+ */
+TimeServer::TimeServer(const ServerOptions& options)
+    : m_port(options.port), m_socket(INVALID_SOCKET), initialized_(false), options_(options), tickSocket_(INVALID_SOCKET), tickSeq_(0), tickMetrics_(0)
+{
+    if (options_.workers == 0) options_.workers = 1;
+    memset(&groupAddr_, 0, sizeof(groupAddr_));
     initialize();
 }
 
@@ -26,7 +39,16 @@ TimeServer::~TimeServer() {
 }
 
 /**
- * @brief Initializes Winsock and binds the UDP socket to the specified port.
+ * @brief Initializes Winsock, binds the shared socket and prepares the workers.
+ *
+ * Worker 0 always uses the socket bound to m_port. With shardSockets enabled every
+ * other worker gets its own socket: Winsock has no SO_REUSEPORT load balancing, so
+ * sharded sockets bind consecutive ports (m_port + id) and clients or a front-end
+ * balancer spread their traffic across them. On the single-packet path every socket,
+ * including those of extraPorts, is registered with the reactor and any worker's loop
+ * may answer a datagram of any of them.
+ * With batchSize > 1 the sockets are created for Registered I/O and each worker gets a
+ * BatchIo backend (see setupBatching()).
  * @return true if initialization succeeds, false otherwise.
  */
 bool TimeServer::initialize() {
@@ -36,134 +58,432 @@ bool TimeServer::initialize() {
         return false;
     }
     initialized_ = true;
+    configureLapStore(options_.lapCapacity);
+    if (options_.admission.enabled()) admission_.reset(new AdmissionControl(options_.admission));
 
-    m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    // A RIO request queue is per socket, so batching needs one socket per worker
+    bool batching = options_.batchSize > 1 && (options_.shardSockets || options_.workers == 1);
+    if (options_.batchSize > 1 && !batching) {
+        logFormat(LogLevel::Warn, "Time Server: Batched I/O needs --shard with several workers; using single-packet path.");
+    }
+    if (options_.busyPollUs > 0 && !batching) {
+        logFormat(LogLevel::Warn, "Time Server: Busy polling needs batched I/O (--batch K); ignored.");
+    }
+    if (options_.scheduler.targetUs > 0 && !batching) {
+        logFormat(LogLevel::Warn, "Time Server: Priority scheduling needs batched I/O (--batch K); ignored.");
+    }
+    m_socket = openSocket(m_port, batching);
     if (INVALID_SOCKET == m_socket) {
-        logError("socket");
         cleanup();
         return false;
     }
 
-    serverAddr_.sin_family = AF_INET;
-    serverAddr_.sin_addr.s_addr = INADDR_ANY;
-    serverAddr_.sin_port = htons(m_port);
-    if (SOCKET_ERROR == bind(m_socket, (SOCKADDR *)&serverAddr_, sizeof(serverAddr_))) {
-        logError("bind");
+    unsigned cpus = cpuCount();
+    for (unsigned id = 0; id < options_.workers; ++id) {
+        int cpu = -1;
+        if (!options_.cpus.empty()) {
+            unsigned wanted = options_.cpus[id % options_.cpus.size()];
+            if (wanted < cpus) cpu = static_cast<int>(wanted);
+            else logFormat(LogLevel::Warn, "Time Server: CPU %u does not exist; worker %u is not pinned.", wanted, id);
+        }
+        int node = (cpu >= 0) ? numaNodeOfCpu(static_cast<unsigned>(cpu)) : -1;
+        std::unique_ptr<Worker> worker(new (node) Worker(id, options_.latencySampleEvery, options_.replyCacheEntries, cpu, node));
+        worker->socket = m_socket;
+        if (options_.shardSockets && id > 0) {
+            worker->socket = openSocket(static_cast<unsigned short>(m_port + id), batching);
+            if (INVALID_SOCKET == worker->socket) {
+                cleanup();
+                return false;
+            }
+            worker->ownsSocket = true;
+        }
+        worker->replySocket = worker->socket;
+        if (cpu >= 0) {
+            logFormat(LogLevel::Info, "Time Server: Worker %u on CPU %d (NUMA node %d).", id, cpu, node);
+        }
+        workers_.push_back(std::move(worker));
+    }
+    for (unsigned short port : options_.extraPorts) {
+        SOCKET sock = openSocket(port, false);
+        if (INVALID_SOCKET == sock) {
+            cleanup();
+            return false;
+        }
+        extraSockets_.push_back(sock);
+    }
+    if (batching) batching = setupBatching();
+    if (!setupReactor(batching)) {
         cleanup();
         return false;
     }
+    if (options_.steerSockets) steerSockets();
+
+    tickSocket_ = m_socket;
+    if (!options_.multicastGroup.empty() && !openTickSocket()) {
+        cleanup();
+        return false;
+    }
+    configureSubscriptions(kDefaultSubscriberCapacity, options_.tickIntervalMs,
+                           groupAddr_.sin_addr.s_addr, groupAddr_.sin_port);
+    if (!options_.tracePath.empty()) {
+        trace_.reset(new TraceRecorder());
+        if (trace_->open(options_.tracePath, static_cast<unsigned>(workers_.size()), options_.traceMaxBytes)) {
+            logFormat(LogLevel::Info, "Time Server: Recording received datagrams to %s.", options_.tracePath.c_str());
+        }
+        else {
+            logFormat(LogLevel::Warn, "Time Server: Cannot create trace file %s; capture disabled.", options_.tracePath.c_str());
+            trace_.reset();
+        }
+    }
     return true;
 }
 
 /**
- * @brief Cleans up socket and Winsock resources.
+ * @brief Moves the receive processing of each socket read by one pinned thread only to that
+ *        thread's CPU (SIO_CPU_AFFINITY).
+ *
+ * That holds for a batched worker's own socket and for the socket of a single worker. Sharded
+ * sockets on the reactor path all complete on one shared port, where any loop may dequeue any
+ * socket's packets, so steering them would not keep packets on a core; they are left alone.
  */
-void TimeServer::cleanup() {
-    if (m_socket != INVALID_SOCKET) {
-        closesocket(m_socket);
-        m_socket = INVALID_SOCKET;
+void TimeServer::steerSockets() {
+    bool warned = false;
+    bool skipped = false;
+    for (const auto& worker : workers_) {
+        if (worker->cpu < 0) continue;
+        bool single = worker->batch ? (options_.shardSockets || options_.workers == 1) : loops_.size() == 1;
+        if (!single) {
+            skipped = true;
+            continue;
+        }
+        if (!steerSocketToCpu(worker->socket, static_cast<unsigned>(worker->cpu)) && !warned) {
+            logFormat(LogLevel::Warn, "Time Server: Cannot steer sockets to worker CPUs (SIO_CPU_AFFINITY): %d.", WSAGetLastError());
+            warned = true;
+        }
     }
-    if (initialized_) {
-        WSACleanup();
-        initialized_ = false;
+    if (skipped) {
+        logFormat(LogLevel::Warn, "Time Server: Socket steering needs batched workers (--batch K) with --shard, or one worker; "
+                                  "the event loops share their sockets, which are left unsteered.");
     }
 }
 
 /**
- * @brief Receives a request from a client, decodes it, and logs the received data.
- * @param request Reference to a Request object to store the decoded request.
- * @param clientAddr Reference to sockaddr_in to store the client's address.
- * @param clientAddrLen Reference to int to store the length of the client's address.
- * @return true on success, false on error.
+ * @brief Creates the socket multicast ticks are sent from.
+ * @return true on success, false otherwise.
  */
-bool TimeServer::receiveRequest(TimeServer::Request& request, sockaddr_in& clientAddr, int& clientAddrLen) {
-    std::vector<char> buffer(BUFFER_SIZE);
-    clientAddrLen = sizeof(clientAddr);
-    int bytesRecv = recvfrom(m_socket, buffer.data(), static_cast<int>(buffer.size()), 0, (sockaddr*)&clientAddr, &clientAddrLen);
-    if (SOCKET_ERROR == bytesRecv) {
-        logError("recvfrom");
+bool TimeServer::openTickSocket() {
+    groupAddr_.sin_family = AF_INET;
+    groupAddr_.sin_addr.s_addr = inet_addr(options_.multicastGroup.c_str());
+    groupAddr_.sin_port = htons(options_.multicastPort);
+    if ((ntohl(groupAddr_.sin_addr.s_addr) & 0xF0000000u) != 0xE0000000u) { // 224.0.0.0/4
+        logFormat(LogLevel::Error, "Time Server: %s is not an IPv4 multicast group.", options_.multicastGroup.c_str());
+        return false;
+    }
+    tickSocket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (INVALID_SOCKET == tickSocket_) {
+        logError("socket");
         return false;
     }
-    buffer.resize(bytesRecv); // shrink to actual size
-    request = decode(buffer);
+    DWORD ttl = options_.multicastTtl;
+    if (SOCKET_ERROR == setsockopt(tickSocket_, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl))) {
+        logError("setsockopt(IP_MULTICAST_TTL)");
+        return false;
+    }
+    return true;
+}
 
-    std::ostringstream oss;
-    oss << "Time Server: Received " << bytesRecv << " bytes" << " | " << request;
-    logMessage(oss.str());
+/**
+ * @brief Attaches a batched I/O backend to every worker, or leaves all on the single-packet path.
+ *
+ * If Registered I/O cannot be set up on any socket (e.g. pre-Windows 8) every worker falls
+ * back to recvfrom/sendto, which works on the same sockets.
+ * @return true if batching is active, false if the single-packet fallback is used.
+ */
+bool TimeServer::setupBatching() {
+    static_assert(BUFFER_SIZE <= static_cast<int>(RequestScheduler::kSlotBytes), "scheduler slots must hold a whole request");
+    for (auto& worker : workers_) {
+        std::unique_ptr<BatchIo> batch(new BatchIo());
+        if (!batch->open(worker->socket, options_.batchSize, BUFFER_SIZE, worker->node, options_.receiveStamps)) {
+            logFormat(LogLevel::Warn, "Time Server: Registered I/O unavailable; using single-packet path.");
+            for (auto& w : workers_) {
+                w->batch.reset();
+                w->scheduler.reset();
+            }
+            return false;
+        }
+        batch->setBusyPoll(options_.busyPollUs);
+        worker->batch = std::move(batch);
+        if (options_.scheduler.targetUs > 0) {
+            worker->scheduler.reset(new RequestScheduler(options_.scheduler, worker->node));
+        }
+    }
+    if (options_.busyPollUs > 0) {
+        logFormat(LogLevel::Info, "Time Server: Busy polling receive queues for up to %u us.", options_.busyPollUs);
+    }
+    if (options_.scheduler.targetUs > 0) {
+        logFormat(LogLevel::Info, "Time Server: Scheduling by priority; shedding after %u us queued for %u ms.",
+                  options_.scheduler.targetUs, options_.scheduler.intervalMs);
+    }
     return true;
 }
 
 /**
- * @brief Sends a response to the client using a vector of bytes.
- * @param response Vector of bytes to send.
- * @param clientAddr Client's address.
- * @param clientAddrLen Length of client's address.
- * @return true on success, false on error.
+ * @brief Creates the reactor and registers the sockets it serves.
+ *
+ * Without batching every worker runs one reactor loop over all sockets. With batching the
+ * workers drain their own sockets and the reactor only serves the extraPorts sockets, on
+ * an additional worker driven by the thread calling run().
+ * @param batching true if the workers drain their sockets through BatchIo.
+ * @return true on success, false otherwise.
  */
-bool TimeServer::sendResponse(const std::vector<char>& response, const sockaddr_in& clientAddr, int clientAddrLen) {
-    int bytesSent = sendto(m_socket, response.data(), (int)response.size(), 0,
-        (const sockaddr*)&clientAddr, clientAddrLen);
-    if (SOCKET_ERROR == bytesSent) {
-        logError("sendto");
+bool TimeServer::setupReactor(bool batching) {
+    reactor_ = Reactor::create(options_.reactor, BUFFER_SIZE, options_.receiveStamps);
+    if (!reactor_) {
+        logFormat(LogLevel::Error, "Time Server: No event loop available.");
         return false;
     }
-    std::ostringstream oss;
-    oss << "Time Server: Sent " << bytesSent << " bytes";
-    logMessage(oss.str());
+    reactor_->setHandler([this](unsigned loop, SOCKET sock, const char* data, size_t len, const sockaddr_storage& from, int fromLen, uint64_t stamp) {
+        onDatagram(loop, sock, data, len, from, fromLen, stamp);
+    });
+
+    std::vector<SOCKET> sockets(extraSockets_);
+    if (batching) {
+        if (!extraSockets_.empty()) {
+            std::unique_ptr<Worker> worker(new (-1) Worker(static_cast<unsigned>(workers_.size()), options_.latencySampleEvery,
+                                                           options_.replyCacheEntries, -1, -1));
+            loops_.push_back(worker.get());
+            workers_.push_back(std::move(worker));
+        }
+    }
+    else {
+        for (auto& worker : workers_) {
+            loops_.push_back(worker.get());
+            if (worker->id == 0 || worker->ownsSocket) sockets.push_back(worker->socket);
+        }
+    }
+    // One receive in flight per loop, so every loop can be busy with the same socket
+    unsigned depth = std::max(2u, static_cast<unsigned>(loops_.size()));
+    for (SOCKET sock : sockets) {
+        if (!reactor_->add(sock, depth)) return false;
+    }
     return true;
 }
 
 /**
- * @brief Sends a string response to the client.
- * @param response_ String to send.
- * @param clientAddr Client's address.
- * @param clientAddrLen Length of client's address.
- * @return true on success, false on error.
+ * @brief Creates a UDP socket bound to the given port on all interfaces of options_.family.
+ *
+ * Dual-stack sockets are IPv6 sockets with IPV6_V6ONLY cleared; IPv4 clients then arrive as
+ * IPv4-mapped addresses. If the host has no IPv6 stack, Dual degrades to IPv4 for this and
+ * every later socket; likewise receive stamps are dropped for all sockets if the stack refuses
+ * them on one.
+ * @param port Port number to bind.
+ * @param registeredIo Create the socket for Registered I/O (batched path).
+ * @return Bound socket, or INVALID_SOCKET on error.
  */
-bool TimeServer::sendResponse(const std::string& response_, const sockaddr_in& clientAddr, int clientAddrLen) {
-    std::vector<char> response(response_.begin(), response_.end());
-    if (sendResponse(response, clientAddr, clientAddrLen)) {
-        std::cout << " | " << response_;
-        return true;
+SOCKET TimeServer::openSocket(unsigned short port, bool registeredIo) {
+    int family = (options_.family == AddressFamily::IPv4) ? AF_INET : AF_INET6;
+    SOCKET sock = registeredIo ? BatchIo::createSocket(family) : socket(family, SOCK_DGRAM, IPPROTO_UDP);
+    if (INVALID_SOCKET == sock && options_.family == AddressFamily::Dual) {
+        logFormat(LogLevel::Warn, "Time Server: IPv6 unavailable; serving IPv4 only.");
+        options_.family = AddressFamily::IPv4;
+        family = AF_INET;
+        sock = registeredIo ? BatchIo::createSocket(family) : socket(family, SOCK_DGRAM, IPPROTO_UDP);
     }
-    return false;
+    if (INVALID_SOCKET == sock) {
+        logError("socket");
+        return INVALID_SOCKET;
+    }
+
+    sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    if (family == AF_INET6) {
+        DWORD v6only = (options_.family == AddressFamily::IPv6) ? 1 : 0;
+        if (SOCKET_ERROR == setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&v6only, sizeof(v6only))) {
+            logError("setsockopt(IPV6_V6ONLY)");
+        }
+        sockaddr_in6& v6 = reinterpret_cast<sockaddr_in6&>(addr);
+        v6.sin6_family = AF_INET6;
+        v6.sin6_addr = in6addr_any;
+        v6.sin6_port = htons(port);
+    }
+    else {
+        sockaddr_in& v4 = reinterpret_cast<sockaddr_in&>(addr);
+        v4.sin_family = AF_INET;
+        v4.sin_addr.s_addr = INADDR_ANY;
+        v4.sin_port = htons(port);
+    }
+    if (SOCKET_ERROR == bind(sock, (SOCKADDR *)&addr, addressLength(addr))) {
+        logError("bind");
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+    if (options_.receiveStamps && !enableReceiveStamps(sock)) {
+        logFormat(LogLevel::Warn, "Time Server: Receive timestamps unavailable (SIO_TIMESTAMPING needs Windows 10 2004+); stamping at decode.");
+        options_.receiveStamps = false;
+    }
+    return sock;
 }
 
 /**
- * @brief Sends a uint32_t response to the client.
- * @param response_ 32-bit unsigned integer to send.
+ * @brief Cleans up socket and Winsock resources.
+ */
+void TimeServer::cleanup() {
+    exporter_.stop();
+    reactor_.reset(); // Cancels the receives in flight before their sockets close
+    loops_.clear();
+    if (tickSocket_ != INVALID_SOCKET && tickSocket_ != m_socket) closesocket(tickSocket_);
+    tickSocket_ = INVALID_SOCKET;
+    for (SOCKET sock : extraSockets_) closesocket(sock);
+    extraSockets_.clear();
+    if (trace_) {
+        trace_->close();
+        logFormat(LogLevel::Info, "Time Server: Trace %s: %llu datagram(s) recorded, %llu dropped.", options_.tracePath.c_str(),
+                  static_cast<unsigned long long>(trace_->recorded()), static_cast<unsigned long long>(trace_->dropped()));
+        trace_.reset();
+    }
+    replayWorker_.reset();
+    for (auto& worker : workers_) {
+        worker->batch.reset();
+        if (worker->ownsSocket && worker->socket != INVALID_SOCKET) {
+            closesocket(worker->socket);
+        }
+        worker->socket = INVALID_SOCKET;
+    }
+    workers_.clear();
+    if (m_socket != INVALID_SOCKET) {
+        closesocket(m_socket);
+        m_socket = INVALID_SOCKET;
+    }
+    if (initialized_) {
+        WSACleanup();
+        initialized_ = false;
+    }
+}
+
+/**
+ * @brief Stamps the receive time of a decoded request if its code needs it, counts and logs it.
+ * @param worker Worker that received the datagram.
+ * @param request Decoded request.
+ * @param len Datagram length.
+ */
+void TimeServer::acceptRequest(Worker& worker, Request& request, size_t len) {
+    if (request.code == ReqCode::GetPreciseTime || request.code == ReqCode::Batch) {
+        request.receivedNs = worker.rxStamp ? stampToPreciseNs(worker.rxStamp) : preciseNowNs();
+    }
+    worker.metrics.countRequest(request.code);
+
+    if (logEnabled(LogLevel::Debug)) {
+        std::ostringstream oss;
+        oss << "Time Server: [" << worker.id << "] Received " << len << " bytes" << " | " << request;
+        std::string msg = oss.str();
+        logMessage(LogLevel::Debug, msg.data(), msg.size());
+    }
+}
+
+/**
+ * @brief Logs a sent response: the header of a binary reply, text if printable, otherwise the
+ *        network-order integer produced by toBytes().
+ * @param workerId Worker that sent the response.
+ * @param data Payload bytes.
+ * @param len Payload length.
+ */
+static void logPayload(unsigned workerId, const char* data, size_t len) {
+    wire::Header header;
+    if (wire::decodeHeader(data, len, header)) {
+        logFormat(LogLevel::Debug, "Time Server: [%u] Sent %d bytes | binary code %d status %u seq %u",
+                  workerId, (int)len, (int)header.code, (unsigned)header.status, header.seq);
+        return;
+    }
+    bool printable = len > 0;
+    for (size_t i = 0; i < len && printable; ++i) {
+        printable = std::isprint(static_cast<unsigned char>(data[i])) != 0;
+    }
+    if (printable || len > sizeof(uint32_t)) {
+        logFormat(LogLevel::Debug, "Time Server: [%u] Sent %d bytes | %.*s", workerId, (int)len, (int)len, data);
+        return;
+    }
+    uint32_t val = 0;
+    for (size_t i = 0; i < len; ++i) val = (val << 8) | static_cast<unsigned char>(data[i]);
+    logFormat(LogLevel::Debug, "Time Server: [%u] Sent %d bytes | %u", workerId, (int)len, val);
+}
+
+/**
+ * @brief Sends a response to the client.
+ * @param worker Worker whose socket is written.
+ * @param response Bytes to send.
+ * @param len Number of bytes to send.
  * @param clientAddr Client's address.
  * @param clientAddrLen Length of client's address.
  * @return true on success, false on error.
  */
-bool TimeServer::sendResponse(uint32_t response_, const sockaddr_in& clientAddr, int clientAddrLen) {
-    std::vector<char> response = toBytes(response_);
-    if (sendResponse(response, clientAddr, clientAddrLen)) {
-        std::cout << " | " << response_;
-        return true;
+bool TimeServer::sendResponse(Worker& worker, const char* response, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen) {
+    uint64_t sendNs = 0;
+    if (worker.markNs) {
+        sendNs = metricsNowNs();
+        worker.metrics.record(Stage::Dispatch, sendNs - worker.markNs);
     }
-    return false;
+    int bytesSent = static_cast<int>(len);
+    if (worker.capture.data) {
+        bytesSent = static_cast<int>(std::min(len, worker.capture.size));
+        memcpy(worker.capture.data, response, static_cast<size_t>(bytesSent));
+        worker.captured = static_cast<size_t>(bytesSent);
+    }
+    else if (worker.batch) {
+        // Queued in the send ring; batchLoop() commits the whole batch at once
+        if (!worker.batch->queueSend(response, bytesSent, clientAddr)) {
+            worker.metrics.countError(ErrorKind::Send);
+            return false;
+        }
+    }
+    else {
+        bytesSent = sendto(worker.replySocket, response, static_cast<int>(len), 0,
+            (const sockaddr*)&clientAddr, clientAddrLen);
+        if (SOCKET_ERROR == bytesSent) {
+            worker.metrics.countError(ErrorKind::Send);
+            logError("sendto");
+            return false;
+        }
+    }
+    if (sendNs) worker.metrics.record(Stage::Send, metricsNowNs() - sendNs);
+    if (worker.chargeKey) admission_->charge(worker.chargeKey, static_cast<size_t>(bytesSent));
+    bumpCounter(worker.metrics.responses);
+    if (logEnabled(LogLevel::Debug)) {
+        logPayload(worker.id, response, static_cast<size_t>(bytesSent));
+    }
+    return true;
 }
 
 /**
- * @brief Decodes a request buffer into a Request struct.
- * @param req Vector of bytes representing the request.
- * @return Decoded Request struct.
+ * @brief Decodes a request buffer into a Request struct without copying it.
+ * @param req Bytes representing the request (must outlive the returned Request).
+ * @param len Number of bytes in req.
+ * @return Decoded Request struct viewing into req.
  */
-TimeServer::Request TimeServer::decode(std::vector<char> req) {
+TimeServer::Request TimeServer::decode(const char* req, size_t len) {
     Request result;
-    result.code = req.empty() ? ReqCode::Error : static_cast<ReqCode>(req[0]);
-    result.params.clear();
+    if (len > 0 && wire::isBinary(req[0])) {
+        // Binary: fixed header, then the raw payload (the city name is the whole payload)
+        if (!wire::decodeHeader(req, len, result.header)) return result;
+        result.binary = true;
+        result.code = result.header.code;
+        if (len > wire::kHeaderSize) {
+            result.payload = ByteView{ req + wire::kHeaderSize, len - wire::kHeaderSize };
+            result.params[result.paramCount++] = result.payload;
+        }
+        return result;
+    }
+    result.code = (len == 0) ? ReqCode::Error : static_cast<ReqCode>(req[0]);
+    if (len > 1) result.payload = ByteView{ req + 1, len - 1 };
 
     // Parse null-separated arguments
     size_t i = 1;
-    while (i < req.size()) {
+    while (i < len) {
         if (req[i] == '\0') {
             ++i;
             size_t start = i;
-            while (i < req.size() && req[i] != '\0') ++i;
-            if (start < req.size()) {
-                result.params.emplace_back(req.begin() + start, req.begin() + i);
+            while (i < len && req[i] != '\0') ++i;
+            if (start < len && result.paramCount < MAX_PARAMS) {
+                result.params[result.paramCount++] = ByteView{ req + start, i - start };
             }
         } else {
             ++i;
@@ -173,67 +493,762 @@ TimeServer::Request TimeServer::decode(std::vector<char> req) {
 }
 
 /**
- * @brief Dispatches the request to the appropriate handler based on the request code and sends the response.
+ * @brief Result of a legacy handler whose request gets no reply (malformed payload).
+ */
+static constexpr size_t kNoReply = static_cast<size_t>(-1);
+
+/**
+ * @brief Formats the legacy reply of one code.
+ * @param req Decoded request (its arity already checked against the registry).
+ * @param clientAddr Client's address (MeasureTimeLap key).
+ * @param out Buffer receiving the reply.
+ * @return Number of bytes written, or kNoReply to drop the request.
+ */
+using LegacyHandler = size_t (*)(const TimeServer::Request& req, const sockaddr_storage& clientAddr, OutSpan out);
+
+/**
+ * @brief Writes the binary reply body of one code.
+ * @param payload Request body.
+ * @param receivedNs Receive time of the datagram (GetPreciseTime).
+ * @param clientAddr Client's address (MeasureTimeLap key, subscriptions).
+ * @param body Buffer receiving the body (at least the registry body size when it is fixed).
+ * @param status Receives the outcome.
+ * @param flags Receives the reply flags, or'ed in.
+ * @return Number of body bytes written.
+ */
+using BinaryHandler = size_t (*)(ByteView payload, uint64_t receivedNs, const sockaddr_storage& clientAddr,
+                                 OutSpan body, wire::Status& status, uint8_t& flags);
+
+/**
+ * @brief Handlers of one code; null where the framing has no answer for it.
+ */
+struct Handlers {
+    ReqCode code;         /**< Request code (the table is indexed by its value, like wire::kCodes). */
+    LegacyHandler legacy; /**< Text/number reply, or null. */
+    BinaryHandler binary; /**< Binary reply body, or null. */
+};
+
+// ---------- legacy handlers ----------
+static size_t legacyGetTime(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return GetTime(out); }
+static size_t legacyGetTimeWithoutDate(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return GetTimeWithoutDate(out); }
+static size_t legacyGetTimeSinceEpoch(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return toBytes(GetTimeSinceEpoch(), out); }
+static size_t legacyGetDelayEstimation(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return toBytes(GetClientToServerDelayEstimation(), out); }
+static size_t legacyMeasureRTT(const TimeServer::Request& req, const sockaddr_storage&, OutSpan out) { return MeasureRTT(req.payload, out); }
+static size_t legacyGetTimeWithoutDateOrSeconds(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return GetTimeWithoutDateOrSeconds(out); }
+static size_t legacyGetYear(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return GetYear(out); }
+static size_t legacyGetMonthAndDay(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return GetMonthAndDay(out); }
+static size_t legacyGetSecondsSinceMonthStart(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return toBytes(GetSecondsSinceBeginingOfMonth(), out); }
+static size_t legacyGetWeekOfYear(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return toBytes(GetWeekOfYear(), out); }
+static size_t legacyGetDaylightSavings(const TimeServer::Request&, const sockaddr_storage&, OutSpan out) { return GetDaylightSavings(out); }
+static size_t legacyGetTimeInCity(const TimeServer::Request& req, const sockaddr_storage&, OutSpan out) { return GetTimeWithoutDateInCity(req.params[0], out); }
+static size_t legacyMeasureTimeLap(const TimeServer::Request&, const sockaddr_storage& clientAddr, OutSpan out) { return MeasureTimeLap(endpointKeyOf(clientAddr), out); }
+
+static size_t legacyGetPreciseTime(const TimeServer::Request& req, const sockaddr_storage&, OutSpan out) {
+    size_t len = GetPreciseTime(req.payload, req.receivedNs, out);
+    return len == 0 ? kNoReply : len;
+}
+
+// ---------- binary handlers ----------
+static size_t binaryTimeFields(ByteView, uint64_t, const sockaddr_storage&, OutSpan body, wire::Status&, uint8_t&) {
+    // One layout for every date and time code; the client picks the fields it shows
+    return GetTimeFields(body);
+}
+
+static size_t binaryTimeInCity(ByteView payload, uint64_t, const sockaddr_storage&, OutSpan body, wire::Status&, uint8_t& flags) {
+    return GetTimeFieldsInCity(payload, body, flags);
+}
+
+static size_t binaryDelayEstimation(ByteView, uint64_t, const sockaddr_storage&, OutSpan body, wire::Status&, uint8_t&) {
+    wire::putLe32(body.data, GetClientToServerDelayEstimation());
+    return wire::kValueSize;
+}
+
+static size_t binarySecondsSinceMonthStart(ByteView, uint64_t, const sockaddr_storage&, OutSpan body, wire::Status&, uint8_t&) {
+    wire::putLe32(body.data, GetSecondsSinceBeginingOfMonth());
+    return wire::kValueSize;
+}
+
+static size_t binaryMeasureTimeLap(ByteView, uint64_t, const sockaddr_storage& clientAddr, OutSpan body, wire::Status&, uint8_t& flags) {
+    uint32_t value = 0;
+    if (!MeasureTimeLapSeconds(endpointKeyOf(clientAddr), value)) {
+        flags |= wire::kFlagLapStarted;
+    }
+    wire::putLe32(body.data, value);
+    return wire::kValueSize;
+}
+
+static size_t binaryMeasureRTT(ByteView payload, uint64_t, const sockaddr_storage&, OutSpan body, wire::Status&, uint8_t&) {
+    size_t len = std::min(payload.len, body.size);
+    if (len > 0) std::memcpy(body.data, payload.data, len);
+    return len;
+}
+
+static size_t binaryPreciseTime(ByteView payload, uint64_t receivedNs, const sockaddr_storage&, OutSpan body, wire::Status& status, uint8_t&) {
+    size_t len = GetPreciseTimeFields(payload, receivedNs, body);
+    if (len == 0) status = wire::Status::BadRequest;
+    return len;
+}
+
+static size_t binarySubscribe(ByteView, uint64_t, const sockaddr_storage& clientAddr, OutSpan body, wire::Status& status, uint8_t&) {
+    return Subscribe(clientAddr, body, status);
+}
+
+static size_t binaryUnsubscribe(ByteView, uint64_t, const sockaddr_storage& clientAddr, OutSpan, wire::Status&, uint8_t&) {
+    Unsubscribe(clientAddr);
+    return 0;
+}
+
+/**
+ * @brief Handler table, indexed by code value like wire::kCodes (Batch is answered by respondBinary()).
+ */
+static constexpr Handlers kHandlers[] = {
+    { ReqCode::Default, nullptr, nullptr },
+    { ReqCode::GetTime, legacyGetTime, binaryTimeFields },
+    { ReqCode::GetTimeWithoutDate, legacyGetTimeWithoutDate, binaryTimeFields },
+    { ReqCode::GetTimeSinceEpoch, legacyGetTimeSinceEpoch, binaryTimeFields },
+    { ReqCode::GetClientToServerDelayEstimation, legacyGetDelayEstimation, binaryDelayEstimation },
+    { ReqCode::MeasuureRTT, legacyMeasureRTT, binaryMeasureRTT },
+    { ReqCode::GetTimeWithoutDateOrSeconds, legacyGetTimeWithoutDateOrSeconds, binaryTimeFields },
+    { ReqCode::GetYear, legacyGetYear, binaryTimeFields },
+    { ReqCode::GetMonthAndDay, legacyGetMonthAndDay, binaryTimeFields },
+    { ReqCode::GetSecondsSinceBeginningOfMonth, legacyGetSecondsSinceMonthStart, binarySecondsSinceMonthStart },
+    { ReqCode::GetWeekOfYear, legacyGetWeekOfYear, binaryTimeFields },
+    { ReqCode::GetDaylightSavings, legacyGetDaylightSavings, binaryTimeFields },
+    { ReqCode::GetTimeWithoutDateInCity, legacyGetTimeInCity, binaryTimeInCity },
+    { ReqCode::MeasureTimeLap, legacyMeasureTimeLap, binaryMeasureTimeLap },
+    { ReqCode::GetPreciseTime, legacyGetPreciseTime, binaryPreciseTime },
+    { ReqCode::Batch, nullptr, nullptr },
+    { ReqCode::Subscribe, nullptr, binarySubscribe },
+    { ReqCode::Unsubscribe, nullptr, binaryUnsubscribe }
+};
+
+/**
+ * @brief Checks that every handler entry sits at the index of its code.
+ * @param i First entry to check.
+ * @return true if entries i.. are in code order.
+ */
+static constexpr bool handlersInOrder(size_t i = 0) {
+    return i == wire::kCodeCount || (static_cast<size_t>(kHandlers[i].code) == i && handlersInOrder(i + 1));
+}
+static_assert(sizeof(kHandlers) / sizeof(kHandlers[0]) == wire::kCodeCount, "one handler entry per registered code");
+static_assert(handlersInOrder(), "kHandlers must be indexed by code value");
+static_assert(static_cast<size_t>(BUFFER_SIZE) >= wire::kHeaderSize + wire::kMaxReplyBody, "reply buffers must hold every fixed binary reply");
+
+/**
+ * @brief Dispatches the request to the handler of its code and sends the response.
+ *        Unknown codes and requests with fewer parameters than the registry requires are dropped;
+ *        replies of per-second, per-parameter codes come from the worker's reply cache when they can.
+ * @param worker Worker that received the request.
  * @param req The decoded Request object.
  * @param clientAddr Client's address.
  * @param clientAddrLen Length of client's address.
  * @return true if dispatch and response succeed, false otherwise.
  */
-bool TimeServer::dispatch(const TimeServer::Request& req, sockaddr_in clientAddr, int clientAddrLen) {
-    switch (req.code) {
-    case ReqCode::GetTime:
-        return sendResponse(GetTime(), clientAddr, clientAddrLen);
-    case ReqCode::GetTimeWithoutDate:
-        return sendResponse(GetTimeWithoutDate(), clientAddr, clientAddrLen);
-    case ReqCode::GetTimeSinceEpoch:
-        return sendResponse(GetTimeSinceEpoch(), clientAddr, clientAddrLen);
-    case ReqCode::GetClientToServerDelayEstimation:
-        return sendResponse(GetClientToServerDelayEstimation(), clientAddr, clientAddrLen);
-    case ReqCode::MeasuureRTT:
-        return sendResponse(MeasureRTT(), clientAddr, clientAddrLen);
-    case ReqCode::GetTimeWithoutDateOrSeconds:
-        return sendResponse(GetTimeWithoutDateOrSeconds(), clientAddr, clientAddrLen);
-    case ReqCode::GetYear:
-        return sendResponse(GetYear(), clientAddr, clientAddrLen);
-    case ReqCode::GetMonthAndDay:
-        return sendResponse(GetMonthAndDay(), clientAddr, clientAddrLen);
-    case ReqCode::GetSecondsSinceBeginningOfMonth:
-        return sendResponse(GetSecondsSinceBeginingOfMonth(), clientAddr, clientAddrLen);
-    case ReqCode::GetWeekOfYear:
-        return sendResponse(GetWeekOfYear(), clientAddr, clientAddrLen);
-    case ReqCode::GetDaylightSavings:
-        return sendResponse(GetDaylightSavings(), clientAddr, clientAddrLen);
-    case ReqCode::GetTimeWithoutDateInCity:
-        // Assumes first parameter is city name
-        return sendResponse(GetTimeWithoutDateInCity(req.params[0]), clientAddr, clientAddrLen);
-    case ReqCode::MeasureTimeLap:
-        // Uses client's address and port for lap measurement
-        return sendResponse(MeasureTimeLap(clientAddr.sin_addr.S_un.S_addr, clientAddr.sin_port), clientAddr, clientAddrLen);
+bool TimeServer::dispatch(Worker& worker, const TimeServer::Request& req, const sockaddr_storage& clientAddr, int clientAddrLen) {
+    if (req.binary) return dispatchBinary(worker, req, clientAddr, clientAddrLen);
+    size_t slot = wire::codeSlot(req.code);
+    LegacyHandler handler = kHandlers[slot].legacy;
+    if (!handler || req.paramCount < wire::kCodes[slot].arity) return false;
+    OutSpan out{ worker.sendBuf, sizeof(worker.sendBuf) };
+    size_t len = 0;
+    if (wire::kCodes[slot].cache != wire::Cacheability::SecondArg || !worker.cache.enabled()) {
+        len = handler(req, clientAddr, out);
+        if (len == kNoReply) return false;
+        return sendResponse(worker, out.data, len, clientAddr, clientAddrLen);
     }
-    return false;
+
+    // Keyed by the normalized parameter, so "New York " and "new york" share an entry
+    char key[ReplyCache::kMaxKey + 1];
+    ByteView keyView{ key, normalizeCity(req.params[0], key, sizeof(key)) };
+    int64_t epoch = static_cast<int64_t>(std::time(nullptr));
+    if (worker.cache.lookup(req.code, keyView, epoch, out, len)) {
+        bumpCounter(worker.metrics.cacheHits);
+    }
+    else {
+        bumpCounter(worker.metrics.cacheMisses);
+        len = handler(req, clientAddr, out);
+        if (len == kNoReply) return false;
+        worker.cache.store(req.code, keyView, epoch, out.data, len);
+    }
+    return sendResponse(worker, out.data, len, clientAddr, clientAddrLen);
 }
 
 /**
- * @brief Main server loop: waits for client requests and dispatches them.
+ * @brief Answers a binary request with a header and a fixed-width little-endian body.
+ *        Malformed or unknown requests are answered with an error status instead of dropped.
+ * @param worker Worker that received the request.
+ * @param req The decoded binary Request object.
+ * @param clientAddr Client's address.
+ * @param clientAddrLen Length of client's address.
+ * @return true if the response was sent, false otherwise.
+ */
+bool TimeServer::dispatchBinary(Worker& worker, const TimeServer::Request& req, const sockaddr_storage& clientAddr, int clientAddrLen) {
+    size_t len = respondBinary(req, clientAddr, OutSpan{ worker.sendBuf, sizeof(worker.sendBuf) });
+    return sendResponse(worker, worker.sendBuf, len, clientAddr, clientAddrLen);
+}
+
+/**
+ * @brief Builds the complete binary reply (header and body) for a binary request.
+ *
+ * Batch items are answered in order, in place. An item whose answer might not fit ends the
+ * reply with kFlagTruncated set, so the client can resend the rest.
+ * @param req The decoded binary Request object.
+ * @param clientAddr Client's address (MeasureTimeLap key).
+ * @param out Buffer receiving the reply (at least wire::kHeaderSize bytes).
+ * @return Number of bytes written.
+ */
+size_t TimeServer::respondBinary(const TimeServer::Request& req, const sockaddr_storage& clientAddr, OutSpan out) {
+    wire::Header header = req.header;
+    header.version = wire::kVersion;
+    header.status = wire::Status::Ok;
+    header.flags = 0;
+    OutSpan body{ out.data + wire::kHeaderSize, out.size - wire::kHeaderSize };
+    size_t len = 0;
+    if (req.header.version != wire::kVersion) {
+        header.status = wire::Status::UnsupportedVersion;
+    }
+    else if (req.code != ReqCode::Batch) {
+        len = answerBinary(req.code, req.payload, req.receivedNs, clientAddr, body, header.status, header.flags);
+    }
+    else {
+        const char* in = req.payload.data;
+        const char* end = in + req.payload.len;
+        size_t items = 0;
+        while (in + wire::kBatchItemHeaderSize <= end && items < wire::kMaxBatchItems) {
+            ReqCode code = static_cast<ReqCode>(in[0]);
+            size_t argLen = static_cast<unsigned char>(in[1]);
+            if (in + wire::kBatchItemHeaderSize + argLen > end) {
+                header.status = wire::Status::BadRequest; // Item runs past the datagram
+                break;
+            }
+            ByteView arg{ in + wire::kBatchItemHeaderSize, argLen };
+            in += wire::kBatchItemHeaderSize + argLen;
+
+            // Check the largest possible answer first, so an item that does not fit has no side
+            // effects (MeasureTimeLap) and the answer can be written in place
+            int fixed = wire::replyBodySize(code);
+            size_t worst = (fixed >= 0) ? static_cast<size_t>(fixed) : argLen;
+            if (len + wire::kBatchReplyItemHeaderSize + worst > body.size) {
+                header.flags |= wire::kFlagTruncated;
+                break;
+            }
+            char* item = body.data + len;
+            OutSpan itemBody{ item + wire::kBatchReplyItemHeaderSize, worst };
+            wire::Status status = wire::Status::Ok;
+            uint8_t flags = 0;
+            size_t n = 0;
+            if (code == ReqCode::Batch) status = wire::Status::UnknownCode; // No nesting
+            else n = answerBinary(code, arg, req.receivedNs, clientAddr, itemBody, status, flags);
+            item[0] = static_cast<char>(code);
+            item[1] = static_cast<char>(status);
+            item[2] = static_cast<char>(flags);
+            item[3] = static_cast<char>(n);
+            len += wire::kBatchReplyItemHeaderSize + n;
+            ++items;
+        }
+    }
+    wire::encodeHeader(out.data, header);
+    return wire::kHeaderSize + len;
+}
+
+/**
+ * @brief Answers one binary request or Batch sub-request.
+ * @param code Request code.
+ * @param payload Request body.
+ * @param receivedNs Receive time of the datagram (GetPreciseTime).
+ * @param clientAddr Client's address (MeasureTimeLap key).
+ * @param body Buffer receiving the reply body.
+ * @param status Receives the outcome.
+ * @param flags Receives the reply flags, or'ed in.
+ * @return Number of body bytes written.
+ */
+size_t TimeServer::answerBinary(ReqCode code, ByteView payload, uint64_t receivedNs, const sockaddr_storage& clientAddr,
+                                OutSpan body, wire::Status& status, uint8_t& flags) {
+    BinaryHandler handler = kHandlers[wire::codeSlot(code)].binary;
+    if (!handler) {
+        status = wire::Status::UnknownCode;
+        return 0;
+    }
+    return handler(payload, receivedNs, clientAddr, body, status, flags);
+}
+
+/**
+ * @brief Main server loop: starts the workers and runs the event loop and its timers
+ *        until stop() is called.
+ *
+ * Housekeeping runs as reactor timers on loop 0, which is driven by the calling thread:
+ * lap and subscription expiry once a second, the throughput report every statsIntervalSec
+ * and the subscriber ticks every tickIntervalMs.
  */
 void TimeServer::run() {
     if (!initialized_) {
-        logMessage("Time Server: Not initialized properly.");
+        logFormat(LogLevel::Error, "Time Server: Not initialized properly.");
+        return;
+    }
+    if (options_.metricsPort != 0) {
+        sockaddr_storage addr;
+        if (!resolveAddress(options_.metricsHost, options_.metricsPort, AF_UNSPEC, addr)) {
+            logFormat(LogLevel::Warn, "Time Server: Cannot resolve metrics address %s; metrics endpoint disabled.",
+                      options_.metricsHost.c_str());
+        }
+        else if (exporter_.start(addr, [this]() { return renderMetrics(); })) {
+            logFormat(LogLevel::Info, "Time Server: Metrics on http://%s/metrics", formatAddress(addr).c_str());
+        }
+    }
+    std::ostringstream oss;
+    oss << "Time Server: Wait for clients' requests (" << options_.workers << " worker(s), "
+        << (options_.shardSockets ? "sharded" : "shared") << " socket, " << reactor_->name() << " reactor).";
+    logMessage(oss.str());
+
+    reactor_->addTimer(std::chrono::seconds(1), []() {
+        expireLaps();
+        expireSubscriptions();
+    });
+    if (options_.statsIntervalSec > 0) {
+        unsigned seconds = options_.statsIntervalSec;
+        lastRequests_.assign(workers_.size(), 0);
+        reactor_->addTimer(std::chrono::seconds(seconds), [this, seconds]() { reportThroughput(lastRequests_, seconds); });
+    }
+    if (options_.tickIntervalMs > 0) {
+        reactor_->addTimer(std::chrono::milliseconds(options_.tickIntervalMs), [this]() { sendTick(); });
+    }
+
+    for (auto& worker : workers_) {
+        Worker* w = worker.get();
+        if (w->batch) w->thread = std::thread([this, w]() {
+            placeThread(*w);
+            batchLoop(*w);
+        });
+    }
+    for (size_t i = 1; i < loops_.size(); ++i) {
+        unsigned loop = static_cast<unsigned>(i);
+        loops_[i]->thread = std::thread([this, loop]() {
+            placeThread(*loops_[loop]);
+            reactor_->run(loop);
+        });
+    }
+    if (!loops_.empty()) placeThread(*loops_[0]);
+    reactor_->run(0);
+
+    for (auto& worker : workers_) {
+        if (worker->batch) worker->batch->wake();
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+    exporter_.stop();
+    logMessage("Time Server: Stopped.");
+}
+
+/**
+ * @brief Ends run(); safe to call from any thread (e.g. a console control handler).
+ */
+void TimeServer::stop() {
+    if (reactor_) reactor_->stop();
+}
+
+/**
+ * @brief Timer task: builds one time tick from the snapshot and sends it to the multicast
+ *        group (if an IPv4 subscriber listens there) and to every unicast subscriber.
+ */
+void TimeServer::sendTick() {
+    subscriberAddresses(tickTargets_);
+    if (tickTargets_.empty()) return; // Nobody listening, not even on the group
+
+    char frame[wire::kHeaderSize + wire::kTimeFieldsSize];
+    wire::Header header;
+    header.code = ReqCode::Subscribe;
+    header.flags = wire::kFlagTick;
+    header.seq = ++tickSeq_;
+    wire::encodeHeader(frame, header);
+    GetTimeFields(OutSpan{ frame + wire::kHeaderSize, wire::kTimeFieldsSize });
+
+    // Multicast groups are IPv4 only: IPv6 subscribers still get unicast, from the server socket
+    bool group = false;
+    for (const sockaddr_storage& target : tickTargets_) {
+        if (tickViaGroup(target)) group = true;
+        else sendTickTo(m_socket, frame, sizeof(frame), target);
+    }
+    if (group && SOCKET_ERROR == sendto(tickSocket_, frame, sizeof(frame), 0, (const sockaddr*)&groupAddr_, sizeof(groupAddr_))) {
+        tickMetrics_.countError(ErrorKind::Send);
+        logError("sendto(multicast)");
+    }
+}
+
+/**
+ * @brief Sends one tick to a unicast subscriber. A subscriber out of admission credit is
+ *        dropped; send failures are counted, and a subscriber that keeps failing is dropped
+ *        (and logged once).
+ * @param sock Socket to send from.
+ * @param frame Tick frame.
+ * @param len Frame length.
+ * @param target Subscriber address.
+ */
+void TimeServer::sendTickTo(SOCKET sock, const char* frame, size_t len, const sockaddr_storage& target) {
+    // Ticks spend the subscriber's reply credit, so a spoofed Subscribe buys no more than any request
+    if (admission_ && !admission_->spend(target, len)) {
+        tickMetrics_.countDrop(DropReason::Amplification);
+        Unsubscribe(target);
+        return;
+    }
+    if (SOCKET_ERROR != sendto(sock, frame, static_cast<int>(len), 0, (const sockaddr*)&target, addressLength(target))) return;
+    tickMetrics_.countError(ErrorKind::Send);
+    int error = WSAGetLastError();
+    if (tickSendFailed(target)) {
+        logFormat(LogLevel::Warn, "Time Server: Dropped subscriber %s after repeated send failures (%d).",
+                  formatAddress(target).c_str(), error);
+    }
+}
+
+/**
+ * @brief Pins the calling thread to a worker's CPU and gives it a node-local time snapshot.
+ *        Does nothing for a worker without a CPU.
+ * @param worker Worker the thread runs.
+ */
+void TimeServer::placeThread(const Worker& worker) {
+    if (worker.cpu < 0) return;
+    if (!pinCurrentThread(static_cast<unsigned>(worker.cpu))) {
+        logFormat(LogLevel::Warn, "Time Server: Cannot pin worker %u to CPU %d: %lu.", worker.id, worker.cpu, GetLastError());
+        return;
+    }
+    useLocalSnapshot();
+}
+
+/**
+ * @brief Reactor handler: decodes, dispatches and answers one datagram on the loop's worker.
+ * @param loop Reactor loop that received the datagram.
+ * @param sock Socket the datagram arrived on (the reply is sent from it).
+ * @param data Datagram bytes (valid until return).
+ * @param len Datagram length.
+ * @param clientAddr Sender address.
+ * @param clientAddrLen Length of the sender address.
+ * @param stamp Stack receive stamp, 0 if none.
+ */
+void TimeServer::onDatagram(unsigned loop, SOCKET sock, const char* data, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen, uint64_t stamp) {
+    Worker& worker = *loops_[loop];
+    worker.replySocket = sock;
+    worker.rxStamp = stamp;
+    serveDatagram(worker, data, len, clientAddr, clientAddrLen);
+}
+
+/**
+ * @brief Admits, decodes, dispatches and answers one datagram, counting it and timing its
+ *        stages if it is sampled.
+ *
+ * Admission runs first and only looks at the source address and length, so a refused
+ * datagram costs one table lookup and no decoding or formatting.
+ * @param worker Worker handling the datagram.
+ * @param data Datagram bytes (valid until return).
+ * @param len Datagram length.
+ * @param clientAddr Sender address.
+ * @param clientAddrLen Length of the sender address.
+ */
+void TimeServer::serveDatagram(Worker& worker, const char* data, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen) {
+    if (admitDatagram(worker, data, len, clientAddr, worker.chargeKey)) {
+        handleDatagram(worker, data, len, clientAddr, clientAddrLen);
+    }
+}
+
+/**
+ * @brief Records a received datagram to the trace and runs admission control on it.
+ * @param worker Worker that received the datagram.
+ * @param data Datagram bytes.
+ * @param len Datagram length.
+ * @param clientAddr Sender address.
+ * @param chargeKey Receives the admission key the reply is charged to, 0 if uncharged.
+ * @return true if admitted, false if refused (the drop is counted).
+ */
+bool TimeServer::admitDatagram(Worker& worker, const char* data, size_t len, const sockaddr_storage& clientAddr, uint64_t& chargeKey) {
+    if (trace_) trace_->record(worker.id, data, len, clientAddr);
+    chargeKey = 0;
+    if (!admission_) return true;
+    DropReason reason;
+    if (admission_->admit(clientAddr, len, chargeKey, reason)) return true;
+    worker.metrics.countDrop(reason);
+    return false;
+}
+
+/**
+ * @brief Decodes, dispatches and answers one admitted datagram, charging the reply to
+ *        worker.chargeKey and stamping it with worker.rxStamp, and times its stages if it
+ *        is sampled.
+ *
+ * A legacy request the registry cannot answer (unknown code, missing city) is counted as a
+ * malformed drop instead of being dispatched; binary requests always get a reply.
+ * @param worker Worker handling the datagram.
+ * @param data Datagram bytes (valid until return).
+ * @param len Datagram length.
+ * @param clientAddr Sender address.
+ * @param clientAddrLen Length of the sender address.
+ */
+void TimeServer::handleDatagram(Worker& worker, const char* data, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen) {
+    // Only sampled requests read the clock; sendResponse() times dispatch and send off markNs.
+    // A malformed datagram does not take the sampling tick, so the next request is timed instead
+    uint64_t startNs = worker.metrics.sampleWithin(1) ? metricsNowNs() : 0;
+    Request request = decode(data, len);
+    if (!request.binary && !wire::legacyWellFormed(request.code, request.paramCount)) {
+        worker.metrics.countDrop(DropReason::Malformed);
+        worker.chargeKey = 0;
+        worker.rxStamp = 0;
         return;
     }
-    logMessage("Time Server: Wait for clients' requests.");
-    while (true) {
-        sockaddr_in clientAddr;
-        int clientAddrLen = sizeof(clientAddr);
-        Request request;
-        receiveRequest(request, clientAddr, clientAddrLen);
+    if (!worker.metrics.sampleNext()) startNs = 0;
+    handleRequest(worker, request, len, clientAddr, clientAddrLen, startNs);
+}
+
+/**
+ * @brief Accounts, dispatches and answers one decoded, well-formed request, charging the
+ *        reply to worker.chargeKey, and clears the worker's per-datagram state.
+ * @param worker Worker handling the request.
+ * @param request Decoded request (its receive time is set here if the code needs it).
+ * @param len Datagram length.
+ * @param clientAddr Sender address.
+ * @param clientAddrLen Length of the sender address.
+ * @param startNs metricsNowNs() when decoding began if the request is sampled, 0 otherwise.
+ */
+void TimeServer::handleRequest(Worker& worker, Request& request, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen, uint64_t startNs) {
+    acceptRequest(worker, request, len);
+    if (startNs) {
+        worker.markNs = metricsNowNs();
+        worker.metrics.record(Stage::Decode, worker.markNs - startNs);
+    }
+    if (!dispatch(worker, request, clientAddr, clientAddrLen)) {
+        worker.metrics.countError(ErrorKind::Dispatch);
+        logFormat(LogLevel::Warn, "Time Server: Dispatch failed.");
+    }
+    if (startNs) {
+        worker.metrics.record(Stage::Total, metricsNowNs() - startNs);
+        worker.markNs = 0;
+    }
+    worker.chargeKey = 0;
+    worker.rxStamp = 0;
+}
+
+/**
+ * @brief Admits one received datagram and queues it in the worker's scheduler.
+ *
+ * Admission still runs at arrival, so a refused source never takes a queue slot. A full queue
+ * either refuses the datagram or evicts a less important one; both count as queue_full.
+ * @param worker Worker owning the scheduler.
+ * @param datagram Received datagram.
+ * @param nowNs metricsNowNs() at receive.
+ */
+void TimeServer::enqueueDatagram(Worker& worker, const BatchIo::Datagram& datagram, uint64_t nowNs) {
+    size_t len = static_cast<size_t>(datagram.len);
+    uint64_t chargeKey = 0;
+    if (!admitDatagram(worker, datagram.data, len, *datagram.addr, chargeKey)) return;
+    // Without a stack stamp the request is stamped here, so its time in the queue still counts
+    // as server residence rather than network delay
+    uint64_t stamp = datagram.stamp ? datagram.stamp : stampNow();
+    bool evicted = false;
+    if (!worker.scheduler->push(datagram.data, len, *datagram.addr, chargeKey, stamp, nowNs, evicted) || evicted) {
+        worker.metrics.countDrop(DropReason::QueueFull);
+    }
+}
+
+// Average datagram length from which BatchDecoder beats decoding one at a time (server_bench)
+static constexpr size_t kBatchDecodeMinAverage = 24;
+
+/**
+ * @brief Builds the Request of one datagram from the batch decoder's arrays.
+ * @param decoder Decoder holding the batch.
+ * @param i Datagram index (well-formed).
+ * @param data Datagram bytes (must outlive the returned Request).
+ * @param len Datagram length.
+ * @return Request viewing into data, as TimeServer::decode() would return it.
+ */
+static TimeServer::Request batchRequest(const BatchDecoder& decoder, unsigned i, const char* data, size_t len) {
+    if (decoder.flags(i) & BatchDecoder::kBinary) return TimeServer::decode(data, len); // Header only, no scan
+    TimeServer::Request request;
+    request.code = decoder.code(i);
+    if (len > 1) request.payload = ByteView{ data + 1, len - 1 };
+    const ParamSpan* params = decoder.params(i);
+    request.paramCount = decoder.paramCount(i);
+    for (size_t p = 0; p < request.paramCount; ++p) {
+        request.params[p] = ByteView{ data + params[p].offset, params[p].len };
+    }
+    return request;
+}
 
-        if (!dispatch(request, clientAddr, clientAddrLen)) {
-            logMessage("Time Server: Dispatch failed.");
+/**
+ * @brief Batched loop: drains up to batchSize datagrams, decodes them (as one batch once they
+ *        are long enough to pay off), dispatches them and flushes the replies.
+ *
+ * A batch averaging kBatchDecodeMinAverage bytes or more goes through decodeBatch(); shorter
+ * ones, the usual polls, are served one datagram at a time like the reactor path.
+ *
+ * With a scheduler every received datagram is copied into it, so the receive slots are re-posted
+ * by the next flush() however long the backlog is. Each pass then dispatches at most a quarter
+ * batch from the queue before receiving again without waiting, so a probe that arrives behind a
+ * burst of bulk requests is dispatched within one pass instead of after the burst.
+ * @param worker Worker owning the loop (must have a batch backend).
+ */
+void TimeServer::batchLoop(Worker& worker) {
+    std::vector<BatchIo::Datagram> batch(options_.batchSize);
+    std::vector<BatchIo::Datagram> admitted(options_.batchSize);
+    std::vector<uint64_t> chargeKeys(options_.batchSize);
+    BatchDecoder decoder(options_.batchSize, MAX_PARAMS);
+    RequestScheduler* scheduler = worker.scheduler.get();
+    unsigned perPass = std::max(1u, options_.batchSize / 4);
+    while (!reactor_->stopping()) {
+        bool wait = !scheduler || scheduler->empty();
+        unsigned n = worker.batch->receive(batch.data(), static_cast<unsigned>(batch.size()), wait);
+        if (!scheduler) {
+            // The batch decoder only pays off once separator scans dominate: short polls (the
+            // usual mix) are cheaper decoded one at a time
+            size_t bytes = 0;
+            for (unsigned i = 0; i < n; ++i) bytes += static_cast<size_t>(batch[i].len);
+            if (bytes < static_cast<size_t>(n) * kBatchDecodeMinAverage) {
+                for (unsigned i = 0; i < n; ++i) {
+                    worker.rxStamp = batch[i].stamp;
+                    serveDatagram(worker, batch[i].data, static_cast<size_t>(batch[i].len), *batch[i].addr, addressLength(*batch[i].addr));
+                }
+            }
+            else {
+                decodeBatch(worker, batch.data(), n, admitted.data(), chargeKeys.data(), decoder);
+            }
+        }
+        else {
+            uint64_t nowNs = metricsNowNs();
+            for (unsigned i = 0; i < n; ++i) enqueueDatagram(worker, batch[i], nowNs);
+            unsigned shed = 0;
+            for (unsigned i = 0; i < perPass; ++i) {
+                const RequestScheduler::Item* item = scheduler->pop(metricsNowNs(), shed);
+                if (!item) break;
+                worker.chargeKey = item->chargeKey;
+                worker.rxStamp = item->stamp;
+                handleDatagram(worker, item->data, static_cast<size_t>(item->len), item->addr, addressLength(item->addr));
+            }
+            if (shed) worker.metrics.countDrop(DropReason::Shed, shed);
         }
+        if (!worker.batch->flush()) {
+            worker.metrics.countError(ErrorKind::Flush);
+        }
+    }
+}
+
+/**
+ * @brief Admits a receive batch, decodes it with the batch decoder and dispatches it in the
+ *        decoder's order; each reply is charged and stamped like its datagram.
+ *
+ * The decoder rejects the malformed datagrams and groups the rest by code, probes first, with
+ * the stateful codes kept in arrival order. Only dispatched datagrams take a sampling tick, as
+ * in handleDatagram(); the clock is read around decode() only if one of them can be sampled,
+ * and a sampled datagram's decode stage is its share of the whole batch.
+ * @param worker Worker owning the batch.
+ * @param batch Received datagrams (valid until flush()).
+ * @param n Number of datagrams.
+ * @param admitted Scratch for the admitted datagrams (n entries).
+ * @param chargeKeys Scratch for their admission keys (n entries).
+ * @param decoder The worker's batch decoder.
+ */
+void TimeServer::decodeBatch(Worker& worker, const BatchIo::Datagram* batch, unsigned n, BatchIo::Datagram* admitted,
+                             uint64_t* chargeKeys, BatchDecoder& decoder) {
+    unsigned count = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        if (!admitDatagram(worker, batch[i].data, static_cast<size_t>(batch[i].len), *batch[i].addr, chargeKeys[count])) continue;
+        admitted[count++] = batch[i];
+    }
+    // Decoded in place: the slots stay valid until flush()
+    bool timed = worker.metrics.sampleWithin(count);
+    uint64_t beginNs = timed ? metricsNowNs() : 0;
+    decoder.decode(admitted, count);
+    uint64_t shareNs = (timed && count) ? (metricsNowNs() - beginNs) / count : 0;
+    if (decoder.malformed()) worker.metrics.countDrop(DropReason::Malformed, decoder.malformed());
+    for (uint32_t i : decoder.order()) {
+        const BatchIo::Datagram& datagram = admitted[i];
+        size_t len = static_cast<size_t>(datagram.len);
+        uint64_t startNs = worker.metrics.sampleNext() ? metricsNowNs() - shareNs : 0;
+        Request request = batchRequest(decoder, i, datagram.data, len);
+        worker.chargeKey = chargeKeys[i];
+        worker.rxStamp = datagram.stamp;
+        handleRequest(worker, request, len, *datagram.addr, addressLength(*datagram.addr), startNs);
     }
 }
 
+/**
+ * @brief Runs one datagram through admission, decoding and dispatch on a private worker and
+ *        copies the reply out instead of sending it. Used to replay traces in process; call
+ *        from one thread only.
+ *
+ * The replay worker has no socket and no batch backend; its id is past every recording worker,
+ * so replayed datagrams are not captured again.
+ * @param data Datagram bytes.
+ * @param len Datagram length.
+ * @param clientAddr Sender address (admission and laps are keyed by it).
+ * @param reply Buffer receiving the reply (replies longer than it are cut).
+ * @return Reply length, or 0 if the datagram was refused or not answered.
+ */
+size_t TimeServer::process(const char* data, size_t len, const sockaddr_storage& clientAddr, OutSpan reply) {
+    if (!replayWorker_) {
+        replayWorker_.reset(new (-1) Worker(static_cast<unsigned>(workers_.size()), options_.latencySampleEvery,
+                                            options_.replyCacheEntries, -1, -1));
+    }
+    Worker& worker = *replayWorker_;
+    worker.capture = reply;
+    worker.captured = 0;
+    serveDatagram(worker, data, len, clientAddr, addressLength(clientAddr));
+    worker.capture = OutSpan{ nullptr, 0 };
+    return worker.captured;
+}
+
+/**
+ * @brief Logs requests per second for each worker since the previous report.
+ * @param last Request totals at the previous report, updated in place.
+ * @param seconds Length of the reporting interval.
+ */
+void TimeServer::reportThroughput(std::vector<uint64_t>& last, unsigned seconds) {
+    std::ostringstream oss;
+    uint64_t total = 0;
+    oss << "Time Server: Throughput";
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        const WorkerMetrics& metrics = workers_[i]->metrics;
+        uint64_t now = metrics.requests.load(std::memory_order_relaxed);
+        uint64_t rate = (now - last[i]) / seconds;
+        total += rate;
+        last[i] = now;
+        uint64_t errors = metrics.errors[static_cast<int>(ErrorKind::Dispatch)].load(std::memory_order_relaxed) +
+                          metrics.errors[static_cast<int>(ErrorKind::Flush)].load(std::memory_order_relaxed);
+        oss << " | [" << i << "] " << rate << " req/s, " << errors << " err";
+    }
+    oss << " | total " << total << " req/s";
+    logMessage(oss.str());
+}
+
+/**
+ * @brief Renders the Prometheus exposition of all workers, sockets and the logger.
+ *        Runs on the exporter thread; only reads relaxed counters.
+ * @return Exposition text.
+ */
+std::string TimeServer::renderMetrics() const {
+    std::string out;
+    std::vector<const WorkerMetrics*> metrics;
+    for (const auto& worker : workers_) metrics.push_back(&worker->metrics);
+    appendWorkerMetrics(out, metrics, &tickMetrics_);
+
+    // Bytes waiting in each socket's receive buffer: a growing queue means the loops fall behind
+    std::vector<SOCKET> sockets;
+    for (const auto& worker : workers_) {
+        if (worker->socket != INVALID_SOCKET && (worker->id == 0 || worker->ownsSocket)) sockets.push_back(worker->socket);
+    }
+    sockets.insert(sockets.end(), extraSockets_.begin(), extraSockets_.end());
+    std::vector<MetricSample> queues;
+    for (SOCKET sock : sockets) {
+        sockaddr_storage local;
+        int localLen = sizeof(local);
+        u_long pending = 0;
+        if (SOCKET_ERROR == getsockname(sock, (sockaddr*)&local, &localLen) ||
+            SOCKET_ERROR == ioctlsocket(sock, FIONREAD, &pending)) continue;
+        unsigned short port = ntohs(local.ss_family == AF_INET6 ? reinterpret_cast<const sockaddr_in6&>(local).sin6_port
+                                                                 : reinterpret_cast<const sockaddr_in&>(local).sin_port);
+        queues.push_back(MetricSample{ "port=\"" + std::to_string(port) + "\"", static_cast<double>(pending) });
+    }
+    appendMetric(out, "timeserver_socket_queue_bytes", "gauge", "Bytes waiting in the socket receive buffer.", queues);
+    appendMetric(out, "timeserver_log_dropped_total", "counter", "Log records dropped because a ring was full.",
+                 { MetricSample{ std::string(), static_cast<double>(loggerDropped()) } });
+    return out;
+}
+
 /**
  * @brief Overloads the << operator for Request struct for logging purposes.
  * @param os Output stream.
@@ -242,16 +1257,21 @@ void TimeServer::run() {
  */
 std::ostream& operator<<(std::ostream& os, const TimeServer::Request& req) {
     os << req.code;
-    if (req.params.empty()) return os << " [No Params]";
+    if (req.binary) {
+        return os << " [binary v" << static_cast<unsigned>(req.header.version) << " seq " << req.header.seq
+                  << ", " << req.payload.len << " payload bytes]";
+    }
+    if (req.code == ReqCode::GetPreciseTime) return os << " [" << req.payload.len << " binary bytes]";
+    if (req.paramCount == 0) return os << " [No Params]";
 
 /* Request struct logging overload - prints request code and parameters
  * Example: if a request has code 1 and parameters ["param1", "param2"], it prints:
  *          "1, Params: [param1, param2]"
  */
     os << ", Params: [";
-    for (size_t i = 0; i < req.params.size(); ++i) {
-        os << req.params[i];
-        if (i + 1 < req.params.size()) os << ", ";
+    for (size_t i = 0; i < req.paramCount; ++i) {
+        os.write(req.params[i].data, static_cast<std::streamsize>(req.params[i].len));
+        if (i + 1 < req.paramCount) os << ", ";
     }
     os << "]";
     return os;
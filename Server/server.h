@@ -12,13 +12,71 @@
 #include <vector>
 #include <iostream>
 #include <string.h>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <new>
 #include "utils.h"
+#include "batchio.h"
+#include "reactor.h"
+#include "metrics.h"
+#include "replycache.h"
+#include "affinity.h"
+#include "scheduler.h"
+#include "rxstamp.h"
+#include "trace.h"
+#include "batchdecode.h"
 
 /**
  * @brief Size of the buffer for receiving requests.
  */
 static constexpr int BUFFER_SIZE = 255;
 
+/**
+ * @brief Maximum number of parameters decoded from one request (extra ones are ignored).
+ */
+static constexpr size_t MAX_PARAMS = 8;
+
+/**
+ * @brief Address families the server sockets accept.
+ */
+enum class AddressFamily {
+    Dual,  /**< IPv6 socket that also accepts IPv4 (as IPv4-mapped addresses); IPv4 only if IPv6 is unavailable. */
+    IPv4,  /**< IPv4 only. */
+    IPv6   /**< IPv6 only (IPV6_V6ONLY). */
+};
+
+/**
+ * @brief Runtime configuration for the TimeServer worker pool.
+ */
+struct ServerOptions {
+    unsigned short port = 27015;     /**< Port number to bind the server to. */
+    unsigned workers = 1;            /**< Number of receive/dispatch worker threads. */
+    bool shardSockets = false;       /**< Give each worker its own bound socket instead of sharing one. */
+    unsigned statsIntervalSec = 0;   /**< Interval of the per-worker throughput report (0 disables it). */
+    unsigned batchSize = 0;          /**< Datagrams drained per batched receive (0/1 = single-packet path). */
+    unsigned busyPollUs = 0;         /**< Batched path: poll an empty receive queue this long before sleeping. */
+    size_t lapCapacity = kDefaultLapCapacity; /**< Maximum concurrently running MeasureTimeLap timers. */
+    unsigned tickIntervalMs = 0;     /**< Interval of the subscriber time ticks (0 disables subscriptions). */
+    std::string multicastGroup;      /**< Send ticks to this IPv4 multicast group instead of each subscriber. */
+    unsigned short multicastPort = 27016; /**< Destination port of multicast ticks. */
+    unsigned multicastTtl = 1;       /**< IP_MULTICAST_TTL of the tick socket (1 = local subnet). */
+    ReactorKind reactor = ReactorKind::Auto; /**< Event loop mechanism. */
+    std::vector<unsigned short> extraPorts; /**< Further ports served by the same event loops. */
+    AddressFamily family = AddressFamily::Dual; /**< Address families of the server sockets. */
+    unsigned latencySampleEvery = 16; /**< Time the stages of one request in this many (0 = never). */
+    std::string metricsHost;         /**< Address of the Prometheus metrics endpoint. */
+    unsigned short metricsPort = 0;  /**< Port of the metrics endpoint (0 disables it). */
+    AdmissionOptions admission;      /**< Per-source rate limit and amplification guard (off by default). */
+    size_t replyCacheEntries = 1024; /**< Per-worker cache of per-second city replies (0 disables it). */
+    std::vector<unsigned> cpus;      /**< Pin worker i to cpus[i % size] and allocate its state on that CPU's node (empty = no pinning). */
+    bool steerSockets = false;       /**< Also steer each batched worker's own socket (or a single worker's) to its CPU. */
+    bool receiveStamps = false;      /**< Take GetPreciseTime's receive time t2 from stack receive timestamps (SIO_TIMESTAMPING). */
+    SchedulerOptions scheduler;      /**< Batched path: priority queue with CoDel shedding between receive and dispatch (off by default). */
+    std::string tracePath;           /**< Record every received datagram to this trace file (empty disables capture). */
+    uint64_t traceMaxBytes = 0;      /**< Size at which the trace file stops growing (0 = unlimited). */
+};
+
 /**
  * @brief TimeServer class implements a UDP time server supporting multiple time-related requests.
  */
@@ -30,96 +88,375 @@ public:
      */
     TimeServer(unsigned short port = 27015);
 
+    /**
+     * @brief Constructs a TimeServer with a worker pool configuration.
+     * @param options Port, worker count, socket sharding and stats settings.
+     */
+    explicit TimeServer(const ServerOptions& options);
+
     /**
      * @brief Destructor. Cleans up resources.
      */
     ~TimeServer();
 
     /**
-     * @brief Main server loop: waits for client requests and dispatches them.
+     * @brief Main server loop: starts the workers and runs the event loop and its timers
+     *        until stop() is called.
      */
     void run();
 
+    /**
+     * @brief Ends run(); safe to call from any thread (e.g. a console control handler).
+     */
+    void stop();
+
     /**
      * @brief Represents a client request, including code and parameters.
+     *
+     * The parameters are views into the buffer the request was decoded from, so a Request is
+     * only valid while that buffer is (the worker's receive buffer or batch slot).
      */
     struct Request {
         /**
          * @brief Constructs a Request with default error code and empty parameters.
          */
-        Request() : code(ReqCode::Error), params() {}
+        Request() : code(ReqCode::Error), paramCount(0), payload{ nullptr, 0 }, receivedNs(0), binary(false) {}
         ReqCode code;                  /**< Request code indicating the type of request. */
-        std::vector<std::string> params; /**< Parameters for the request (e.g., city name). */
+        ByteView params[MAX_PARAMS];   /**< Parameters for the request (e.g., city name). */
+        size_t paramCount;             /**< Number of valid entries in params. */
+        ByteView payload;              /**< Every byte after the code, or after the header if binary. */
+        uint64_t receivedNs;           /**< Receive time (stack stamp, or the decode time), taken only for GetPreciseTime and Batch. */
+        bool binary;                   /**< Request used binary framing and gets a binary reply. */
+        wire::Header header;           /**< Header of a binary request. */
     };
 
+    /**
+     * @brief Decodes a request buffer into a Request struct without copying it.
+     * @param req Bytes representing the request (must outlive the returned Request).
+     * @param len Number of bytes in req.
+     * @return Decoded Request struct viewing into req.
+     */
+    static Request decode(const char* req, size_t len);
+
+    /**
+     * @brief Builds the complete binary reply (header and body) for a binary request.
+     *        Batch requests get one packed answer per sub-request, up to the buffer size.
+     * @param req The decoded binary Request object.
+     * @param clientAddr Client's address (MeasureTimeLap key).
+     * @param out Buffer receiving the reply (at least wire::kHeaderSize bytes).
+     * @return Number of bytes written.
+     */
+    static size_t respondBinary(const Request& req, const sockaddr_storage& clientAddr, OutSpan out);
+
+    /**
+     * @brief Runs one datagram through admission, decoding and dispatch on a private worker and
+     *        copies the reply out instead of sending it. Used to replay traces in process; call
+     *        from one thread only.
+     * @param data Datagram bytes.
+     * @param len Datagram length.
+     * @param clientAddr Sender address (admission and laps are keyed by it).
+     * @param reply Buffer receiving the reply (replies longer than it are cut).
+     * @return Reply length, or 0 if the datagram was refused or not answered.
+     */
+    size_t process(const char* data, size_t len, const sockaddr_storage& clientAddr, OutSpan reply);
+
 private:
     /**
-     * @brief Initializes Winsock and binds the UDP socket to the specified port.
+     * @brief Per-worker state: its socket, reply buffer and metrics.
+     *
+     * A worker either runs one event loop of the reactor (single-packet path) or drains its
+     * own socket through a BatchIo backend.
+     */
+    struct Worker {
+        Worker(unsigned id_, unsigned sampleEvery, size_t cacheEntries, int cpu_, int node_)
+            : id(id_), cpu(cpu_), node(node_), socket(INVALID_SOCKET), ownsSocket(false), replySocket(INVALID_SOCKET),
+              metrics(sampleEvery), markNs(0), chargeKey(0), rxStamp(0), capture{ nullptr, 0 }, captured(0),
+              cache(cacheEntries, node_) {}
+
+        /**
+         * @brief Allocates a worker on a NUMA node (its metrics, buffers and cache table are local).
+         * @param bytes Size of the worker.
+         * @param node Preferred node, or -1 for the default policy.
+         * @return Memory for the worker.
+         */
+        static void* operator new(size_t bytes, int node) {
+            void* memory = allocOnNode(bytes, node);
+            if (!memory) throw std::bad_alloc();
+            return memory;
+        }
+
+        /**
+         * @brief Releases a worker.
+         * @param memory Memory from operator new.
+         */
+        static void operator delete(void* memory) { freeNodeMemory(memory); }
+
+        /**
+         * @brief Releases a worker whose constructor threw.
+         * @param memory Memory from operator new.
+         */
+        static void operator delete(void* memory, int) { freeNodeMemory(memory); }
+
+        unsigned id;                         /**< Worker index (0..workers-1). */
+        int cpu;                             /**< CPU the worker's thread is pinned to, or -1. */
+        int node;                            /**< NUMA node of cpu, or -1. */
+        SOCKET socket;                       /**< Socket bound for this worker (shared or sharded). */
+        bool ownsSocket;                     /**< true if the socket is sharded to this worker. */
+        SOCKET replySocket;                  /**< Socket the request being answered arrived on. */
+        std::thread thread;                  /**< Thread running the worker's loop. */
+        WorkerMetrics metrics;               /**< Counters and stage latencies (written by this worker only). */
+        uint64_t markNs;                     /**< End of the decode stage of a timed request, 0 if untimed. */
+        uint64_t chargeKey;                  /**< Admission key the reply is charged to, 0 if uncharged. */
+        uint64_t rxStamp;                    /**< Receive stamp of the datagram being handled (counter ticks), 0 if none. */
+        OutSpan capture;                     /**< Replay worker: replies are copied here instead of sent (data null = send). */
+        size_t captured;                     /**< Length of the last reply copied to capture. */
+        ReplyCache cache;                    /**< Ready-to-send replies of cacheable codes for the current second. */
+        std::unique_ptr<BatchIo> batch;      /**< Batched I/O backend, or null for the single-packet path. */
+        std::unique_ptr<RequestScheduler> scheduler; /**< Priority queue of the batched loop, or null to dispatch in arrival order. */
+        char sendBuf[BUFFER_SIZE];           /**< Reusable buffer handlers format responses into. */
+    };
+
+    /**
+     * @brief Initializes Winsock, binds the shared socket and prepares the workers.
      * @return true if initialization succeeds, false otherwise.
      */
     bool initialize();
 
+    /**
+     * @brief Creates a UDP socket bound to the given port on all interfaces of options_.family.
+     * @param port Port number to bind.
+     * @param registeredIo Create the socket for Registered I/O (batched path).
+     * @return Bound socket, or INVALID_SOCKET on error.
+     */
+    SOCKET openSocket(unsigned short port, bool registeredIo);
+
+    /**
+     * @brief Attaches a batched I/O backend to every worker, or leaves all on the single-packet path.
+     * @return true if batching is active, false if the single-packet fallback is used.
+     */
+    bool setupBatching();
+
+    /**
+     * @brief Creates the reactor and registers the sockets it serves.
+     * @param batching true if the workers drain their sockets through BatchIo.
+     * @return true on success, false otherwise.
+     */
+    bool setupReactor(bool batching);
+
+    /**
+     * @brief Reactor handler: decodes, dispatches and answers one datagram on the loop's worker.
+     * @param loop Reactor loop that received the datagram.
+     * @param sock Socket the datagram arrived on (the reply is sent from it).
+     * @param data Datagram bytes (valid until return).
+     * @param len Datagram length.
+     * @param clientAddr Sender address.
+     * @param clientAddrLen Length of the sender address.
+     * @param stamp Stack receive stamp, 0 if none.
+     */
+    void onDatagram(unsigned loop, SOCKET sock, const char* data, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen, uint64_t stamp);
+
+    /**
+     * @brief Pins the calling thread to a worker's CPU and gives it a node-local time snapshot.
+     *        Does nothing for a worker without a CPU.
+     * @param worker Worker the thread runs.
+     */
+    static void placeThread(const Worker& worker);
+
+    /**
+     * @brief Records a received datagram to the trace and runs admission control on it.
+     * @param worker Worker that received the datagram.
+     * @param data Datagram bytes.
+     * @param len Datagram length.
+     * @param clientAddr Sender address.
+     * @param chargeKey Receives the admission key the reply is charged to, 0 if uncharged.
+     * @return true if admitted, false if refused (the drop is counted).
+     */
+    bool admitDatagram(Worker& worker, const char* data, size_t len, const sockaddr_storage& clientAddr, uint64_t& chargeKey);
+
+    /**
+     * @brief Admits, decodes, dispatches and answers one datagram, counting it and timing its
+     *        stages if it is sampled.
+     * @param worker Worker handling the datagram.
+     * @param data Datagram bytes (valid until return).
+     * @param len Datagram length.
+     * @param clientAddr Sender address.
+     * @param clientAddrLen Length of the sender address.
+     */
+    void serveDatagram(Worker& worker, const char* data, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen);
+
+    /**
+     * @brief Decodes, dispatches and answers one admitted datagram, charging the reply to
+     *        worker.chargeKey and stamping it with worker.rxStamp, and times its stages if it
+     *        is sampled.
+     * @param worker Worker handling the datagram.
+     * @param data Datagram bytes (valid until return).
+     * @param len Datagram length.
+     * @param clientAddr Sender address.
+     * @param clientAddrLen Length of the sender address.
+     */
+    void handleDatagram(Worker& worker, const char* data, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen);
+
+    /**
+     * @brief Accounts, dispatches and answers one decoded, well-formed request, charging the
+     *        reply to worker.chargeKey, and clears the worker's per-datagram state.
+     * @param worker Worker handling the request.
+     * @param request Decoded request (its receive time is set here if the code needs it).
+     * @param len Datagram length.
+     * @param clientAddr Sender address.
+     * @param clientAddrLen Length of the sender address.
+     * @param startNs metricsNowNs() when decoding began if the request is sampled, 0 otherwise.
+     */
+    void handleRequest(Worker& worker, Request& request, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen, uint64_t startNs);
+
+    /**
+     * @brief Admits one received datagram and queues it in the worker's scheduler.
+     * @param worker Worker owning the scheduler.
+     * @param datagram Received datagram.
+     * @param nowNs metricsNowNs() at receive.
+     */
+    void enqueueDatagram(Worker& worker, const BatchIo::Datagram& datagram, uint64_t nowNs);
+
+    /**
+     * @brief Batched loop: drains up to batchSize datagrams, decodes them (as one batch once they
+     *        are long enough to pay off), dispatches them and flushes the replies.
+     *        With a scheduler, datagrams are queued on arrival and dispatched by priority.
+     * @param worker Worker owning the loop (must have a batch backend).
+     */
+    void batchLoop(Worker& worker);
+
+    /**
+     * @brief Admits a receive batch, decodes it with the batch decoder and dispatches it in the
+     *        decoder's order; each reply is charged and stamped like its datagram.
+     * @param worker Worker owning the batch.
+     * @param batch Received datagrams (valid until flush()).
+     * @param n Number of datagrams.
+     * @param admitted Scratch for the admitted datagrams (n entries).
+     * @param chargeKeys Scratch for their admission keys (n entries).
+     * @param decoder The worker's batch decoder.
+     */
+    void decodeBatch(Worker& worker, const BatchIo::Datagram* batch, unsigned n, BatchIo::Datagram* admitted,
+                     uint64_t* chargeKeys, BatchDecoder& decoder);
+
+    /**
+     * @brief Timer task: builds one time tick from the snapshot and sends it to the multicast
+     *        group (if an IPv4 subscriber listens there) and to every unicast subscriber.
+     */
+    void sendTick();
+
+    /**
+     * @brief Sends one tick to a unicast subscriber. A subscriber out of admission credit is
+     *        dropped; send failures are counted, and a subscriber that keeps failing is dropped
+     *        (and logged once).
+     * @param sock Socket to send from.
+     * @param frame Tick frame.
+     * @param len Frame length.
+     * @param target Subscriber address.
+     */
+    void sendTickTo(SOCKET sock, const char* frame, size_t len, const sockaddr_storage& target);
+
+    /**
+     * @brief Moves the receive processing of each socket read by one pinned thread only to that
+     *        thread's CPU (SIO_CPU_AFFINITY).
+     */
+    void steerSockets();
+
+    /**
+     * @brief Creates the socket multicast ticks are sent from.
+     * @return true on success, false otherwise.
+     */
+    bool openTickSocket();
+
+    /**
+     * @brief Logs requests per second for each worker since the previous report.
+     * @param last Request totals at the previous report, updated in place.
+     * @param seconds Length of the reporting interval.
+     */
+    void reportThroughput(std::vector<uint64_t>& last, unsigned seconds);
+
+    /**
+     * @brief Renders the Prometheus exposition of all workers, sockets and the logger.
+     *        Runs on the exporter thread; only reads relaxed counters.
+     * @return Exposition text.
+     */
+    std::string renderMetrics() const;
+
     /**
      * @brief Cleans up socket and Winsock resources.
      */
     void cleanup();
 
     /**
-     * @brief Receives a request from a client, decodes it, and logs the received data.
-     * @param request Reference to a Request object to store the decoded request.
-     * @param clientAddr Reference to sockaddr_in to store the client's address.
-     * @param clientAddrLen Reference to int to store the length of the client's address.
-     * @return true on success, false on error.
+     * @brief Stamps the receive time of a decoded request if its code needs it, counts and logs it.
+     * @param worker Worker that received the datagram.
+     * @param request Decoded request.
+     * @param len Datagram length.
      */
-    bool receiveRequest(Request& request, sockaddr_in& clientAddr, int& clientAddrLen);
+    void acceptRequest(Worker& worker, Request& request, size_t len);
 
     /**
-     * @brief Sends a response to the client using a vector of bytes.
-     * @param response Vector of bytes to send.
+     * @brief Sends a response to the client.
+     * @param worker Worker whose socket is written.
+     * @param response Bytes to send.
+     * @param len Number of bytes to send.
      * @param clientAddr Client's address.
      * @param clientAddrLen Length of client's address.
      * @return true on success, false on error.
      */
-    bool sendResponse(const std::vector<char>& response, const sockaddr_in& clientAddr, int clientAddrLen);
+    bool sendResponse(Worker& worker, const char* response, size_t len, const sockaddr_storage& clientAddr, int clientAddrLen);
 
     /**
-     * @brief Sends a string response to the client.
-     * @param response String to send.
+     * @brief Dispatches the request to the appropriate handler based on the request code and sends the response.
+     * @param worker Worker that received the request.
+     * @param req The decoded Request object.
      * @param clientAddr Client's address.
      * @param clientAddrLen Length of client's address.
-     * @return true on success, false on error.
+     * @return true if dispatch and response succeed, false otherwise.
      */
-    bool sendResponse(const std::string& response, const sockaddr_in& clientAddr, int clientAddrLen);
+    bool dispatch(Worker& worker, const TimeServer::Request& req, const sockaddr_storage& clientAddr, int clientAddrLen);
 
     /**
-     * @brief Sends a uint32_t response to the client.
-     * @param response 32-bit unsigned integer to send.
+     * @brief Answers a binary request with a header and a fixed-width little-endian body.
+     *        Malformed or unknown requests are answered with an error status instead of dropped.
+     * @param worker Worker that received the request.
+     * @param req The decoded binary Request object.
      * @param clientAddr Client's address.
      * @param clientAddrLen Length of client's address.
-     * @return true on success, false on error.
+     * @return true if the response was sent, false otherwise.
      */
-    bool sendResponse(uint32_t response, const sockaddr_in& clientAddr, int clientAddrLen);
+    bool dispatchBinary(Worker& worker, const TimeServer::Request& req, const sockaddr_storage& clientAddr, int clientAddrLen);
 
     /**
-     * @brief Decodes a request buffer into a Request struct.
-     * @param req Vector of bytes representing the request.
-     * @return Decoded Request struct.
-     */
-    Request decode(std::vector<char> req);
-
-    /**
-     * @brief Dispatches the request to the appropriate handler based on the request code and sends the response.
-     * @param req The decoded Request object.
-     * @param clientAddr Client's address.
-     * @param clientAddrLen Length of client's address.
-     * @return true if dispatch and response succeed, false otherwise.
+     * @brief Answers one binary request or Batch sub-request.
+     * @param code Request code.
+     * @param payload Request body.
+     * @param receivedNs Receive time of the datagram (GetPreciseTime).
+     * @param clientAddr Client's address (MeasureTimeLap key).
+     * @param body Buffer receiving the reply body.
+     * @param status Receives the outcome.
+     * @param flags Receives the reply flags, or'ed in.
+     * @return Number of body bytes written.
      */
-    bool dispatch(const TimeServer::Request& req, sockaddr_in clientAddr, int clientAddrLen);
+    static size_t answerBinary(ReqCode code, ByteView payload, uint64_t receivedNs, const sockaddr_storage& clientAddr,
+                               OutSpan body, wire::Status& status, uint8_t& flags);
 
-    SOCKET m_socket;              /**< UDP socket for communication. */
+    SOCKET m_socket;              /**< UDP socket shared by the non-sharded workers. */
     unsigned short m_port;        /**< Port number the server is bound to. */
-    sockaddr_in serverAddr_;      /**< Server address structure. */
     bool initialized_;            /**< Indicates if Winsock is initialized. */
+    ServerOptions options_;       /**< Worker pool configuration. */
+    std::vector<std::unique_ptr<Worker>> workers_; /**< Receive/dispatch workers. */
+    std::vector<Worker*> loops_;  /**< Worker of each reactor loop (loop 0 runs on the thread calling run()). */
+    std::vector<SOCKET> extraSockets_; /**< Sockets bound to options_.extraPorts. */
+    std::unique_ptr<Reactor> reactor_; /**< Event loop: sockets of the single-packet path and all timers. */
+    std::vector<uint64_t> lastRequests_; /**< Request totals at the previous throughput report. */
+    SOCKET tickSocket_;           /**< Socket multicast ticks are sent from (m_socket without a group). */
+    sockaddr_in groupAddr_;       /**< Multicast destination of ticks (sin_addr 0 = unicast). */
+    std::vector<sockaddr_storage> tickTargets_; /**< Subscriber addresses of the current tick. */
+    uint32_t tickSeq_;            /**< Number of the last tick sent. */
+    WorkerMetrics tickMetrics_;   /**< Counters of the tick timer (written only by loop 0). */
+    MetricsExporter exporter_;     /**< Prometheus endpoint (started by run() if metricsPort is set). */
+    std::unique_ptr<AdmissionControl> admission_; /**< Admission table, or null if admission control is off. */
+    std::unique_ptr<TraceRecorder> trace_; /**< Capture of received datagrams, or null if tracing is off. */
+    std::unique_ptr<Worker> replayWorker_; /**< Worker of process(), created on first use. */
 };
 
 /**
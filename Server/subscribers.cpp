@@ -0,0 +1,106 @@
+/**
+ * @file subscribers.cpp
+ * @brief Implementation of the time-tick subscriber set.
+ *
+ * Subscribe and the tick fan-out are rare compared to time requests (once per renewal and
+ * once per tick), so a single mutex over a hash map is sufficient.
+ * Compatible with C++14.
+ */
+
+#include "subscribers.h"
+#include "utils.h"
+
+/**
+ * @brief Constructs an empty set.
+ * @param capacity Maximum number of subscribers.
+ * @param ttl Lifetime of a subscription after its last renewal.
+ */
+SubscriberSet::SubscriberSet(size_t capacity, clock::duration ttl)
+    : capacity_(capacity), ttl_(ttl)
+{
+}
+
+/**
+ * @brief Adds a subscriber or renews an existing subscription.
+ * @param addr Subscriber address.
+ * @param now Current time.
+ * @return true if subscribed, false if the set is full.
+ */
+bool SubscriberSet::subscribe(const sockaddr_storage& addr, clock::time_point now) {
+    std::lock_guard<std::mutex> lk(mx_);
+    EndpointKey key = endpointKeyOf(addr);
+    auto it = subs_.find(key);
+    if (it != subs_.end()) {
+        it->second.expires = now + ttl_;
+        it->second.failures = 0;
+        return true;
+    }
+    if (subs_.size() >= capacity_) return false;
+    subs_.emplace(key, Subscriber{ addr, now + ttl_, 0 });
+    return true;
+}
+
+/**
+ * @brief Removes a subscriber.
+ * @param addr Subscriber address.
+ * @return true if it was subscribed, false otherwise.
+ */
+bool SubscriberSet::unsubscribe(const sockaddr_storage& addr) {
+    std::lock_guard<std::mutex> lk(mx_);
+    return subs_.erase(endpointKeyOf(addr)) > 0;
+}
+
+/**
+ * @brief Records a tick that could not be sent; the subscriber is dropped once this has
+ *        happened limit times since its last renewal.
+ * @param addr Subscriber address.
+ * @param limit Failures tolerated per renewal.
+ * @return true if the subscriber was dropped, false otherwise.
+ */
+bool SubscriberSet::sendFailed(const sockaddr_storage& addr, unsigned limit) {
+    std::lock_guard<std::mutex> lk(mx_);
+    auto it = subs_.find(endpointKeyOf(addr));
+    if (it == subs_.end() || ++it->second.failures < limit) return false;
+    subs_.erase(it);
+    return true;
+}
+
+/**
+ * @brief Drops subscriptions that have outlived their time-to-live.
+ * @param now Current time.
+ * @return Number of subscriptions removed.
+ */
+size_t SubscriberSet::expire(clock::time_point now) {
+    std::lock_guard<std::mutex> lk(mx_);
+    size_t removed = 0;
+    for (auto it = subs_.begin(); it != subs_.end();) {
+        if (it->second.expires <= now) {
+            it = subs_.erase(it);
+            ++removed;
+        }
+        else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+/**
+ * @brief Copies the live subscriber addresses, so ticks can be sent without holding the lock.
+ * @param out Receives the addresses (cleared first).
+ */
+void SubscriberSet::addresses(std::vector<sockaddr_storage>& out) const {
+    std::lock_guard<std::mutex> lk(mx_);
+    out.clear();
+    out.reserve(subs_.size());
+    for (const auto& entry : subs_) out.push_back(entry.second.addr);
+}
+
+/**
+ * @brief Number of live subscriptions.
+ * @return Subscriber count.
+ */
+size_t SubscriberSet::size() const {
+    std::lock_guard<std::mutex> lk(mx_);
+    return subs_.size();
+}
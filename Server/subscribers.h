@@ -0,0 +1,97 @@
+/**
+ * @file subscribers.h
+ * @brief Bounded, expiring set of time-tick subscribers.
+ *
+ * This header provides the SubscriberSet used by the Subscribe request. A subscription lives
+ * for a fixed time-to-live after its last Subscribe and is dropped by the periodic expiry, so
+ * clients that vanish stop receiving ticks without having to unsubscribe.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <WinSock2.h>
+#include <ws2tcpip.h>
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <cstddef>
+#include "lapstore.h"
+
+/**
+ * @brief Thread-safe set of subscriber endpoints with a common time-to-live.
+ */
+class SubscriberSet {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Constructs an empty set.
+     * @param capacity Maximum number of subscribers.
+     * @param ttl Lifetime of a subscription after its last renewal.
+     */
+    SubscriberSet(size_t capacity, clock::duration ttl);
+
+    /**
+     * @brief Adds a subscriber or renews an existing subscription.
+     * @param addr Subscriber address.
+     * @param now Current time.
+     * @return true if subscribed, false if the set is full.
+     */
+    bool subscribe(const sockaddr_storage& addr, clock::time_point now);
+
+    /**
+     * @brief Removes a subscriber.
+     * @param addr Subscriber address.
+     * @return true if it was subscribed, false otherwise.
+     */
+    bool unsubscribe(const sockaddr_storage& addr);
+
+    /**
+     * @brief Records a tick that could not be sent; the subscriber is dropped once this has
+     *        happened limit times since its last renewal.
+     * @param addr Subscriber address.
+     * @param limit Failures tolerated per renewal.
+     * @return true if the subscriber was dropped, false otherwise.
+     */
+    bool sendFailed(const sockaddr_storage& addr, unsigned limit);
+
+    /**
+     * @brief Drops subscriptions that have outlived their time-to-live.
+     * @param now Current time.
+     * @return Number of subscriptions removed.
+     */
+    size_t expire(clock::time_point now);
+
+    /**
+     * @brief Copies the live subscriber addresses, so ticks can be sent without holding the lock.
+     * @param out Receives the addresses (cleared first).
+     */
+    void addresses(std::vector<sockaddr_storage>& out) const;
+
+    /**
+     * @brief Number of live subscriptions.
+     * @return Subscriber count.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Lifetime of a subscription after its last renewal.
+     * @return Time-to-live.
+     */
+    clock::duration ttl() const { return ttl_; }
+
+private:
+    /**
+     * @brief One subscription.
+     */
+    struct Subscriber {
+        sockaddr_storage addr;     /**< Address ticks are sent to (IPv4 or IPv6). */
+        clock::time_point expires; /**< End of the subscription unless renewed. */
+        unsigned failures;         /**< Ticks that could not be sent since the last renewal. */
+    };
+
+    mutable std::mutex mx_;        /**< Guards subs_. */
+    std::unordered_map<EndpointKey, Subscriber, EndpointKeyHash> subs_; /**< Live subscriptions. */
+    size_t capacity_;              /**< Maximum number of subscribers. */
+    clock::duration ttl_;          /**< Lifetime of a subscription. */
+};
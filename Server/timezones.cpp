@@ -0,0 +1,420 @@
+/**
+ * @file timezones.cpp
+ * @brief Compiled zone table and yearly-cached DST transitions.
+ *
+ * Date arithmetic uses the proleptic Gregorian day count (days since 1970-01-01) instead of
+ * mktime, so transitions are independent of the server's own time zone.
+ * Compatible with C++14.
+ */
+#include "timezones.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+/**
+ * @brief Daylight Saving Time rule of a zone.
+ */
+enum class DstRule { None, EU, US, AU, NZ };
+
+/**
+ * @brief One DST transition: the given Sunday of a month at a fixed time of day.
+ */
+struct Transition {
+    int month;   /**< Month (1-12). */
+    int week;    /**< Sunday of the month (1-4, or 5 for the last one). */
+    int minutes; /**< Minutes after midnight at which the change happens. */
+    bool utc;    /**< true if minutes are UTC, false if local standard time. */
+};
+
+/**
+ * @brief Start and end of the DST period of a rule.
+ */
+struct DstSpec { Transition start, end; };
+
+// Indexed by DstRule. End times are given in standard time (US 02:00 DST = 01:00 standard)
+static const DstSpec kRules[] = {
+    { {  0, 0,   0, false }, {  0, 0,   0, false } }, // None
+    { {  3, 5,  60, true  }, { 10, 5,  60, true  } }, // EU: last Sun Mar .. last Sun Oct, 01:00 UTC
+    { {  3, 2, 120, false }, { 11, 1,  60, false } }, // US: 2nd Sun Mar 02:00 .. 1st Sun Nov 02:00 DST
+    { { 10, 1, 120, false }, {  4, 1, 120, false } }, // AU: 1st Sun Oct 02:00 .. 1st Sun Apr 03:00 DST
+    { {  9, 5, 120, false }, {  4, 1, 120, false } }, // NZ: last Sun Sep 02:00 .. 1st Sun Apr 03:00 DST
+};
+
+/**
+ * @brief Zone rule: standard offset and DST rule.
+ */
+struct TimeZone {
+    const char* name; /**< Canonical name. */
+    int stdOffsetMin; /**< Standard offset from UTC in minutes. */
+    DstRule rule;     /**< DST rule. */
+};
+
+/**
+ * @brief Lookup name of a zone.
+ */
+struct ZoneAlias {
+    const char* name; /**< City name or code. */
+    int zone;         /**< Index into kZones. */
+};
+
+// Standard offsets and rules as of 2025 (IANA tzdata); ids are positions in this table
+static constexpr TimeZone kZones[] = {
+    { "utc",              0, DstRule::None },
+    { "london",           0, DstRule::EU   },
+    { "dublin",           0, DstRule::EU   },
+    { "lisbon",           0, DstRule::EU   },
+    { "reykjavik",        0, DstRule::None },
+    { "paris",           60, DstRule::EU   },
+    { "berlin",          60, DstRule::EU   },
+    { "prague",          60, DstRule::EU   },
+    { "madrid",          60, DstRule::EU   },
+    { "rome",            60, DstRule::EU   },
+    { "amsterdam",       60, DstRule::EU   },
+    { "brussels",        60, DstRule::EU   },
+    { "vienna",          60, DstRule::EU   },
+    { "zurich",          60, DstRule::EU   },
+    { "stockholm",       60, DstRule::EU   },
+    { "oslo",            60, DstRule::EU   },
+    { "copenhagen",      60, DstRule::EU   },
+    { "warsaw",          60, DstRule::EU   },
+    { "budapest",        60, DstRule::EU   },
+    { "lagos",           60, DstRule::None },
+    { "athens",         120, DstRule::EU   },
+    { "helsinki",       120, DstRule::EU   },
+    { "kyiv",           120, DstRule::EU   },
+    { "bucharest",      120, DstRule::EU   },
+    { "johannesburg",   120, DstRule::None },
+    { "istanbul",       180, DstRule::None },
+    { "moscow",         180, DstRule::None },
+    { "nairobi",        180, DstRule::None },
+    { "doha",           180, DstRule::None },
+    { "riyadh",         180, DstRule::None },
+    { "tehran",         210, DstRule::None },
+    { "dubai",          240, DstRule::None },
+    { "karachi",        300, DstRule::None },
+    { "mumbai",         330, DstRule::None },
+    { "kathmandu",      345, DstRule::None },
+    { "dhaka",          360, DstRule::None },
+    { "bangkok",        420, DstRule::None },
+    { "jakarta",        420, DstRule::None },
+    { "singapore",      480, DstRule::None },
+    { "hong-kong",      480, DstRule::None },
+    { "beijing",        480, DstRule::None },
+    { "taipei",         480, DstRule::None },
+    { "manila",         480, DstRule::None },
+    { "perth",          480, DstRule::None },
+    { "seoul",          540, DstRule::None },
+    { "tokyo",          540, DstRule::None },
+    { "adelaide",       570, DstRule::AU   },
+    { "brisbane",       600, DstRule::None },
+    { "sydney",         600, DstRule::AU   },
+    { "melbourne",      600, DstRule::AU   },
+    { "auckland",       720, DstRule::NZ   },
+    { "honolulu",      -600, DstRule::None },
+    { "anchorage",     -540, DstRule::US   },
+    { "los-angeles",   -480, DstRule::US   },
+    { "vancouver",     -480, DstRule::US   },
+    { "denver",        -420, DstRule::US   },
+    { "phoenix",       -420, DstRule::None },
+    { "chicago",       -360, DstRule::US   },
+    { "mexico-city",   -360, DstRule::None },
+    { "new-york",      -300, DstRule::US   },
+    { "toronto",       -300, DstRule::US   },
+    { "bogota",        -300, DstRule::None },
+    { "lima",          -300, DstRule::None },
+    { "caracas",       -240, DstRule::None },
+    { "sao-paulo",     -180, DstRule::None },
+    { "buenos-aires",  -180, DstRule::None },
+};
+
+// Lookup names (lowercase, spaces as hyphens) and legacy codes, sorted by strcmp
+static constexpr ZoneAlias kAliases[] = {
+    { "1",             28 },
+    { "2",              7 },
+    { "3",             59 },
+    { "4",              6 },
+    { "adelaide",      46 },
+    { "amsterdam",     10 },
+    { "anchorage",     52 },
+    { "athens",        20 },
+    { "auckland",      50 },
+    { "bangkok",       36 },
+    { "beijing",       40 },
+    { "berlin",         6 },
+    { "bogota",        61 },
+    { "boston",        59 },
+    { "brisbane",      47 },
+    { "brussels",      11 },
+    { "bucharest",     23 },
+    { "budapest",      18 },
+    { "buenos-aires",  65 },
+    { "canberra",      48 },
+    { "caracas",       63 },
+    { "chicago",       57 },
+    { "copenhagen",    16 },
+    { "delhi",         33 },
+    { "denver",        55 },
+    { "dhaka",         35 },
+    { "doha",          28 },
+    { "dubai",         31 },
+    { "dublin",         2 },
+    { "gmt",            0 },
+    { "helsinki",      21 },
+    { "hong-kong",     39 },
+    { "hongkong",      39 },
+    { "honolulu",      51 },
+    { "istanbul",      25 },
+    { "jakarta",       37 },
+    { "johannesburg",  24 },
+    { "karachi",       32 },
+    { "kathmandu",     34 },
+    { "kiev",          22 },
+    { "kolkata",       33 },
+    { "kyiv",          22 },
+    { "la",            53 },
+    { "lagos",         19 },
+    { "lima",          62 },
+    { "lisbon",         3 },
+    { "london",         1 },
+    { "los-angeles",   53 },
+    { "losangeles",    53 },
+    { "madrid",         8 },
+    { "manila",        42 },
+    { "melbourne",     49 },
+    { "mexico-city",   58 },
+    { "montreal",      60 },
+    { "moscow",        26 },
+    { "mumbai",        33 },
+    { "nairobi",       27 },
+    { "new-delhi",     33 },
+    { "new-york",      59 },
+    { "newyork",       59 },
+    { "nyc",           59 },
+    { "oslo",          15 },
+    { "paris",          5 },
+    { "perth",         43 },
+    { "phoenix",       56 },
+    { "prague",         7 },
+    { "reykjavik",      4 },
+    { "riyadh",        29 },
+    { "rome",           9 },
+    { "san-francisco", 53 },
+    { "sao-paulo",     64 },
+    { "saopaulo",      64 },
+    { "seattle",       53 },
+    { "seoul",         44 },
+    { "shanghai",      40 },
+    { "singapore",     38 },
+    { "stockholm",     14 },
+    { "sydney",        48 },
+    { "taipei",        41 },
+    { "tehran",        30 },
+    { "tokyo",         45 },
+    { "toronto",       60 },
+    { "uk",             1 },
+    { "utc",            0 },
+    { "vancouver",     54 },
+    { "vienna",        12 },
+    { "warsaw",        17 },
+    { "washington",    59 },
+    { "wellington",    50 },
+    { "z",              0 },
+    { "zulu",           0 },
+    { "zurich",        13 },
+};
+
+static constexpr size_t kZoneCount = sizeof(kZones) / sizeof(kZones[0]);
+static constexpr size_t kAliasCount = sizeof(kAliases) / sizeof(kAliases[0]);
+
+/**
+ * @brief Compile-time strcmp(a, b) < 0.
+ * @param a First string.
+ * @param b Second string.
+ * @return true if a sorts before b.
+ */
+static constexpr bool str_less(const char* a, const char* b) {
+    while (*a && *a == *b) { ++a; ++b; }
+    return static_cast<unsigned char>(*a) < static_cast<unsigned char>(*b);
+}
+
+/**
+ * @brief Checks at compile time that kAliases is strictly sorted (binary search relies on it).
+ * @return true if sorted.
+ */
+static constexpr bool aliases_sorted() {
+    for (size_t i = 1; i < kAliasCount; ++i) {
+        if (!str_less(kAliases[i - 1].name, kAliases[i].name)) return false;
+    }
+    return true;
+}
+static_assert(aliases_sorted(), "kAliases must be sorted by strcmp");
+
+/**
+ * @brief Days since 1970-01-01 of a civil date.
+ * @param y Year.
+ * @param m Month (1-12).
+ * @param d Day of month (1-31).
+ * @return Day number.
+ */
+static int64_t days_from_civil(int64_t y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/**
+ * @brief Civil year of a day number.
+ * @param z Days since 1970-01-01.
+ * @return Year.
+ */
+static int year_from_days(int64_t z) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    return static_cast<int>(yoe + era * 400 + (mp >= 10 ? 1 : 0));
+}
+
+/**
+ * @brief Day of week of a day number.
+ * @param z Days since 1970-01-01.
+ * @return Day of week (0=Sun..6=Sat).
+ */
+static int weekday_from_days(int64_t z) {
+    return static_cast<int>(z >= -4 ? (z + 4) % 7 : (z + 5) % 7 + 6);
+}
+
+/**
+ * @brief Day number of the given Sunday of a month.
+ * @param year Year.
+ * @param month Month (1-12).
+ * @param week Sunday of the month (1-4, or 5 for the last one).
+ * @return Day number.
+ */
+static int64_t sunday_of_month(int year, int month, int week) {
+    if (week < 5) {
+        int64_t first = days_from_civil(year, month, 1);
+        return first + (7 - weekday_from_days(first)) % 7 + (week - 1) * 7;
+    }
+    int64_t last = days_from_civil(month == 12 ? year + 1 : year, month == 12 ? 1 : month + 1, 1) - 1;
+    return last - weekday_from_days(last);
+}
+
+/**
+ * @brief Epoch second of a transition in a given year.
+ * @param year Year.
+ * @param t Transition.
+ * @param stdOffsetMin Standard offset of the zone in minutes.
+ * @return UTC epoch seconds.
+ */
+static int64_t transition_epoch(int year, const Transition& t, int stdOffsetMin) {
+    int64_t local = sunday_of_month(year, t.month, t.week) * 86400 + t.minutes * 60;
+    return t.utc ? local : local - stdOffsetMin * 60;
+}
+
+/**
+ * @brief DST start and end instants of every zone for one year.
+ */
+struct YearTable {
+    int year;                    /**< Year the instants belong to. */
+    int64_t start[kZoneCount];   /**< DST start (UTC epoch seconds). */
+    int64_t end[kZoneCount];     /**< DST end (UTC epoch seconds). */
+};
+
+// Current year's table, rebuilt into the other slot when the year changes
+static YearTable g_years[2];
+static std::atomic<const YearTable*> g_year{ nullptr };
+static std::mutex g_year_mx;
+static int g_year_next = 0;
+
+/**
+ * @brief Returns the transition table of the year containing now (lock-free after the first call of a year).
+ * @param now Instant (UTC epoch seconds).
+ * @return Year table.
+ */
+static const YearTable& year_table(std::time_t now) {
+    int64_t days = static_cast<int64_t>(now) / 86400 - (now < 0 && now % 86400 ? 1 : 0);
+    int year = year_from_days(days);
+    const YearTable* table = g_year.load(std::memory_order_acquire);
+    if (table && table->year == year) return *table;
+
+    std::lock_guard<std::mutex> lk(g_year_mx);
+    table = g_year.load(std::memory_order_acquire);
+    if (table && table->year == year) return *table;
+
+    YearTable& next = g_years[g_year_next];
+    g_year_next ^= 1;
+    next.year = year;
+    for (size_t i = 0; i < kZoneCount; ++i) {
+        const DstSpec& spec = kRules[static_cast<int>(kZones[i].rule)];
+        next.start[i] = transition_epoch(year, spec.start, kZones[i].stdOffsetMin);
+        next.end[i] = transition_epoch(year, spec.end, kZones[i].stdOffsetMin);
+    }
+    g_year.store(&next, std::memory_order_release);
+    return next;
+}
+
+/**
+ * @brief Finds the zone of a normalized city name or code.
+ * @param name City name or code (lowercase, spaces replaced by hyphens, null-terminated).
+ * @return Zone id, or -1 if the name is unknown.
+ */
+int findZone(const char* name) {
+    size_t lo = 0, hi = kAliasCount;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = std::strcmp(kAliases[mid].name, name);
+        if (cmp == 0) return kAliases[mid].zone;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+/**
+ * @brief Returns the UTC offset of a zone at the given instant, including DST.
+ * @param zone Zone id returned by findZone().
+ * @param now Instant (UTC epoch seconds).
+ * @return Offset from UTC in minutes.
+ */
+int zoneOffsetMinutes(int zone, std::time_t now) {
+    const TimeZone& tz = kZones[zone];
+    if (tz.rule == DstRule::None) return tz.stdOffsetMin;
+    const YearTable& table = year_table(now);
+    int64_t start = table.start[zone], end = table.end[zone];
+    // Southern-hemisphere periods wrap around the new year (start > end)
+    bool dst = (start < end) ? (now >= start && now < end) : (now >= start || now < end);
+    return tz.stdOffsetMin + (dst ? 60 : 0);
+}
+
+/**
+ * @brief Returns the standard (non-DST) UTC offset of a zone.
+ * @param zone Zone id returned by findZone().
+ * @return Offset from UTC in minutes.
+ */
+int zoneStdOffsetMinutes(int zone) {
+    return kZones[zone].stdOffsetMin;
+}
+
+/**
+ * @brief Number of zones in the table.
+ * @return Zone count (valid ids are 0..zoneCount()-1).
+ */
+size_t zoneCount() {
+    return kZoneCount;
+}
+
+/**
+ * @brief Canonical name of a zone.
+ * @param zone Zone id.
+ * @return Zone name (static storage).
+ */
+const char* zoneName(int zone) {
+    return kZones[zone].name;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file timezones.h
+ * @brief Compiled timezone table for GetTimeWithoutDateInCity.
+ *
+ * This header provides lookup of a normalized city name or code to a zone id and the UTC offset
+ * of a zone at a given instant. Zone rules are compiled in (Windows has no tzdata); each zone's
+ * DST transitions are computed arithmetically once per year and cached as epoch seconds, so a
+ * lookup is one binary search plus two integer compares.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <ctime>
+#include <cstddef>
+
+/**
+ * @brief Finds the zone of a normalized city name or code.
+ * @param name City name or code (lowercase, spaces replaced by hyphens, null-terminated).
+ * @return Zone id, or -1 if the name is unknown.
+ */
+int findZone(const char* name);
+
+/**
+ * @brief Returns the UTC offset of a zone at the given instant, including DST.
+ * @param zone Zone id returned by findZone().
+ * @param now Instant (UTC epoch seconds).
+ * @return Offset from UTC in minutes.
+ */
+int zoneOffsetMinutes(int zone, std::time_t now);
+
+/**
+ * @brief Returns the standard (non-DST) UTC offset of a zone.
+ * @param zone Zone id returned by findZone().
+ * @return Offset from UTC in minutes.
+ */
+int zoneStdOffsetMinutes(int zone);
+
+/**
+ * @brief Number of zones in the table.
+ * @return Zone count (valid ids are 0..zoneCount()-1).
+ */
+size_t zoneCount();
+
+/**
+ * @brief Canonical name of a zone.
+ * @param zone Zone id.
+ * @return Zone name (static storage).
+ */
+const char* zoneName(int zone);
@@ -0,0 +1,254 @@
+/**
+ * @file trace.cpp
+ * @brief Implementation of trace capture and reading.
+ *
+ * Workers encode the file record directly into their ring entry, so the writer thread only
+ * concatenates entries and issues one fwrite per pass, the way the logger's flusher does.
+ * Compatible with C++14.
+ */
+#include "trace.h"
+#include "metrics.h"
+#include "utils.h"
+#include "../Common/protocol.h"
+#include <chrono>
+#include <cstring>
+
+static constexpr char kTraceMagic[8] = { 'T', 'S', 'T', 'R', 'A', 'C', 'E', '1' };
+static constexpr uint32_t kTraceVersion = 1;
+static constexpr size_t kTraceHeaderSize = 24;
+static constexpr size_t kRecordHeaderSize = 30;
+static constexpr size_t kTraceRingSize = 4096; // records per worker (power of two)
+
+/**
+ * @brief One encoded record as stored in a ring.
+ */
+struct TraceEntry {
+    uint32_t size;                                      /**< Valid bytes in bytes. */
+    char bytes[kRecordHeaderSize + kTraceMaxDatagram];  /**< Record exactly as written to the file. */
+};
+
+/**
+ * @brief Per-worker SPSC ring; head and tail are kept on separate cache lines.
+ */
+struct TraceRecorder::Ring {
+    Ring() : head(0), tail(0), dropped(0) {}
+    std::atomic<size_t> head;           /**< Next entry to write (worker). */
+    char pad1[64];
+    std::atomic<size_t> tail;           /**< Next entry to read (writer thread). */
+    char pad2[64];
+    std::atomic<uint64_t> dropped;      /**< Records lost because the ring was full. */
+    TraceEntry entries[kTraceRingSize]; /**< Entry storage. */
+};
+
+/**
+ * @brief Constructs a closed recorder.
+ */
+TraceRecorder::TraceRecorder()
+    : file_(nullptr), startNs_(0), maxBytes_(0), written_(0), recorded_(0), truncated_(0), running_(false) {}
+
+/**
+ * @brief Destructor. Writes what is still queued and closes the file.
+ */
+TraceRecorder::~TraceRecorder() {
+    close();
+}
+
+/**
+ * @brief Creates the trace file and starts the writer thread.
+ * @param path Trace file (truncated).
+ * @param rings Number of producers; worker ids 0..rings-1 may record.
+ * @param maxBytes Size at which the file stops growing (0 = unlimited).
+ * @return true on success, false if the file cannot be created.
+ */
+bool TraceRecorder::open(const std::string& path, unsigned rings, uint64_t maxBytes) {
+    close();
+    if (0 != fopen_s(&file_, path.c_str(), "wb") || !file_) {
+        file_ = nullptr;
+        return false;
+    }
+    char header[kTraceHeaderSize];
+    std::memcpy(header, kTraceMagic, sizeof(kTraceMagic));
+    wire::putLe32(header + 8, kTraceVersion);
+    wire::putLe32(header + 12, 0);
+    wire::putLe64(header + 16, preciseNowNs());
+    startNs_ = metricsNowNs();
+    if (std::fwrite(header, 1, sizeof(header), file_) != sizeof(header)) {
+        std::fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+    written_ = sizeof(header);
+    maxBytes_ = maxBytes;
+    for (unsigned i = 0; i < rings; ++i) rings_.push_back(new Ring());
+    running_.store(true, std::memory_order_release);
+    writer_ = std::thread([this]() { writeLoop(); });
+    return true;
+}
+
+/**
+ * @brief Drains the rings, stops the writer thread and closes the file.
+ */
+void TraceRecorder::close() {
+    if (!running_.exchange(false)) return;
+    if (writer_.joinable()) writer_.join();
+    std::fclose(file_);
+    file_ = nullptr;
+    for (Ring* ring : rings_) {
+        truncated_.fetch_add(ring->dropped.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        delete ring;
+    }
+    rings_.clear();
+}
+
+/**
+ * @brief Appends a datagram to a worker's ring (called by that worker only).
+ * @param worker Worker id (ids without a ring are ignored).
+ * @param data Datagram bytes.
+ * @param len Datagram length.
+ * @param from Sender address.
+ */
+void TraceRecorder::record(unsigned worker, const char* data, size_t len, const sockaddr_storage& from) {
+    if (worker >= rings_.size()) return;
+    Ring& ring = *rings_[worker];
+    size_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= kTraceRingSize) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (len > kTraceMaxDatagram) len = kTraceMaxDatagram;
+
+    TraceEntry& entry = ring.entries[head & (kTraceRingSize - 1)];
+    char* out = entry.bytes;
+    wire::putLe64(out, metricsNowNs() - startNs_);
+    std::memset(out + 12, 0, 16);
+    if (from.ss_family == AF_INET6) {
+        const sockaddr_in6& v6 = reinterpret_cast<const sockaddr_in6&>(from);
+        out[8] = 6;
+        wire::putLe16(out + 10, ntohs(v6.sin6_port));
+        std::memcpy(out + 12, &v6.sin6_addr, 16);
+    }
+    else {
+        const sockaddr_in& v4 = reinterpret_cast<const sockaddr_in&>(from);
+        out[8] = 4;
+        wire::putLe16(out + 10, ntohs(v4.sin_port));
+        std::memcpy(out + 12, &v4.sin_addr, 4);
+    }
+    out[9] = static_cast<char>(worker);
+    wire::putLe16(out + 28, static_cast<uint16_t>(len));
+    std::memcpy(out + kRecordHeaderSize, data, len);
+    entry.size = static_cast<uint32_t>(kRecordHeaderSize + len);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Datagrams lost to full rings or the size limit.
+ * @return Drop count.
+ */
+uint64_t TraceRecorder::dropped() const {
+    uint64_t total = truncated_.load(std::memory_order_relaxed);
+    for (const Ring* ring : rings_) total += ring->dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+/**
+ * @brief Moves every pending record of every ring into a batch, honouring the size limit.
+ * @param batch Output buffer (appended to).
+ */
+void TraceRecorder::drain(std::string& batch) {
+    for (Ring* ring : rings_) {
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const TraceEntry& entry = ring->entries[tail & (kTraceRingSize - 1)];
+            if (maxBytes_ != 0 && written_ + entry.size > maxBytes_) {
+                truncated_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            batch.append(entry.bytes, entry.size);
+            written_ += entry.size;
+            recorded_.fetch_add(1, std::memory_order_relaxed);
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+}
+
+/**
+ * @brief Writer thread: moves the rings' records to the file until close().
+ */
+void TraceRecorder::writeLoop() {
+    std::string batch;
+    batch.reserve(256 * 1024);
+    while (true) {
+        bool running = running_.load(std::memory_order_acquire);
+        drain(batch);
+        if (!batch.empty()) {
+            std::fwrite(batch.data(), 1, batch.size(), file_);
+            batch.clear();
+        }
+        else if (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!running) break;
+    }
+    std::fflush(file_);
+}
+
+/**
+ * @brief Destructor. Closes the file.
+ */
+TraceReader::~TraceReader() {
+    if (file_) std::fclose(file_);
+}
+
+/**
+ * @brief Opens a trace and checks its header.
+ * @param path Trace file.
+ * @return true on success, false if the file is missing or not a trace of this version.
+ */
+bool TraceReader::open(const std::string& path) {
+    if (file_) std::fclose(file_);
+    if (0 != fopen_s(&file_, path.c_str(), "rb") || !file_) {
+        file_ = nullptr;
+        return false;
+    }
+    char header[kTraceHeaderSize];
+    if (std::fread(header, 1, sizeof(header), file_) != sizeof(header) ||
+        0 != std::memcmp(header, kTraceMagic, sizeof(kTraceMagic)) || wire::getLe32(header + 8) != kTraceVersion) {
+        std::fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+    startNs_ = wire::getLe64(header + 16);
+    return true;
+}
+
+/**
+ * @brief Reads the next record.
+ * @param out Record read.
+ * @return true if a record was read, false at the end of the trace (or at a cut-off record).
+ */
+bool TraceReader::next(TraceRecord& out) {
+    char header[kRecordHeaderSize];
+    if (!file_ || std::fread(header, 1, sizeof(header), file_) != sizeof(header)) return false;
+    size_t len = wire::getLe16(header + 28);
+    if (len > kTraceMaxDatagram || std::fread(out.data, 1, len, file_) != len) return false;
+
+    out.offsetNs = wire::getLe64(header);
+    out.worker = static_cast<uint8_t>(header[9]);
+    out.len = len;
+    std::memset(&out.from, 0, sizeof(out.from));
+    unsigned short port = htons(wire::getLe16(header + 10));
+    if (header[8] == 6) {
+        sockaddr_in6& v6 = reinterpret_cast<sockaddr_in6&>(out.from);
+        v6.sin6_family = AF_INET6;
+        v6.sin6_port = port;
+        std::memcpy(&v6.sin6_addr, header + 12, 16);
+    }
+    else {
+        sockaddr_in& v4 = reinterpret_cast<sockaddr_in&>(out.from);
+        v4.sin_family = AF_INET;
+        v4.sin_port = port;
+        std::memcpy(&v4.sin_addr, header + 12, 4);
+    }
+    return true;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file trace.h
+ * @brief Capture of received datagrams to a compact binary trace, and the reader used to replay it.
+ *
+ * With tracing enabled every worker appends each datagram it receives, before admission and
+ * decoding, to a single-producer ring of its own; a writer thread drains the rings into the
+ * trace file. As with the logger, a full ring drops the record and counts it instead of
+ * blocking the worker, and the file stops growing at a configured size.
+ *
+ * File layout (little-endian):
+ *   header  "TSTRACE1" | u32 version | u32 reserved | u64 start (ns since the Unix epoch)
+ *   record  u64 offset (ns since start) | u8 family (4 or 6) | u8 worker | u16 port |
+ *           16 address bytes (IPv4 in the first 4) | u16 length | datagram bytes
+ *
+ * Bench/replay.cpp feeds a trace back through the server, in process or over the wire.
+ * Compatible with C++14.
+ */
+#pragma once
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Largest datagram a trace record holds (longer ones are cut to this length).
+ */
+static constexpr size_t kTraceMaxDatagram = 256;
+
+/**
+ * @brief One received datagram, as read back from a trace.
+ */
+struct TraceRecord {
+    uint64_t offsetNs;                /**< Receive time, in ns since the start of the trace. */
+    unsigned worker;                  /**< Worker that received it. */
+    sockaddr_storage from;            /**< Sender address (IPv6 scope ids are not kept). */
+    size_t len;                       /**< Datagram length. */
+    char data[kTraceMaxDatagram];     /**< Datagram bytes. */
+};
+
+/**
+ * @brief Non-blocking trace writer with one ring per worker.
+ */
+class TraceRecorder {
+public:
+    /**
+     * @brief Constructs a closed recorder.
+     */
+    TraceRecorder();
+
+    /**
+     * @brief Destructor. Writes what is still queued and closes the file.
+     */
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    /**
+     * @brief Creates the trace file and starts the writer thread.
+     * @param path Trace file (truncated).
+     * @param rings Number of producers; worker ids 0..rings-1 may record.
+     * @param maxBytes Size at which the file stops growing (0 = unlimited).
+     * @return true on success, false if the file cannot be created.
+     */
+    bool open(const std::string& path, unsigned rings, uint64_t maxBytes);
+
+    /**
+     * @brief Drains the rings, stops the writer thread and closes the file.
+     */
+    void close();
+
+    /**
+     * @brief Appends a datagram to a worker's ring (called by that worker only).
+     * @param worker Worker id (ids without a ring are ignored).
+     * @param data Datagram bytes.
+     * @param len Datagram length.
+     * @param from Sender address.
+     */
+    void record(unsigned worker, const char* data, size_t len, const sockaddr_storage& from);
+
+    /**
+     * @brief Datagrams written to the file so far.
+     * @return Record count.
+     */
+    uint64_t recorded() const { return recorded_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Datagrams lost to full rings or the size limit.
+     * @return Drop count.
+     */
+    uint64_t dropped() const;
+
+private:
+    struct Ring;
+
+    /**
+     * @brief Writer thread: moves the rings' records to the file until close().
+     */
+    void writeLoop();
+
+    /**
+     * @brief Moves every pending record of every ring into a batch, honouring the size limit.
+     * @param batch Output buffer (appended to).
+     */
+    void drain(std::string& batch);
+
+    std::vector<Ring*> rings_;          /**< One ring per worker. */
+    std::FILE* file_;                   /**< Trace file, null while closed. */
+    uint64_t startNs_;                  /**< metricsNowNs() at open, the zero of record offsets. */
+    uint64_t maxBytes_;                 /**< Size limit (0 = unlimited). */
+    uint64_t written_;                  /**< Bytes in the file (writer thread only). */
+    std::atomic<uint64_t> recorded_;    /**< Records written. */
+    std::atomic<uint64_t> truncated_;   /**< Records dropped by the size limit. */
+    std::atomic<bool> running_;         /**< Cleared by close(). */
+    std::thread writer_;                /**< Writer thread. */
+};
+
+/**
+ * @brief Sequential reader of a trace file.
+ */
+class TraceReader {
+public:
+    /**
+     * @brief Constructs a closed reader.
+     */
+    TraceReader() : file_(nullptr), startNs_(0) {}
+
+    /**
+     * @brief Destructor. Closes the file.
+     */
+    ~TraceReader();
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    /**
+     * @brief Opens a trace and checks its header.
+     * @param path Trace file.
+     * @return true on success, false if the file is missing or not a trace of this version.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Reads the next record.
+     * @param out Record read.
+     * @return true if a record was read, false at the end of the trace (or at a cut-off record).
+     */
+    bool next(TraceRecord& out);
+
+    /**
+     * @brief Wall-clock start of the trace.
+     * @return Nanoseconds since the Unix epoch.
+     */
+    uint64_t startNs() const { return startNs_; }
+
+private:
+    std::FILE* file_;    /**< Trace file, null while closed. */
+    uint64_t startNs_;   /**< Start from the header. */
+};
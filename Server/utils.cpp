@@ -7,9 +7,11 @@
  */
 
 #include "utils.h"
+#include "timezones.h"
 #include <vector>
 #include <string>
 #include <mutex>
+#include <memory>
 #include <unordered_map>
 #include <chrono>
 #include <sstream>
@@ -18,6 +20,7 @@
 #include <ctime>
 #include <iostream>
 #include <iomanip>
+#include <cstdio>
 
 constexpr size_t BUFFER_SIZE = 255;
 
@@ -28,23 +31,8 @@ constexpr size_t BUFFER_SIZE = 255;
  * @return Reference to the output stream.
  */
 std::ostream& operator<<(std::ostream& os, ReqCode code) {
-    switch (code) {
-    case ReqCode::Error: return os << "Error";
-    case ReqCode::GetTime: return os << "GetTime";
-    case ReqCode::GetTimeWithoutDate: return os << "GetTimeWithoutDate";
-    case ReqCode::GetTimeSinceEpoch: return os << "GetTimeSinceEpoch";
-    case ReqCode::GetClientToServerDelayEstimation: return os << "GetClientToServerDelayEstimation";
-    case ReqCode::MeasuureRTT: return os << "MeasuureRTT";
-    case ReqCode::GetTimeWithoutDateOrSeconds: return os << "GetTimeWithoutDateOrSeconds";
-    case ReqCode::GetYear: return os << "GetYear";
-    case ReqCode::GetMonthAndDay: return os << "GetMonthAndDay";
-    case ReqCode::GetSecondsSinceBeginningOfMonth: return os << "GetSecondsSinceBeginningOfMonth";
-    case ReqCode::GetWeekOfYear: return os << "GetWeekOfYear";
-    case ReqCode::GetDaylightSavings: return os << "GetDaylightSavings";
-    case ReqCode::GetTimeWithoutDateInCity: return os << "GetTimeWithoutDateInCity";
-    case ReqCode::MeasureTimeLap: return os << "MeasureTimeLap";
-    default: return os << "Unknown";
-    }
+    if (code == ReqCode::Error) return os << "Error";
+    return os << wire::codeInfo(code).name;
 }
 
 // ---------- common helpers ----------
@@ -63,25 +51,6 @@ void getCurrentTimeString(std::vector<char>& buffer) {
     buffer.resize(len > 0 ? len : BUFFER_SIZE);
 }
 
-/**
- * @brief Logs an error message with the location and last Winsock error code.
- * @param where Name of the function or location where the error occurred.
- */
-void logError(const char* where) {
-    std::cout << "Time Server: Error at " << where << "(): " << WSAGetLastError() << std::endl;
-}
-
-/**
- * @brief Logs a message with a timestamp.
- * @param message Message to log.
- */
-void logMessage(const std::string& message) {
-    auto now = std::time(nullptr);
-    std::tm tm = to_local(now);
-    std::string timestamp = fmt_tm(tm, "%Y-%m-%d %H:%M:%S");
-    std::cout << "\n[" << timestamp << "] " << message;
-}
-
 // ---------- small helpers ----------
 /**
  * @brief Converts a time_t to local time (thread-safe).
@@ -98,15 +67,26 @@ static std::tm to_local(std::time_t t) { std::tm out{}; localtime_s(&out, &t); r
 static std::tm to_utc(std::time_t t) { std::tm out{}; gmtime_s(&out, &t); return out; }
 
 /**
- * @brief Formats a std::tm struct as a string using the given pattern.
+ * @brief Formats a std::tm struct into a buffer using the given pattern.
  * @param tm Time struct.
  * @param pat Format pattern (strftime).
- * @return Formatted time string.
+ * @param out Buffer receiving the formatted text (not null-terminated in the count).
+ * @return Number of bytes written.
  */
-static std::string fmt_tm(const std::tm& tm, const char* pat) {
-    std::vector<char> buf(BUFFER_SIZE, 0);
-    std::strftime(buf.data(), buf.size(), pat, &tm);
-    return std::string(buf.data());
+static size_t fmt_tm(const std::tm& tm, const char* pat, OutSpan out) {
+    return std::strftime(out.data, out.size, pat, &tm);
+}
+
+/**
+ * @brief Copies a null-terminated string into a buffer.
+ * @param out Destination buffer.
+ * @param s String to copy.
+ * @return Number of bytes written (truncated to the buffer size).
+ */
+static size_t put_str(OutSpan out, const char* s) {
+    size_t len = std::min(std::strlen(s), out.size);
+    std::memcpy(out.data, s, len);
+    return len;
 }
 
 /**
@@ -127,220 +107,342 @@ static uint32_t seconds_since_month_start(std::time_t now) {
  */
 static uint32_t week_of_year(std::time_t now) {
     std::tm tm = to_local(now);
-    std::vector<char> buf(BUFFER_SIZE, 0);
-    std::strftime(buf.data(), buf.size(), "%U", &tm); // Sunday-based, 00..53
-    uint32_t num = static_cast<uint32_t>(std::atoi(buf.data()));
+    char buf[8] = { 0 };
+    std::strftime(buf, sizeof(buf), "%U", &tm); // Sunday-based, 00..53
+    uint32_t num = static_cast<uint32_t>(std::atoi(buf));
     return num;
 }
 
 /**
- * @brief Trims whitespace, converts to lowercase, and replaces spaces with hyphens.
- * @param s String to normalize.
- * @return Normalized string.
+ * @brief Fills the broken-down part of wire::TimeFields from a std::tm.
+ * @param tm Broken-down time.
+ * @param epoch Instant described by tm.
+ * @param utcOffsetMin Offset of tm from UTC in minutes.
+ * @param fields Fields to fill.
+ */
+static void fill_fields(const std::tm& tm, std::time_t epoch, int utcOffsetMin, wire::TimeFields& fields) {
+    fields.epochSec = static_cast<uint64_t>(epoch);
+    fields.micros = 0;
+    fields.utcOffsetMin = static_cast<int16_t>(utcOffsetMin);
+    fields.year = static_cast<uint16_t>(tm.tm_year + 1900);
+    fields.month = static_cast<uint8_t>(tm.tm_mon + 1);
+    fields.day = static_cast<uint8_t>(tm.tm_mday);
+    fields.hour = static_cast<uint8_t>(tm.tm_hour);
+    fields.minute = static_cast<uint8_t>(tm.tm_min);
+    fields.second = static_cast<uint8_t>(tm.tm_sec);
+    fields.weekday = static_cast<uint8_t>(tm.tm_wday);
+    fields.dst = tm.tm_isdst > 0 ? 1 : 0;
+    fields.week = static_cast<uint8_t>((tm.tm_yday + 7 - tm.tm_wday) / 7); // Same as %U
+}
+
+// ---------- time snapshot cache ----------
+// Snapshots live in a small ring; a slot is only rewritten kSnapshotSlots - 1 ticks after it
+// was retired, long after any reader has finished copying from it.
+static constexpr size_t kSnapshotSlots = 4;
+static TimeSnapshot g_snapshots[kSnapshotSlots];
+static std::atomic<const TimeSnapshot*> g_snapshot{ nullptr };
+static size_t g_snapshot_next = 0;
+static std::mutex g_snapshot_mx; // serializes builders only
+
+/**
+ * @brief Formats one snapshot text field.
+ * @param tm Local time.
+ * @param pat Format pattern (strftime).
+ * @param text Field to fill.
  */
-static std::string trim_lower(std::string s) {
-    auto not_space = [](unsigned char c) { return !std::isspace(c); };
-    s.erase(s.begin(), std::find_if(s.begin(), s.end(), not_space));
-    s.erase(std::find_if(s.rbegin(), s.rend(), not_space).base(), s.end());
-    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) {
-        return std::tolower(c);
-        });
-    std::replace(s.begin(), s.end(), ' ', '-'); // Replace spaces with hyphens
-    return s;
+static void fill_text(const std::tm& tm, const char* pat, SnapshotText& text) {
+    text.len = fmt_tm(tm, pat, OutSpan{ text.data, sizeof(text.data) });
 }
 
 /**
- * @brief Normalizes a city name to a canonical form for timezone lookup.
- * @param city_ City name or code.
- * @return Normalized city string.
+ * @brief Formats every field of a snapshot for the given second.
+ * @param now Second to describe.
+ * @param snap Snapshot to fill.
  */
-std::string normalize_city(std::string& city_) {
-    std::string city = trim_lower(city_);
-    if (city == "doha" || city == "1") {
-        return "doha";
-    }
-    else if (city == "prague" || city == "2") {
-        return "prague";
-    }
-    else if (city == "new-york" || city == "newyork" || city == "new york" || city == "3") {
-        return "new-york";
-    }
-    else if (city == "berlin" || city == "4") {
-        return "berlin";
+static void build_snapshot(std::time_t now, TimeSnapshot& snap) {
+    std::tm tm = to_local(now);
+    snap.epoch = now;
+    fill_text(tm, "%d/%m/%Y %H:%M:%S", snap.dateTime);
+    fill_text(tm, "%H:%M:%S", snap.time);
+    fill_text(tm, "%H:%M", snap.timeNoSeconds);
+    fill_text(tm, "%Y", snap.year);
+    fill_text(tm, "%d/%m", snap.monthDay);
+    snap.weekOfYear = week_of_year(now);
+    snap.secondsSinceMonthStart = seconds_since_month_start(now);
+    snap.dst = tm.tm_isdst > 0;
+
+    // Local offset from UTC: the difference of the two broken-down times is below one day
+    std::tm utc = to_utc(now);
+    int days = tm.tm_yday - utc.tm_yday;
+    if (tm.tm_year != utc.tm_year) days = (tm.tm_year > utc.tm_year) ? 1 : -1;
+    int offset = days * 1440 + (tm.tm_hour - utc.tm_hour) * 60 + (tm.tm_min - utc.tm_min);
+    fill_fields(tm, now, offset, snap.fields);
+}
+
+/**
+ * @brief Returns the shared snapshot for a second, rebuilding it on a tick (lock-free read).
+ *
+ * The first caller that notices a new second builds the next ring slot and publishes it;
+ * concurrent callers keep using the previous snapshot instead of waiting, unless there is none
+ * or they ask to wait.
+ * @param now Current second.
+ * @param wait true to wait for a concurrent build instead of returning the previous snapshot.
+ * @return Shared snapshot (of the previous second while another thread builds this one, unless wait).
+ */
+static const TimeSnapshot& shared_snapshot(std::time_t now, bool wait) {
+    const TimeSnapshot* snap = g_snapshot.load(std::memory_order_acquire);
+    if (snap && snap->epoch == now) return *snap;
+
+    std::unique_lock<std::mutex> lk(g_snapshot_mx, std::defer_lock);
+    if (snap && !wait) {
+        if (!lk.try_lock()) return *snap; // another thread is building this tick
     }
     else {
-        return "utc";
+        lk.lock();
     }
+    snap = g_snapshot.load(std::memory_order_acquire);
+    if (snap && snap->epoch == now) return *snap;
+
+    TimeSnapshot& next = g_snapshots[g_snapshot_next];
+    g_snapshot_next = (g_snapshot_next + 1) % kSnapshotSlots;
+    build_snapshot(now, next);
+    g_snapshot.store(&next, std::memory_order_release);
+    return next;
 }
 
+// Thread-local snapshot copy of workers that called useLocalSnapshot()
+static thread_local bool t_local_snapshot = false;
+static thread_local TimeSnapshot t_snapshot;
+
 /**
- * @brief Daylight Saving Time rule for a city.
+ * @brief Makes timeSnapshot() on the calling thread answer from a thread-local copy, refreshed
+ *        once per second, so a worker pinned to a NUMA node reads snapshot bytes from its own
+ *        node instead of sharing the global slots' cache lines with the other nodes.
  */
-enum class DstRule { None, EU, US };
+void useLocalSnapshot() {
+    t_snapshot.epoch = -1;
+    t_local_snapshot = true;
+}
 
 /**
- * @brief City timezone information.
+ * @brief Returns the snapshot for a second, from the thread-local copy if the thread has one.
+ * @param now Current second.
+ * @param wait true to wait for a concurrent build of this second (see shared_snapshot()).
+ * @return Snapshot for the second.
  */
-struct CityTz { int base_utc_hours; bool has_dst; DstRule rule; };
-
-// City timezone map
-static const std::unordered_map<std::string, CityTz> kCities = {
-    {"bangkok", {+7, false, DstRule::None}},
-    {"prague",  {+1, true,  DstRule::EU  }},
-    {"berlin",  {+1, true,  DstRule::EU  }},
-    {"new york",{ -5, true,  DstRule::US  }},
-};
+static const TimeSnapshot& snapshot_at(std::time_t now, bool wait) {
+    if (!t_local_snapshot) return shared_snapshot(now, wait);
+    if (t_snapshot.epoch != now) t_snapshot = shared_snapshot(now, wait);
+    return t_snapshot;
+}
 
 /**
- * @brief Calculates the nth weekday of a month (e.g., 2nd Sunday).
- * @param year Year.
- * @param month Month (1-12).
- * @param weekday Day of week (0=Sun..6=Sat).
- * @param nth Nth occurrence.
- * @return Day of month for nth weekday.
+ * @brief Returns the snapshot for the current second, rebuilding it on a tick (lock-free read).
+ *        Threads that called useLocalSnapshot() get their copy, refreshed on the first call of a second.
+ * @return Snapshot for the current second.
  */
-static int nth_weekday_of_month(int year, int month, int weekday, int nth) {
-    std::tm tm{}; tm.tm_year = year - 1900; tm.tm_mon = month - 1; tm.tm_mday = 1;
-    std::mktime(&tm);
-    int first = tm.tm_wday; // 0=Sun..6=Sat
-    return 1 + ((7 + weekday - first) % 7) + (nth - 1) * 7;
+const TimeSnapshot& timeSnapshot() {
+    return snapshot_at(std::time(nullptr), false);
 }
 
 /**
- * @brief Calculates the last weekday of a month (e.g., last Sunday).
- * @param year Year.
- * @param month Month (1-12).
- * @param weekday Day of week (0=Sun..6=Sat).
- * @return Day of month for last weekday.
+ * @brief Copies a snapshot text field into a buffer.
+ * @param out Destination buffer.
+ * @param text Field to copy.
+ * @return Number of bytes written (truncated to the buffer size).
  */
-static int last_weekday_of_month(int year, int month, int weekday) {
-    std::tm tm{}; tm.tm_year = year - 1900; tm.tm_mon = month; tm.tm_mday = 0; // last of prev
-    std::mktime(&tm);
-    int last_dom = tm.tm_mday;
-    tm.tm_mday = 1; std::mktime(&tm);
-    int first = tm.tm_wday;
-    int last_wd = (first + (last_dom - 1)) % 7;
-    int delta = (7 + last_wd - weekday) % 7;
-    return last_dom - delta;
+static size_t put_text(OutSpan out, const SnapshotText& text) {
+    size_t len = std::min(text.len, out.size);
+    std::memcpy(out.data, text.data, len);
+    return len;
 }
 
 /**
- * @brief Checks if the given UTC time is in EU DST window.
- * @param utc UTC time struct.
- * @return true if DST is active, false otherwise.
+ * @brief Trims whitespace, converts to lowercase, and replaces spaces with hyphens.
+ * @param s Text to normalize.
+ * @param out Buffer receiving the normalized, null-terminated text.
+ * @param cap Capacity of out (longer input is truncated).
+ * @return Length of the normalized text.
+ */
+static size_t trim_lower(ByteView s, char* out, size_t cap) {
+    const char* b = s.data;
+    const char* e = s.data + s.len;
+    while (b < e && std::isspace(static_cast<unsigned char>(*b))) ++b;
+    while (e > b && std::isspace(static_cast<unsigned char>(e[-1]))) --e;
+    size_t n = 0;
+    for (; b < e && n + 1 < cap; ++b) {
+        char c = static_cast<char>(std::tolower(static_cast<unsigned char>(*b)));
+        out[n++] = (c == ' ') ? '-' : c; // Replace spaces with hyphens
+    }
+    out[n] = '\0';
+    return n;
+}
+
+/**
+ * @brief Normalizes a city name or code the way the zone lookup does (trimmed, lowercase,
+ *        spaces as hyphens), e.g. to key cached city replies.
+ * @param cityName City name or code.
+ * @param out Buffer receiving the normalized, null-terminated text.
+ * @param cap Capacity of out (longer input is truncated, as by the zone lookup).
+ * @return Length of the normalized text.
  */
-static bool is_dst_eu(const std::tm& utc) {
-    int y = utc.tm_year + 1900;
-    int start = last_weekday_of_month(y, 3, 0);   // last Sunday in March, 01:00 UTC
-    int end = last_weekday_of_month(y, 10, 0);  // last Sunday in Oct,   01:00 UTC
-    int mon = utc.tm_mon + 1, day = utc.tm_mday, h = utc.tm_hour;
-    if (mon < 3 || mon > 10) return false;
-    if (mon > 3 && mon < 10) return true;
-    if (mon == 3)  return (day > start) || (day == start && h >= 1);
-    if (mon == 10) return (day < end) || (day == end && h < 1);
-    return false;
+size_t normalizeCity(ByteView cityName, char* out, size_t cap) {
+    return trim_lower(cityName, out, cap);
 }
 
 /**
- * @brief Checks if the given local time is in US DST window (approximate).
- * @param now_local_base Local time as time_t.
- * @return true if DST is active, false otherwise.
+ * @brief Looks up the zone of a city name or code.
+ * @param city_name City name or code.
+ * @return Zone id, or -1 if unknown.
  */
-static bool is_dst_us_local_approx(std::time_t now_local_base) {
-    std::tm t = to_utc(now_local_base); // treat as local clock for that zone
-    int y = t.tm_year + 1900;
-    int start = nth_weekday_of_month(y, 3, 0, 2);  // 2nd Sunday Mar, 02:00 local
-    int end = nth_weekday_of_month(y, 11, 0, 1); // 1st Sunday Nov, 02:00 local
-    int mon = t.tm_mon + 1, day = t.tm_mday, h = t.tm_hour;
-    if (mon < 3 || mon > 11) return false;
-    if (mon > 3 && mon < 11) return true;
-    if (mon == 3)  return (day > start) || (day == start && h >= 2);
-    if (mon == 11) return (day < end) || (day == end && h < 2);
-    return false;
+static int city_zone(ByteView city_name) {
+    char city[32];
+    trim_lower(city_name, city, sizeof(city));
+    return findZone(city);
 }
 
 /**
  * @brief Gets the current time in a specified city, considering DST.
- * @param city City name or code.
- * @return Time string in HH:MM:SS format for the city.
+ * @param city_name City name or code.
+ * @param out Buffer receiving the time in HH:MM:SS format for the city.
+ * @return Number of bytes written.
  */
-static std::string time_in_city(std::string city) {
-    city = normalize_city(city);
+static size_t time_in_city(ByteView city_name, OutSpan out) {
     std::time_t now = std::time(nullptr);
-    std::tm utc_tm = to_utc(now);
-
-    // Add Doha and UTC support to the city map
-    static const std::unordered_map<std::string, CityTz> kCitiesExt = {
-        {"prague",  {+1, true,  DstRule::EU  }},
-        {"berlin",  {+1, true,  DstRule::EU  }},
-        {"new-york",{ -5, true,  DstRule::US  }},
-        {"doha",    {+3, false, DstRule::None}},
-        {"utc",     {0,  false, DstRule::None}}
-    };
-
-    auto it = kCitiesExt.find(city);
-    if (it == kCitiesExt.end()) {
-        return fmt_tm(utc_tm, "%H:%M:%S");
-    }
 
-    int offset = it->second.base_utc_hours;
-    if (it->second.has_dst) {
-        if (it->second.rule == DstRule::EU) {
-            if (is_dst_eu(utc_tm)) offset += 1;
-        }
-        else if (it->second.rule == DstRule::US) {
-            if (is_dst_us_local_approx(now + offset * 3600)) offset += 1;
-        }
-    }
-    std::tm city_tm = to_utc(now + offset * 3600);
-    return fmt_tm(city_tm, "%H:%M:%S");
+    // Unknown cities fall back to UTC
+    int zone = city_zone(city_name);
+    int offset = (zone < 0) ? 0 : zoneOffsetMinutes(zone, now);
+    std::tm city_tm = to_utc(now + offset * 60);
+    return fmt_tm(city_tm, "%H:%M:%S", out);
 }
 
+// Lap timing storage, locked per shard (timers expire after 180 seconds)
+static const std::chrono::seconds kLapTtl(180);
+static std::unique_ptr<ShardedLapStore> g_lap(new ShardedLapStore(kDefaultLapShards, kDefaultLapCapacity, kLapTtl));
+
 /**
- * @brief Key for identifying client endpoints for lap timing.
+ * @brief Replaces the lap store with an empty one (call before the workers start).
+ * @param capacity Maximum number of concurrently running lap timers.
+ * @param shards Number of independently locked shards.
  */
-struct EndpointKey { unsigned long addr_be; unsigned short port_be; };
+void configureLapStore(size_t capacity, size_t shards) {
+    g_lap.reset(new ShardedLapStore(shards, capacity, kLapTtl));
+}
 
 /**
- * @brief Equality operator for EndpointKey.
- * @param a First key.
- * @param b Second key.
- * @return true if keys are equal, false otherwise.
+ * @brief Drops lap timers that have outlived their time-to-live.
+ *        Called periodically by the server so idle timers do not wait for the next lap request.
+ * @return Number of timers removed.
  */
-static bool operator==(const EndpointKey& a, const EndpointKey& b) {
-    return a.addr_be == b.addr_be && a.port_be == b.port_be;
+size_t expireLaps() {
+    return g_lap->expire(std::chrono::steady_clock::now());
+}
+
+// Time-tick subscriptions (expire 60 seconds after the last Subscribe)
+static const std::chrono::seconds kSubscriptionTtl(60);
+static const unsigned kMaxTickFailures = 3; // failed sends tolerated per renewal
+static std::unique_ptr<SubscriberSet> g_subs(new SubscriberSet(kDefaultSubscriberCapacity, kSubscriptionTtl));
+static unsigned g_tick_interval_ms = 0;
+static unsigned long g_group_addr_be = 0;
+static unsigned short g_group_port_be = 0;
+
+/**
+ * @brief Sets up time-tick subscriptions (call before the workers start).
+ * @param capacity Maximum number of subscribers.
+ * @param intervalMs Tick interval announced to subscribers (0 = subscriptions disabled).
+ * @param groupAddrBe Multicast group ticks are sent to (network order), or 0 for unicast.
+ * @param groupPortBe Multicast port (network order).
+ */
+void configureSubscriptions(size_t capacity, unsigned intervalMs, unsigned long groupAddrBe, unsigned short groupPortBe) {
+    g_subs.reset(new SubscriberSet(capacity, kSubscriptionTtl));
+    g_tick_interval_ms = intervalMs;
+    g_group_addr_be = groupAddrBe;
+    g_group_port_be = groupPortBe;
 }
 
 /**
- * @brief Hash function for EndpointKey.
+ * @brief Whether a subscriber is served by the multicast group rather than by unicast.
+ * @param client Subscriber address.
+ * @return true if a group is configured and the address is IPv4 (or IPv4-mapped); groups are IPv4 only.
  */
-struct EndpointKeyHash {
-    size_t operator()(const EndpointKey& k) const noexcept {
-        return (static_cast<size_t>(k.addr_be) << 16) ^ k.port_be;
+bool tickViaGroup(const sockaddr_storage& client) {
+    if (g_group_addr_be == 0) return false;
+    return client.ss_family != AF_INET6 || isV4Mapped(reinterpret_cast<const sockaddr_in6&>(client).sin6_addr);
+}
+
+/**
+ * @brief Registers or renews a subscription and describes how ticks will arrive.
+ * @param client Subscriber address.
+ * @param out Buffer receiving the Subscribe body (at least wire::kSubscribeBodySize bytes).
+ * @param status Receives Unavailable if subscriptions are disabled or full.
+ * @return Number of bytes written.
+ */
+size_t Subscribe(const sockaddr_storage& client, OutSpan out, wire::Status& status) {
+    if (out.size < wire::kSubscribeBodySize || g_tick_interval_ms == 0 ||
+        !g_subs->subscribe(client, std::chrono::steady_clock::now())) {
+        status = wire::Status::Unavailable;
+        return 0;
     }
-};
+    wire::putLe32(out.data, static_cast<uint32_t>(kSubscriptionTtl.count()));
+    wire::putLe32(out.data + 4, g_tick_interval_ms);
+    bool viaGroup = tickViaGroup(client);
+    uint32_t group = viaGroup ? static_cast<uint32_t>(g_group_addr_be) : 0;
+    std::memcpy(out.data + 8, &group, 4); // Network order, 0 = unicast
+    wire::putLe16(out.data + 12, viaGroup ? ntohs(g_group_port_be) : 0);
+    return wire::kSubscribeBodySize;
+}
+
+/**
+ * @brief Ends a subscription (unknown subscribers are ignored).
+ * @param client Subscriber address.
+ */
+void Unsubscribe(const sockaddr_storage& client) {
+    g_subs->unsubscribe(client);
+}
 
-// Lap timing storage and mutex
-static std::unordered_map<EndpointKey, std::chrono::steady_clock::time_point, EndpointKeyHash> g_lap;
-static std::mutex g_lap_mx;
+/**
+ * @brief Records a tick that could not be sent to a subscriber, dropping it after repeated failures.
+ * @param client Subscriber address.
+ * @return true if the subscription was dropped, false otherwise.
+ */
+bool tickSendFailed(const sockaddr_storage& client) {
+    return g_subs->sendFailed(client, kMaxTickFailures);
+}
+
+/**
+ * @brief Drops subscriptions that were not renewed within their time-to-live.
+ * @return Number of subscriptions removed.
+ */
+size_t expireSubscriptions() {
+    return g_subs->expire(std::chrono::steady_clock::now());
+}
+
+/**
+ * @brief Copies the live subscriber addresses for the tick fan-out.
+ * @param out Receives the addresses.
+ */
+void subscriberAddresses(std::vector<sockaddr_storage>& out) {
+    g_subs->addresses(out);
+}
 
 // ---------- Handlers 1..13 ----------
 /**
  * @brief Gets the current date and time as a string.
- * @return Date and time string in DD/MM/YYYY HH:MM:SS format.
+ * @param out Buffer receiving the date and time in DD/MM/YYYY HH:MM:SS format.
+ * @return Number of bytes written.
  */
-std::string GetTime() {
-    auto now = std::time(nullptr);
-    return fmt_tm(to_local(now), "%d/%m/%Y %H:%M:%S");
+size_t GetTime(OutSpan out) {
+    return put_text(out, timeSnapshot().dateTime);
 }
 
 /**
  * @brief Gets the current time (without date) as a string.
- * @return Time string in HH:MM:SS format.
+ * @param out Buffer receiving the time in HH:MM:SS format.
+ * @return Number of bytes written.
  */
-std::string GetTimeWithoutDate() {
-    auto now = std::time(nullptr);
-    return fmt_tm(to_local(now), "%H:%M:%S");
+size_t GetTimeWithoutDate(OutSpan out) {
+    return put_text(out, timeSnapshot().time);
 }
 
 /**
@@ -363,37 +465,47 @@ uint32_t GetClientToServerDelayEstimation() {
 
 /**
  * @brief Handler for RTT measurement (returns Pong).
- * @return String containing a single null character.
- */
-std::string MeasureRTT() {
-    return std::string(1, 0); // Pong
+ *        A probe payload (e.g. a sequence number) is echoed so replies can be matched to probes.
+ * @param payload Request bytes after the code byte (may be empty).
+ * @param out Buffer receiving the echoed payload, or a single null character without one.
+ * @return Number of bytes written.
+ */
+size_t MeasureRTT(ByteView payload, OutSpan out) {
+    if (out.size == 0) return 0;
+    if (payload.len == 0) {
+        out.data[0] = 0; // Pong
+        return 1;
+    }
+    size_t len = std::min(payload.len, out.size);
+    std::memcpy(out.data, payload.data, len);
+    return len;
 }
 
 /**
  * @brief Gets the current time without seconds.
- * @return Time string in HH:MM format.
+ * @param out Buffer receiving the time in HH:MM format.
+ * @return Number of bytes written.
  */
-std::string GetTimeWithoutDateOrSeconds() {
-    auto now = std::time(nullptr);
-    return fmt_tm(to_local(now), "%H:%M");
+size_t GetTimeWithoutDateOrSeconds(OutSpan out) {
+    return put_text(out, timeSnapshot().timeNoSeconds);
 }
 
 /**
  * @brief Gets the current year as a string.
- * @return Year string in YYYY format.
+ * @param out Buffer receiving the year in YYYY format.
+ * @return Number of bytes written.
  */
-std::string GetYear() {
-    auto now = std::time(nullptr);
-    return fmt_tm(to_local(now), "%Y");
+size_t GetYear(OutSpan out) {
+    return put_text(out, timeSnapshot().year);
 }
 
 /**
  * @brief Gets the current month and day as a string.
- * @return String in DD/MM format.
+ * @param out Buffer receiving the date in DD/MM format.
+ * @return Number of bytes written.
  */
-std::string GetMonthAndDay() {
-    auto now = std::time(nullptr);
-    return fmt_tm(to_local(now), "%d/%m");
+size_t GetMonthAndDay(OutSpan out) {
+    return put_text(out, timeSnapshot().monthDay);
 }
 
 /**
@@ -401,7 +513,7 @@ std::string GetMonthAndDay() {
  * @return Seconds since month start.
  */
 uint32_t GetSecondsSinceBeginingOfMonth() {
-    return seconds_since_month_start(std::time(nullptr));
+    return timeSnapshot().secondsSinceMonthStart;
 }
 
 /**
@@ -409,72 +521,163 @@ uint32_t GetSecondsSinceBeginingOfMonth() {
  * @return Week number (0..53).
  */
 uint32_t GetWeekOfYear() {
-    return week_of_year(std::time(nullptr));
+    return timeSnapshot().weekOfYear;
 }
 
 /**
  * @brief Gets whether daylight savings is active (1) or not (0).
- * @return "1" if DST is active, "0" otherwise.
+ * @param out Buffer receiving "1" if DST is active, "0" otherwise.
+ * @return Number of bytes written.
  */
-std::string GetDaylightSavings() {
-    std::tm tm = to_local(std::time(nullptr));
-    return (tm.tm_isdst > 0) ? "1" : "0";
+size_t GetDaylightSavings(OutSpan out) {
+    return put_str(out, timeSnapshot().dst ? "1" : "0");
 }
 
 /**
  * @brief Gets the current time in a specified city.
  * @param cityName City name or code.
- * @return Time string in HH:MM:SS format for the city.
+ * @param out Buffer receiving the time in HH:MM:SS format for the city.
+ * @return Number of bytes written.
  */
-std::string GetTimeWithoutDateInCity(const std::string& cityName) {
-    return time_in_city(cityName);
+size_t GetTimeWithoutDateInCity(ByteView cityName, OutSpan out) {
+    return time_in_city(cityName, out);
 }
 
 /**
- * @brief Measures the time lap for a client endpoint.
- *        Starts timer on first request, returns elapsed time on second request.
- * @param src_addr_be Source address (big-endian).
- * @param src_port_be Source port (big-endian).
- * @return Elapsed time in MM:SS format, or "Timer started" on first request.
+ * @brief Fills the binary date and time answer for the current local time.
+ *        The broken-down fields come from the snapshot of the precise clock's second, which is
+ *        refreshed (once, shared) if it is behind; only the microseconds are read per request.
+ * @param out Buffer receiving wire::TimeFields (at least wire::kTimeFieldsSize bytes).
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t GetTimeFields(OutSpan out) {
+    if (out.size < wire::kTimeFieldsSize) return 0;
+    uint64_t ns = preciseNowNs();
+    std::time_t sec = static_cast<std::time_t>(ns / 1000000000ull);
+    // Waits out a concurrent rebuild so the fields and the microseconds belong to the same second
+    wire::TimeFields fields = snapshot_at(sec, true).fields;
+    fields.micros = static_cast<uint32_t>(ns % 1000000000ull / 1000);
+    wire::encodeTime(out.data, fields);
+    return wire::kTimeFieldsSize;
+}
+
+/**
+ * @brief Fills the binary date and time answer for a city.
+ * @param cityName City name or code.
+ * @param out Buffer receiving wire::TimeFields (at least wire::kTimeFieldsSize bytes).
+ * @param flags Receives wire::kFlagUnknownZone if the city is unknown and UTC was used.
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t GetTimeFieldsInCity(ByteView cityName, OutSpan out, uint8_t& flags) {
+    if (out.size < wire::kTimeFieldsSize) return 0;
+    uint64_t ns = preciseNowNs();
+    std::time_t now = static_cast<std::time_t>(ns / 1000000000ull);
+
+    // Unknown cities fall back to UTC
+    int zone = city_zone(cityName);
+    if (zone < 0) flags |= wire::kFlagUnknownZone;
+    int offset = (zone < 0) ? 0 : zoneOffsetMinutes(zone, now);
+    std::tm city_tm = to_utc(now + offset * 60);
+    city_tm.tm_isdst = (zone >= 0 && offset != zoneStdOffsetMinutes(zone)) ? 1 : 0;
+    wire::TimeFields fields;
+    fill_fields(city_tm, now, offset, fields);
+    fields.micros = static_cast<uint32_t>(ns % 1000000000ull / 1000);
+    wire::encodeTime(out.data, fields);
+    return wire::kTimeFieldsSize;
+}
+
+/**
+ * @brief Builds the endpoint key of a client address (IPv4, IPv6 or IPv4-mapped IPv6).
+ * @param addr Client address.
+ * @return Endpoint key; an IPv4 client has the same key on IPv4 and dual-stack sockets.
+ */
+EndpointKey endpointKeyOf(const sockaddr_storage& addr) {
+    if (addr.ss_family == AF_INET6) {
+        const sockaddr_in6& v6 = reinterpret_cast<const sockaddr_in6&>(addr);
+        return endpointKeyV6(v6.sin6_addr.s6_addr, v6.sin6_port);
+    }
+    const sockaddr_in& v4 = reinterpret_cast<const sockaddr_in&>(addr);
+    return endpointKeyV4(static_cast<uint32_t>(v4.sin_addr.s_addr), v4.sin_port);
+}
+
+/**
+ * @brief Measures the time lap for a client endpoint in whole seconds.
+ * @param client Client endpoint.
+ * @param elapsedSec Receives the elapsed seconds on the second request.
+ * @return true if a lap was completed, false if this request started the timer.
  */
-std::string MeasureTimeLap(unsigned long src_addr_be, unsigned short src_port_be) {
+bool MeasureTimeLapSeconds(const EndpointKey& client, uint32_t& elapsedSec) {
     using clock = std::chrono::steady_clock;
-    EndpointKey key{ src_addr_be, src_port_be };
+    clock::time_point start;
     auto now = clock::now();
-    std::lock_guard<std::mutex> lk(g_lap_mx);
-
-    // Remove all expired measurements (older than 180 seconds)
-    for (auto it = g_lap.begin(); it != g_lap.end(); ) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - it->second).count();
-        if (elapsed > 180) {
-            it = g_lap.erase(it);
-        } else {
-            ++it;
-        }
+    if (!g_lap->lap(client, now, start)) {
+        // First request: start measurement (evicts the shard's oldest timer when full)
+        return false;
     }
+    elapsedSec = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now - start).count());
+    return true;
+}
 
-    auto it = g_lap.find(key);
-    if (it == g_lap.end()) {
-        // First request: start measurement
-        g_lap[key] = now;
-        return "Timer started";
+/**
+ * @brief Measures the time lap for a client endpoint.
+ *        Starts timer on first request, returns elapsed time on second request.
+ * @param client Client endpoint.
+ * @param out Buffer receiving the elapsed time in MM:SS format, or "Timer started" on first request.
+ * @return Number of bytes written.
+ */
+size_t MeasureTimeLap(const EndpointKey& client, OutSpan out) {
+    uint32_t sec;
+    if (!MeasureTimeLapSeconds(client, sec)) {
+        return put_str(out, "Timer started");
     }
-    auto sec = std::chrono::duration_cast<std::chrono::seconds>(now - it->second).count();
-    g_lap.erase(it); // Remove measurement after second request
     int minutes = static_cast<int>(sec / 60);
     int seconds = static_cast<int>(sec % 60);
-    std::ostringstream os;
-    os << std::setfill('0') << std::setw(2) << minutes << ":"
-       << std::setfill('0') << std::setw(2) << seconds;
-    return os.str();
+    char buf[16];
+    int len = std::snprintf(buf, sizeof(buf), "%02d:%02d", minutes, seconds);
+    buf[sizeof(buf) - 1] = '\0';
+    return (len > 0) ? put_str(out, buf) : 0;
+}
+
+/**
+ * @brief Builds a GetPreciseTime reply: echoes the client's sequence and t1, adds the server's
+ *        receive time t2 and stamps the transmit time t3 last, just before returning.
+ * @param payload Request bytes after the code byte (kPreciseRequestSize, big-endian).
+ * @param receivedNs Receive time t2 taken when the datagram was read.
+ * @param out Buffer receiving the reply (at least kPreciseReplySize bytes).
+ * @return Number of bytes written, or 0 if the payload is malformed.
+ */
+size_t GetPreciseTime(ByteView payload, uint64_t receivedNs, OutSpan out) {
+    if (payload.len != kPreciseRequestSize || out.size < kPreciseReplySize) return 0;
+    out.data[0] = static_cast<char>(ReqCode::GetPreciseTime);
+    out.data[1] = out.data[2] = out.data[3] = 0;
+    std::memcpy(out.data + 4, payload.data, kPreciseRequestSize); // sequence and t1, unchanged
+    wire::putBe64(out.data + 16, receivedNs);
+    wire::putBe64(out.data + 24, preciseNowNs());
+    return kPreciseReplySize;
+}
+
+/**
+ * @brief Builds the binary GetPreciseTime body: t1 echoed, t2 and t3, little-endian.
+ * @param payload Request bytes after the header (t1 u64, little-endian).
+ * @param receivedNs Receive time t2 taken when the datagram was read.
+ * @param out Buffer receiving the body (at least wire::kPreciseBodySize bytes).
+ * @return Number of bytes written, or 0 if the payload is malformed.
+ */
+size_t GetPreciseTimeFields(ByteView payload, uint64_t receivedNs, OutSpan out) {
+    if (payload.len != 8 || out.size < wire::kPreciseBodySize) return 0;
+    std::memcpy(out.data, payload.data, 8); // t1, unchanged
+    wire::putLe64(out.data + 8, receivedNs);
+    wire::putLe64(out.data + 16, preciseNowNs());
+    return wire::kPreciseBodySize;
 }
 
 /**
- * @brief Converts a uint32_t value to a vector of bytes (network order, no leading zeros).
+ * @brief Writes a uint32_t value as bytes (network order, no leading zeros).
  * @param val Value to convert.
- * @return Vector of bytes representing the value.
+ * @param out Buffer receiving the bytes (at least 4 bytes).
+ * @return Number of bytes written.
  */
-std::vector<char> toBytes(uint32_t val) {
+size_t toBytes(uint32_t val, OutSpan out) {
     uint32_t netVal = htonl(val);
     unsigned char buf[sizeof(netVal)];
     std::memcpy(buf, &netVal, sizeof(netVal));
@@ -483,5 +686,7 @@ std::vector<char> toBytes(uint32_t val) {
     while (start < sizeof(buf) && buf[start] == 0) {
         ++start;
     }
-    return std::vector<char>(buf + start, buf + sizeof(buf));
+    size_t len = std::min(sizeof(buf) - start, out.size);
+    std::memcpy(out.data, buf + start, len);
+    return len;
 }
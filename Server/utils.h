@@ -9,38 +9,81 @@
 #include <ctime>
 #include <chrono>
 #include <string>
+#include <vector>
 #include <sstream>
 #include <iomanip>
 #include <unordered_map>
 #include <mutex>
+#include <atomic>
 #include <cctype>
 #include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <WinSock2.h>
 #include <cstring>
+#include "logger.h"
+#include "lapstore.h"
+#include "subscribers.h"
+#include "../Common/protocol.h"
+#include "../Common/netaddr.h"
+#include "../Common/clock.h"
 
 /**
- * @brief Request codes for time server operations.
- */
-enum class ReqCode : char {
-    Error = -1,              /**< Error or invalid request. */
-    Default = 0,             /**< Default value. */
-    GetTime,                 /**< Get current date and time. */
-    GetTimeWithoutDate,      /**< Get current time (no date). */
-    GetTimeSinceEpoch,       /**< Get seconds since Unix epoch. */
-    GetClientToServerDelayEstimation, /**< Get tick count for delay estimation. */
-    MeasuureRTT,             /**< Measure round-trip time. */
-    GetTimeWithoutDateOrSeconds, /**< Get current time (no seconds). */
-    GetYear,                 /**< Get current year. */
-    GetMonthAndDay,          /**< Get current month and day. */
-    GetSecondsSinceBeginningOfMonth, /**< Get seconds since month start. */
-    GetWeekOfYear,           /**< Get current week of year. */
-    GetDaylightSavings,      /**< Get daylight savings status. */
-    GetTimeWithoutDateInCity,/**< Get current time in a specified city. */
-    MeasureTimeLap           /**< Measure time lap for a client. */
+ * @brief Non-owning read-only byte range (e.g. a request parameter inside the receive buffer).
+ */
+struct ByteView {
+    const char* data; /**< First byte. */
+    size_t len;       /**< Number of bytes. */
+};
+
+/**
+ * @brief Non-owning writable byte range that handlers format their response into.
+ */
+struct OutSpan {
+    char* data;  /**< First byte of the output buffer. */
+    size_t size; /**< Capacity of the output buffer. */
+};
+
+/**
+ * @brief Pre-formatted text field of a TimeSnapshot.
+ */
+struct SnapshotText {
+    char data[24]; /**< Formatted bytes (not null-terminated in the count). */
+    size_t len;    /**< Number of valid bytes. */
+};
+
+/**
+ * @brief Every local-time answer for one wall-clock second, formatted once.
+ *
+ * Snapshots are rebuilt on the first request of each new second and published through an
+ * atomic pointer, so handlers read them lock-free and only copy bytes.
+ */
+struct TimeSnapshot {
+    std::time_t epoch;               /**< Second this snapshot describes. */
+    SnapshotText dateTime;           /**< DD/MM/YYYY HH:MM:SS */
+    SnapshotText time;               /**< HH:MM:SS */
+    SnapshotText timeNoSeconds;      /**< HH:MM */
+    SnapshotText year;               /**< YYYY */
+    SnapshotText monthDay;           /**< DD/MM */
+    uint32_t weekOfYear;             /**< Sunday-based week number (0..53). */
+    uint32_t secondsSinceMonthStart; /**< Seconds since the first of the month, 00:00 local. */
+    bool dst;                        /**< Daylight saving time in effect. */
+    wire::TimeFields fields;         /**< Binary answer (micros filled in per request). */
 };
 
+/**
+ * @brief Returns the snapshot for the current second, rebuilding it on a tick (lock-free read).
+ * @return Snapshot for the current second.
+ */
+const TimeSnapshot& timeSnapshot();
+
+/**
+ * @brief Makes timeSnapshot() on the calling thread answer from a thread-local copy, refreshed
+ *        once per second, so a worker pinned to a NUMA node reads snapshot bytes from its own
+ *        node instead of sharing the global slots' cache lines with the other nodes.
+ */
+void useLocalSnapshot();
+
 /**
  * @brief Overloads the << operator for ReqCode enum for readable output.
  * @param os Output stream.
@@ -55,52 +98,191 @@ std::ostream& operator<<(std::ostream& os, ReqCode code);
  */
 void getCurrentTimeString(std::vector<char>& buffer);
 
-/**
- * @brief Logs an error message with the location and last Winsock error code.
- * @param where Name of the function or location where the error occurred.
- */
-void logError(const char* where);
-
-/**
- * @brief Logs a message with a timestamp.
- * @param message Message to log.
- */
-void logMessage(const std::string& message);
-
-// Request handlers for each supported operation
+// Request handlers for each supported operation.
+// Text handlers format into the caller's buffer and return the number of bytes written;
+// numeric handlers return the value, which toBytes() serializes.
 // 1. Get current date and time
-std::string GetTime();
+size_t GetTime(OutSpan out);
 // 2. Get current time (no date)
-std::string GetTimeWithoutDate();
+size_t GetTimeWithoutDate(OutSpan out);
 // 3. Get seconds since epoch
 uint32_t GetTimeSinceEpoch();
 // 4. Estimate client-to-server delay
 uint32_t GetClientToServerDelayEstimation();
 // 5. Measure round-trip time (RTT)
-std::string MeasureRTT();
+size_t MeasureRTT(ByteView payload, OutSpan out);
 // 6. Get time without seconds
-std::string GetTimeWithoutDateOrSeconds();
+size_t GetTimeWithoutDateOrSeconds(OutSpan out);
 // 7. Get current year
-std::string GetYear();
+size_t GetYear(OutSpan out);
 // 8. Get current month and day
-std::string GetMonthAndDay();
+size_t GetMonthAndDay(OutSpan out);
 // 9. Get seconds since beginning of month
 uint32_t GetSecondsSinceBeginingOfMonth();
 // 10. Get week number of year
 uint32_t GetWeekOfYear();
 // 11. Get daylight savings status
-std::string GetDaylightSavings();
+size_t GetDaylightSavings(OutSpan out);
 // 12. Get time in another city
-std::string GetTimeWithoutDateInCity(const std::string& cityName);
+size_t GetTimeWithoutDateInCity(ByteView cityName, OutSpan out);
+
+/**
+ * @brief Normalizes a city name or code the way the zone lookup does (trimmed, lowercase,
+ *        spaces as hyphens), e.g. to key cached city replies.
+ * @param cityName City name or code.
+ * @param out Buffer receiving the normalized, null-terminated text.
+ * @param cap Capacity of out (longer input is truncated, as by the zone lookup).
+ * @return Length of the normalized text.
+ */
+size_t normalizeCity(ByteView cityName, char* out, size_t cap);
+
+/**
+ * @brief Fills the binary date and time answer for the current local time.
+ * @param out Buffer receiving wire::TimeFields (at least wire::kTimeFieldsSize bytes).
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t GetTimeFields(OutSpan out);
+
+/**
+ * @brief Fills the binary date and time answer for a city.
+ * @param cityName City name or code.
+ * @param out Buffer receiving wire::TimeFields (at least wire::kTimeFieldsSize bytes).
+ * @param flags Receives wire::kFlagUnknownZone if the city is unknown and UTC was used.
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t GetTimeFieldsInCity(ByteView cityName, OutSpan out, uint8_t& flags);
+
+/**
+ * @brief Builds the endpoint key of a client address (IPv4, IPv6 or IPv4-mapped IPv6).
+ * @param addr Client address.
+ * @return Endpoint key; an IPv4 client has the same key on IPv4 and dual-stack sockets.
+ */
+EndpointKey endpointKeyOf(const sockaddr_storage& addr);
+
+/**
+ * @brief Measures the time lap for a client endpoint in whole seconds.
+ * @param client Client endpoint.
+ * @param elapsedSec Receives the elapsed seconds on the second request.
+ * @return true if a lap was completed, false if this request started the timer.
+ */
+bool MeasureTimeLapSeconds(const EndpointKey& client, uint32_t& elapsedSec);
 
 /**
  * @brief Measures the time lap for a client endpoint.
  *        Starts timer on first request, returns elapsed time on second request.
- * @param src_addr_be Source address (big-endian).
- * @param src_port_be Source port (big-endian).
- * @return Elapsed time in MM:SS format, or "Timer started" on first request.
+ * @param client Client endpoint.
+ * @param out Buffer receiving the elapsed time in MM:SS format, or "Timer started" on first request.
+ * @return Number of bytes written.
+ */
+size_t MeasureTimeLap(const EndpointKey& client, OutSpan out);
+
+/**
+ * @brief Payload size of a GetPreciseTime request after the code byte (sequence u32, t1 u64).
+ */
+constexpr size_t kPreciseRequestSize = 12;
+
+/**
+ * @brief Size of a GetPreciseTime reply (code, 3 reserved bytes, sequence u32, t1/t2/t3 u64).
+ */
+constexpr size_t kPreciseReplySize = 32;
+
+/**
+ * @brief Builds a GetPreciseTime reply: echoes the client's sequence and t1, adds the server's
+ *        receive time t2 and stamps the transmit time t3 last, just before returning.
+ * @param payload Request bytes after the code byte (kPreciseRequestSize, big-endian).
+ * @param receivedNs Receive time t2 taken when the datagram was read.
+ * @param out Buffer receiving the reply (at least kPreciseReplySize bytes).
+ * @return Number of bytes written, or 0 if the payload is malformed.
+ */
+size_t GetPreciseTime(ByteView payload, uint64_t receivedNs, OutSpan out);
+
+/**
+ * @brief Builds the binary GetPreciseTime body: t1 echoed, t2 and t3, little-endian.
+ * @param payload Request bytes after the header (t1 u64, little-endian).
+ * @param receivedNs Receive time t2 taken when the datagram was read.
+ * @param out Buffer receiving the body (at least wire::kPreciseBodySize bytes).
+ * @return Number of bytes written, or 0 if the payload is malformed.
+ */
+size_t GetPreciseTimeFields(ByteView payload, uint64_t receivedNs, OutSpan out);
+
+/**
+ * @brief Default maximum number of concurrently running lap timers.
+ */
+constexpr size_t kDefaultLapCapacity = 65536;
+
+/**
+ * @brief Default number of independently locked lap store shards.
+ */
+constexpr size_t kDefaultLapShards = 64;
+
+/**
+ * @brief Replaces the lap store with an empty one (call before the workers start).
+ * @param capacity Maximum number of concurrently running lap timers.
+ * @param shards Number of independently locked shards.
+ */
+void configureLapStore(size_t capacity, size_t shards = kDefaultLapShards);
+
+/**
+ * @brief Drops lap timers that have outlived their time-to-live.
+ *        Called periodically by the server so idle timers do not wait for the next lap request.
+ * @return Number of timers removed.
+ */
+size_t expireLaps();
+
+/**
+ * @brief Default maximum number of time-tick subscribers.
+ */
+constexpr size_t kDefaultSubscriberCapacity = 65536;
+
+/**
+ * @brief Sets up time-tick subscriptions (call before the workers start).
+ * @param capacity Maximum number of subscribers.
+ * @param intervalMs Tick interval announced to subscribers (0 = subscriptions disabled).
+ * @param groupAddrBe Multicast group ticks are sent to (network order), or 0 for unicast.
+ * @param groupPortBe Multicast port (network order).
+ */
+void configureSubscriptions(size_t capacity, unsigned intervalMs, unsigned long groupAddrBe, unsigned short groupPortBe);
+
+/**
+ * @brief Whether a subscriber is served by the multicast group rather than by unicast.
+ * @param client Subscriber address.
+ * @return true if a group is configured and the address is IPv4 (or IPv4-mapped); groups are IPv4 only.
+ */
+bool tickViaGroup(const sockaddr_storage& client);
+
+/**
+ * @brief Registers or renews a subscription and describes how ticks will arrive.
+ * @param client Subscriber address.
+ * @param out Buffer receiving the Subscribe body (at least wire::kSubscribeBodySize bytes).
+ * @param status Receives Unavailable if subscriptions are disabled or full.
+ * @return Number of bytes written.
+ */
+size_t Subscribe(const sockaddr_storage& client, OutSpan out, wire::Status& status);
+
+/**
+ * @brief Ends a subscription (unknown subscribers are ignored).
+ * @param client Subscriber address.
+ */
+void Unsubscribe(const sockaddr_storage& client);
+
+/**
+ * @brief Records a tick that could not be sent to a subscriber, dropping it after repeated failures.
+ * @param client Subscriber address.
+ * @return true if the subscription was dropped, false otherwise.
+ */
+bool tickSendFailed(const sockaddr_storage& client);
+
+/**
+ * @brief Drops subscriptions that were not renewed within their time-to-live.
+ * @return Number of subscriptions removed.
+ */
+size_t expireSubscriptions();
+
+/**
+ * @brief Copies the live subscriber addresses for the tick fan-out.
+ * @param out Receives the addresses.
  */
-std::string MeasureTimeLap(unsigned long src_addr_be, unsigned short src_port_be);
+void subscriberAddresses(std::vector<sockaddr_storage>& out);
 
 // Small helpers
 /**
@@ -118,12 +300,13 @@ static std::tm to_local(std::time_t t);
 static std::tm to_utc(std::time_t t);
 
 /**
- * @brief Formats a std::tm struct as a string using the given pattern.
+ * @brief Formats a std::tm struct into a buffer using the given pattern.
  * @param tm Time struct.
  * @param pat Format pattern (strftime).
- * @return Formatted time string.
+ * @param out Buffer receiving the formatted text (not null-terminated in the count).
+ * @return Number of bytes written.
  */
-static std::string fmt_tm(const std::tm& tm, const char* pat);
+static size_t fmt_tm(const std::tm& tm, const char* pat, OutSpan out);
 
 /**
  * @brief Calculates seconds since the beginning of the month.
@@ -141,54 +324,41 @@ static uint32_t week_of_year(std::time_t now);
 
 /**
  * @brief Trims whitespace, converts to lowercase, and replaces spaces with hyphens.
- * @param s String to normalize.
- * @return Normalized string.
- */
-static std::string trim_lower(std::string s);
-
-/**
- * @brief Calculates the nth weekday of a month (e.g., 2nd Sunday).
- * @param year Year.
- * @param month Month (1-12).
- * @param weekday Day of week (0=Sun..6=Sat).
- * @param nth Nth occurrence.
- * @return Day of month for nth weekday.
- */
-static int nth_weekday_of_month(int year, int month, int weekday, int nth);
-
-/**
- * @brief Calculates the last weekday of a month (e.g., last Sunday).
- * @param year Year.
- * @param month Month (1-12).
- * @param weekday Day of week (0=Sun..6=Sat).
- * @return Day of month for last weekday.
+ * @param s Text to normalize.
+ * @param out Buffer receiving the normalized, null-terminated text.
+ * @param cap Capacity of out (longer input is truncated).
+ * @return Length of the normalized text.
  */
-static int last_weekday_of_month(int year, int month, int weekday);
+static size_t trim_lower(ByteView s, char* out, size_t cap);
 
 /**
- * @brief Checks if the given UTC time is in EU DST window.
- * @param utc UTC time struct.
- * @return true if DST is active, false otherwise.
+ * @brief Looks up the zone of a city name or code.
+ * @param city_name City name or code.
+ * @return Zone id, or -1 if unknown.
  */
-static bool is_dst_eu(const std::tm& utc);
+static int city_zone(ByteView city_name);
 
 /**
- * @brief Checks if the given local time is in US DST window (approximate).
- * @param now_local_base Local time as time_t.
- * @return true if DST is active, false otherwise.
+ * @brief Fills the broken-down part of wire::TimeFields from a std::tm.
+ * @param tm Broken-down time.
+ * @param epoch Instant described by tm.
+ * @param utcOffsetMin Offset of tm from UTC in minutes.
+ * @param fields Fields to fill.
  */
-static bool is_dst_us_local_approx(std::time_t now_local_base);
+static void fill_fields(const std::tm& tm, std::time_t epoch, int utcOffsetMin, wire::TimeFields& fields);
 
 /**
  * @brief Gets the current time in a specified city, considering DST.
  * @param city_name City name or code.
- * @return Time string in HH:MM:SS format for the city.
+ * @param out Buffer receiving the time in HH:MM:SS format for the city.
+ * @return Number of bytes written.
  */
-static std::string time_in_city(std::string city_name);
+static size_t time_in_city(ByteView city_name, OutSpan out);
 
 /**
- * @brief Converts a uint32_t value to a vector of bytes (network order, no leading zeros).
+ * @brief Writes a uint32_t value as bytes (network order, no leading zeros).
  * @param val Value to convert.
- * @return Vector of bytes representing the value.
+ * @param out Buffer receiving the bytes (at least 4 bytes).
+ * @return Number of bytes written.
  */
-std::vector<char> toBytes(uint32_t val);        
\ No newline at end of file
+size_t toBytes(uint32_t val, OutSpan out);        
\ No newline at end of file